@@ -28,6 +28,9 @@
 // Custom headers
 #include "shaders.h"
 #include "mesh.h"
+#include "texturecache.h"
+#include "progressivetexture.h"
+#include "skyboxset.h"
 
 using namespace glm;
 
@@ -52,8 +55,13 @@ int viewMode = 3;
 bool drawCube = false;
 bool isOpen = false;
 
+// Skies, switched between with a crossfade
+int starSky, daySky, nightSky;
+int skyMode = 0;                // 0 stars, 1 day, 2 night
+bool dayNightCycle = false;     // Day and night follow the earth's rotation
+float skyFadeTime = 2.0f;       // Seconds a switch fades over
+
 // Textures
-GLuint skyboxTexture;
 GLuint diffuseTexture, specularTexture;
 GLuint moonTexture, sunTexture;
 
@@ -93,52 +101,70 @@ void Initialize()
         dumpProgram(emissiveProgram, "Simple program for the sun");
     }
 
-    // Load in all 6 faces of the skybox cube
-    skyboxTexture = SOIL_load_OGL_cubemap
+    // Register the skies, only the stars are loaded now. The others are decoded
+    // in the background when they're about to be shown.
+    starSky = SkyboxSet::Add
     (
         ASSETS"textures/star_sky/stars.png", // posx
         ASSETS"textures/star_sky/stars.png", // negx
         ASSETS"textures/star_sky/stars.png", // posy
         ASSETS"textures/star_sky/stars.png", // negy
         ASSETS"textures/star_sky/stars.png", // posz
-        ASSETS"textures/star_sky/stars.png", // negz
-        SOIL_LOAD_RGB,      // This means we're expecting it to have RGB channels
-        SOIL_CREATE_NEW_ID, // This means we want to create a new texture instead of overwriting one 
-        SOIL_FLAG_MIPMAPS   // This means we want it to generate mip-maps.
+        ASSETS"textures/star_sky/stars.png"  // negz
+    );
+    daySky = SkyboxSet::Add
+    (
+        ASSETS"textures/yokohama_day/posx.jpg",
+        ASSETS"textures/yokohama_day/negx.jpg",
+        ASSETS"textures/yokohama_day/posy.jpg",
+        ASSETS"textures/yokohama_day/negy.jpg",
+        ASSETS"textures/yokohama_day/posz.jpg",
+        ASSETS"textures/yokohama_day/negz.jpg"
+    );
+    nightSky = SkyboxSet::Add
+    (
+        ASSETS"textures/yokohama_night/posx.jpg",
+        ASSETS"textures/yokohama_night/negx.jpg",
+        ASSETS"textures/yokohama_night/posy.jpg",
+        ASSETS"textures/yokohama_night/negy.jpg",
+        ASSETS"textures/yokohama_night/posz.jpg",
+        ASSETS"textures/yokohama_night/negz.jpg"
     );
+    SkyboxSet::Load(starSky);
 
-    diffuseTexture = SOIL_load_OGL_texture
+    diffuseTexture = TextureCache::LoadTextureProgressive
     (
         ASSETS"textures/earthDiffuse.png",
         SOIL_LOAD_AUTO,
-        SOIL_CREATE_NEW_ID,
         SOIL_FLAG_MIPMAPS | SOIL_FLAG_INVERT_Y | SOIL_FLAG_NTSC_SAFE_RGB | SOIL_FLAG_COMPRESS_TO_DXT
     );
 
-    specularTexture = SOIL_load_OGL_texture
+    specularTexture = TextureCache::LoadTextureProgressive
     (
         ASSETS"textures/earthSpecular.png",
         SOIL_LOAD_AUTO,
-        SOIL_CREATE_NEW_ID,
         SOIL_FLAG_INVERT_Y | SOIL_FLAG_NTSC_SAFE_RGB | SOIL_FLAG_COMPRESS_TO_DXT
     );
 
-    moonTexture = SOIL_load_OGL_texture
+    moonTexture = TextureCache::LoadTextureProgressive
     (
         ASSETS"textures/moonTexture.png",
         SOIL_LOAD_AUTO,
-        SOIL_CREATE_NEW_ID,
         SOIL_FLAG_INVERT_Y | SOIL_FLAG_NTSC_SAFE_RGB | SOIL_FLAG_COMPRESS_TO_DXT
     );
 
-    sunTexture = SOIL_load_OGL_texture
+    sunTexture = TextureCache::LoadTextureProgressive
     (
         ASSETS"textures/sunTexture.png",
         SOIL_LOAD_AUTO,
-        SOIL_CREATE_NEW_ID,
         SOIL_FLAG_INVERT_Y | SOIL_FLAG_NTSC_SAFE_RGB | SOIL_FLAG_COMPRESS_TO_DXT
     );
 
+    // The 2D textures show a thumbnail until the loader thread has decoded them,
+    // ProgressiveTexture::Update swaps the real images in over the next few frames.
+    TextureCache::TrimImages();
+    TextureCache::PrintStats();
+
     cameraPosition = vec3(0, 0, -5);
     cameraTarget = vec3(0, 0, 0);
 }
@@ -202,6 +228,21 @@ void Update(float deltaTime)
       //  viewMatrix = inverse(lookAt(moonPosition, (earthPosition), vec3(0, 1, 0)));
     //}
 
+    // Day from a quarter to three quarters of the earth's turn. The other sky is
+    // prefetched a few seconds before the switch, so it's resident when the fade starts.
+    if (dayNightCycle)
+    {
+        float timeOfDay = fract(planetRotations);
+        bool isDay = timeOfDay >= 0.25f && timeOfDay < 0.75f;
+        float daysToSwitch = isDay ? 0.75f - timeOfDay : fract(0.25f - timeOfDay);
+        if (daysToSwitch < 5.0f * simulationSpeed)
+            SkyboxSet::Prefetch(isDay ? nightSky : daySky);
+        skyMode = isDay ? 1 : 2;
+    }
+
+    int skies[3] = { starSky, daySky, nightSky };
+    SkyboxSet::Show(skies[skyMode], skyFadeTime);
+
     std::cout << planetRotations << std::endl;
 }
 
@@ -214,14 +255,11 @@ void Render()
         glUseProgram(skyboxProgram);                                    // <- Use the skybox shader program. This has the vertex and fragment  shader for the skybox
 
         // Getting uniform locations  
-        GLuint sLoc = glGetUniformLocation(skyboxProgram, "skybox");    // <- Get the uniform location for the skybox
         GLuint vLoc = glGetUniformLocation(skyboxProgram, "view");      // <- Get the uniform location for the view matrix
         GLuint pLoc = glGetUniformLocation(skyboxProgram, "proj");      // <- Get the uniform location for the projection matrix
 
-        // Binding skybox texture
-        glUniform1i(sLoc, 0);                                           // <- 1) Get the uniform location for the cubemap sampler, and set it to index zero                       
-        glActiveTexture(GL_TEXTURE0);                                   // <- 2) Set the active texture to also be index zero, matching above                             
-        glBindTexture(GL_TEXTURE_CUBE_MAP, skyboxTexture);              // <- 3) Bind the skybox texture. This texture is bound to zero, so it will be sampled              
+        // Binding skybox textures
+        SkyboxSet::Bind(skyboxProgram, 0);                              // <- Binds the sky to index zero and the one it's fading to to index one, and sets the blend
                                    
         // Passing up view-projection matrix
         glUniformMatrix4fv(vLoc, 1, GL_FALSE,                           // <- Pass through a special version of the view matrix. This has no position information, as
@@ -231,8 +269,11 @@ void Render()
         // Drawing the skybox
         Primitive::DrawSkybox();                                        // <- Draw the skybox here. It's an inverted cube around the camera                                     
                           
-        // Unbinding the texture and program
-        glBindTexture(GL_TEXTURE_CUBE_MAP, GL_NONE);                    // <- Unbind the texture after we've drawn the skybox here                                  
+        // Unbinding the textures and program
+        glActiveTexture(GL_TEXTURE1);                                   // <- Unbind both skies after we've drawn the skybox here
+        glBindTexture(GL_TEXTURE_CUBE_MAP, GL_NONE);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, GL_NONE);
         glUseProgram(GL_NONE);                                          // <- Unbind the shader program after we've used it here                                    
     }
 
@@ -353,10 +394,11 @@ void Cleanup()
     glDeleteProgram(skyboxProgram);
     glDeleteProgram(phongProgram);
 
-    // Cleanup the textures here
-    glDeleteTextures(1, &skyboxTexture);
-    glDeleteTextures(1, &diffuseTexture);
-    glDeleteTextures(1, &specularTexture);
+    // Cleanup the textures here, after the loader thread is done with them
+    ProgressiveTexture::Shutdown();
+    SkyboxSet::Shutdown();
+    TextureCache::Release(diffuseTexture);
+    TextureCache::Release(specularTexture);
 }
 
 void GUI()
@@ -376,6 +418,17 @@ void GUI()
         //ImGui::RadioButton("Static View", &viewMode, 4);
 
 		// ImGui::Checkbox("Draw Cube", &drawCube);
+
+        // Hovering over a sky is a good sign it's about to be picked, so start loading it
+        ImGui::Spacing();
+        ImGui::RadioButton("Stars", &skyMode, 0); if (ImGui::IsItemHovered()) SkyboxSet::Prefetch(starSky); ImGui::SameLine();
+        ImGui::RadioButton("Day", &skyMode, 1);   if (ImGui::IsItemHovered()) SkyboxSet::Prefetch(daySky);  ImGui::SameLine();
+        ImGui::RadioButton("Night", &skyMode, 2); if (ImGui::IsItemHovered()) SkyboxSet::Prefetch(nightSky);
+        ImGui::Checkbox("Day/Night Cycle", &dayNightCycle);
+        ImGui::DragFloat("Sky Fade (s)", &skyFadeTime, 0.05f, 0.0f, 10.0f);
+
+        SkyboxStats sky = SkyboxSet::Stats();
+        ImGui::Text("Skies: %d resident (%.1f MB), %d loading", sky.resident, sky.residentBytes / (1024.0f * 1024.0f), sky.loading);
     }
     ImGui::End();
 }
@@ -450,6 +503,8 @@ int main()
         oldTime = currentTime;
         
         // Call the helper functions
+        ProgressiveTexture::Update();
+        SkyboxSet::Update();
         Update(deltaTime);
         Render();
         GUI();
@@ -459,9 +514,10 @@ int main()
         glfwSwapBuffers(window);
     }
 
-    // close GL context and any other GLFW resources
-    glfwTerminate();
-    ImGui_ImplGlfwGL3_Shutdown();
+    // Free our GL objects and ImGui's while the context still exists,
+    // then close GL context and any other GLFW resources
     Cleanup();
+    ImGui_ImplGlfwGL3_Shutdown();
+    glfwTerminate();
     return 0;
 }
\ No newline at end of file
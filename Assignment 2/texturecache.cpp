@@ -0,0 +1,239 @@
+/*****************************************
+ *
+ *           texturecache.cpp
+ *
+ *  Shared, reference counted texture and
+ *  decoded image cache.
+ *
+ ****************************************/
+
+#include "texturecache.h"
+#include "progressivetexture.h"
+
+#include <SOIL.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+std::map<TextureCache::ImageKey, ImageRef> TextureCache::images;
+std::map<TextureCache::TextureKey, TextureCache::TextureEntry> TextureCache::textures;
+std::map<GLuint, TextureCache::TextureKey> TextureCache::textureKeys;
+
+int TextureCache::decodes = 0;
+int TextureCache::imageHits = 0;
+int TextureCache::uploads = 0;
+int TextureCache::textureHits = 0;
+
+std::mutex TextureCache::soilMutex;
+
+DecodedImage::~DecodedImage()
+{
+    SOIL_free_image_data(pixels);
+}
+
+bool TextureCache::ImageKey::operator<(const ImageKey& o) const
+{
+    if (path != o.path) return path < o.path;
+    if (mtime != o.mtime) return mtime < o.mtime;
+    return channels < o.channels;
+}
+
+bool TextureCache::TextureKey::operator<(const TextureKey& o) const
+{
+    if (path != o.path) return path < o.path;
+    if (mtime != o.mtime) return mtime < o.mtime;
+    if (channels != o.channels) return channels < o.channels;
+    return flags < o.flags;
+}
+
+// Resolve the file to one canonical name so "textures/../textures/a.png" and "textures/a.png" match
+bool TextureCache::MakeImageKey(const char* fileName, int forceChannels, ImageKey& key)
+{
+#ifdef _WIN32
+    char resolved[_MAX_PATH];
+    if (_fullpath(resolved, fileName, _MAX_PATH) == NULL)
+        return false;
+    struct _stat st;
+    if (_stat(resolved, &st) != 0)
+        return false;
+#else
+    char* resolvedPath = realpath(fileName, NULL);
+    if (resolvedPath == NULL)
+        return false;
+    std::string resolved = resolvedPath;
+    free(resolvedPath);
+    struct stat st;
+    if (stat(resolved.c_str(), &st) != 0)
+        return false;
+#endif
+
+    key.path = resolved;
+    key.mtime = (long long)st.st_mtime;
+    key.channels = forceChannels;
+    return true;
+}
+
+ImageRef TextureCache::LoadImage(const char* fileName, int forceChannels)
+{
+    ImageKey key;
+    if (!MakeImageKey(fileName, forceChannels, key))
+    {
+        printf("can't find image: %s\n", fileName);
+        return ImageRef();
+    }
+
+    std::map<ImageKey, ImageRef>::iterator itr = images.find(key);
+    if (itr != images.end())
+    {
+        imageHits++;
+        return itr->second;
+    }
+
+    DecodedImage* image = new DecodedImage();
+    {
+        std::lock_guard<std::mutex> lock(soilMutex);
+        image->pixels = SOIL_load_image(key.path.c_str(), &image->width, &image->height, &image->channels, forceChannels);
+        if (image->pixels == NULL)
+        {
+            printf("can't load image %s: %s\n", fileName, SOIL_last_result());
+            delete image;
+            return ImageRef();
+        }
+    }
+
+    // SOIL reports the channels in the file, we want the ones in the buffer
+    if (forceChannels != SOIL_LOAD_AUTO)
+        image->channels = forceChannels;
+
+    decodes++;
+    ImageRef ref(image);
+    images[key] = ref;
+    return ref;
+}
+
+GLuint TextureCache::FindTexture(const TextureKey& key)
+{
+    std::map<TextureKey, TextureEntry>::iterator itr = textures.find(key);
+    if (itr == textures.end())
+        return 0;
+
+    textureHits++;
+    itr->second.refCount++;
+    return itr->second.texture;
+}
+
+void TextureCache::AddTexture(const TextureKey& key, GLuint texture)
+{
+    uploads++;
+    TextureEntry entry;
+    entry.texture = texture;
+    entry.refCount = 1;
+    textures[key] = entry;
+    textureKeys[texture] = key;
+}
+
+bool TextureCache::MakeTextureKey(const char* fileName, int forceChannels, unsigned int soilFlags, TextureKey& key)
+{
+    ImageKey imageKey;
+    if (!MakeImageKey(fileName, forceChannels, imageKey))
+    {
+        printf("can't find texture: %s\n", fileName);
+        return false;
+    }
+
+    key.path = imageKey.path;
+    key.mtime = imageKey.mtime;
+    key.channels = forceChannels;
+    key.flags = soilFlags;
+    return true;
+}
+
+GLuint TextureCache::LoadTexture(const char* fileName, int forceChannels, unsigned int soilFlags)
+{
+    TextureKey key;
+    if (!MakeTextureKey(fileName, forceChannels, soilFlags, key))
+        return 0;
+
+    GLuint texture = FindTexture(key);
+    if (texture != 0)
+        return texture;
+
+    ImageRef image = LoadImage(fileName, forceChannels);
+    if (!image)
+        return 0;
+
+    // SOIL works on its own copy of the pixels, so the shared buffer stays untouched
+    {
+        std::lock_guard<std::mutex> lock(soilMutex);
+        texture = SOIL_create_OGL_texture(image->pixels, image->width, image->height, image->channels,
+            SOIL_CREATE_NEW_ID, soilFlags);
+        if (texture == 0)
+        {
+            printf("can't create texture %s: %s\n", fileName, SOIL_last_result());
+            return 0;
+        }
+    }
+
+    AddTexture(key, texture);
+    return texture;
+}
+
+GLuint TextureCache::LoadTextureProgressive(const char* fileName, int forceChannels, unsigned int soilFlags)
+{
+    TextureKey key;
+    if (!MakeTextureKey(fileName, forceChannels, soilFlags, key))
+        return 0;
+
+    // It ends up as the same texture LoadTexture makes, so the two share cache entries
+    GLuint texture = FindTexture(key);
+    if (texture != 0)
+        return texture;
+
+    texture = ProgressiveTexture::Load(fileName, forceChannels, soilFlags);
+    if (texture == 0)
+        return 0;
+
+    AddTexture(key, texture);
+    return texture;
+}
+
+void TextureCache::Release(GLuint texture)
+{
+    std::map<GLuint, TextureKey>::iterator keyItr = textureKeys.find(texture);
+    if (keyItr == textureKeys.end())
+    {   // Not one of ours (e.g. a baked texture), so nobody else is sharing it
+        if (texture != 0)
+        {
+            ProgressiveTexture::Cancel(texture);
+            glDeleteTextures(1, &texture);
+        }
+        return;
+    }
+
+    std::map<TextureKey, TextureEntry>::iterator itr = textures.find(keyItr->second);
+    if (--itr->second.refCount > 0)
+        return;
+
+    ProgressiveTexture::Cancel(texture);
+    glDeleteTextures(1, &texture);
+    textures.erase(itr);
+    textureKeys.erase(keyItr);
+}
+
+void TextureCache::TrimImages()
+{
+    for (std::map<ImageKey, ImageRef>::iterator itr = images.begin(); itr != images.end(); )
+    {
+        if (itr->second.use_count() == 1)
+            itr = images.erase(itr);
+        else
+            ++itr;
+    }
+}
+
+void TextureCache::PrintStats()
+{
+    printf("Texture cache: %d decodes (%d shared), %d uploads (%d shared), %d textures live\n",
+        decodes, imageHits, uploads, textureHits, (int)textures.size());
+}
@@ -0,0 +1,99 @@
+/**************************************************
+ *
+ *                 texturecache.h
+ *
+ *  Deduplicates texture loads. Decoded images are
+ *  keyed by (canonical path, modification time,
+ *  channels) and GL textures additionally by the
+ *  SOIL flags, so asking for the same file twice
+ *  costs one decode and one upload. Both are
+ *  reference counted.
+ *
+ ***************************************************/
+
+#ifndef TEXTURECACHE_H
+#define TEXTURECACHE_H
+
+#include <GL/gl3w.h>
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+struct DecodedImage
+{
+    unsigned char* pixels;  // Owned, freed with SOIL_free_image_data
+    int width, height, channels;
+
+    ~DecodedImage();
+};
+
+typedef std::shared_ptr<const DecodedImage> ImageRef;
+
+class TextureCache
+{
+public:
+    // Drop-in replacement for SOIL_load_OGL_texture. Every successful call adds a
+    // reference that Release gives back. Cubemaps are loaded by SkyboxSet.
+    static GLuint LoadTexture(const char* fileName, int forceChannels, unsigned int soilFlags);
+
+    // Like LoadTexture, but returns straight away with a preview of the image that is
+    // replaced by the real thing in the background. See progressivetexture.h, it needs
+    // ProgressiveTexture::Update every frame.
+    static GLuint LoadTextureProgressive(const char* fileName, int forceChannels, unsigned int soilFlags);
+
+    // Decoded pixels, shared between everyone asking for the same file. Returns null on failure.
+    static ImageRef LoadImage(const char* fileName, int forceChannels);
+
+    // Drops one reference, the texture is deleted with the last one.
+    // Textures that didn't come from the cache are deleted straight away.
+    static void Release(GLuint texture);
+
+    // Frees decoded images that only the cache is holding on to. Call once loading is done.
+    static void TrimImages();
+
+    static void PrintStats();
+
+    // SOIL isn't thread safe and keeps its last error in a global. Every SOIL call that
+    // could overlap the progressive texture or skybox workers holds this, along with its
+    // SOIL_last_result.
+    static std::mutex soilMutex;
+
+private:
+    struct ImageKey
+    {
+        std::string path;
+        long long mtime;
+        int channels;
+        bool operator<(const ImageKey& o) const;
+    };
+
+    struct TextureKey
+    {
+        std::string path;       // Canonical
+        long long mtime;
+        int channels;
+        unsigned int flags;
+        bool operator<(const TextureKey& o) const;
+    };
+
+    struct TextureEntry
+    {
+        GLuint texture;
+        int refCount;
+    };
+
+    static bool MakeImageKey(const char* fileName, int forceChannels, ImageKey& key);
+    static bool MakeTextureKey(const char* fileName, int forceChannels, unsigned int soilFlags, TextureKey& key);
+    static GLuint FindTexture(const TextureKey& key);
+    static void AddTexture(const TextureKey& key, GLuint texture);
+
+    static std::map<ImageKey, ImageRef> images;
+    static std::map<TextureKey, TextureEntry> textures;
+    static std::map<GLuint, TextureKey> textureKeys;
+
+    static int decodes, imageHits, uploads, textureHits;
+};
+
+#endif
@@ -0,0 +1,606 @@
+/*****************************************
+ *
+ *           blockcompress.cpp
+ *
+ *  Block encoders. Colour endpoints start
+ *  from the inset bounding box or the
+ *  principal axis of the block and are then
+ *  refined against the actual error, every
+ *  texel picking the closest palette entry.
+ *
+ ****************************************/
+
+#include "blockcompress.h"
+#include "threadpool.h"
+
+#include <math.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BC_SSE2
+#endif
+
+#define BAND_BLOCK_ROWS 4       // Rows of blocks per ParallelFor index
+#define NUDGE_ROUNDS 8          // Passes of single step endpoint changes at high quality
+
+static inline int Clamp(int v, int lo, int hi)
+{
+    return v < lo ? lo : v > hi ? hi : v;
+}
+
+// Rounds to the nearest 565 colour rather than truncating, which halves the average error
+static inline unsigned short PackRGB565(const float rgb[3])
+{
+    int r = Clamp((int)(rgb[0] * (31.0f / 255.0f) + 0.5f), 0, 31);
+    int g = Clamp((int)(rgb[1] * (63.0f / 255.0f) + 0.5f), 0, 63);
+    int b = Clamp((int)(rgb[2] * (31.0f / 255.0f) + 0.5f), 0, 31);
+    return (unsigned short)((r << 11) | (g << 5) | b);
+}
+
+static inline void UnpackRGB565(unsigned short c, int rgb[3])
+{
+    int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+    rgb[0] = (r << 3) | (r >> 2);
+    rgb[1] = (g << 2) | (g >> 4);
+    rgb[2] = (b << 3) | (b >> 2);
+}
+
+// Grab a 4x4 block of RGBA texels, clamping at the image edges
+static void FetchBlock(const unsigned char* rgba, int width, int height, int bx, int by, unsigned char block[64])
+{
+    for (int y = 0; y < 4; y++)
+    {
+        int sy = by * 4 + y; if (sy >= height) sy = height - 1;
+        for (int x = 0; x < 4; x++)
+        {
+            int sx = bx * 4 + x; if (sx >= width) sx = width - 1;
+            memcpy(&block[(y * 4 + x) * 4], &rgba[((size_t)sy * width + sx) * 4], 4);
+        }
+    }
+}
+
+//------------------------------------------------------------------------------------------------ BC1
+
+// The texels split into channels, four texels to a register in the error loop
+struct ColourBlock
+{
+    float r[16], g[16], b[16];
+};
+
+static void SplitBlock(const unsigned char block[64], ColourBlock& cb)
+{
+    for (int i = 0; i < 16; i++)
+    {
+        cb.r[i] = block[i * 4 + 0];
+        cb.g[i] = block[i * 4 + 1];
+        cb.b[i] = block[i * 4 + 2];
+    }
+}
+
+// Palette of a 4 colour block, with the same integer rounding as the decoder
+static void MakePalette(unsigned short c0, unsigned short c1, float palette[4][3])
+{
+    int a[3], b[3];
+    UnpackRGB565(c0, a);
+    UnpackRGB565(c1, b);
+    for (int c = 0; c < 3; c++)
+    {
+        palette[0][c] = (float)a[c];
+        palette[1][c] = (float)b[c];
+        palette[2][c] = (float)((2 * a[c] + b[c]) / 3);
+        palette[3][c] = (float)((a[c] + 2 * b[c]) / 3);
+    }
+}
+
+// Picks the closest palette entry for every texel and returns the summed squared error.
+// The sums are whole numbers well under 2^24, so floats hold them exactly.
+static float FitIndices(const ColourBlock& cb, const float palette[4][3], unsigned int& indices)
+{
+    indices = 0;
+#if defined(BC_SSE2)
+    __m128 total = _mm_setzero_ps();
+    for (int i = 0; i < 16; i += 4)
+    {
+        __m128 r = _mm_loadu_ps(cb.r + i), g = _mm_loadu_ps(cb.g + i), b = _mm_loadu_ps(cb.b + i);
+        __m128 best = _mm_set1_ps(1e30f), bestIndex = _mm_setzero_ps();
+        for (int p = 0; p < 4; p++)
+        {
+            __m128 dr = _mm_sub_ps(r, _mm_set1_ps(palette[p][0]));
+            __m128 dg = _mm_sub_ps(g, _mm_set1_ps(palette[p][1]));
+            __m128 db = _mm_sub_ps(b, _mm_set1_ps(palette[p][2]));
+            __m128 error = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)), _mm_mul_ps(db, db));
+
+            __m128 closer = _mm_cmplt_ps(error, best);
+            best = _mm_min_ps(error, best);
+            bestIndex = _mm_or_ps(_mm_and_ps(closer, _mm_set1_ps((float)p)), _mm_andnot_ps(closer, bestIndex));
+        }
+        total = _mm_add_ps(total, best);
+
+        int lanes[4];
+        _mm_storeu_si128((__m128i*)lanes, _mm_cvttps_epi32(bestIndex));
+        for (int k = 0; k < 4; k++)
+            indices |= (unsigned int)lanes[k] << ((i + k) * 2);
+    }
+
+    float sums[4];
+    _mm_storeu_ps(sums, total);
+    return sums[0] + sums[1] + sums[2] + sums[3];
+#else
+    float total = 0.0f;
+    for (int i = 0; i < 16; i++)
+    {
+        int best = 0;
+        float bestError = 1e30f;
+        for (int p = 0; p < 4; p++)
+        {
+            float dr = cb.r[i] - palette[p][0];
+            float dg = cb.g[i] - palette[p][1];
+            float db = cb.b[i] - palette[p][2];
+            float error = dr * dr + dg * dg + db * db;
+            if (error < bestError) { bestError = error; best = p; }
+        }
+        total += bestError;
+        indices |= (unsigned int)best << (i * 2);
+    }
+    return total;
+#endif
+}
+
+// Orders a pair of 565 endpoints for the 4 colour mode (c0 > c1) and fits the indices.
+// Equal endpoints would switch to the 3 colour mode, but then every texel is index 0 anyway.
+static float TryEndpoints(const ColourBlock& cb, unsigned short a, unsigned short b,
+                          unsigned short& c0, unsigned short& c1, unsigned int& indices)
+{
+    c0 = a > b ? a : b;
+    c1 = a > b ? b : a;
+
+    float palette[4][3];
+    MakePalette(c0, c1, palette);
+    return FitIndices(cb, palette, indices);
+}
+
+static void BoundingBoxEndpoints(const unsigned char block[64], float hi[3], float lo[3])
+{
+    unsigned char mins[4], maxs[4];
+#if defined(BC_SSE2)
+    __m128i t0 = _mm_loadu_si128((const __m128i*)block), t1 = _mm_loadu_si128((const __m128i*)(block + 16));
+    __m128i t2 = _mm_loadu_si128((const __m128i*)(block + 32)), t3 = _mm_loadu_si128((const __m128i*)(block + 48));
+    __m128i mn = _mm_min_epu8(_mm_min_epu8(t0, t1), _mm_min_epu8(t2, t3));
+    __m128i mx = _mm_max_epu8(_mm_max_epu8(t0, t1), _mm_max_epu8(t2, t3));
+
+    // Fold the four texels in each register down to one
+    mn = _mm_min_epu8(mn, _mm_srli_si128(mn, 8));
+    mn = _mm_min_epu8(mn, _mm_srli_si128(mn, 4));
+    mx = _mm_max_epu8(mx, _mm_srli_si128(mx, 8));
+    mx = _mm_max_epu8(mx, _mm_srli_si128(mx, 4));
+    int packedMin = _mm_cvtsi128_si32(mn), packedMax = _mm_cvtsi128_si32(mx);
+    memcpy(mins, &packedMin, 4);
+    memcpy(maxs, &packedMax, 4);
+#else
+    memset(mins, 255, 4);
+    memset(maxs, 0, 4);
+    for (int i = 0; i < 16; i++)
+        for (int c = 0; c < 4; c++)
+        {
+            if (block[i * 4 + c] < mins[c]) mins[c] = block[i * 4 + c];
+            if (block[i * 4 + c] > maxs[c]) maxs[c] = block[i * 4 + c];
+        }
+#endif
+
+    // Pull the box in by 1/16th, this reduces the error of the interpolated colours
+    for (int c = 0; c < 3; c++)
+    {
+        int inset = (maxs[c] - mins[c]) >> 4;
+        lo[c] = (float)(mins[c] + inset);
+        hi[c] = (float)(maxs[c] - inset);
+    }
+}
+
+// Endpoints at the extremes of the block along the direction its colours vary the most
+static void PrincipalAxisEndpoints(const ColourBlock& cb, float hi[3], float lo[3])
+{
+    float mean[3] = { 0.0f, 0.0f, 0.0f };
+    for (int i = 0; i < 16; i++)
+    {
+        mean[0] += cb.r[i];
+        mean[1] += cb.g[i];
+        mean[2] += cb.b[i];
+    }
+    for (int c = 0; c < 3; c++)
+        mean[c] /= 16.0f;
+
+    float cov[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };     // rr rg rb gg gb bb
+    for (int i = 0; i < 16; i++)
+    {
+        float r = cb.r[i] - mean[0], g = cb.g[i] - mean[1], b = cb.b[i] - mean[2];
+        cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+        cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+    }
+
+    // A few rounds of power iteration find the main axis well enough for 16 points
+    float axis[3] = { 1.0f, 1.0f, 1.0f };
+    for (int iteration = 0; iteration < 8; iteration++)
+    {
+        float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+        float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+        float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+        float length = fmaxf(fabsf(x), fmaxf(fabsf(y), fabsf(z)));
+        if (length < 1e-6f)
+            break; // A flat block, every texel is the mean
+        axis[0] = x / length; axis[1] = y / length; axis[2] = z / length;
+    }
+
+    float length2 = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+    float tmin = 0.0f, tmax = 0.0f;
+    for (int i = 0; i < 16; i++)
+    {
+        float t = ((cb.r[i] - mean[0]) * axis[0] + (cb.g[i] - mean[1]) * axis[1] + (cb.b[i] - mean[2]) * axis[2]) / length2;
+        if (t < tmin) tmin = t;
+        if (t > tmax) tmax = t;
+    }
+
+    for (int c = 0; c < 3; c++)
+    {
+        hi[c] = fminf(fmaxf(mean[c] + axis[c] * tmax, 0.0f), 255.0f);
+        lo[c] = fminf(fmaxf(mean[c] + axis[c] * tmin, 0.0f), 255.0f);
+    }
+}
+
+// Least squares endpoints for a fixed set of indices. False if the indices don't pin
+// both endpoints down (every texel on the same one).
+static bool SolveEndpoints(const ColourBlock& cb, unsigned int indices, float hi[3], float lo[3])
+{
+    static const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };  // Of c0, c1 gets the rest
+
+    float aa = 0.0f, bb = 0.0f, ab = 0.0f;
+    float ax[3] = { 0.0f, 0.0f, 0.0f }, bx[3] = { 0.0f, 0.0f, 0.0f };
+    for (int i = 0; i < 16; i++)
+    {
+        float a = weights[(indices >> (i * 2)) & 3], b = 1.0f - a;
+        aa += a * a; bb += b * b; ab += a * b;
+        ax[0] += a * cb.r[i]; ax[1] += a * cb.g[i]; ax[2] += a * cb.b[i];
+        bx[0] += b * cb.r[i]; bx[1] += b * cb.g[i]; bx[2] += b * cb.b[i];
+    }
+
+    float det = aa * bb - ab * ab;
+    if (fabsf(det) < 1e-4f)
+        return false;
+
+    for (int c = 0; c < 3; c++)
+    {
+        hi[c] = fminf(fmaxf((ax[c] * bb - bx[c] * ab) / det, 0.0f), 255.0f);
+        lo[c] = fminf(fmaxf((bx[c] * aa - ax[c] * ab) / det, 0.0f), 255.0f);
+    }
+    return true;
+}
+
+// Tries every single step change of one endpoint channel in 565 space, keeping any that help
+static bool NudgeEndpoints(const ColourBlock& cb, unsigned short& c0, unsigned short& c1, unsigned int& indices, float& error)
+{
+    static const int shifts[3] = { 11, 5, 0 }, limits[3] = { 31, 63, 31 };
+
+    bool improved = false;
+    for (int endpoint = 0; endpoint < 2; endpoint++)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            for (int step = -1; step <= 1; step += 2)
+            {
+                unsigned short e = endpoint == 0 ? c0 : c1;
+                int v = ((e >> shifts[c]) & limits[c]) + step;
+                if (v < 0 || v > limits[c])
+                    continue;
+                e = (unsigned short)((e & ~(limits[c] << shifts[c])) | (v << shifts[c]));
+
+                unsigned short t0, t1;
+                unsigned int trialIndices;
+                float trial = TryEndpoints(cb, endpoint == 0 ? e : c0, endpoint == 0 ? c1 : e, t0, t1, trialIndices);
+                if (trial < error)
+                {
+                    c0 = t0; c1 = t1; indices = trialIndices; error = trial;
+                    improved = true;
+                }
+            }
+        }
+    }
+    return improved;
+}
+
+// BC1 colour block, always in the opaque 4 colour mode (c0 > c1)
+static void EncodeColorBlock(const unsigned char block[64], CompressQuality quality, unsigned char out[8])
+{
+    ColourBlock cb;
+    SplitBlock(block, cb);
+
+    float hi[3], lo[3];
+    if (quality == COMPRESS_FAST)
+        BoundingBoxEndpoints(block, hi, lo);
+    else
+        PrincipalAxisEndpoints(cb, hi, lo);
+
+    unsigned short c0, c1;
+    unsigned int indices;
+    float error = TryEndpoints(cb, PackRGB565(hi), PackRGB565(lo), c0, c1, indices);
+
+    int refinements = quality == COMPRESS_FAST ? 0 : quality == COMPRESS_NORMAL ? 1 : 4;
+    for (int i = 0; i < refinements && error > 0.0f; i++)
+    {
+        if (!SolveEndpoints(cb, indices, hi, lo))
+            break;
+
+        unsigned short t0, t1;
+        unsigned int trialIndices;
+        float trial = TryEndpoints(cb, PackRGB565(hi), PackRGB565(lo), t0, t1, trialIndices);
+        if (trial >= error)
+            break;
+        c0 = t0; c1 = t1; indices = trialIndices; error = trial;
+    }
+
+    if (quality == COMPRESS_HIGH)
+        for (int round = 0; round < NUDGE_ROUNDS && error > 0.0f && NudgeEndpoints(cb, c0, c1, indices, error); round++)
+            ;
+
+    out[0] = (unsigned char)(c0 & 0xff); out[1] = (unsigned char)(c0 >> 8);
+    out[2] = (unsigned char)(c1 & 0xff); out[3] = (unsigned char)(c1 >> 8);
+    out[4] = (unsigned char)(indices);       out[5] = (unsigned char)(indices >> 8);
+    out[6] = (unsigned char)(indices >> 16); out[7] = (unsigned char)(indices >> 24);
+}
+
+//------------------------------------------------------------------------------------------------ BC4
+
+// The 8 value palette for hi > lo, in index order
+static void MakeChannelPalette(int hi, int lo, int palette[8])
+{
+    palette[0] = hi;
+    palette[1] = lo;
+    for (int i = 1; i < 7; i++)
+        palette[i + 1] = ((7 - i) * hi + i * lo) / 7;
+}
+
+static int FitChannel(const unsigned char block[64], int channel, int hi, int lo, unsigned long long& indices)
+{
+    int palette[8];
+    MakeChannelPalette(hi, lo, palette);
+
+    int total = 0;
+    indices = 0;
+    for (int i = 0; i < 16; i++)
+    {
+        int v = block[i * 4 + channel], best = 0, bestError = 0x7fffffff;
+        for (int p = 0; p < 8; p++)
+        {
+            int error = (v - palette[p]) * (v - palette[p]);
+            if (error < bestError) { bestError = error; best = p; }
+        }
+        total += bestError;
+        indices |= (unsigned long long)best << (i * 3);
+    }
+    return total;
+}
+
+// BC4 single channel block (used for BC3 alpha and both BC5 channels), 8 value mode
+static void EncodeChannelBlock(const unsigned char block[64], int channel, CompressQuality quality, unsigned char out[8])
+{
+    int lo = 255, hi = 0;
+    for (int i = 0; i < 16; i++)
+    {
+        int v = block[i * 4 + channel];
+        if (v < lo) lo = v;
+        if (v > hi) hi = v;
+    }
+
+    unsigned long long indices = 0;
+    if (hi != lo && quality == COMPRESS_FAST)
+    {
+        int range = hi - lo;
+        for (int i = 0; i < 16; i++)
+        {
+            // Position along the ramp from hi (0) to lo (7)
+            int t = ((hi - block[i * 4 + channel]) * 7 + range / 2) / range;
+            int index = t == 0 ? 0 : (t == 7 ? 1 : t + 1);
+            indices |= (unsigned long long)index << (i * 3);
+        }
+    }
+    else if (hi != lo)
+    {
+        int error = FitChannel(block, channel, hi, lo, indices);
+
+        // Pulling the ends in can land the ramp's steps closer to the values in between
+        int insets = quality == COMPRESS_HIGH ? 4 : 1;
+        int bestHi = hi, bestLo = lo;
+        for (int a = 0; a < insets; a++)
+        {
+            for (int b = 0; b < insets; b++)
+            {
+                if ((a == 0 && b == 0) || hi - a <= lo + b)
+                    continue;
+                unsigned long long trialIndices;
+                int trial = FitChannel(block, channel, hi - a, lo + b, trialIndices);
+                if (trial < error)
+                {
+                    error = trial; indices = trialIndices;
+                    bestHi = hi - a; bestLo = lo + b;
+                }
+            }
+        }
+        hi = bestHi;
+        lo = bestLo;
+    }
+
+    out[0] = (unsigned char)hi;
+    out[1] = (unsigned char)lo;
+    for (int b = 0; b < 6; b++)
+        out[2 + b] = (unsigned char)(indices >> (b * 8));
+}
+
+//------------------------------------------------------------------------------------------------ Images
+
+void CompressImage(BakedFormat format, const unsigned char* rgba, int width, int height, unsigned char* out,
+                   CompressQuality quality, CompressStats* stats)
+{
+    int blocksX = (width + 3) / 4;
+    int blocksY = (height + 3) / 4;
+    unsigned int blockBytes = BakedBlockBytes(format);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    int bands = (blocksY + BAND_BLOCK_ROWS - 1) / BAND_BLOCK_ROWS;
+    ThreadPool::ParallelFor(bands, [&](int band)
+    {
+        int lastRow = (band + 1) * BAND_BLOCK_ROWS < blocksY ? (band + 1) * BAND_BLOCK_ROWS : blocksY;
+        unsigned char block[64];
+        for (int by = band * BAND_BLOCK_ROWS; by < lastRow; by++)
+        {
+            for (int bx = 0; bx < blocksX; bx++)
+            {
+                FetchBlock(rgba, width, height, bx, by, block);
+                unsigned char* dst = out + ((size_t)by * blocksX + bx) * blockBytes;
+
+                switch (format)
+                {
+                case BTEX_BC1:
+                    EncodeColorBlock(block, quality, dst);
+                    break;
+                case BTEX_BC3:
+                    EncodeChannelBlock(block, 3, quality, dst);
+                    EncodeColorBlock(block, quality, dst + 8);
+                    break;
+                case BTEX_BC5:
+                    EncodeChannelBlock(block, 0, quality, dst);
+                    EncodeChannelBlock(block, 1, quality, dst + 8);
+                    break;
+                }
+            }
+        }
+    });
+
+    if (stats)
+    {
+        stats->blocks = (size_t)blocksX * blocksY;
+        stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        stats->psnr = CompressionPSNR(format, rgba, out, width, height);
+    }
+}
+
+static void DecodeColorBlock(const unsigned char in[8], unsigned char block[64])
+{
+    unsigned short c0 = (unsigned short)(in[0] | (in[1] << 8));
+    unsigned short c1 = (unsigned short)(in[2] | (in[3] << 8));
+    unsigned int indices = in[4] | (in[5] << 8) | (in[6] << 16) | ((unsigned int)in[7] << 24);
+
+    int palette[4][3], a[3], b[3];
+    UnpackRGB565(c0, a);
+    UnpackRGB565(c1, b);
+    for (int c = 0; c < 3; c++)
+    {
+        palette[0][c] = a[c];
+        palette[1][c] = b[c];
+        if (c0 > c1)
+        {
+            palette[2][c] = (2 * a[c] + b[c]) / 3;
+            palette[3][c] = (a[c] + 2 * b[c]) / 3;
+        }
+        else
+        {
+            palette[2][c] = (a[c] + b[c]) / 2;
+            palette[3][c] = 0;
+        }
+    }
+
+    for (int i = 0; i < 16; i++)
+    {
+        int index = (indices >> (i * 2)) & 3;
+        for (int c = 0; c < 3; c++)
+            block[i * 4 + c] = (unsigned char)palette[index][c];
+    }
+}
+
+static void DecodeChannelBlock(const unsigned char in[8], int channel, unsigned char block[64])
+{
+    int hi = in[0], lo = in[1], palette[8];
+    if (hi > lo)
+    {
+        MakeChannelPalette(hi, lo, palette);
+    }
+    else
+    {
+        palette[0] = hi;
+        palette[1] = lo;
+        for (int i = 1; i < 5; i++)
+            palette[i + 1] = ((5 - i) * hi + i * lo) / 5;
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+
+    unsigned long long indices = 0;
+    for (int b = 0; b < 6; b++)
+        indices |= (unsigned long long)in[2 + b] << (b * 8);
+    for (int i = 0; i < 16; i++)
+        block[i * 4 + channel] = (unsigned char)palette[(indices >> (i * 3)) & 7];
+}
+
+void DecompressImage(BakedFormat format, const unsigned char* data, int width, int height, unsigned char* rgba)
+{
+    int blocksX = (width + 3) / 4;
+    int blocksY = (height + 3) / 4;
+    unsigned int blockBytes = BakedBlockBytes(format);
+
+    for (int by = 0; by < blocksY; by++)
+    {
+        for (int bx = 0; bx < blocksX; bx++)
+        {
+            const unsigned char* in = data + ((size_t)by * blocksX + bx) * blockBytes;
+            unsigned char block[64];
+            for (int i = 0; i < 16; i++)
+            {
+                block[i * 4 + 0] = block[i * 4 + 1] = block[i * 4 + 2] = 0;
+                block[i * 4 + 3] = 255;
+            }
+
+            switch (format)
+            {
+            case BTEX_BC1:
+                DecodeColorBlock(in, block);
+                break;
+            case BTEX_BC3:
+                DecodeChannelBlock(in, 3, block);
+                DecodeColorBlock(in + 8, block);
+                break;
+            case BTEX_BC5:
+                DecodeChannelBlock(in, 0, block);
+                DecodeChannelBlock(in + 8, 1, block);
+                break;
+            }
+
+            for (int y = 0; y < 4 && by * 4 + y < height; y++)
+                for (int x = 0; x < 4 && bx * 4 + x < width; x++)
+                    memcpy(&rgba[((size_t)(by * 4 + y) * width + bx * 4 + x) * 4], &block[(y * 4 + x) * 4], 4);
+        }
+    }
+}
+
+double CompressionPSNR(BakedFormat format, const unsigned char* rgba, const unsigned char* data, int width, int height)
+{
+    std::vector<unsigned char> decoded((size_t)width * height * 4);
+    DecompressImage(format, data, width, height, &decoded[0]);
+
+    int first = 0, last = 3;        // Channels the format keeps, [first, last)
+    if (format == BTEX_BC3) last = 4;
+    if (format == BTEX_BC5) last = 2;
+
+    double sum = 0.0;
+    for (size_t p = 0; p < decoded.size(); p += 4)
+        for (int c = first; c < last; c++)
+        {
+            double d = (double)rgba[p + c] - decoded[p + c];
+            sum += d * d;
+        }
+
+    double mse = sum / ((double)width * height * (last - first));
+    if (mse <= 0.0)
+        return 99.0;    // Lossless, which only happens for flat images
+    return 10.0 * log10(255.0 * 255.0 / mse);
+}
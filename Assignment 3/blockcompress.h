@@ -0,0 +1,48 @@
+/**************************************************
+ *
+ *                 blockcompress.h
+ *
+ *  Encoders for the BC1 (DXT1), BC3 (DXT5) and
+ *  BC5 (RGTC2) block formats. Used by the texture
+ *  baker, and by texture arrays that compress
+ *  their levels while they stream in. Rows of
+ *  blocks are spread over the thread pool and the
+ *  palette fitting uses SSE when it's available.
+ *
+ ***************************************************/
+
+#ifndef BLOCKCOMPRESS_H
+#define BLOCKCOMPRESS_H
+
+#include "texturefile.h"
+
+enum CompressQuality
+{
+    COMPRESS_FAST,      // Inset bounding box endpoints, about what SOIL does
+    COMPRESS_NORMAL,    // Principal axis endpoints, refined once by least squares
+    COMPRESS_HIGH,      // Keeps refining and nudges the endpoints while the error drops
+};
+
+struct CompressStats
+{
+    size_t blocks;
+    double seconds;
+    double psnr;        // Over the channels the format stores, in dB
+};
+
+// Compresses a tightly packed RGBA8 image. 'out' must hold
+// BakedLevelSize(format, width, height) bytes. Images that aren't
+// a multiple of 4 are padded by repeating the last row/column.
+//  BC1 encodes RGB, BC3 encodes RGBA, BC5 encodes R and G.
+// Filling in 'stats' costs a decode of the result to measure the PSNR.
+void CompressImage(BakedFormat format, const unsigned char* rgba, int width, int height, unsigned char* out,
+                   CompressQuality quality = COMPRESS_NORMAL, CompressStats* stats = nullptr);
+
+// Decodes back to RGBA8 the way the GPU would. Channels the format
+// doesn't store come out as 0 (255 for alpha).
+void DecompressImage(BakedFormat format, const unsigned char* data, int width, int height, unsigned char* rgba);
+
+// Peak signal to noise ratio between an image and its compressed version
+double CompressionPSNR(BakedFormat format, const unsigned char* rgba, const unsigned char* data, int width, int height);
+
+#endif
@@ -0,0 +1,207 @@
+/*****************************************
+ *
+ *             camerapath.cpp
+ *
+ *  Keyframed camera rails with an arc
+ *  length table for constant speed.
+ *
+ ****************************************/
+
+#include "camerapath.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+
+CameraPath::CameraPath()
+    : closed(false), lookAlong(true)
+{
+}
+
+glm::vec3 CameraPath::Bezier(const glm::vec3 c[4], float t)
+{
+    float u = 1.0f - t;
+    return c[0] * (u * u * u) + c[1] * (3.0f * u * u * t) + c[2] * (3.0f * u * t * t) + c[3] * (t * t * t);
+}
+
+glm::vec3 CameraPath::BezierDirection(const glm::vec3 c[4], float t)
+{
+    float u = 1.0f - t;
+    return (c[1] - c[0]) * (3.0f * u * u) + (c[2] - c[1]) * (6.0f * u * t) + (c[3] - c[2]) * (3.0f * t * t);
+}
+
+bool CameraPath::Build(const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& targets,
+                       CameraPathCurve curve, bool closed)
+{
+    segments.clear();
+    distances.clear();
+    this->closed = closed;
+    lookAlong = targets.empty();
+
+    int keys = (int)positions.size();
+    if (!lookAlong && (int)targets.size() != keys)
+    {
+        printf("Camera path has %d positions but %d targets\n", keys, (int)targets.size());
+        return false;
+    }
+    const std::vector<glm::vec3>& looks = lookAlong ? positions : targets;
+
+    if (curve == CAMERAPATH_CATMULL_ROM)
+    {
+        if (keys < 2)
+        {
+            printf("Camera path needs at least 2 keys, has %d\n", keys);
+            return false;
+        }
+
+        // Each segment between keys i and i + 1 as a Bezier, its handles a sixth of the
+        // way along the tangents. An open rail's ends repeat the end keys.
+        int count = closed ? keys : keys - 1;
+        for (int i = 0; i < count; i++)
+        {
+            int k[4];
+            for (int j = 0; j < 4; j++)
+            {
+                int key = i - 1 + j;
+                k[j] = closed ? (key + keys) % keys : std::min(std::max(key, 0), keys - 1);
+            }
+
+            Segment segment;
+            segment.position[0] = positions[k[1]];
+            segment.position[1] = positions[k[1]] + (positions[k[2]] - positions[k[0]]) * (1.0f / 6.0f);
+            segment.position[2] = positions[k[2]] - (positions[k[3]] - positions[k[1]]) * (1.0f / 6.0f);
+            segment.position[3] = positions[k[2]];
+            segment.target[0] = looks[k[1]];
+            segment.target[1] = looks[k[1]] + (looks[k[2]] - looks[k[0]]) * (1.0f / 6.0f);
+            segment.target[2] = looks[k[2]] - (looks[k[3]] - looks[k[1]]) * (1.0f / 6.0f);
+            segment.target[3] = looks[k[2]];
+            segments.push_back(segment);
+        }
+    }
+    else
+    {
+        if (keys < 3 || keys % 3 != (closed ? 0 : 1))
+        {
+            printf("Bezier camera path needs 3n%s keys, has %d\n", closed ? "" : " + 1", keys);
+            return false;
+        }
+
+        int count = closed ? keys / 3 : (keys - 1) / 3;
+        for (int i = 0; i < count; i++)
+        {
+            Segment segment;
+            for (int j = 0; j < 4; j++)
+            {
+                int key = (i * 3 + j) % keys;
+                segment.position[j] = positions[key];
+                segment.target[j] = looks[key];
+            }
+            segments.push_back(segment);
+        }
+    }
+
+    // The running length, summed over short chords. Evaluate's speed is only as even as
+    // these samples are, CAMERAPATH_SAMPLES keeps it within a few percent on tight turns.
+    distances.reserve(segments.size() * CAMERAPATH_SAMPLES + 1);
+    distances.push_back(0.0f);
+    float length = 0.0f;
+    for (const Segment& segment : segments)
+    {
+        glm::vec3 previous = segment.position[0];
+        for (int s = 1; s <= CAMERAPATH_SAMPLES; s++)
+        {
+            glm::vec3 point = Bezier(segment.position, s / (float)CAMERAPATH_SAMPLES);
+            length += glm::length(point - previous);
+            distances.push_back(length);
+            previous = point;
+        }
+    }
+    if (length <= 0.0f)
+    {
+        printf("Camera path has no length\n");
+        segments.clear();
+        distances.clear();
+        return false;
+    }
+    return true;
+}
+
+void CameraPath::Evaluate(float distance, glm::vec3& position, glm::vec3& target) const
+{
+    if (segments.empty())
+    {
+        position = target = glm::vec3(0.0f);
+        return;
+    }
+
+    // The sample at or after the distance, and how far the distance is between it and the last
+    distance = Wrap(distance);
+    int sample = (int)(std::upper_bound(distances.begin(), distances.end(), distance) - distances.begin());
+    sample = std::min(std::max(sample, 1), (int)distances.size() - 1);
+    float span = distances[sample] - distances[sample - 1];
+    float between = span > 0.0f ? (distance - distances[sample - 1]) / span : 0.0f;
+
+    // Straight between the samples' parameters, then one Newton step along the curve for
+    // where the speed changes within the sample, tight turns mostly
+    int segment = (sample - 1) / CAMERAPATH_SAMPLES;
+    float t0 = ((sample - 1) % CAMERAPATH_SAMPLES) / (float)CAMERAPATH_SAMPLES;
+    float t1 = t0 + 1.0f / CAMERAPATH_SAMPLES;
+    float t = t0 + between / CAMERAPATH_SAMPLES;
+    const Segment& g = segments[segment];
+    float speed = glm::length(BezierDirection(g.position, t));
+    if (speed > 0.0f)
+    {
+        float along = glm::length(Bezier(g.position, t) - Bezier(g.position, t0));
+        t = std::min(std::max(t + (distance - distances[sample - 1] - along) / speed, t0), t1);
+    }
+    position = Bezier(g.position, t);
+
+    if (lookAlong)
+    {
+        glm::vec3 direction = BezierDirection(g.position, t);
+        if (glm::length(direction) == 0.0f)
+            direction = g.position[3] - g.position[0];
+        target = position + direction;
+    }
+    else
+    {
+        target = Bezier(g.target, t);
+    }
+}
+
+float CameraPath::Length() const
+{
+    return distances.empty() ? 0.0f : distances.back();
+}
+
+int CameraPath::Keys() const
+{
+    return segments.empty() ? 0 : (int)segments.size() + (closed ? 0 : 1);
+}
+
+float CameraPath::KeyDistance(int key) const
+{
+    if (segments.empty())
+        return 0.0f;
+    key = std::min(std::max(key, 0), (int)segments.size());
+    return distances[key * CAMERAPATH_SAMPLES];
+}
+
+float CameraPath::Wrap(float distance) const
+{
+    float length = Length();
+    if (length <= 0.0f)
+        return 0.0f;
+    if (!closed)
+        return std::min(std::max(distance, 0.0f), length);
+
+    distance = fmodf(distance, length);
+    if (distance < 0.0f)
+        distance += length;
+    return distance < length ? distance : 0.0f;
+}
+
+bool CameraPath::Closed() const
+{
+    return closed;
+}
@@ -5,11 +5,12 @@ out vec4 frag_colour;
 in VertexData
 {
 	vec2 texcoord;
+	flat int layer;
 }	inData;
 
-uniform sampler2D emissiveTex;
+uniform sampler2DArray planetTex;
 
 void main()
 {
-	frag_colour = texture(emissiveTex, inData.texcoord) * 1.5f;
+	frag_colour = texture(planetTex, vec3(inData.texcoord, inData.layer)) * 1.5f;
 }
\ No newline at end of file
@@ -1,21 +1,28 @@
 #version 400
 
+#define MAX_INSTANCES 16
+
 layout (location = 0) in vec3 vertexPosition;
 layout (location = 2) in vec2 vertexTexCoord;
 
 out VertexData
 {
 	vec2 texcoord;
+	flat int layer;		// Layer in the planet texture array
 }	outData;
 
-uniform mat4 model;
+// One entry per body, picked with gl_InstanceID
+uniform mat4 models[MAX_INSTANCES];
+uniform int emissiveLayers[MAX_INSTANCES];
+
 uniform mat4 view;
 uniform mat4 proj;
 
 void main()
 {
 	outData.texcoord	= vertexTexCoord;
+	outData.layer		= emissiveLayers[gl_InstanceID];
 
-    gl_Position = proj * view * model * vec4(vertexPosition, 1.0f);
+    gl_Position = proj * view * models[gl_InstanceID] * vec4(vertexPosition, 1.0f);
 
 }
\ No newline at end of file
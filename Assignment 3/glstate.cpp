@@ -0,0 +1,199 @@
+/*****************************************
+ *
+ *               glstate.cpp
+ *
+ *  The render state cache and its call
+ *  counts.
+ *
+ ****************************************/
+
+#include "glstate.h"
+
+#include <string.h>
+
+#define UNKNOWN 0xffffffffu     // Not a name GL hands out, so it never matches
+
+GLuint GLState::program = UNKNOWN;
+GLuint GLState::vao = UNKNOWN;
+GLuint GLState::activeUnit = UNKNOWN;
+GLuint GLState::textures[GLSTATE_TEXTURE_UNITS][GLSTATE_TEXTURE_TARGETS];
+GLuint GLState::buffers[GLSTATE_BUFFER_TARGETS];
+GLuint GLState::depthMask = UNKNOWN;
+GLuint GLState::blend = UNKNOWN;
+GLuint GLState::blendSource = UNKNOWN;
+GLuint GLState::blendDestination = UNKNOWN;
+GLStateStats GLState::counting = {};
+GLStateStats GLState::lastFrame = {};
+
+int GLState::TextureTarget(GLenum target)
+{
+    switch (target)
+    {
+    case GL_TEXTURE_2D:         return 0;
+    case GL_TEXTURE_2D_ARRAY:   return 1;
+    case GL_TEXTURE_CUBE_MAP:   return 2;
+    case GL_TEXTURE_3D:         return 3;
+    case GL_TEXTURE_BUFFER:     return 4;
+    default:                    return -1;
+    }
+}
+
+// GL_ELEMENT_ARRAY_BUFFER isn't here on purpose: it belongs to the bound vertex array,
+// so it changes whenever that does
+int GLState::BufferTarget(GLenum target)
+{
+    switch (target)
+    {
+    case GL_ARRAY_BUFFER:           return 0;
+    case GL_PIXEL_PACK_BUFFER:      return 1;
+    case GL_PIXEL_UNPACK_BUFFER:    return 2;
+    case GL_UNIFORM_BUFFER:         return 3;
+    case GL_TEXTURE_BUFFER:         return 4;
+    default:                        return -1;
+    }
+}
+
+void GLState::Count(int call, bool issued)
+{
+    if (issued)
+    {
+        counting.issued[call]++;
+        counting.totalIssued++;
+    }
+    else
+    {
+        counting.skipped[call]++;
+        counting.totalSkipped++;
+    }
+}
+
+// Counts the call, and returns whether it has to be sent
+bool GLState::Changed(GLuint& current, GLuint value, int call)
+{
+    bool changed = current != value;
+    current = value;
+    Count(call, changed);
+    return changed;
+}
+
+void GLState::UseProgram(GLuint program)
+{
+    if (Changed(GLState::program, program, GLSTATE_PROGRAM))
+        glUseProgram(program);
+}
+
+void GLState::BindVertexArray(GLuint vao)
+{
+    if (Changed(GLState::vao, vao, GLSTATE_VERTEX_ARRAY))
+        glBindVertexArray(vao);
+}
+
+void GLState::BindTexture(int unit, GLenum target, GLuint texture)
+{
+    if (Changed(activeUnit, (GLuint)unit, GLSTATE_TEXTURE))
+        glActiveTexture(GL_TEXTURE0 + unit);
+
+    int t = TextureTarget(target);
+    if (t < 0 || unit >= GLSTATE_TEXTURE_UNITS)
+    {
+        Count(GLSTATE_TEXTURE, true);
+        glBindTexture(target, texture);
+        return;
+    }
+    if (Changed(textures[unit][t], texture, GLSTATE_TEXTURE))
+        glBindTexture(target, texture);
+}
+
+void GLState::BindBuffer(GLenum target, GLuint buffer)
+{
+    int b = BufferTarget(target);
+    if (b < 0)
+    {
+        Count(GLSTATE_BUFFER, true);
+        glBindBuffer(target, buffer);
+        return;
+    }
+    if (Changed(buffers[b], buffer, GLSTATE_BUFFER))
+        glBindBuffer(target, buffer);
+}
+
+void GLState::DepthMask(bool write)
+{
+    if (Changed(depthMask, write ? GL_TRUE : GL_FALSE, GLSTATE_DEPTH_BLEND))
+        glDepthMask(write ? GL_TRUE : GL_FALSE);
+}
+
+void GLState::Blend(bool enable)
+{
+    if (!Changed(blend, enable ? GL_TRUE : GL_FALSE, GLSTATE_DEPTH_BLEND))
+        return;
+    if (enable)
+        glEnable(GL_BLEND);
+    else
+        glDisable(GL_BLEND);
+}
+
+void GLState::BlendFunc(GLenum source, GLenum destination)
+{
+    bool changed = blendSource != source || blendDestination != destination;
+    blendSource = source;
+    blendDestination = destination;
+    Count(GLSTATE_DEPTH_BLEND, changed);
+    if (changed)
+        glBlendFunc(source, destination);
+}
+
+void GLState::DeleteTextures(GLsizei count, const GLuint* names)
+{
+    for (GLsizei i = 0; i < count; i++)
+        for (int unit = 0; unit < GLSTATE_TEXTURE_UNITS; unit++)
+            for (int t = 0; t < GLSTATE_TEXTURE_TARGETS; t++)
+                if (names[i] != 0 && textures[unit][t] == names[i])
+                    textures[unit][t] = 0;
+    glDeleteTextures(count, names);
+}
+
+void GLState::DeleteBuffers(GLsizei count, const GLuint* names)
+{
+    for (GLsizei i = 0; i < count; i++)
+        for (int b = 0; b < GLSTATE_BUFFER_TARGETS; b++)
+            if (names[i] != 0 && buffers[b] == names[i])
+                buffers[b] = 0;
+    glDeleteBuffers(count, names);
+}
+
+void GLState::DeleteVertexArrays(GLsizei count, const GLuint* names)
+{
+    for (GLsizei i = 0; i < count; i++)
+        if (names[i] != 0 && vao == names[i])
+            vao = 0;
+    glDeleteVertexArrays(count, names);
+}
+
+void GLState::Invalidate()
+{
+    program = vao = activeUnit = UNKNOWN;
+    for (int unit = 0; unit < GLSTATE_TEXTURE_UNITS; unit++)
+        for (int t = 0; t < GLSTATE_TEXTURE_TARGETS; t++)
+            textures[unit][t] = UNKNOWN;
+    for (int b = 0; b < GLSTATE_BUFFER_TARGETS; b++)
+        buffers[b] = UNKNOWN;
+    depthMask = blend = blendSource = blendDestination = UNKNOWN;
+}
+
+void GLState::EndFrame()
+{
+    lastFrame = counting;
+    memset(&counting, 0, sizeof(counting));
+}
+
+GLStateStats GLState::Stats()
+{
+    return lastFrame;
+}
+
+const char* GLState::CallName(int call)
+{
+    static const char* names[GLSTATE_CALLS] = { "Program", "Vertex array", "Texture", "Buffer", "Depth and blend" };
+    return call >= 0 && call < GLSTATE_CALLS ? names[call] : "";
+}
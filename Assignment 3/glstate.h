@@ -0,0 +1,87 @@
+/**************************************************
+ *
+ *                   glstate.h
+ *
+ *  Remembers what's bound and set in the GL
+ *  context, so a call that wouldn't change
+ *  anything never reaches the driver. That
+ *  covers the program, the vertex array, the
+ *  textures on every unit, the buffer bindings,
+ *  the depth mask and blending.
+ *
+ *  With that, nothing needs unbinding once it's
+ *  been used: whatever draws next binds what it
+ *  needs, and only what differs is sent. It only
+ *  works if every bind goes through here. Code
+ *  that binds behind its back, like SOIL, has to
+ *  be followed by Invalidate.
+ *
+ *  Calls sent and skipped are counted per frame.
+ *
+ ***************************************************/
+
+#ifndef GLSTATE_H
+#define GLSTATE_H
+
+#include <GL/gl3w.h>
+
+#define GLSTATE_TEXTURE_UNITS   16
+#define GLSTATE_TEXTURE_TARGETS 5   // 2D, 2D array, cube map, 3D, buffer
+#define GLSTATE_BUFFER_TARGETS  5   // Array, pixel pack and unpack, uniform, texture
+
+enum GLStateCall
+{
+    GLSTATE_PROGRAM,
+    GLSTATE_VERTEX_ARRAY,
+    GLSTATE_TEXTURE,        // Active texture unit changes included
+    GLSTATE_BUFFER,
+    GLSTATE_DEPTH_BLEND,    // Depth mask, blend enable and blend function
+    GLSTATE_CALLS
+};
+
+struct GLStateStats
+{
+    int issued[GLSTATE_CALLS];
+    int skipped[GLSTATE_CALLS];
+    int totalIssued, totalSkipped;
+};
+
+class GLState
+{
+public:
+    static void UseProgram(GLuint program);
+    static void BindVertexArray(GLuint vao);
+    static void BindTexture(int unit, GLenum target, GLuint texture);   // Leaves 'unit' active
+    static void BindBuffer(GLenum target, GLuint buffer);
+    static void DepthMask(bool write);
+    static void Blend(bool enable);
+    static void BlendFunc(GLenum source, GLenum destination);
+
+    // Deleting an object unbinds it, so a new one given the same name has to be bound again
+    static void DeleteTextures(GLsizei count, const GLuint* textures);
+    static void DeleteBuffers(GLsizei count, const GLuint* buffers);
+    static void DeleteVertexArrays(GLsizei count, const GLuint* vaos);
+
+    // Forgets everything, so the next call of each kind is sent whatever it is. Once the
+    // context is made, and after anything that binds without going through here.
+    static void Invalidate();
+
+    // Once a frame, starts counting again. Stats returns the frame before.
+    static void EndFrame();
+    static GLStateStats Stats();
+    static const char* CallName(int call);
+
+private:
+    static int TextureTarget(GLenum target);    // -1 for ones that aren't tracked
+    static int BufferTarget(GLenum target);
+    static void Count(int call, bool issued);
+    static bool Changed(GLuint& current, GLuint value, int call);
+
+    static GLuint program, vao, activeUnit;
+    static GLuint textures[GLSTATE_TEXTURE_UNITS][GLSTATE_TEXTURE_TARGETS];
+    static GLuint buffers[GLSTATE_BUFFER_TARGETS];
+    static GLuint depthMask, blend, blendSource, blendDestination;
+    static GLStateStats counting, lastFrame;
+};
+
+#endif
@@ -31,6 +31,9 @@
 #include <iostream> // Used for std::cout
 #include <vector>   // Used for std::vector<vec3>
 #include <map>      // Used for std::map
+#include <string>   // Used for std::string
+#include <algorithm> // Used for std::min
+#include <cmath>    // Used for log2f
 
 #include <ctime>    // For time()
 #include <cstdlib>  // For srand() and rand()
@@ -38,6 +41,16 @@
 // Custom headers
 #include "shaders.h"
 #include "mesh.h"
+#include "texturecache.h"
+#include "texturearray.h"
+#include "texturestreamer.h"
+#include "threadpool.h"
+#include "virtualtexture.h"
+#include "panorama.h"
+#include "camerapath.h"
+#include "framepacer.h"
+#include "fixedstep.h"
+#include "glstate.h"
 
 using namespace glm;
 
@@ -47,7 +60,7 @@ GLFWwindow* window;
 int width = 1280, height = 720;
 
 // Shader programs
-GLuint phongProgram, skyboxProgram, emissiveProgram;
+GLuint phongProgram, skyboxProgram, emissiveProgram, feedbackProgram;
 
 // Variables for uniforms
 mat4 projectionMatrix, viewMatrix, modelMatrix[14];
@@ -58,16 +71,24 @@ mat4 m, v, vNoPos, p;
 
 // Solar system variables
 float earthDays = 17.62f;
+float previousEarthDays = 17.62f; // As of the step before, the frame is drawn between the two
 float moonRotation = 0.0f;
 float simulationSpeed = 0.5f;
 int viewMode = 3;
 
+// The rail view flies the camera round the inner planets at a steady speed
+CameraPath cameraRail;
+float railDistance = 0.0f;
+float railSpeed = 8.0f; // Units a second, in real time rather than simulated days
+
 float specularPower = 20.0f; // Create a variable to go to GLSL
 
 							 // Textures
 GLuint skyboxTexture;
-GLuint diffuseTexture, specularTexture;
-GLuint moonTexture, asteroidTexture, sunTexture, mercuryTexture, venusTexture, marsTexture, jupiterTexture, saturnTexture, neptuneTexture, uranusTexture;
+CubemapInfo skyboxInfo; // Tells us if the skybox ended up as a real cubemap or a single 2D image
+int planetTextures;     // Handle of the planet texture array in the TextureStreamer, the bodies below pick their layers
+int litPlanetTextures;  // Same for the lit bodies, with their specular masks packed into alpha
+float textureBudgetMB = 64.0f;
 
 glm::vec3   accumPos = glm::vec3(0.0f);
 
@@ -96,6 +117,27 @@ enum
 	ASTEROID = 11,
 };
 
+// A body drawn as one instance of a batched sphere draw
+struct PlanetInstance
+{
+	int model;          // Index into modelMatrix
+	int layer;          // Layer in planetTextures, or litPlanetTextures for phongBodies
+	int virtualTexture; // Used instead of the layer when it isn't -1, see VirtualTexture
+};
+
+// What a lit body is shaded with. The specular map is packed into the alpha of the colour
+// map, so the lighting shader reads both in one fetch instead of binding two layers.
+struct PlanetMaterial
+{
+	int model;
+	const char* colourMap;
+	const char* specularMap;    // Grey, only the green channel is kept
+	const char* tiledMap;       // Both tiled by tools/vttiler, for maps too big for the array. Optional.
+};
+
+const int MAX_INSTANCES = 16; // Must match MAX_INSTANCES in simpleLights.vert and emissive.vert
+std::vector<PlanetInstance> phongBodies, emissiveBodies;
+
 void Initialize()
 {
 	// Make a simple shader for the sphere we're drawing
@@ -107,6 +149,15 @@ void Initialize()
 		dumpProgram(phongProgram, "Simple program for phong lighting");
 	}
 
+	// Same vertex shader, writing out which virtual texture tiles are visible instead of colour
+	{
+		GLuint vs = buildShader(GL_VERTEX_SHADER, ASSETS"simpleLights.vert");
+		GLuint fs = buildShader(GL_FRAGMENT_SHADER, ASSETS"vtfeedback.frag");
+		feedbackProgram = buildProgram(vs, fs, 0);
+		feedbackProgram = linkProgram(feedbackProgram);
+		dumpProgram(feedbackProgram, "Virtual texture feedback program");
+	}
+
 	// Make a simple shader for the skybox
 	{
 		GLuint vs = buildShader(GL_VERTEX_SHADER, ASSETS"skybox.vert");
@@ -125,121 +176,104 @@ void Initialize()
 		dumpProgram(emissiveProgram, "Simple program for the sun");
 	}
 
-	// Load in all 6 faces of the skybox cube
-	skyboxTexture = SOIL_load_OGL_cubemap
-	(
-		ASSETS"textures/star_sky/stars.png", // posx
-		ASSETS"textures/star_sky/stars.png", // negx
-		ASSETS"textures/star_sky/stars.png", // posy
-		ASSETS"textures/star_sky/stars.png", // negy
-		ASSETS"textures/star_sky/stars.png", // posz
-		ASSETS"textures/star_sky/stars.png", // negz
-		SOIL_LOAD_RGB,      // This means we're expecting it to have RGB channels
-		SOIL_CREATE_NEW_ID, // This means we want to create a new texture instead of overwriting one 
-		SOIL_FLAG_MIPMAPS   // This means we want it to generate mip-maps.
-	);
+	// The star sky is one panorama, resampled into a real cubemap. That's slow the first time,
+	// after which it loads from the compressed stars.png.cube.btex next to it.
+	skyboxTexture = LoadPanoramaCubemap(ASSETS"textures/star_sky/stars.png", 0, &skyboxInfo);
+
+	// If that fails, load in all 6 faces of the skybox cube. They're all stars.png, so the cache
+	// decodes it once and stores it as a single 2D image that skybox.frag samples by direction
+	if (skyboxTexture == 0)
+	{
+		skyboxTexture = TextureCache::LoadCubemap
+		(
+			ASSETS"textures/star_sky/stars.png", // posx
+			ASSETS"textures/star_sky/stars.png", // negx
+			ASSETS"textures/star_sky/stars.png", // posy
+			ASSETS"textures/star_sky/stars.png", // negy
+			ASSETS"textures/star_sky/stars.png", // posz
+			ASSETS"textures/star_sky/stars.png", // negz
+			SOIL_LOAD_RGB,      // This means we're expecting it to have RGB channels
+			SOIL_FLAG_MIPMAPS,  // This means we want it to generate mip-maps.
+			&skyboxInfo
+		);
+	}
 
 	v = inverse(lookAt(vec3(0, 1, -3), vec3(0), vec3(0, 1, 0)));
 
-	diffuseTexture = SOIL_load_OGL_texture
-	(
-		ASSETS"textures/earthDiffuse.png",
-		SOIL_LOAD_AUTO,
-		SOIL_CREATE_NEW_ID,
-		SOIL_FLAG_MIPMAPS | SOIL_FLAG_INVERT_Y | SOIL_FLAG_NTSC_SAFE_RGB | SOIL_FLAG_COMPRESS_TO_DXT
-	);
-
-	specularTexture = SOIL_load_OGL_texture
-	(
-		ASSETS"textures/earthSpecular.png",
-		SOIL_LOAD_AUTO,
-		SOIL_CREATE_NEW_ID,
-		SOIL_FLAG_INVERT_Y | SOIL_FLAG_NTSC_SAFE_RGB | SOIL_FLAG_COMPRESS_TO_DXT
-	);
-
-	moonTexture = SOIL_load_OGL_texture
-	(
-		ASSETS"textures/moonTexture.png",
-		SOIL_LOAD_AUTO,
-		SOIL_CREATE_NEW_ID,
-		SOIL_FLAG_INVERT_Y | SOIL_FLAG_NTSC_SAFE_RGB | SOIL_FLAG_COMPRESS_TO_DXT
-	);
-
-	sunTexture = SOIL_load_OGL_texture
-	(
-		ASSETS"textures/sunTexture.png",
-		SOIL_LOAD_AUTO,
-		SOIL_CREATE_NEW_ID,
-		SOIL_FLAG_INVERT_Y | SOIL_FLAG_NTSC_SAFE_RGB | SOIL_FLAG_COMPRESS_TO_DXT
-	);
-
-	mercuryTexture = SOIL_load_OGL_texture
-	(
-		ASSETS"textures/mercury.png",
-		SOIL_LOAD_AUTO,
-		SOIL_CREATE_NEW_ID,
-		SOIL_FLAG_INVERT_Y | SOIL_FLAG_NTSC_SAFE_RGB | SOIL_FLAG_COMPRESS_TO_DXT
-	);
-
-	asteroidTexture = SOIL_load_OGL_texture
-	(
-		ASSETS"textures/asteroid.png",
-		SOIL_LOAD_AUTO,
-		SOIL_CREATE_NEW_ID,
-		SOIL_FLAG_INVERT_Y | SOIL_FLAG_NTSC_SAFE_RGB | SOIL_FLAG_COMPRESS_TO_DXT
-	);
-
-	venusTexture = SOIL_load_OGL_texture
-	(
-		ASSETS"textures/venus.png",
-		SOIL_LOAD_AUTO,
-		SOIL_CREATE_NEW_ID,
-		SOIL_FLAG_INVERT_Y | SOIL_FLAG_NTSC_SAFE_RGB | SOIL_FLAG_COMPRESS_TO_DXT
-	);
-
-	marsTexture = SOIL_load_OGL_texture
-	(
-		ASSETS"textures/mars.png",
-		SOIL_LOAD_AUTO,
-		SOIL_CREATE_NEW_ID,
-		SOIL_FLAG_INVERT_Y | SOIL_FLAG_NTSC_SAFE_RGB | SOIL_FLAG_COMPRESS_TO_DXT
-	);
-
-	jupiterTexture = SOIL_load_OGL_texture
-	(
-		ASSETS"textures/jupiter.png",
-		SOIL_LOAD_AUTO,
-		SOIL_CREATE_NEW_ID,
-		SOIL_FLAG_INVERT_Y | SOIL_FLAG_NTSC_SAFE_RGB | SOIL_FLAG_COMPRESS_TO_DXT
-	);
-
-	saturnTexture = SOIL_load_OGL_texture
-	(
-		ASSETS"textures/saturn.png",
-		SOIL_LOAD_AUTO,
-		SOIL_CREATE_NEW_ID,
-		SOIL_FLAG_INVERT_Y | SOIL_FLAG_NTSC_SAFE_RGB | SOIL_FLAG_COMPRESS_TO_DXT
-	);
-
-	neptuneTexture = SOIL_load_OGL_texture
-	(
-		ASSETS"textures/neptune.png",
-		SOIL_LOAD_AUTO,
-		SOIL_CREATE_NEW_ID,
-		SOIL_FLAG_INVERT_Y | SOIL_FLAG_NTSC_SAFE_RGB | SOIL_FLAG_COMPRESS_TO_DXT
-	);
-
-	uranusTexture = SOIL_load_OGL_texture
-	(
-		ASSETS"textures/uranus.png",
-		SOIL_LOAD_AUTO,
-		SOIL_CREATE_NEW_ID,
-		SOIL_FLAG_INVERT_Y | SOIL_FLAG_NTSC_SAFE_RGB | SOIL_FLAG_COMPRESS_TO_DXT
-	);
+	// Planet textures. They're all resampled to the same size and packed into one texture array,
+	// so every body can be drawn from the same binding. Missing files get a placeholder layer.
+	// The streamer decodes them in the background and only keeps the mip levels that are
+	// big enough to see, so the full 2048x1024 chain is only resident up close.
+	// The mips are Kaiser filtered in linear light, so the planets stay crisp and
+	// don't darken as they shrink into the distance, then compressed to BC1 on the
+	// streamer's thread, which makes each level an eighth of the size.
+	// The lit bodies get an array of their own, BC3 so the packed specular mask survives.
+	// Bodies with a tiled map (16K and up) are virtual textured instead: only the tiles on
+	// screen are loaded, into a cache of 32x32 BC3 tiles (18 MB) whatever the map size.
+	// The array layer is still there in case the tiled map is missing.
+	// A layer baked by texbake -size (see tools/texbake.cpp) is copied from its .btex instead
+	// of being decoded, resampled and compressed, the PNG is only the fallback.
+	TextureStreamer::Start((size_t)(textureBudgetMB * 1024 * 1024));
+	VirtualTexture::Start(32, BTEX_BC3);
+	{
+		// The moon has no specular map, it uses its own colour like before
+		const PlanetMaterial litMaterials[] =
+		{
+			{ EARTH, ASSETS"textures/earthDiffuse.png", ASSETS"textures/earthSpecular.png", ASSETS"textures/earth.vtex" },
+			{ MOON,  ASSETS"textures/moonTexture.png",  ASSETS"textures/moonTexture.png",   ASSETS"textures/moon.vtex" },
+		};
+
+		TextureArrayBuilder litPlanets(2048, 1024);
+		litPlanets.SetMipFilter(MIP_KAISER);
+		litPlanets.SetBlockFormat(BTEX_BC3, COMPRESS_NORMAL);
+		for (const PlanetMaterial& material : litMaterials)
+		{
+			int layer = litPlanets.AddPackedLayer(material.colourMap, material.specularMap, true, true);
+			phongBodies.push_back({ material.model, layer, VirtualTexture::Add(material.tiledMap) });
+		}
+		litPlanetTextures = TextureStreamer::Add(litPlanets);
+
+		TextureArrayBuilder planets(2048, 1024);
+		planets.SetMipFilter(MIP_KAISER);
+		planets.SetBlockFormat(BTEX_BC1, COMPRESS_NORMAL);
+		int sunLayer = planets.AddLayer(ASSETS"textures/sunTexture.png", true, true);
+		int mercuryLayer = planets.AddLayer(ASSETS"textures/mercury.png", true, true);
+		int asteroidLayer = planets.AddLayer(ASSETS"textures/asteroid.png", true, true);
+		int venusLayer = planets.AddLayer(ASSETS"textures/venus.png", true, true);
+		planets.AddLayer(ASSETS"textures/mars.png", true, true);
+		planets.AddLayer(ASSETS"textures/jupiter.png", true, true);
+		planets.AddLayer(ASSETS"textures/saturn.png", true, true);
+		int neptuneLayer = planets.AddLayer(ASSETS"textures/neptune.png", true, true);
+		planets.AddLayer(ASSETS"textures/uranus.png", true, true);
+		planetTextures = TextureStreamer::Add(planets);
+
+		emissiveBodies.push_back({ SUN, sunLayer, -1 });
+		emissiveBodies.push_back({ MERCURY, mercuryLayer, -1 });
+		emissiveBodies.push_back({ VENUS, venusLayer, -1 });
+		emissiveBodies.push_back({ NEPTUNE, neptuneLayer, -1 });
+		emissiveBodies.push_back({ ASTEROID, asteroidLayer, -1 });
+	}
+
+	// Everything is uploaded, the decoded pixels aren't needed anymore
+	TextureCache::TrimImages();
+	TextureCache::PrintStats();
 
 	cameraPosition = vec3(0, 0, -5);
 	cameraTarget = vec3(0, 0, 0);
 
+	// A loop just outside the earth's orbit, rising and dipping, looking in past the sun
+	{
+		std::vector<vec3> positions = {
+			vec3(0.0f, 8.0f, -45.0f), vec3(40.0f, 3.0f, -20.0f), vec3(35.0f, 14.0f, 25.0f),
+			vec3(-10.0f, 4.0f, 42.0f), vec3(-45.0f, 10.0f, 5.0f), vec3(-25.0f, 2.0f, -30.0f)
+		};
+		std::vector<vec3> targets = {
+			vec3(0.0f), vec3(-5.0f, 0.0f, 5.0f), vec3(0.0f),
+			vec3(5.0f, 0.0f, -10.0f), vec3(0.0f), vec3(10.0f, 0.0f, 5.0f)
+		};
+		cameraRail.Build(positions, targets, CAMERAPATH_CATMULL_ROM, true);
+	}
+
 	// -------------- From Lab 4
 	{
 		float positions[12] =
@@ -253,6 +287,14 @@ void Initialize()
 	// -------------------------------------------------------------------
 }
 
+// One fixed step of the solar system. The speed is in days per 1/120 s, the frame the
+// loop used to be held to, so it reads the same as it always has.
+void Simulate(float step)
+{
+	previousEarthDays = earthDays;
+	earthDays += simulationSpeed * 120.0f * step;
+}
+
 void Update(float deltaTime)
 {
 	mat4 identity, translation, scaling, rotation;
@@ -267,9 +309,6 @@ void Update(float deltaTime)
 	accumPos.x += asteroidVelocity.x;
 	accumPos.y += asteroidVelocity.y;
 
-	// Add to the rotation, in days.
-	earthDays += simulationSpeed;
-
 	// ----From lab 7
 	// Set the viewport incase the window size changed
 	glfwGetFramebufferSize(window, &width, &height);
@@ -280,7 +319,8 @@ void Update(float deltaTime)
 	p = perspective(radians(60.0f), ratio, 0.1f, 1000.0f);
 	// ------------------
 
-	float planetRotations = earthDays;
+	// Every orbit and spin is worked out from the day, so blending it blends them all
+	float planetRotations = mix(previousEarthDays, earthDays, FixedStep::Alpha());
 
 	if (viewMode == 4) planetRotations = 17.62f;
 
@@ -414,26 +454,114 @@ void Update(float deltaTime)
 	{   // Static view
 		viewMatrix = inverse(lookAt(moonPosition, (earthPosition), vec3(0, 1, 0)));
 	}
+	else if (viewMode == 5)
+	{   // Ride the rail
+		railDistance = cameraRail.Wrap(railDistance + railSpeed * deltaTime);
+		vec3 railPosition, railTarget;
+		cameraRail.Evaluate(railDistance, railPosition, railTarget);
+		viewMatrix = inverse(lookAt(railPosition, railTarget, vec3(0, 1, 0)));
+	}
 	std::cout << planetRotations << std::endl;
 }
 
+// Tells the streamer how much of the planet textures can actually be seen this frame
+void RequestPlanetDetail()
+{
+	mat4 view = inverse(viewMatrix);
+
+	for (int batch = 0; batch < 2; batch++)
+	{
+		const std::vector<PlanetInstance>& bodies = batch == 0 ? phongBodies : emissiveBodies;
+		int textures = batch == 0 ? litPlanetTextures : planetTextures;
+		for (const PlanetInstance& body : bodies)
+		{
+			if (body.virtualTexture >= 0)
+				continue; // Its tiles are picked by the feedback pass
+
+			vec3 centre = vec3(view * modelMatrix[body.model] * vec4(0, 0, 0, 1));
+			float radius = 0.5f * length(vec3(modelMatrix[body.model][0])); // The sphere mesh has a radius of 0.5
+			float distance = -centre.z;
+			if (distance < -radius)
+				continue; // Behind the camera
+
+			// Projected diameter in pixels, from right next to the sphere everything is needed
+			float diameter = distance > radius ? 2.0f * radius * projectionMatrix[1][1] / distance * height * 0.5f : (float)height;
+
+			// The map wraps all the way around, so the middle of the visible half shows
+			// about pi texels of its width per pixel of diameter
+			TextureStreamer::RequestResolution(textures, diameter * pi<float>());
+		}
+	}
+}
+
+// Draws the earth and moon with whichever program is bound, the phong one or the feedback one
+void DrawLitBodies(GLuint program)
+{
+	mat4 view = inverse(viewMatrix);
+
+	mat4 models[MAX_INSTANCES], norms[MAX_INSTANCES];
+	GLint litLayers[MAX_INSTANCES], virtualTextures[MAX_INSTANCES];
+	int count = std::min((int)phongBodies.size(), MAX_INSTANCES);
+	for (int i = 0; i < count; i++)
+	{
+		models[i] = modelMatrix[phongBodies[i].model];
+		norms[i] = transpose(inverse(models[i]));                       // <- Normals go into world space with the inverse transpose
+		litLayers[i] = phongBodies[i].layer;
+		virtualTextures[i] = phongBodies[i].virtualTexture;
+	}
+
+	glUniform3fv(glGetUniformLocation(program, "cameraPos"), 1, &cameraPosition[0]);
+	glUniformMatrix4fv(glGetUniformLocation(program, "view"), 1, GL_FALSE, &view[0][0]);
+	glUniformMatrix4fv(glGetUniformLocation(program, "proj"), 1, GL_FALSE, &projectionMatrix[0][0]);
+
+	// Per body data, the vertex shader picks its entry with gl_InstanceID
+	glUniformMatrix4fv(glGetUniformLocation(program, "models"), count, GL_FALSE, &models[0][0][0]);
+	glUniformMatrix4fv(glGetUniformLocation(program, "norms"), count, GL_FALSE, &norms[0][0][0]);
+	glUniform1iv(glGetUniformLocation(program, "litLayers"), count, litLayers);
+	glUniform1iv(glGetUniformLocation(program, "virtualTextures"), count, virtualTextures);
+
+	Primitive::DrawSphereInstanced(count);
+}
+
 void Render()
 {
+	// The scene draws opaque with depth writes, whatever was left set at the end of the last frame
+	GLState::DepthMask(true);
+	GLState::Blend(false);
+
+	//------------------------------------------------------------------------------------------------ Virtual Texture Feedback
+
+	// The lit bodies again, small, recording which tiles they'd sample. It's read back a
+	// couple of frames later, so this never waits on the GPU.
+	if (VirtualTexture::Count() > 0)
+	{
+		VirtualTexture::BeginFeedback(width, height);
+		GLState::UseProgram(feedbackProgram);
+		VirtualTexture::Bind(feedbackProgram, 1, 2);
+		glUniform1f(glGetUniformLocation(feedbackProgram, "lodBias"), -log2f((float)VT_FEEDBACK_SCALE));
+		DrawLitBodies(feedbackProgram);
+		VirtualTexture::EndFeedback();
+	}
+
 	//------------------------------------------------------------------------------------------------ Draw Skybox
 
 	{
 		// Use the special skybox program
-		glUseProgram(skyboxProgram);                                    // <- Use the skybox shader program. This has the vertex and fragment  shader for the skybox
+		GLState::UseProgram(skyboxProgram);                             // <- Use the skybox shader program. This has the vertex and fragment  shader for the skybox
 
 																		// Getting uniform locations  
 		GLuint sLoc = glGetUniformLocation(skyboxProgram, "skybox");    // <- Get the uniform location for the skybox
+		GLuint fLoc = glGetUniformLocation(skyboxProgram, "skyboxFace");// <- Get the uniform location for the single image skybox
+		GLuint oLoc = glGetUniformLocation(skyboxProgram, "singleFace");// <- Get the uniform location for the single image switch
 		GLuint vLoc = glGetUniformLocation(skyboxProgram, "view");      // <- Get the uniform location for the view matrix
 		GLuint pLoc = glGetUniformLocation(skyboxProgram, "proj");      // <- Get the uniform location for the projection matrix
 
 																		// Binding skybox texture
-		glUniform1i(sLoc, 0);                                           // <- 1) Get the uniform location for the cubemap sampler, and set it to index zero                       
-		glActiveTexture(GL_TEXTURE0);                                   // <- 2) Set the active texture to also be index zero, matching above                             
-		glBindTexture(GL_TEXTURE_CUBE_MAP, skyboxTexture);              // <- 3) Bind the skybox texture. This texture is bound to zero, so it will be sampled              
+		glUniform1i(sLoc, 0);                                           // <- 1) The cubemap sampler reads index zero, and the 2D one index one. They
+		glUniform1i(fLoc, 1);                                           //    can't share an index because they're different sampler types
+		glUniform1i(oLoc, skyboxInfo.target == GL_TEXTURE_2D);          // <- 2) Tell the shader which of the two to use
+		GLState::BindTexture(skyboxInfo.target == GL_TEXTURE_2D ? 1 : 0, // <- 3) Bind the skybox texture to the matching index
+			skyboxInfo.target, skyboxTexture);
 
 																		// Passing up view-projection matrix
 		glUniformMatrix4fv(vLoc, 1, GL_FALSE,                           // <- Pass through a special version of the view matrix. This has no position information, as
@@ -443,310 +571,45 @@ void Render()
 
 																		// Drawing the skybox
 		Primitive::DrawSkybox();                                        // <- Draw the skybox here. It's an inverted cube around the camera                                     
-
-																		// Unbinding the texture and program
-		glBindTexture(GL_TEXTURE_CUBE_MAP, GL_NONE);                    // <- Unbind the texture after we've drawn the skybox here                                  
-		glUseProgram(GL_NONE);                                          // <- Unbind the shader program after we've used it here                                    
 	}
 
 	//------------------------------------------------------------------------------------------------ Draw Models
 
-	{   //----------------------------------------------------------- EARTH ----------------------------------------------------------------------
-		// Use the phong program
-		glUseProgram(phongProgram);                                         // <- Use the phong lighting shader program
-
-																			// Getting uniform locations
-		GLuint dtLoc = glGetUniformLocation(phongProgram, "diffuseTex");    // <- Get the uniform location for the diffuse texture
-		GLuint stLoc = glGetUniformLocation(phongProgram, "specularTex");   // <- Get the uniform location for the diffuse texture
-		GLuint cLoc = glGetUniformLocation(phongProgram, "cameraPos");      // <- Get the uniform location for the projection matrix
-		GLuint mLoc = glGetUniformLocation(phongProgram, "model");          // <- Get the uniform location for the model matrix
-		GLuint vLoc = glGetUniformLocation(phongProgram, "view");           // <- Get the uniform location for the view matrix
-		GLuint pLoc = glGetUniformLocation(phongProgram, "proj");           // <- Get the uniform location for the projection matrix
-		GLuint nLoc = glGetUniformLocation(phongProgram, "norm");           // <- Get the uniform location for the normal matrix
-
-		GLuint sLoc = glGetUniformLocation(phongProgram, "specPower");
-		glUniform1f(sLoc, specularPower);
-
-		// Binding diffuse texture
-		glUniform1i(dtLoc, 0);                                              // <- 1) Get the uniform location for the 2D sampler, and set it to index zero                       
-		glActiveTexture(GL_TEXTURE0);                                       // <- 2) Set the active texture to also be index zero, matching above                             
-		glBindTexture(GL_TEXTURE_2D, diffuseTexture);                       // <- 3) Bind the diffuse texture (bound to index 0)
-
-																			// Binding specular texture
-		glUniform1i(stLoc, 1);
-		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, specularTexture);
-
-		// Passing MVP matrix
-		glUniformMatrix4fv(mLoc, 1, GL_FALSE, &modelMatrix[EARTH][0][0]);   // <- Pass through the model matrix here to the vertex shader
-		glUniformMatrix4fv(vLoc, 1, GL_FALSE, &inverse(viewMatrix)[0][0]);  // <- Pass through the inverse of the view matrix here to the vertex shader
-		glUniformMatrix4fv(pLoc, 1, GL_FALSE, &projectionMatrix[0][0]);     // <- Pass through the projection matrix here to the vertex shader
-		glUniformMatrix4fv(nLoc, 1, GL_FALSE,                               // <- Pass through the transpose of the inverse of the model matrix
-			&transpose(inverse(modelMatrix[EARTH]))[0][0]);                 //    so that we correctly transform the normals into world space as well
-
-																			// Passing up additional information
-		glUniform3fv(cLoc, 1, &cameraPosition[0]);                          // <- Pass through the camera location to the shader
-
-		Primitive::DrawSphere();    // Earth
-
-									// Unbinding textures
-		glActiveTexture(GL_TEXTURE1);                               // <- Set Texture 1 to be active, and then                
-		glBindTexture(GL_TEXTURE_2D, GL_NONE);                      // <- unbind it here
-		glActiveTexture(GL_TEXTURE0);                               // <- Set Texture 0 to be active, and then         
-		glBindTexture(GL_TEXTURE_2D, GL_NONE);                      // <- unbind it here            
+	// Each batch has its planet maps in one texture array, so it's a single bind per batch
+	GLState::DepthMask(true);                                           // <- The skybox turned depth writes off
 
-	}
-	{ //----------------------------------------------------------- THE MOON (see above for comments) --------------------------------------------------
-	  // Use the phong program
-		glUseProgram(phongProgram);                                         // <- Use the phong lighting shader program
-
-																			// Getting uniform locations
-		GLuint dtLoc = glGetUniformLocation(phongProgram, "diffuseTex");    // <- Get the uniform location for the diffuse texture
-		GLuint stLoc = glGetUniformLocation(phongProgram, "specularTex");   // <- Get the uniform location for the diffuse texture
-		GLuint cLoc = glGetUniformLocation(phongProgram, "cameraPos");      // <- Get the uniform location for the projection matrix
-		GLuint mLoc = glGetUniformLocation(phongProgram, "model");          // <- Get the uniform location for the model matrix
-		GLuint vLoc = glGetUniformLocation(phongProgram, "view");           // <- Get the uniform location for the view matrix
-		GLuint pLoc = glGetUniformLocation(phongProgram, "proj");           // <- Get the uniform location for the projection matrix
-		GLuint nLoc = glGetUniformLocation(phongProgram, "norm");           // <- Get the uniform location for the normal matrix
-
-		GLuint sLoc = glGetUniformLocation(phongProgram, "specPower");
-		glUniform1f(sLoc, specularPower);
-																	// Binding diffuse texture
-		glUniform1i(dtLoc, 0);
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, moonTexture);
-
-		// Binding specular texture
-		glUniform1i(stLoc, 1);
-		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, moonTexture);
-
-		// Passing MVP matrix
-		glUniformMatrix4fv(mLoc, 1, GL_FALSE, &modelMatrix[MOON][0][0]);
-		glUniformMatrix4fv(vLoc, 1, GL_FALSE, &inverse(viewMatrix)[0][0]);
-		glUniformMatrix4fv(pLoc, 1, GL_FALSE, &projectionMatrix[0][0]);
-		glUniformMatrix4fv(nLoc, 1, GL_FALSE,
-			&transpose(inverse(modelMatrix[MOON]))[0][0]);
-
-		// Passing up additional information
-		glUniform3fv(cLoc, 1, &cameraPosition[0]);
-
-		Primitive::DrawSphere();    // Moon
-
-									// Unbinding textures
-		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, GL_NONE);
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, GL_NONE);
-
-		// unbinding the shader program
-		glUseProgram(GL_NONE);
+	mat4 view = inverse(viewMatrix);
 
+	{   //----------------------------------------------------------- LIT BODIES (earth, moon) -----------------------------------------------------
+		GLState::UseProgram(phongProgram);                                  // <- Use the phong lighting shader program
+		GLState::BindTexture(0, GL_TEXTURE_2D_ARRAY, TextureStreamer::Texture(litPlanetTextures));
+		VirtualTexture::Bind(phongProgram, 1, 2);                          // <- The tile cache and indirection go on indices one and two
+
+		glUniform1i(glGetUniformLocation(phongProgram, "planetTex"), 0);   // <- The texture array is on index zero
+		glUniform1f(glGetUniformLocation(phongProgram, "specPower"), specularPower);
+
+		DrawLitBodies(phongProgram);
 	}
-	{	//----------------------------------------------------------- THE SUN (see above for comments) ----------------------------------------------------
-		// Use the phong program
-		glUseProgram(phongProgram);                                         // <- Use the phong lighting shader program
-
-																			// Getting uniform locations
-		GLuint dtLoc = glGetUniformLocation(phongProgram, "diffuseTex");    // <- Get the uniform location for the diffuse texture
-		GLuint stLoc = glGetUniformLocation(phongProgram, "specularTex");   // <- Get the uniform location for the diffuse texture
-		GLuint cLoc = glGetUniformLocation(phongProgram, "cameraPos");      // <- Get the uniform location for the projection matrix
-		GLuint mLoc = glGetUniformLocation(phongProgram, "model");          // <- Get the uniform location for the model matrix
-		GLuint vLoc = glGetUniformLocation(phongProgram, "view");           // <- Get the uniform location for the view matrix
-		GLuint pLoc = glGetUniformLocation(phongProgram, "proj");           // <- Get the uniform location for the projection matrix
-		GLuint nLoc = glGetUniformLocation(phongProgram, "norm");           // <- Get the uniform location for the normal matrix
-
-		GLuint sLoc = glGetUniformLocation(phongProgram, "specPower");
-		glUniform1f(sLoc, specularPower);
-		glUseProgram(emissiveProgram);
-
-		mLoc = glGetUniformLocation(emissiveProgram, "model");
-		vLoc = glGetUniformLocation(emissiveProgram, "view");
-		pLoc = glGetUniformLocation(emissiveProgram, "proj");
-		GLuint etLoc = glGetUniformLocation(emissiveProgram, "emissiveTex");
-
-		// Binding emissive texture
-		glUniform1i(etLoc, 0);
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, sunTexture);
-
-		// Passing MVP matrix
-		glUniformMatrix4fv(mLoc, 1, GL_FALSE, &modelMatrix[SUN][0][0]);
-		glUniformMatrix4fv(vLoc, 1, GL_FALSE, &inverse(viewMatrix)[0][0]);
-		glUniformMatrix4fv(pLoc, 1, GL_FALSE, &projectionMatrix[0][0]);
-
-		Primitive::DrawSphere();    // Sun
-
-									// Unbinding textures
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, GL_NONE);
-
-		// unbinding the shader program
-		glUseProgram(GL_NONE);
-	}
-	{ //----------------------------------------------------------- MERCURY (see above for comments) ----------------------------------------------------
-	  // Use the phong program
-		glUseProgram(phongProgram);                                         // <- Use the phong lighting shader program
-
-																			// Getting uniform locations
-		GLuint dtLoc = glGetUniformLocation(phongProgram, "diffuseTex");    // <- Get the uniform location for the diffuse texture
-		GLuint stLoc = glGetUniformLocation(phongProgram, "specularTex");   // <- Get the uniform location for the diffuse texture
-		GLuint cLoc = glGetUniformLocation(phongProgram, "cameraPos");      // <- Get the uniform location for the projection matrix
-		GLuint mLoc = glGetUniformLocation(phongProgram, "model");          // <- Get the uniform location for the model matrix
-		GLuint vLoc = glGetUniformLocation(phongProgram, "view");           // <- Get the uniform location for the view matrix
-		GLuint pLoc = glGetUniformLocation(phongProgram, "proj");           // <- Get the uniform location for the projection matrix
-		GLuint nLoc = glGetUniformLocation(phongProgram, "norm");           // <- Get the uniform location for the normal matrix
-
-		GLuint sLoc = glGetUniformLocation(phongProgram, "specPower");
-		glUniform1f(sLoc, specularPower);
-		glUseProgram(emissiveProgram);
-
-		mLoc = glGetUniformLocation(emissiveProgram, "model");
-		vLoc = glGetUniformLocation(emissiveProgram, "view");
-		pLoc = glGetUniformLocation(emissiveProgram, "proj");
-		GLuint etLoc = glGetUniformLocation(emissiveProgram, "emissiveTex");
-
-		// Binding emissive texture
-		glUniform1i(etLoc, 0);
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, mercuryTexture);
-
-		// Passing MVP matrix
-		glUniformMatrix4fv(mLoc, 1, GL_FALSE, &modelMatrix[MERCURY][0][0]);
-		glUniformMatrix4fv(vLoc, 1, GL_FALSE, &inverse(viewMatrix)[0][0]);
-		glUniformMatrix4fv(pLoc, 1, GL_FALSE, &projectionMatrix[0][0]);
-
-		Primitive::DrawSphere();    // Mercury
-
-									// Unbinding textures
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, GL_NONE);
-
-		// unbinding the shader program
-		glUseProgram(GL_NONE);
-	}
-	{	//----------------------------------------------------------- VENUS (see above for comments) ----------------------------------------------------
-		// Use the phong program
-		glUseProgram(phongProgram);                                         // <- Use the phong lighting shader program
-
-																			// Getting uniform locations
-		GLuint dtLoc = glGetUniformLocation(phongProgram, "diffuseTex");    // <- Get the uniform location for the diffuse texture
-		GLuint stLoc = glGetUniformLocation(phongProgram, "specularTex");   // <- Get the uniform location for the diffuse texture
-		GLuint cLoc = glGetUniformLocation(phongProgram, "cameraPos");      // <- Get the uniform location for the projection matrix
-		GLuint mLoc = glGetUniformLocation(phongProgram, "model");          // <- Get the uniform location for the model matrix
-		GLuint vLoc = glGetUniformLocation(phongProgram, "view");           // <- Get the uniform location for the view matrix
-		GLuint pLoc = glGetUniformLocation(phongProgram, "proj");           // <- Get the uniform location for the projection matrix
-		GLuint nLoc = glGetUniformLocation(phongProgram, "norm");           // <- Get the uniform location for the normal matrix
-
-		GLuint sLoc = glGetUniformLocation(phongProgram, "specPower");
-		glUniform1f(sLoc, specularPower);
-		glUseProgram(emissiveProgram);
-
-		mLoc = glGetUniformLocation(emissiveProgram, "model");
-		vLoc = glGetUniformLocation(emissiveProgram, "view");
-		pLoc = glGetUniformLocation(emissiveProgram, "proj");
-		GLuint etLoc = glGetUniformLocation(emissiveProgram, "emissiveTex");
-
-		// Binding emissive texture
-		glUniform1i(etLoc, 0);
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, venusTexture);
-
-		// Passing MVP matrix
-		glUniformMatrix4fv(mLoc, 1, GL_FALSE, &modelMatrix[VENUS][0][0]);
-		glUniformMatrix4fv(vLoc, 1, GL_FALSE, &inverse(viewMatrix)[0][0]);
-		glUniformMatrix4fv(pLoc, 1, GL_FALSE, &projectionMatrix[0][0]);
-
-		Primitive::DrawSphere();    // Venus
-
-									// Unbinding textures
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, GL_NONE);
-
-		// unbinding the shader program
-		glUseProgram(GL_NONE);
-	}
-	{ //----------------------------------------------------------- NEPTUNE (see above for comments) ----------------------------------------------------
-	  // Use the phong program
-		glUseProgram(phongProgram);                                         // <- Use the phong lighting shader program
-
-																			// Getting uniform locations
-		GLuint dtLoc = glGetUniformLocation(phongProgram, "diffuseTex");    // <- Get the uniform location for the diffuse texture
-		GLuint stLoc = glGetUniformLocation(phongProgram, "specularTex");   // <- Get the uniform location for the diffuse texture
-		GLuint cLoc = glGetUniformLocation(phongProgram, "cameraPos");      // <- Get the uniform location for the projection matrix
-		GLuint mLoc = glGetUniformLocation(phongProgram, "model");          // <- Get the uniform location for the model matrix
-		GLuint vLoc = glGetUniformLocation(phongProgram, "view");           // <- Get the uniform location for the view matrix
-		GLuint pLoc = glGetUniformLocation(phongProgram, "proj");           // <- Get the uniform location for the projection matrix
-		GLuint nLoc = glGetUniformLocation(phongProgram, "norm");           // <- Get the uniform location for the normal matrix
-
-		GLuint sLoc = glGetUniformLocation(phongProgram, "specPower");
-		glUniform1f(sLoc, specularPower);
-		glUseProgram(emissiveProgram);
-
-		mLoc = glGetUniformLocation(emissiveProgram, "model");
-		vLoc = glGetUniformLocation(emissiveProgram, "view");
-		pLoc = glGetUniformLocation(emissiveProgram, "proj");
-		GLuint etLoc = glGetUniformLocation(emissiveProgram, "emissiveTex");
-
-		// Binding emissive texture
-		glUniform1i(etLoc, 0);
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, neptuneTexture);
-
-		// Passing MVP matrix
-		glUniformMatrix4fv(mLoc, 1, GL_FALSE, &modelMatrix[NEPTUNE][0][0]);
-		glUniformMatrix4fv(vLoc, 1, GL_FALSE, &inverse(viewMatrix)[0][0]);
-		glUniformMatrix4fv(pLoc, 1, GL_FALSE, &projectionMatrix[0][0]);
-
-		Primitive::DrawSphere();    // Neptune
-
-									// Unbinding textures
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, GL_NONE);
-
-		// unbinding the shader program
-		glUseProgram(GL_NONE);
-	}
-	{ //----------------------------------------------------------- Asteroid (see above for comments) ----------------------------------------------------
-	  // Use the phong program
-		glUseProgram(phongProgram);                                         // <- Use the phong lighting shader program
-
-																			// Getting uniform locations
-		GLuint dtLoc = glGetUniformLocation(phongProgram, "diffuseTex");    // <- Get the uniform location for the diffuse texture
-		GLuint stLoc = glGetUniformLocation(phongProgram, "specularTex");   // <- Get the uniform location for the diffuse texture
-		GLuint cLoc = glGetUniformLocation(phongProgram, "cameraPos");      // <- Get the uniform location for the projection matrix
-		GLuint mLoc = glGetUniformLocation(phongProgram, "model");          // <- Get the uniform location for the model matrix
-		GLuint vLoc = glGetUniformLocation(phongProgram, "view");           // <- Get the uniform location for the view matrix
-		GLuint pLoc = glGetUniformLocation(phongProgram, "proj");           // <- Get the uniform location for the projection matrix
-		GLuint nLoc = glGetUniformLocation(phongProgram, "norm");           // <- Get the uniform location for the normal matrix
-
-		GLuint sLoc = glGetUniformLocation(phongProgram, "specPower");
-		glUniform1f(sLoc, specularPower);
-		glUseProgram(emissiveProgram);
-
-		mLoc = glGetUniformLocation(emissiveProgram, "model");
-		vLoc = glGetUniformLocation(emissiveProgram, "view");
-		pLoc = glGetUniformLocation(emissiveProgram, "proj");
-		GLuint etLoc = glGetUniformLocation(emissiveProgram, "emissiveTex");
-
-		// Binding emissive texture
-		glUniform1i(etLoc, 0);
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, asteroidTexture);
-
-		// Passing MVP matrix
-		glUniformMatrix4fv(mLoc, 1, GL_FALSE, &modelMatrix[ASTEROID][0][0]);
-		glUniformMatrix4fv(vLoc, 1, GL_FALSE, &inverse(viewMatrix)[0][0]);
-		glUniformMatrix4fv(pLoc, 1, GL_FALSE, &projectionMatrix[0][0]);
-
-		Primitive::DrawSphere();    // Asteroid
-
-									// Unbinding textures
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, GL_NONE);
-
-		// unbinding the shader program
-		glUseProgram(GL_NONE);
+	{   //----------------------------------------------------------- EMISSIVE BODIES (sun, mercury, venus, neptune, asteroid) ----------------------
+		GLState::UseProgram(emissiveProgram);
+		GLState::BindTexture(0, GL_TEXTURE_2D_ARRAY, TextureStreamer::Texture(planetTextures));
+
+		mat4 models[MAX_INSTANCES];
+		GLint emissiveLayers[MAX_INSTANCES];
+		int count = std::min((int)emissiveBodies.size(), MAX_INSTANCES);
+		for (int i = 0; i < count; i++)
+		{
+			models[i] = modelMatrix[emissiveBodies[i].model];
+			emissiveLayers[i] = emissiveBodies[i].layer;
+		}
+
+		glUniform1i(glGetUniformLocation(emissiveProgram, "planetTex"), 0);
+		glUniformMatrix4fv(glGetUniformLocation(emissiveProgram, "view"), 1, GL_FALSE, &view[0][0]);
+		glUniformMatrix4fv(glGetUniformLocation(emissiveProgram, "proj"), 1, GL_FALSE, &projectionMatrix[0][0]);
+		glUniformMatrix4fv(glGetUniformLocation(emissiveProgram, "models"), count, GL_FALSE, &models[0][0][0]);
+		glUniform1iv(glGetUniformLocation(emissiveProgram, "emissiveLayers"), count, emissiveLayers);
+
+		Primitive::DrawSphereInstanced(count);
 	}
 }
 
@@ -755,11 +618,16 @@ void Cleanup()
 	// Cleanup the shader programs here
 	glDeleteProgram(skyboxProgram);
 	glDeleteProgram(phongProgram);
+	glDeleteProgram(emissiveProgram);
+	glDeleteProgram(feedbackProgram);
 
 	// Cleanup the textures here
-	glDeleteTextures(1, &skyboxTexture);
-	glDeleteTextures(1, &diffuseTexture);
-	glDeleteTextures(1, &specularTexture);
+	TextureCache::Release(skyboxTexture);
+	TextureStreamer::PrintStats();
+	TextureStreamer::Shutdown();
+	VirtualTexture::PrintStats();
+	VirtualTexture::Shutdown();
+	ThreadPool::Shutdown();
 }
 
 void GUI()
@@ -768,14 +636,57 @@ void GUI()
 	{
 		ImGui::Text("%.1f FPS", ImGui::GetIO().Framerate);
 
+		// How the frames are paced, and how closely they kept to it
+		int pacing = FramePacer::Mode();
+		float rate = FramePacer::Rate();
+		bool repace = ImGui::Combo("Frame pacing", &pacing, "Vsync\0Uncapped\0Capped\0");
+		if (pacing == PACING_CAPPED)
+			repace |= ImGui::SliderFloat("Frame rate", &rate, 30.0f, 240.0f, "%.0f");
+		if (repace)
+			FramePacer::SetMode(pacing, rate);
+		FramePacerStats pacingStats = FramePacer::Stats();
+		ImGui::Text("Frames %.2f ms, %.3f ms jitter", pacingStats.frameMs, pacingStats.jitterMs);
+		if (pacing == PACING_CAPPED)
+			ImGui::Text("Late by %.3f ms, %.2f ms at worst, %d missed, %.2f ms spinning",
+				pacingStats.meanErrorMs, pacingStats.worstErrorMs, pacingStats.missed, pacingStats.spinMs);
+
 		ImGui::Spacing();
 		ImGui::DragFloat("Simulation Speed", &simulationSpeed, 0.01f, 100.0f); simulationSpeed = clamp(simulationSpeed, 0.01f, 100.0f);
+		float simulationRate = FixedStep::Rate();
+		if (ImGui::SliderFloat("Simulation Rate (Hz)", &simulationRate, 30.0f, 960.0f, "%.0f"))
+			FixedStep::SetRate(simulationRate);
+		FixedStepStats stepStats = FixedStep::Stats();
+		ImGui::Text("%d steps this frame, %.0f a second, %.2f s dropped", stepStats.steps, stepStats.stepsPerSecond,
+			stepStats.droppedSeconds);
 		ImGui::RadioButton("View 1", &viewMode, 0); ImGui::SameLine();
 		ImGui::RadioButton("View 2", &viewMode, 1); ImGui::SameLine();
 		ImGui::RadioButton("View 3", &viewMode, 2); ImGui::SameLine();
 		ImGui::RadioButton("View 4", &viewMode, 3);
 
-		ImGui::RadioButton("Static View", &viewMode, 4);
+		ImGui::RadioButton("Static View", &viewMode, 4); ImGui::SameLine();
+		ImGui::RadioButton("Rail", &viewMode, 5);
+		if (viewMode == 5)
+			ImGui::DragFloat("Rail Speed", &railSpeed, 0.1f, 0.0f, 100.0f);
+
+		ImGui::Spacing();
+		if (ImGui::DragFloat("Texture Budget (MB)", &textureBudgetMB, 1.0f, 4.0f, 1024.0f))
+			TextureStreamer::SetBudget((size_t)(textureBudgetMB * 1024 * 1024));
+		TextureStreamerStats streamStats = TextureStreamer::Stats();
+		ImGui::Text("Textures: %.1f MB resident, %d loading", streamStats.resident / (1024.0f * 1024.0f), streamStats.pendingJobs);
+		ImGui::Text("Planet mip %d (wants %d)", TextureStreamer::ResidentLevel(planetTextures), TextureStreamer::DesiredLevel(planetTextures));
+		ImGui::Text("Lit planet mip %d (wants %d)", TextureStreamer::ResidentLevel(litPlanetTextures), TextureStreamer::DesiredLevel(litPlanetTextures));
+		if (VirtualTexture::Count() > 0)
+		{
+			VirtualTextureStats vtStats = VirtualTexture::Stats();
+			ImGui::Text("Tiles: %d / %d cached, %d visible, %d loading", vtStats.residentTiles, vtStats.cacheTiles,
+				vtStats.visibleTiles, vtStats.pendingTiles);
+		}
+
+		ImGui::Spacing();
+		GLStateStats stateStats = GLState::Stats();
+		ImGui::Text("GL state: %d calls sent, %d skipped", stateStats.totalIssued, stateStats.totalSkipped);
+		for (int i = 0; i < GLSTATE_CALLS; i++)
+			ImGui::Text("  %s: %d sent, %d skipped", GLState::CallName(i), stateStats.issued[i], stateStats.skipped[i]);
 	}
 	ImGui::End();
 }
@@ -807,10 +718,11 @@ int main()
 	}
 	glfwSetWindowSizeCallback(window, OnWindowResized);
 	glfwMakeContextCurrent(window);
-	glfwSwapInterval(0); // essentially turn off vsync
+	FramePacer::SetMode(PACING_CAPPED, 120.0f); // 120 fps, sleeping rather than spinning between frames
 
 						 // start GL3W
 	gl3wInit();
+	GLState::Invalidate();
 
 	// Resize at least once
 	OnWindowResized(window, width, height);
@@ -836,7 +748,8 @@ int main()
 	float oldTime = 0.0f, currentTime = 0.0f, deltaTime = 0.0f;
 	while (!glfwWindowShouldClose(window))
 	{
-		do { currentTime = (float)glfwGetTime(); } while (currentTime - oldTime < 1.0f / 120.0f);
+		FramePacer::Wait();
+		currentTime = (float)glfwGetTime();
 		//FreeCam(deltaTime);
 		// update other events like input handling 
 		glfwPollEvents();
@@ -849,8 +762,16 @@ int main()
 		deltaTime = currentTime - oldTime; // Difference in time
 		oldTime = currentTime;
 
+		// The simulation runs at its own rate, however fast the frames come
+		int steps = FixedStep::Advance(deltaTime);
+		for (int i = 0; i < steps; i++)
+			Simulate(FixedStep::Step());
+
 		// Call the helper functions
 		Update(deltaTime);
+		RequestPlanetDetail();
+		TextureStreamer::Update();
+		VirtualTexture::Update();
 		Render();
 		FreeCam(deltaTime);
 		GUI();
@@ -858,12 +779,14 @@ int main()
 		// Finish by drawing the GUI
 		ImGui::Render();
 		glfwSwapBuffers(window);
+		GLState::EndFrame();
 	}
 
-	// close GL context and any other GLFW resources
-	glfwTerminate();
-	ImGui_ImplGlfwGL3_Shutdown();
+	// Free our GL objects and ImGui's while the context still exists,
+	// then close GL context and any other GLFW resources
 	Cleanup();
+	ImGui_ImplGlfwGL3_Shutdown();
+	glfwTerminate();
 	return 0;
 }
 
@@ -1,4 +1,5 @@
 #include "Mesh.h"
+#include "glstate.h"
 
 #include <GLM/glm.hpp>
 
@@ -108,10 +109,10 @@ std::vector<Mesh> Mesh::LoadOBJ(std::string baseLoc, std::string fileName)
                 }
 
                 glGenVertexArrays(1, &mesh_object.vao);
-                glBindVertexArray(mesh_object.vao);
+                GLState::BindVertexArray(mesh_object.vao);
 
                 glGenBuffers(1, &mesh_object.vbo);
-                glBindBuffer(GL_ARRAY_BUFFER, mesh_object.vbo);
+                GLState::BindBuffer(GL_ARRAY_BUFFER, mesh_object.vbo);
                 glBufferData(GL_ARRAY_BUFFER, sizeof(float) * interleavedVBO.size(), &interleavedVBO[0], GL_STATIC_DRAW);
 
                 // Vertex info
@@ -138,7 +139,7 @@ std::vector<Mesh> Mesh::LoadOBJ(std::string baseLoc, std::string fileName)
 
 void Mesh::DrawMesh()
 {
-    glBindVertexArray(vao);
+    GLState::BindVertexArray(vao);
     glDrawArrays(GL_TRIANGLES, 0, vertexCount);
 }
 
@@ -153,6 +154,11 @@ Primitive Primitive::quad = Primitive();
 Primitive Primitive::skybox = Primitive();
 
 void Primitive::DrawSphere()
+{
+    DrawSphereInstanced(1);
+}
+
+void Primitive::DrawSphereInstanced(int instanceCount)
 {
     if (!sInit)
     {
@@ -263,10 +269,10 @@ void Primitive::DrawSphere()
         ////////////////////////////////////////////////////////////////////////////////////////////////////////
 
         glGenVertexArrays(1, &sphere.vao);
-        glBindVertexArray(sphere.vao);
+        GLState::BindVertexArray(sphere.vao);
 
         glGenBuffers(1, &sphere.vbo);
-        glBindBuffer(GL_ARRAY_BUFFER, sphere.vbo);
+        GLState::BindBuffer(GL_ARRAY_BUFFER, sphere.vbo);
         glBufferData(GL_ARRAY_BUFFER, sizeof(float) * interleavedVBO.size(), &interleavedVBO[0], GL_STATIC_DRAW);
 
         // Vertex info
@@ -284,8 +290,8 @@ void Primitive::DrawSphere()
         #pragma endregion
     }
 
-    glBindVertexArray(sphere.vao);
-    glDrawArrays(GL_TRIANGLES, 0, sphere.vertexCount);
+    GLState::BindVertexArray(sphere.vao);
+    glDrawArraysInstanced(GL_TRIANGLES, 0, sphere.vertexCount, instanceCount);
 }
 
 void Primitive::DrawBox()
@@ -416,10 +422,10 @@ void Primitive::DrawBox()
         ////////////////////////////////////////////////////////////////////////////////////////////////////////
 
         glGenVertexArrays(1, &box.vao);
-        glBindVertexArray(box.vao);
+        GLState::BindVertexArray(box.vao);
 
         glGenBuffers(1, &box.vbo);
-        glBindBuffer(GL_ARRAY_BUFFER, box.vbo);
+        GLState::BindBuffer(GL_ARRAY_BUFFER, box.vbo);
         glBufferData(GL_ARRAY_BUFFER, sizeof(float) * interleavedVBO.size(), &interleavedVBO[0], GL_STATIC_DRAW);
 
         // Vertex info
@@ -437,7 +443,7 @@ void Primitive::DrawBox()
         #pragma endregion
     }
 
-    glBindVertexArray(box.vao);
+    GLState::BindVertexArray(box.vao);
     glDrawArrays(GL_TRIANGLES, 0, box.vertexCount);
 }
 
@@ -500,10 +506,10 @@ void Primitive::DrawFullscreenQuad()
         ////////////////////////////////////////////////////////////////////////////////////////////////////////
 
         glGenVertexArrays(1, &quad.vao);
-        glBindVertexArray(quad.vao);
+        GLState::BindVertexArray(quad.vao);
 
         glGenBuffers(1, &quad.vbo);
-        glBindBuffer(GL_ARRAY_BUFFER, quad.vbo);
+        GLState::BindBuffer(GL_ARRAY_BUFFER, quad.vbo);
         glBufferData(GL_ARRAY_BUFFER, sizeof(float) * interleavedVBO.size(), &interleavedVBO[0], GL_STATIC_DRAW);
 
         // Vertex info
@@ -520,7 +526,7 @@ void Primitive::DrawFullscreenQuad()
         quad.vertexCount = (unsigned int)triangles.size();
         #pragma endregion
     }
-    glBindVertexArray(quad.vao);
+    GLState::BindVertexArray(quad.vao);
     glDrawArrays(GL_TRIANGLES, 0, quad.vertexCount);
 }
 
@@ -577,23 +583,22 @@ void Primitive::DrawSkybox()
 
         GLuint vbo;
         glGenBuffers(1, &vbo);
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        GLState::BindBuffer(GL_ARRAY_BUFFER, vbo);
         glBufferData(GL_ARRAY_BUFFER, 3 * 36 * sizeof(float), &points, GL_STATIC_DRAW);
 
         GLuint vao;
         glGenVertexArrays(1, &vao);
-        glBindVertexArray(vao);
+        GLState::BindVertexArray(vao);
         glEnableVertexAttribArray(0);
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        GLState::BindBuffer(GL_ARRAY_BUFFER, vbo);
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
 
         skybox.vao = vao;
         skybox.vbo = vbo;
     }
 
-    glDepthMask(GL_FALSE);
-    glBindVertexArray(skybox.vao);
+    // Whatever draws next turns depth writes back on if it wants them
+    GLState::DepthMask(false);
+    GLState::BindVertexArray(skybox.vao);
     glDrawArrays(GL_TRIANGLES, 0, 36);
-    glBindVertexArray(0);
-    glDepthMask(GL_TRUE);
 }
@@ -22,6 +22,7 @@ class Primitive
 {
 public:
     static void DrawSphere();
+    static void DrawSphereInstanced(int instanceCount); // gl_InstanceID picks the per-body data
     static void DrawBox();
     static void DrawFullscreenQuad();
     static void DrawSkybox();
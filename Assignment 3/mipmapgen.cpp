@@ -0,0 +1,534 @@
+/*****************************************
+ *
+ *           mipmapgen.cpp
+ *
+ *  Separable downsampling filters for
+ *  building mip chains.
+ *
+ ****************************************/
+
+#include "mipmapgen.h"
+#include "threadpool.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define MIP_AVX2
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MIP_SSE2
+#endif
+
+#define BAND_ROWS 16            // Output rows per ParallelFor index
+#define MAX_TAPS 8
+#define ENCODE_STEPS 4096       // Linear to sRGB table resolution, within one step of exact
+
+// Filters work on linear floats, these convert to and from the 8 bit values
+struct ColourTables
+{
+    float srgbToLinear[256];
+    float unormToFloat[256];    // A lookup is quicker than converting each byte
+    unsigned char linearToSrgb[ENCODE_STEPS + 1];
+
+    ColourTables()
+    {
+        for (int i = 0; i < 256; i++)
+        {
+            float c = i / 255.0f;
+            srgbToLinear[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+            unormToFloat[i] = c;
+        }
+        for (int i = 0; i <= ENCODE_STEPS; i++)
+        {
+            float l = (float)i / ENCODE_STEPS;
+            float c = l <= 0.0031308f ? l * 12.92f : 1.055f * powf(l, 1.0f / 2.4f) - 0.055f;
+            linearToSrgb[i] = (unsigned char)(c * 255.0f + 0.5f);
+        }
+    }
+};
+
+static const ColourTables& Tables()
+{
+    static ColourTables tables;     // Built once, thread safe since C++11
+    return tables;
+}
+
+struct Kernel
+{
+    int taps;
+    int first;                  // Offset of the first tap from 2 * the output texel
+    float weights[MAX_TAPS];
+};
+
+static double BesselI0(double x)
+{
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 32; k++)
+    {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+static Kernel MakeKernel(MipFilter filter)
+{
+    Kernel kernel;
+    if (filter == MIP_BOX)
+    {
+        kernel.taps = 2;
+        kernel.first = 0;
+        kernel.weights[0] = kernel.weights[1] = 0.5f;
+        return kernel;
+    }
+
+    // Sinc stretched for a 2x reduction under a Kaiser window spanning 4 source texels
+    // either side. The taps sit 0.5, 1.5, 2.5 and 3.5 texels from the output centre.
+    const double alpha = 4.0, pi = 3.14159265358979;
+    kernel.taps = 8;
+    kernel.first = -3;
+    double total = 0.0, weights[MAX_TAPS];
+    for (int t = 0; t < kernel.taps; t++)
+    {
+        double d = t + kernel.first - 0.5;
+        double x = d / 2.0;
+        double sinc = sin(pi * x) / (pi * x);
+        double r = d / 4.0;
+        weights[t] = sinc * BesselI0(alpha * sqrt(1.0 - r * r)) / BesselI0(alpha);
+        total += weights[t];
+    }
+    for (int t = 0; t < kernel.taps; t++)
+        kernel.weights[t] = (float)(weights[t] / total);
+    return kernel;
+}
+
+// Source index of every tap of every output texel along one axis, edges already handled
+static void MakeTapIndices(const Kernel& kernel, int srcSize, int dstSize, bool wrap, std::vector<int>& indices)
+{
+    indices.resize((size_t)dstSize * kernel.taps);
+    for (int x = 0; x < dstSize; x++)
+    {
+        for (int t = 0; t < kernel.taps; t++)
+        {
+            int i = 2 * x + kernel.first + t;
+            if (wrap)
+                i = ((i % srcSize) + srcSize) % srcSize;
+            else
+                i = i < 0 ? 0 : i >= srcSize ? srcSize - 1 : i;
+            indices[(size_t)x * kernel.taps + t] = i;
+        }
+    }
+}
+
+static void DecodeRow(const unsigned char* src, int width, bool srgb, float* out)
+{
+    const float* colour = srgb ? Tables().srgbToLinear : Tables().unormToFloat;
+    const float* alpha = Tables().unormToFloat;
+    for (int x = 0; x < width; x++, src += 4, out += 4)
+    {
+        out[0] = colour[src[0]];
+        out[1] = colour[src[1]];
+        out[2] = colour[src[2]];
+        out[3] = alpha[src[3]];
+    }
+}
+
+// 2x2 average of two source rows straight on the bytes, rounding like (a + b + c + d + 2) / 4.
+// Only for data that can be averaged as stored, and both dimensions at least 2.
+static void BoxRows(const unsigned char* row0, const unsigned char* row1, int dstWidth, unsigned char* out)
+{
+    int x = 0;
+#if defined(MIP_SSE2)
+    // Each 16 byte load holds 4 source texels, which make 2 output texels
+    const __m128i zero = _mm_setzero_si128(), two = _mm_set1_epi16(2);
+    for (; x + 4 <= dstWidth; x += 4)
+    {
+        __m128i halves[2];
+        for (int i = 0; i < 2; i++)
+        {
+            __m128i a = _mm_loadu_si128((const __m128i*)(row0 + (x + i * 2) * 8));
+            __m128i b = _mm_loadu_si128((const __m128i*)(row1 + (x + i * 2) * 8));
+
+            // Sum vertically in 16 bits, texels 0,1 in 'low' and 2,3 in 'high'
+            __m128i low = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+            __m128i high = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+
+            // Then horizontally, 0 + 1 next to 2 + 3
+            __m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(low, high), _mm_unpackhi_epi64(low, high));
+            halves[i] = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+        }
+        _mm_storeu_si128((__m128i*)(out + x * 4), _mm_packus_epi16(halves[0], halves[1]));
+    }
+#endif
+    for (; x < dstWidth; x++)
+    {
+        const unsigned char* a = row0 + x * 8;
+        const unsigned char* b = row1 + x * 8;
+        for (int c = 0; c < 4; c++)
+            out[x * 4 + c] = (unsigned char)((a[c] + a[c + 4] + b[c] + b[c + 4] + 2) / 4);
+    }
+}
+
+// One output texel through the tap index table, for the texels whose taps go past the edge
+static inline void FilterTexel(const float* row, const Kernel& kernel, const int* taps, float* out)
+{
+#if defined(MIP_SSE2)
+    __m128 sum = _mm_setzero_ps();
+    for (int t = 0; t < kernel.taps; t++)
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(row + taps[t] * 4), _mm_set1_ps(kernel.weights[t])));
+    _mm_storeu_ps(out, sum);
+#else
+    float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    for (int t = 0; t < kernel.taps; t++)
+        for (int c = 0; c < 4; c++)
+            sum[c] += row[taps[t] * 4 + c] * kernel.weights[t];
+    memcpy(out, sum, sizeof(sum));
+#endif
+}
+
+// Filters a decoded row horizontally, one RGBA texel (4 floats) per output texel. The tap
+// count is a template argument so the inner loop unrolls.
+template <int TAPS>
+static void FilterRow(const float* row, int srcWidth, const Kernel& kernel, const int* indices, int dstWidth, float* out)
+{
+    // Texels in [first, last) have all their taps inside the row and read them directly
+    int first = 0, last = dstWidth;
+    while (first < dstWidth && 2 * first + kernel.first < 0)
+        first++;
+    while (last > first && 2 * (last - 1) + kernel.first + TAPS > srcWidth)
+        last--;
+
+    for (int x = 0; x < first; x++)
+        FilterTexel(row, kernel, indices + (size_t)x * TAPS, out + x * 4);
+    for (int x = last; x < dstWidth; x++)
+        FilterTexel(row, kernel, indices + (size_t)x * TAPS, out + x * 4);
+
+    int x = first;
+#if defined(MIP_AVX2)
+    // Two output texels per register
+    __m256 wide[TAPS];
+    for (int t = 0; t < TAPS; t++)
+        wide[t] = _mm256_set1_ps(kernel.weights[t]);
+    for (; x + 2 <= last; x += 2)
+    {
+        const float* p = row + (2 * x + kernel.first) * 4;
+        __m256 sum = _mm256_setzero_ps();
+        for (int t = 0; t < TAPS; t++)
+        {
+            __m256 texels = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p + t * 4)), _mm_loadu_ps(p + 8 + t * 4), 1);
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(texels, wide[t]));
+        }
+        _mm256_storeu_ps(out + x * 4, sum);
+    }
+#endif
+#if defined(MIP_SSE2)
+    __m128 weights[TAPS];
+    for (int t = 0; t < TAPS; t++)
+        weights[t] = _mm_set1_ps(kernel.weights[t]);
+    for (; x < last; x++)
+    {
+        const float* p = row + (2 * x + kernel.first) * 4;
+        __m128 sum = _mm_setzero_ps();
+        for (int t = 0; t < TAPS; t++)
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(p + t * 4), weights[t]));
+        _mm_storeu_ps(out + x * 4, sum);
+    }
+#else
+    for (; x < last; x++)
+    {
+        const float* p = row + (2 * x + kernel.first) * 4;
+        float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        for (int t = 0; t < TAPS; t++)
+            for (int c = 0; c < 4; c++)
+                sum[c] += p[t * 4 + c] * kernel.weights[t];
+        memcpy(out + x * 4, sum, sizeof(sum));
+    }
+#endif
+}
+
+// Weighted sum of already filtered rows, which is just a long run of floats
+static void CombineRows(const float* const* rows, const Kernel& kernel, int count, float* out)
+{
+    int i = 0;
+#if defined(MIP_AVX2)
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 sum = _mm256_setzero_ps();
+        for (int t = 0; t < kernel.taps; t++)
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(rows[t] + i), _mm256_set1_ps(kernel.weights[t])));
+        _mm256_storeu_ps(out + i, sum);
+    }
+#endif
+#if defined(MIP_SSE2)
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 sum = _mm_setzero_ps();
+        for (int t = 0; t < kernel.taps; t++)
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(rows[t] + i), _mm_set1_ps(kernel.weights[t])));
+        _mm_storeu_ps(out + i, sum);
+    }
+#endif
+    for (; i < count; i++)
+    {
+        float sum = 0.0f;
+        for (int t = 0; t < kernel.taps; t++)
+            sum += rows[t][i] * kernel.weights[t];
+        out[i] = sum;
+    }
+}
+
+static void EncodeRow(const float* row, int width, bool srgb, unsigned char* out)
+{
+    const unsigned char* toSrgb = Tables().linearToSrgb;
+#if defined(MIP_SSE2)
+    float colourScale = srgb ? (float)ENCODE_STEPS : 255.0f;
+    const __m128 scale = _mm_setr_ps(colourScale, colourScale, colourScale, 255.0f);
+    const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+    for (int x = 0; x < width; x++, row += 4, out += 4)
+    {
+        // The Kaiser lobes can overshoot, so clamp before rounding
+        __m128 v = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(row), zero), one);
+        int values[4];
+        _mm_storeu_si128((__m128i*)values, _mm_cvtps_epi32(_mm_mul_ps(v, scale)));
+        for (int c = 0; c < 3; c++)
+            out[c] = srgb ? toSrgb[values[c]] : (unsigned char)values[c];
+        out[3] = (unsigned char)values[3];
+    }
+#else
+    for (int x = 0; x < width; x++, row += 4, out += 4)
+    {
+        for (int c = 0; c < 4; c++)
+        {
+            float v = row[c] < 0.0f ? 0.0f : row[c] > 1.0f ? 1.0f : row[c];
+            if (c < 3 && srgb)
+                out[c] = toSrgb[(int)(v * ENCODE_STEPS + 0.5f)];
+            else
+                out[c] = (unsigned char)(v * 255.0f + 0.5f);
+        }
+    }
+#endif
+}
+
+void DownsampleRGBA(const unsigned char* src, int width, int height, unsigned char* dst, const MipOptions& options)
+{
+    int dw = width > 1 ? width / 2 : 1;
+    int dh = height > 1 ? height / 2 : 1;
+    int bands = (dh + BAND_ROWS - 1) / BAND_ROWS;
+
+    // A plain box over data that isn't sRGB needs no conversion at all. Its taps never
+    // reach past the edge, so wrapping makes no difference.
+    if (options.filter == MIP_BOX && !options.srgb && width > 1 && height > 1)
+    {
+        ThreadPool::ParallelFor(bands, [&](int band)
+        {
+            int y1 = (band + 1) * BAND_ROWS < dh ? (band + 1) * BAND_ROWS : dh;
+            for (int y = band * BAND_ROWS; y < y1; y++)
+            {
+                const unsigned char* row0 = src + (size_t)(y * 2) * width * 4;
+                BoxRows(row0, row0 + (size_t)width * 4, dw, dst + (size_t)y * dw * 4);
+            }
+        });
+        return;
+    }
+
+    Kernel kernel = MakeKernel(options.filter);
+    std::vector<int> columns, rows;
+    MakeTapIndices(kernel, width, dw, options.wrapX, columns);
+    MakeTapIndices(kernel, height, dh, options.wrapY, rows);
+
+    ThreadPool::ParallelFor(bands, [&](int band)
+    {
+        int y0 = band * BAND_ROWS;
+        int y1 = y0 + BAND_ROWS < dh ? y0 + BAND_ROWS : dh;
+
+        // Each source row the band touches is decoded and filtered across once. slots maps
+        // a source row to where its filtered copy lives, rows shared by neighbouring
+        // output rows (or wrapped around from the other edge) are reused.
+        std::vector<int> slots(height, -1);
+        std::vector<float> decoded((size_t)width * 4), filtered;
+        filtered.reserve((size_t)((y1 - y0) * 2 + kernel.taps) * dw * 4);
+        int used = 0;
+        for (int y = y0; y < y1; y++)
+        {
+            for (int t = 0; t < kernel.taps; t++)
+            {
+                int sy = rows[(size_t)y * kernel.taps + t];
+                if (slots[sy] >= 0)
+                    continue;
+                slots[sy] = used++;
+                filtered.resize((size_t)used * dw * 4);
+                DecodeRow(src + (size_t)sy * width * 4, width, options.srgb, &decoded[0]);
+                float* out = &filtered[(size_t)slots[sy] * dw * 4];
+                if (kernel.taps == 2)
+                    FilterRow<2>(&decoded[0], width, kernel, &columns[0], dw, out);
+                else
+                    FilterRow<MAX_TAPS>(&decoded[0], width, kernel, &columns[0], dw, out);
+            }
+        }
+
+        std::vector<float> combined((size_t)dw * 4);
+        const float* taps[MAX_TAPS];
+        for (int y = y0; y < y1; y++)
+        {
+            for (int t = 0; t < kernel.taps; t++)
+                taps[t] = &filtered[(size_t)slots[rows[(size_t)y * kernel.taps + t]] * dw * 4];
+            CombineRows(taps, kernel, dw * 4, &combined[0]);
+            EncodeRow(&combined[0], dw, options.srgb, dst + (size_t)y * dw * 4);
+        }
+    });
+}
+
+void GenerateMipChain(const unsigned char* rgba, int width, int height, const MipOptions& options,
+                      std::vector< std::vector<unsigned char> >& levels)
+{
+    int count = 0;
+    for (int w = width, h = height; w > 1 || h > 1; w = w > 1 ? w / 2 : 1, h = h > 1 ? h / 2 : 1)
+        count++;
+
+    // Reserved up front, each level is read straight out of the one before it
+    levels.clear();
+    levels.reserve(count);
+    const unsigned char* current = rgba;
+    while (width > 1 || height > 1)
+    {
+        int dw = width > 1 ? width / 2 : 1;
+        int dh = height > 1 ? height / 2 : 1;
+        levels.push_back(std::vector<unsigned char>((size_t)dw * dh * 4));
+        DownsampleRGBA(current, width, height, &levels.back()[0], options);
+
+        current = &levels.back()[0];
+        width = dw;
+        height = dh;
+    }
+}
+
+// Expands a pixel of any channel count to RGBA the same way GL would upload it
+static inline void FetchRGBA(const unsigned char* p, int channels, float out[4])
+{
+    switch (channels)
+    {
+    case 1: out[0] = out[1] = out[2] = p[0]; out[3] = 255.0f; break;
+    case 2: out[0] = out[1] = out[2] = p[0]; out[3] = p[1]; break;
+    case 3: out[0] = p[0]; out[1] = p[1]; out[2] = p[2]; out[3] = 255.0f; break;
+    default: out[0] = p[0]; out[1] = p[1]; out[2] = p[2]; out[3] = p[3]; break;
+    }
+}
+
+// The source texels each output texel along one axis reads, and their weights. Shrinking
+// averages everything the output texel covers, weighted by how much of each source texel
+// is inside it, so detail finer than the output can't alias into it. Growing is the usual
+// linear tent between the two nearest texel centres.
+struct ResampleTaps
+{
+    int maxTaps;
+    std::vector<int> first;         // Per output texel
+    std::vector<float> weights;     // maxTaps per output texel, unused ones 0
+
+    ResampleTaps(int srcSize, int dstSize)
+    {
+        float scale = (float)srcSize / dstSize;
+        maxTaps = scale > 1.0f ? (int)ceilf(scale) + 1 : 2;
+        first.resize(dstSize);
+        weights.assign((size_t)dstSize * maxTaps, 0.0f);
+
+        for (int x = 0; x < dstSize; x++)
+        {
+            float* w = &weights[(size_t)x * maxTaps];
+            if (scale > 1.0f)
+            {
+                float x0 = x * scale, x1 = (x + 1) * scale;
+                int i0 = (int)x0;
+                int i1 = (int)ceilf(x1) < srcSize ? (int)ceilf(x1) : srcSize;
+                first[x] = i0;
+                for (int i = i0; i < i1 && i - i0 < maxTaps; i++)
+                {
+                    float covered = (i + 1 < x1 ? i + 1 : x1) - (i > x0 ? i : x0);
+                    w[i - i0] = covered > 0.0f ? covered / scale : 0.0f;
+                }
+            }
+            else
+            {   // Sample at the texel centres so the edges line up at any scale
+                float f = (x + 0.5f) * scale - 0.5f;
+                if (f < 0.0f) f = 0.0f;
+                int i0 = (int)f;
+                float t = f - i0;
+                first[x] = i0;
+                w[0] = 1.0f - t;
+                w[1] = i0 + 1 < srcSize ? t : 0.0f;
+                if (i0 + 1 >= srcSize)
+                    w[0] = 1.0f;
+            }
+        }
+    }
+};
+
+void ResampleToRGBA(const unsigned char* src, int srcWidth, int srcHeight, int channels,
+                    unsigned char* dst, int dstWidth, int dstHeight, bool flipY)
+{
+    ResampleTaps columns(srcWidth, dstWidth), rows(srcHeight, dstHeight);
+
+    // Source rows filtered across, kept in a ring for as long as output rows still read
+    // them. The rows an output row reads are consecutive and only move forwards, so they
+    // never land on the same slot.
+    int ringRows = rows.maxTaps;
+    std::vector<float> ring((size_t)ringRows * dstWidth * 4);
+    std::vector<int> ringSource(ringRows, -1);
+    std::vector<float> sum((size_t)dstWidth * 4);
+
+    for (int y = 0; y < dstHeight; y++)
+    {
+        std::fill(sum.begin(), sum.end(), 0.0f);
+        const float* rowWeights = &rows.weights[(size_t)y * rows.maxTaps];
+        for (int k = 0; k < rows.maxTaps; k++)
+        {
+            int sy = rows.first[y] + k;
+            if (rowWeights[k] == 0.0f || sy >= srcHeight)
+                continue;
+
+            float* filtered = &ring[(size_t)(sy % ringRows) * dstWidth * 4];
+            if (ringSource[sy % ringRows] != sy)
+            {
+                ringSource[sy % ringRows] = sy;
+                const unsigned char* row = src + (size_t)sy * srcWidth * channels;
+                for (int x = 0; x < dstWidth; x++)
+                {
+                    float texel[4] = { 0.0f, 0.0f, 0.0f, 0.0f }, p[4];
+                    const float* w = &columns.weights[(size_t)x * columns.maxTaps];
+                    for (int j = 0; j < columns.maxTaps; j++)
+                    {
+                        int sx = columns.first[x] + j;
+                        if (w[j] == 0.0f || sx >= srcWidth)
+                            continue;
+                        FetchRGBA(row + sx * channels, channels, p);
+                        for (int i = 0; i < 4; i++)
+                            texel[i] += p[i] * w[j];
+                    }
+                    memcpy(&filtered[x * 4], texel, sizeof(texel));
+                }
+            }
+
+            for (size_t i = 0; i < sum.size(); i++)
+                sum[i] += filtered[i] * rowWeights[k];
+        }
+
+        unsigned char* out = dst + (size_t)(flipY ? dstHeight - 1 - y : y) * dstWidth * 4;
+        for (size_t i = 0; i < sum.size(); i++)
+            out[i] = (unsigned char)(sum[i] < 255.0f ? sum[i] + 0.5f : 255.0f);
+    }
+}
+
+const char* MipKernelName()
+{
+#if defined(MIP_AVX2)
+    return "AVX2";
+#elif defined(MIP_SSE2)
+    return "SSE2";
+#else
+    return "scalar";
+#endif
+}
@@ -0,0 +1,51 @@
+/**************************************************
+ *
+ *                  mipmapgen.h
+ *
+ *  CPU mip chain generation for RGBA8 images, so
+ *  neither SOIL nor glGenerateMipmap has to do it
+ *  on the GL thread. Colour maps are filtered in
+ *  linear light, otherwise distant planets come
+ *  out darker than they should. Each level is
+ *  split into bands of rows that run on the
+ *  thread pool, with SSE2 or AVX2 inner loops
+ *  when the compiler targets them.
+ *
+ ***************************************************/
+
+#ifndef MIPMAPGEN_H
+#define MIPMAPGEN_H
+
+#include <vector>
+
+enum MipFilter
+{
+    MIP_BOX,        // 2x2 average, what glGenerateMipmap does
+    MIP_KAISER,     // 8 tap Kaiser windowed sinc, keeps small levels sharp
+};
+
+struct MipOptions
+{
+    MipFilter filter;
+    bool srgb;              // RGB holds sRGB values, filter them in linear. Alpha is always linear.
+    bool wrapX, wrapY;      // Sample across the edge like GL_REPEAT, otherwise clamp
+
+    MipOptions() : filter(MIP_BOX), srgb(false), wrapX(false), wrapY(false) {}
+};
+
+// Halves an RGBA8 image. dst holds max(width / 2, 1) x max(height / 2, 1) pixels.
+void DownsampleRGBA(const unsigned char* src, int width, int height, unsigned char* dst, const MipOptions& options);
+
+// Fills 'levels' with every level below the image down to 1x1, levels[0] being level 1.
+void GenerateMipChain(const unsigned char* rgba, int width, int height, const MipOptions& options,
+                      std::vector< std::vector<unsigned char> >& levels);
+
+// Resamples an 8 bit image with 1 to 4 channels into an RGBA image. Area averaged along
+// an axis that shrinks, bilinear along one that grows.
+void ResampleToRGBA(const unsigned char* src, int srcWidth, int srcHeight, int channels,
+                    unsigned char* dst, int dstWidth, int dstHeight, bool flipY);
+
+// Which inner loops this build uses, "AVX2", "SSE2" or "scalar"
+const char* MipKernelName();
+
+#endif
@@ -0,0 +1,256 @@
+/*****************************************
+ *
+ *           panorama.cpp
+ *
+ *  Equirectangular to cubemap resampling
+ *  and the baked cache around it.
+ *
+ ****************************************/
+
+#include "panorama.h"
+#include "blockcompress.h"
+#include "mipmapgen.h"
+#include "glstate.h"
+#include "texturecache.h"
+#include "textureloader.h"
+#include "threadpool.h"
+
+#include <SOIL.h>
+
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <sys/stat.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PANO_SSE2
+#endif
+
+#define BAND_ROWS 16            // Face rows per ParallelFor index
+
+static const float pi = 3.14159265358979f;
+
+// Direction through texel centre (sc, tc) of a face, the way GL picks cubemap faces
+static inline void FaceDirection(int face, float sc, float tc, float d[3])
+{
+    switch (face)
+    {
+    case 0: d[0] =  1.0f; d[1] = -tc;   d[2] = -sc;   break; // +X
+    case 1: d[0] = -1.0f; d[1] = -tc;   d[2] =  sc;   break; // -X
+    case 2: d[0] =  sc;   d[1] =  1.0f; d[2] =  tc;   break; // +Y
+    case 3: d[0] =  sc;   d[1] = -1.0f; d[2] = -tc;   break; // -Y
+    case 4: d[0] =  sc;   d[1] = -tc;   d[2] =  1.0f; break; // +Z
+    default: d[0] = -sc;  d[1] = -tc;   d[2] = -1.0f; break; // -Z
+    }
+}
+
+#if defined(PANO_SSE2)
+static inline __m128 LoadTexel(const unsigned char* p)
+{
+    int packed;
+    memcpy(&packed, p, 4);
+    __m128i zero = _mm_setzero_si128();
+    __m128i wide = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero), zero);
+    return _mm_cvtepi32_ps(wide);
+}
+#endif
+
+// Adds the bilinear sample at panorama texel coordinates (x, y) to sum. X wraps, Y clamps.
+static inline void AddBilinear(const unsigned char* rgba, int width, int height, float x, float y, float sum[4])
+{
+    x -= 0.5f;
+    y -= 0.5f;
+    float fx = floorf(x), fy = floorf(y);
+    float tx = x - fx, ty = y - fy;
+
+    int x0 = (int)fx % width;
+    if (x0 < 0) x0 += width;
+    int x1 = x0 + 1 < width ? x0 + 1 : 0;
+    int y0 = (int)fy, y1 = y0 + 1;
+    if (y0 < 0) y0 = 0;
+    if (y1 > height - 1) y1 = height - 1;
+    if (y0 > height - 1) y0 = height - 1;
+
+    const unsigned char* row0 = rgba + (size_t)y0 * width * 4;
+    const unsigned char* row1 = rgba + (size_t)y1 * width * 4;
+
+#if defined(PANO_SSE2)
+    __m128 a = LoadTexel(row0 + x0 * 4), b = LoadTexel(row0 + x1 * 4);
+    __m128 c = LoadTexel(row1 + x0 * 4), d = LoadTexel(row1 + x1 * 4);
+    __m128 wx = _mm_set1_ps(tx), wy = _mm_set1_ps(ty);
+    __m128 top = _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), wx));
+    __m128 bottom = _mm_add_ps(c, _mm_mul_ps(_mm_sub_ps(d, c), wx));
+    __m128 result = _mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(bottom, top), wy));
+    _mm_storeu_ps(sum, _mm_add_ps(_mm_loadu_ps(sum), result));
+#else
+    for (int i = 0; i < 4; i++)
+    {
+        float top = row0[x0 * 4 + i] + (row0[x1 * 4 + i] - row0[x0 * 4 + i]) * tx;
+        float bottom = row1[x0 * 4 + i] + (row1[x1 * 4 + i] - row1[x0 * 4 + i]) * tx;
+        sum[i] += top + (bottom - top) * ty;
+    }
+#endif
+}
+
+void EquirectToCubeFaces(const unsigned char* rgba, int width, int height, int faceSize,
+                         std::vector<unsigned char> faces[6])
+{
+    for (int face = 0; face < 6; face++)
+        faces[face].resize((size_t)faceSize * faceSize * 4);
+
+    // A face spans a quarter of the width and half the height at its centre, take enough
+    // taps that every panorama texel under it counts
+    int tapsX = (width + faceSize * 4 - 1) / (faceSize * 4);
+    int tapsY = (height + faceSize * 2 - 1) / (faceSize * 2);
+    float scale = 1.0f / (tapsX * tapsY);
+
+    int bands = (faceSize + BAND_ROWS - 1) / BAND_ROWS;
+    ThreadPool::ParallelFor(6 * bands, [&](int index)
+    {
+        int face = index / bands;
+        int first = (index % bands) * BAND_ROWS;
+        int last = first + BAND_ROWS < faceSize ? first + BAND_ROWS : faceSize;
+        unsigned char* out = &faces[face][0];
+
+        for (int y = first; y < last; y++)
+        {
+            for (int x = 0; x < faceSize; x++)
+            {
+                float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+                for (int j = 0; j < tapsY; j++)
+                {
+                    float tc = 2.0f * (y + (j + 0.5f) / tapsY) / faceSize - 1.0f;
+                    for (int i = 0; i < tapsX; i++)
+                    {
+                        float sc = 2.0f * (x + (i + 0.5f) / tapsX) / faceSize - 1.0f;
+                        float d[3];
+                        FaceDirection(face, sc, tc, d);
+
+                        float length = sqrtf(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+                        float u = 0.5f + atan2f(d[0], -d[2]) / (2.0f * pi);
+                        float v = acosf(d[1] / length) / pi;
+                        AddBilinear(rgba, width, height, u * width, v * height, sum);
+                    }
+                }
+
+                unsigned char* p = out + ((size_t)y * faceSize + x) * 4;
+                for (int c = 0; c < 4; c++)
+                {
+                    float value = sum[c] * scale + 0.5f;
+                    p[c] = (unsigned char)(value > 255.0f ? 255.0f : value);
+                }
+            }
+        }
+    });
+}
+
+static long long FileTime(const char* fileName)
+{
+#ifdef _WIN32
+    struct _stat st;
+    if (_stat(fileName, &st) != 0)
+        return -1;
+#else
+    struct stat st;
+    if (stat(fileName, &st) != 0)
+        return -1;
+#endif
+    return (long long)st.st_mtime;
+}
+
+GLuint LoadPanoramaCubemap(const char* fileName, int faceSize, CubemapInfo* info)
+{
+    long long sourceTime = FileTime(fileName);
+    if (sourceTime < 0)
+    {
+        printf("can't find panorama %s\n", fileName);
+        return 0;
+    }
+
+    std::string cacheName = std::string(fileName) + ".cube.btex";
+    BakedTextureInfo baked;
+    GLuint texture = 0;
+
+    // Reuse the cache if it's up to date. Without a face size any size will do.
+    if (FileTime(cacheName.c_str()) >= sourceTime)
+    {
+        texture = LoadBakedTexture(cacheName.c_str(), &baked);
+        if (texture != 0 && (baked.target != GL_TEXTURE_CUBE_MAP || (faceSize != 0 && baked.width != faceSize)))
+        {
+            GLState::DeleteTextures(1, &texture);
+            texture = 0;
+        }
+    }
+
+    if (texture == 0)
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        int width, height, channels;
+        unsigned char* pixels;
+        {
+            std::lock_guard<std::mutex> lock(TextureCache::soilMutex);
+            pixels = SOIL_load_image(fileName, &width, &height, &channels, SOIL_LOAD_RGBA);
+            if (pixels == NULL)
+            {
+                printf("can't load image %s: %s\n", fileName, SOIL_last_result());
+                return 0;
+            }
+        }
+
+        if (faceSize == 0)
+        {
+            faceSize = width / 4 > height / 2 ? width / 4 : height / 2;
+            faceSize = (faceSize + 3) & ~3;
+        }
+
+        std::vector<unsigned char> faces[6];
+        EquirectToCubeFaces(pixels, width, height, faceSize, faces);
+        SOIL_free_image_data(pixels);
+
+        // Level major, the six faces of each level together, like WriteBakedTexture wants
+        MipOptions options;
+        options.srgb = true;
+        std::vector< std::vector< std::vector<unsigned char> > > chains(6);
+        for (int face = 0; face < 6; face++)
+            GenerateMipChain(&faces[face][0], faceSize, faceSize, options, chains[face]);
+
+        int levels = (int)chains[0].size() + 1;
+        std::vector< std::vector<unsigned char> > levelData(levels * 6);
+        for (int level = 0; level < levels; level++)
+        {
+            int size = faceSize >> level; if (size == 0) size = 1;
+            for (int face = 0; face < 6; face++)
+            {
+                const unsigned char* image = level == 0 ? &faces[face][0] : &chains[face][level - 1][0];
+                std::vector<unsigned char>& out = levelData[level * 6 + face];
+                out.resize(BakedLevelSize(BTEX_BC1, size, size));
+                CompressImage(BTEX_BC1, image, size, size, &out[0]);
+            }
+        }
+
+        // The values stay sRGB encoded but the file isn't flagged as such, the sky has always
+        // been sampled without conversion and would come out darker. Only the mips say so.
+        if (!WriteBakedTexture(cacheName.c_str(), BTEX_BC1, faceSize, faceSize, 6, BTEX_FLAG_LINEAR_MIPS, levelData))
+            return 0;
+
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        printf("panorama %s: %dx%d to six %dx%d faces in %.0f ms, cached as %s\n",
+            fileName, width, height, faceSize, faceSize, ms, cacheName.c_str());
+
+        texture = LoadBakedTexture(cacheName.c_str(), &baked);
+        if (texture == 0)
+            return 0;
+    }
+
+    if (info)
+    {
+        info->target = GL_TEXTURE_CUBE_MAP;
+        info->bytes = baked.bytes;
+        info->bytesSaved = 0;
+    }
+    return texture;
+}
@@ -0,0 +1,36 @@
+/**************************************************
+ *
+ *                   panorama.h
+ *
+ *  Turns a single equirectangular panorama into
+ *  a cubemap, so a sky can ship as one image
+ *  instead of six faces. The faces are resampled
+ *  on the thread pool with an SSE2 bilinear
+ *  filter, then mipmapped, compressed and cached
+ *  as a baked texture (see texturefile.h), so only
+ *  the first load pays for any of it.
+ *
+ ***************************************************/
+
+#ifndef PANORAMA_H
+#define PANORAMA_H
+
+#include <GL/gl3w.h>
+
+#include "texturecache.h"
+
+#include <vector>
+
+// Resamples an RGBA8 panorama (longitude across, the top row looking straight up) into
+// six faceSize x faceSize RGBA8 faces in GL order: +X, -X, +Y, -Y, +Z, -Z. Where the
+// panorama is denser than the faces several bilinear taps are averaged per texel.
+void EquirectToCubeFaces(const unsigned char* rgba, int width, int height, int faceSize,
+                         std::vector<unsigned char> faces[6]);
+
+// Loads a panorama as a BC1 cubemap. The result is cached next to it as
+// <fileName>.cube.btex and reused while it is newer than the image and the same size.
+// faceSize 0 picks a size that doesn't lose detail in either direction. Returns 0 if the
+// image can't be loaded or the cache can't be written, the caller can fall back to faces.
+GLuint LoadPanoramaCubemap(const char* fileName, int faceSize = 0, CubemapInfo* info = nullptr);
+
+#endif
@@ -8,15 +8,67 @@ in VertexData
 	vec3 worldPos;
 	vec3 eyePos;
 	vec2 texcoord;
+	flat int layer;		// Layer in the planet texture array, specular mask in its alpha
+	flat int virtualTexture;	// Or the virtual texture to use instead, -1 for none
 }	inData;
 
-uniform sampler2D diffuseTex;
-uniform sampler2D specularTex; // It's already here
+uniform sampler2DArray planetTex; // Every lit planet map, the layer comes from the vertex shader
+
+// Virtual textures, see virtualtexture.h. The indirection array has a texel per tile
+// (and a layer per texture) holding where the tile is in the cache, and which level
+// is really there, in case it's still a coarser stand-in.
+#define MAX_VIRTUAL_TEXTURES 4
+#define VT_TILE_SIZE 128
+#define VT_TILE_BORDER 4
+#define VT_FLAG_WRAPX 0x2	// VTEX_FLAG_WRAPX in tilefile.h
+
+uniform usampler2DArray vtIndirection;
+uniform sampler2D vtCache;
+uniform ivec2 vtSizes[MAX_VIRTUAL_TEXTURES];	// Level 0, in texels
+uniform int vtLevels[MAX_VIRTUAL_TEXTURES];
+uniform int vtFlags[MAX_VIRTUAL_TEXTURES];		// VT_FLAG_*
+uniform int vtCacheTiles;						// Per side
 
 uniform float specPower;
 
 vec3 sunPosition = vec3(0); // Sun is at the origin
 
+// One bilinear tap from a level, or from the coarser tile standing in for it
+vec4 SampleVirtualLevel(int id, vec2 uv, int level)
+{
+	ivec2 levelSize = max(vtSizes[id] >> level, ivec2(1));
+	ivec2 tiles = (levelSize + VT_TILE_SIZE - 1) / VT_TILE_SIZE;
+	ivec2 tile = min(ivec2(uv * vec2(levelSize)) / VT_TILE_SIZE, tiles - 1);
+	uvec4 entry = texelFetch(vtIndirection, ivec3(tile, id), level);
+
+	// Position inside the tile that's actually resident, then into its cache slot
+	vec2 texel = uv * vec2(max(vtSizes[id] >> int(entry.z), ivec2(1)));
+	vec2 inTile = texel - floor(texel / VT_TILE_SIZE) * VT_TILE_SIZE;
+	float stride = VT_TILE_SIZE + 2 * VT_TILE_BORDER;
+	vec2 cacheTexel = vec2(entry.xy) * stride + VT_TILE_BORDER + inTile;
+	return textureLod(vtCache, cacheTexel / (stride * vtCacheTiles), 0.0f);
+}
+
+// The cache has no mips, so the filtering between levels is done here: a tap from the
+// level where a texel is about a pixel and one from the level above, mixed by how far
+// between them the pixel is. vtfeedback.frag asks for the finer of the two, and every
+// tile asked for brings the coarser ones covering it.
+vec4 SampleVirtual(int id, vec2 uv, vec2 dx, vec2 dy)
+{
+	vec2 size = vec2(vtSizes[id]);
+	dx *= size;
+	dy *= size;
+	float lod = clamp(0.5f * log2(max(dot(dx, dx), dot(dy, dy))), 0.0f, float(vtLevels[id] - 1));
+	int level = int(lod);
+
+	uv.x = (vtFlags[id] & VT_FLAG_WRAPX) != 0 ? fract(uv.x) : clamp(uv.x, 0.0f, 1.0f);
+	uv.y = clamp(uv.y, 0.0f, 1.0f);
+	vec4 fine = SampleVirtualLevel(id, uv, level);
+	if (level + 1 >= vtLevels[id])
+		return fine;
+	return mix(fine, SampleVirtualLevel(id, uv, level + 1), lod - float(level));
+}
+
 void main()
 {
 	float luminance = 1.2f;
@@ -25,18 +77,23 @@ void main()
 	float NoL = max(0.0f, dot(normal, light));
 	vec3 V = normalize(inData.worldPos - inData.eyePos);
 
-	vec4 diffuseTexture = texture(diffuseTex, inData.texcoord);
+	// One fetch for both, the colour in rgb and the specular mask packed into alpha.
+	// The derivatives are taken out here, where every pixel of the quad runs them.
+	vec2 dx = dFdx(inData.texcoord), dy = dFdy(inData.texcoord);
+	vec4 planetTexel;
+	if (inData.virtualTexture >= 0)
+		planetTexel = SampleVirtual(inData.virtualTexture, inData.texcoord, dx, dy);
+	else
+		planetTexel = texture(planetTex, vec3(inData.texcoord, inData.layer));
 
 	// Do diffuse light
-	vec3 diffuse = diffuseTexture.rgb * vec3(NoL) * luminance;
+	vec3 diffuse = planetTexel.rgb * vec3(NoL) * luminance;
 
-	vec4 specularColor = texture(specularTex, inData.texcoord);
-	//vec4 specularColor = texture(specularTex, inData.texcoord);
-	
-	// Do specular light
+	// Do specular light. The specular maps are grey, so the mask is both the tint and the shininess
+	float specularMask = planetTexel.a;
 	vec3 R = normalize(reflect(-light, normal));
 	float VoR = max(0.0f, dot(-V, R));
-	vec3 specular = specularColor.rgb * pow(VoR, specularColor.g * specPower) * (NoL > 0.0 ? 1.0 : 0.0);
+	vec3 specular = vec3(specularMask) * pow(VoR, specularMask * specPower) * (NoL > 0.0 ? 1.0 : 0.0);
 
 	frag_colour.rgb = diffuse + specular;
 	frag_colour.a = 1.0f;
@@ -1,5 +1,7 @@
 #version 400
 
+#define MAX_INSTANCES 16
+
 layout (location = 0) in vec3 vertexPosition;
 layout (location = 1) in vec3 vertexNormal;
 layout (location = 2) in vec2 vertexTexCoord;
@@ -10,21 +12,31 @@ out VertexData
 	vec3 worldPos;
 	vec3 eyePos;
 	vec2 texcoord;
+	flat int layer;		// Layer in the planet texture array, specular mask in its alpha
+	flat int virtualTexture;	// Or the virtual texture to use instead, -1 for none
 }	outData;
 
-uniform mat4 model;
+// One entry per body, picked with gl_InstanceID
+uniform mat4 models[MAX_INSTANCES];
+uniform mat4 norms[MAX_INSTANCES];
+uniform int litLayers[MAX_INSTANCES];
+uniform int virtualTextures[MAX_INSTANCES];
+
 uniform mat4 view;
 uniform mat4 proj;
-uniform mat4 norm;
 
 uniform vec3 cameraPos;
 
 void main()
 {
+	mat4 model = models[gl_InstanceID];
+
 	outData.worldPos	= vec3(model * vec4(vertexPosition, 1.0f));
 	outData.eyePos		= cameraPos;
-    outData.normal		= normalize(vec3(norm * vec4(vertexNormal, 1.0f)));
+    outData.normal		= normalize(vec3(norms[gl_InstanceID] * vec4(vertexNormal, 1.0f)));
 	outData.texcoord	= vertexTexCoord;
+	outData.layer		= litLayers[gl_InstanceID];
+	outData.virtualTexture = virtualTextures[gl_InstanceID];
 
 	outData.texcoord.x  = 1.0f - outData.texcoord.x;
 
@@ -3,11 +3,37 @@
 in vec3 direction;
  
 uniform samplerCube skybox;
+uniform sampler2D skyboxFace;	// Used instead of the cubemap when all six faces are the same image
+uniform bool singleFace;
 
 out vec4 frag_colour;
+
+// Works out which face the direction hits and where on it, the same way the
+// hardware does for a cubemap, so one 2D image can stand in for all six faces
+vec2 CubeFaceUV(vec3 d)
+{
+	vec3 a = abs(d);
+	float sc, tc, ma;
+	if (a.x >= a.y && a.x >= a.z)	{ ma = a.x; sc = d.x > 0.0 ? -d.z :  d.z; tc = -d.y; }
+	else if (a.y >= a.z)			{ ma = a.y; sc = d.x; tc = d.y > 0.0 ? d.z : -d.z; }
+	else							{ ma = a.z; sc = d.z > 0.0 ? d.x : -d.x; tc = -d.y; }
+	return (vec2(sc, tc) / ma + 1.0) * 0.5;
+}
  
 void main()
 {    
 	float exposure = 2.0f;
-	frag_colour = texture(skybox, direction) * exposure;
-}
\ No newline at end of file
+	if (singleFace)
+	{
+		vec2 uv = CubeFaceUV(direction);
+
+		// The coordinates jump at face edges, don't let that pick the smallest mip
+		vec2 dx = dFdx(uv), dy = dFdy(uv);
+		if (dot(dx, dx) > 0.01 || dot(dy, dy) > 0.01)
+			dx = dy = vec2(0.0);
+
+		frag_colour = textureGrad(skyboxFace, uv, dx, dy) * exposure;
+	}
+	else
+		frag_colour = texture(skybox, direction) * exposure;
+}
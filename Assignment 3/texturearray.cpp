@@ -0,0 +1,363 @@
+/*****************************************
+ *
+ *           texturearray.cpp
+ *
+ *  Builds a 2D texture array out of
+ *  separate image files.
+ *
+ ****************************************/
+
+#include "texturearray.h"
+#include "texturecache.h"
+#include "thumbnail.h"
+#include "mappedfile.h"
+
+#include <SOIL.h>
+
+#include <stdio.h>
+#include <string.h>
+
+// S3TC isn't part of core GL, so gl3w's header doesn't always define these
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT         0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT        0x83F3
+#endif
+
+TextureArrayBuilder::TextureArrayBuilder(int width, int height)
+    : width(width), height(height), mipFilter(MIP_BOX), compressed(false), blockFormat(BTEX_BC1), blockQuality(COMPRESS_NORMAL)
+{
+}
+
+void TextureArrayBuilder::SetBlockFormat(BakedFormat format, CompressQuality quality)
+{
+    compressed = true;
+    blockFormat = format;
+    blockQuality = quality;
+}
+
+int TextureArrayBuilder::AddLayer(const char* fileName, bool flipY, bool ntscSafe, bool srgb)
+{
+    Layer layer;
+    layer.fileName = fileName;
+    layer.flipY = flipY;
+    layer.ntscSafe = ntscSafe;
+    layer.srgb = srgb;
+    layers.push_back(layer);
+    return (int)layers.size() - 1;
+}
+
+int TextureArrayBuilder::AddPackedLayer(const char* colourFile, const char* maskFile, bool flipY, bool ntscSafe)
+{
+    if (compressed && blockFormat != BTEX_BC3)
+        printf("texture array: %s packs a mask into alpha, which this block format drops\n", colourFile);
+
+    int index = AddLayer(colourFile, flipY, ntscSafe, true);
+    layers[index].maskFile = maskFile;
+    return index;
+}
+
+// Grey checkerboard, obvious enough to spot a missing texture without being garish
+static void FillPlaceholder(unsigned char* dst, int width, int height)
+{
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            unsigned char v = (((x / 32) + (y / 32)) & 1) ? 160 : 96;
+            unsigned char* p = dst + ((size_t)y * width + x) * 4;
+            p[0] = p[1] = p[2] = v;
+            p[3] = 255;
+        }
+    }
+}
+
+// Resamples a grey map to the layer size and writes its green channel into the alpha
+static void PackMask(const unsigned char* mask, int maskWidth, int maskHeight, int channels,
+                     std::vector<unsigned char>& rgba, int width, int height, bool flipY)
+{
+    std::vector<unsigned char> resampled((size_t)width * height * 4);
+    ResampleToRGBA(mask, maskWidth, maskHeight, channels, &resampled[0], width, height, flipY);
+    for (size_t p = 0; p < resampled.size(); p += 4)
+        rgba[p + 3] = resampled[p + 1];
+}
+
+static void ClearAlpha(std::vector<unsigned char>& rgba)
+{
+    for (size_t p = 3; p < rgba.size(); p += 4)
+        rgba[p] = 0;
+}
+
+static void MakeNTSCSafe(std::vector<unsigned char>& pixels)
+{   // Same range SOIL squeezes colours into, alpha is left alone
+    for (size_t p = 0; p < pixels.size(); p++)
+        if ((p & 3) != 3)
+            pixels[p] = (unsigned char)(16 + (pixels[p] * 219 + 127) / 255);
+}
+
+// The array repeats around the planets (S) and clamps at the poles (T), the mips should too
+MipOptions TextureArrayBuilder::LayerMipOptions(const Layer& layer) const
+{
+    MipOptions options;
+    options.filter = mipFilter;
+    options.srgb = layer.srgb;
+    options.wrapX = true;
+    options.wrapY = false;
+    return options;
+}
+
+int TextureArrayBuilder::Levels() const
+{
+    int levels = 1;
+    for (int size = width > height ? width : height; size > 1; size /= 2)
+        levels++;
+    return levels;
+}
+
+GLenum TextureArrayBuilder::InternalFormat() const
+{
+    if (!compressed)
+        return GL_RGBA8;
+
+    switch (blockFormat)
+    {
+    case BTEX_BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    case BTEX_BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    case BTEX_BC5: return GL_COMPRESSED_RG_RGTC2;
+    }
+    return GL_NONE;
+}
+
+size_t TextureArrayBuilder::LayerBytes(int level) const
+{
+    int w = width >> level;  if (w == 0) w = 1;
+    int h = height >> level; if (h == 0) h = 1;
+    return compressed ? BakedLevelSize(blockFormat, w, h) : (size_t)w * h * 4;
+}
+
+size_t TextureArrayBuilder::LevelBytes(int level) const
+{
+    return LayerBytes(level) * layers.size();
+}
+
+void TextureArrayBuilder::StoreLayer(const unsigned char* rgba, int level, int layer, std::vector<unsigned char>& levelData) const
+{
+    int w = width >> level;  if (w == 0) w = 1;
+    int h = height >> level; if (h == 0) h = 1;
+    unsigned char* slot = &levelData[LayerBytes(level) * layer];
+    if (compressed)
+        CompressImage(blockFormat, rgba, w, h, slot, blockQuality);
+    else
+        memcpy(slot, rgba, LayerBytes(level));
+}
+
+bool TextureArrayBuilder::OpenBaked(const Layer& layer, MappedFile& file, BakedTextureView& view) const
+{
+    // Only block compressed arrays, the baked data can't be expanded back to RGBA8 here
+    std::string name = layer.fileName + ".btex";
+    if (!compressed || !file.Open(name.c_str()))
+        return false;
+    if (!ParseBakedTexture(file.Data(), file.Size(), view, name.c_str()))
+        return false;
+
+    const BakedTextureHeader& header = *view.header;
+    if (header.format != (uint32_t)blockFormat || header.width != (uint32_t)width || header.height != (uint32_t)height ||
+        header.faces != 1 || header.levels != (uint32_t)Levels() || (header.flags & BTEX_FLAG_SRGB) != 0 ||
+        ((header.flags & BTEX_FLAG_LINEAR_MIPS) != 0) != layer.srgb)
+    {
+        printf("texture array: %s doesn't fit a %dx%d array, decoding %s instead\n", name.c_str(), width, height,
+            layer.fileName.c_str());
+        return false;
+    }
+    return true;
+}
+
+// Each level straight out of the mapping into the layer's slot
+void TextureArrayBuilder::CopyBaked(const BakedTextureView& view, int firstLevel, int layer,
+                                    std::vector< std::vector<unsigned char> >& levels) const
+{
+    for (int level = firstLevel; level < Levels(); level++)
+        memcpy(&levels[level - firstLevel][LayerBytes(level) * layer], view.LevelData(level, 0), LayerBytes(level));
+}
+
+int TextureArrayBuilder::BakedLayers() const
+{
+    int baked = 0;
+    for (size_t i = 0; i < layers.size(); i++)
+    {
+        MappedFile file;
+        BakedTextureView view;
+        if (OpenBaked(layers[i], file, view))
+            baked++;
+    }
+    return baked;
+}
+
+void TextureArrayBuilder::BuildLevels(int firstLevel, std::vector< std::vector<unsigned char> >& levels, int* missing) const
+{
+    int levelCount = Levels();
+    levels.assign(levelCount - firstLevel, std::vector<unsigned char>());
+    for (int level = firstLevel; level < levelCount; level++)
+        levels[level - firstLevel].resize(LevelBytes(level));
+
+    if (missing)
+        *missing = 0;
+
+    std::vector<unsigned char> current((size_t)width * height * 4), half;
+    for (size_t i = 0; i < layers.size(); i++)
+    {
+        const Layer& layer = layers[i];
+
+        MappedFile baked;
+        BakedTextureView view;
+        if (OpenBaked(layer, baked, view))
+        {
+            CopyBaked(view, firstLevel, (int)i, levels);
+            continue;
+        }
+
+        // Straight through SOIL, the texture cache isn't safe to use off the GL thread,
+        // but SOIL itself is shared with it, so the decode holds the cache's lock
+        int w, h, channels;
+        std::unique_lock<std::mutex> soilLock(TextureCache::soilMutex);
+        unsigned char* image = SOIL_load_image(layer.fileName.c_str(), &w, &h, &channels, SOIL_LOAD_AUTO);
+        if (image == NULL)
+            printf("can't load image %s: %s\n", layer.fileName.c_str(), SOIL_last_result());
+        soilLock.unlock();
+
+        if (image == NULL)
+        {
+            current.resize((size_t)width * height * 4);
+            FillPlaceholder(&current[0], width, height);
+            if (missing)
+                (*missing)++;
+        }
+        else
+        {
+            std::vector<unsigned char> thumbnail;
+            int tw, th;
+            if (!LoadThumbnail(layer.fileName.c_str(), thumbnail, tw, th))
+                SaveThumbnail(layer.fileName.c_str(), image, w, h, channels);
+
+            current.resize((size_t)width * height * 4);
+            ResampleToRGBA(image, w, h, channels, &current[0], width, height, layer.flipY);
+
+            // A layer packed with its own brightness doesn't need a second decode
+            if (layer.maskFile == layer.fileName)
+                PackMask(image, w, h, channels, current, width, height, layer.flipY);
+            SOIL_free_image_data(image);
+            if (layer.ntscSafe)
+                MakeNTSCSafe(current);
+        }
+
+        if (!layer.maskFile.empty() && (image == NULL || layer.maskFile != layer.fileName))
+        {
+            int mw, mh, mc;
+            soilLock.lock();
+            unsigned char* mask = SOIL_load_image(layer.maskFile.c_str(), &mw, &mh, &mc, SOIL_LOAD_AUTO);
+            if (mask == NULL)
+                printf("can't load image %s: %s\n", layer.maskFile.c_str(), SOIL_last_result());
+            soilLock.unlock();
+
+            if (mask == NULL)
+            {
+                ClearAlpha(current);
+            }
+            else
+            {
+                std::vector<unsigned char> thumbnail;
+                int tw, th;
+                if (!LoadThumbnail(layer.maskFile.c_str(), thumbnail, tw, th))
+                    SaveThumbnail(layer.maskFile.c_str(), mask, mw, mh, mc);
+
+                PackMask(mask, mw, mh, mc, current, width, height, layer.flipY);
+                SOIL_free_image_data(mask);
+            }
+        }
+
+        // Walk down the chain, copying out the levels that were asked for
+        MipOptions options = LayerMipOptions(layer);
+        w = width; h = height;
+        for (int level = 0; level < levelCount; level++)
+        {
+            if (level >= firstLevel)
+                StoreLayer(&current[0], level, (int)i, levels[level - firstLevel]);
+            if (level + 1 < levelCount)
+            {
+                int hw = w > 1 ? w / 2 : 1, hh = h > 1 ? h / 2 : 1;
+                half.resize((size_t)hw * hh * 4);
+                DownsampleRGBA(&current[0], w, h, &half[0], options);
+                current.swap(half);
+                w = hw; h = hh;
+            }
+        }
+    }
+}
+
+int TextureArrayBuilder::BuildPreviewLevels(std::vector< std::vector<unsigned char> >& levels) const
+{
+    int levelCount = Levels();
+    int firstLevel = 0;
+    while (firstLevel < levelCount - 1 && ((width >> firstLevel) > THUMBNAIL_SIZE || (height >> firstLevel) > THUMBNAIL_SIZE))
+        firstLevel++;
+
+    int w = width >> firstLevel;  if (w == 0) w = 1;
+    int h = height >> firstLevel; if (h == 0) h = 1;
+
+    levels.assign(levelCount - firstLevel, std::vector<unsigned char>());
+    for (int level = firstLevel; level < levelCount; level++)
+        levels[level - firstLevel].resize(LevelBytes(level));
+
+    std::vector<unsigned char> thumbnail, current((size_t)w * h * 4), half;
+    for (size_t i = 0; i < layers.size(); i++)
+    {
+        const Layer& layer = layers[i];
+
+        // A baked layer's real levels are as cheap to read as a thumbnail
+        MappedFile baked;
+        BakedTextureView view;
+        if (OpenBaked(layer, baked, view))
+        {
+            CopyBaked(view, firstLevel, (int)i, levels);
+            continue;
+        }
+
+        int tw, th;
+        current.resize((size_t)w * h * 4);
+        if (LoadThumbnail(layer.fileName.c_str(), thumbnail, tw, th))
+        {
+            ResampleToRGBA(&thumbnail[0], tw, th, 4, &current[0], w, h, layer.flipY);
+            if (layer.ntscSafe)
+                MakeNTSCSafe(current);
+        }
+        else
+        {
+            for (size_t p = 0; p < current.size(); p++)
+                current[p] = (p & 3) == 3 ? 255 : 128;
+        }
+
+        if (!layer.maskFile.empty())
+        {
+            if (LoadThumbnail(layer.maskFile.c_str(), thumbnail, tw, th))
+                PackMask(&thumbnail[0], tw, th, 4, current, w, h, layer.flipY);
+            else
+                ClearAlpha(current);
+        }
+
+        MipOptions options = LayerMipOptions(layer);
+        int cw = w, ch = h;
+        for (int level = firstLevel; level < levelCount; level++)
+        {
+            StoreLayer(&current[0], level, (int)i, levels[level - firstLevel]);
+            if (level + 1 < levelCount)
+            {
+                int hw = cw > 1 ? cw / 2 : 1, hh = ch > 1 ? ch / 2 : 1;
+                half.resize((size_t)hw * hh * 4);
+                DownsampleRGBA(&current[0], cw, ch, &half[0], options);
+                current.swap(half);
+                cw = hw; ch = hh;
+            }
+        }
+    }
+
+    return firstLevel;
+}
@@ -0,0 +1,116 @@
+/**************************************************
+ *
+ *                 texturearray.h
+ *
+ *  Packs same-format textures (the planet maps)
+ *  into one GL_TEXTURE_2D_ARRAY. Every image is
+ *  resampled to a common size so they can share
+ *  the array, and shaders pick the layer per
+ *  instance, so a whole batch of bodies draws with
+ *  a single bind. The builder only makes the
+ *  levels, TextureStreamer uploads them.
+ *
+ *  A layer baked to the array's size and block
+ *  format (texbake -size, written next to the
+ *  image as <image>.btex) is copied straight out
+ *  of its mapping, with no decode, resample or
+ *  compression at runtime. Images without one
+ *  are decoded as before.
+ *
+ ***************************************************/
+
+#ifndef TEXTUREARRAY_H
+#define TEXTUREARRAY_H
+
+#include <GL/gl3w.h>
+
+#include "blockcompress.h"
+#include "texturefile.h"
+#include "mipmapgen.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class MappedFile;
+
+class TextureArrayBuilder
+{
+public:
+    TextureArrayBuilder(int width, int height);
+
+    // Queues an image and returns the layer it will end up in. flipY and ntscSafe do
+    // what SOIL_FLAG_INVERT_Y and SOIL_FLAG_NTSC_SAFE_RGB do. If the file can't be
+    // loaded the layer gets a placeholder, so the returned index is always usable.
+    // Pass srgb = false for data rather than colour (specular or normal maps), so the
+    // mips are averaged as stored instead of in linear light.
+    int AddLayer(const char* fileName, bool flipY, bool ntscSafe, bool srgb = true);
+
+    // Queues a colour map with a grey map (a specular mask) packed into its alpha, so a
+    // shader gets both from one fetch. The mask is the second image's green channel and
+    // is resampled and flipped like the colour. Passing the colour map as its own mask
+    // uses its brightness. A mask that can't be loaded leaves the alpha at 0.
+    // Needs RGBA8 or BC3, BC1 has nowhere to keep the alpha.
+    int AddPackedLayer(const char* colourFile, const char* maskFile, bool flipY, bool ntscSafe);
+
+    // Filter used for every level below the first, MIP_BOX unless set
+    void SetMipFilter(MipFilter filter) { mipFilter = filter; }
+
+    // Block compresses every level as it's built, instead of storing RGBA8. BC1 is an
+    // eighth of the size, so far more of the chain fits in the streamer's budget.
+    void SetBlockFormat(BakedFormat format, CompressQuality quality);
+
+    // Decodes and resamples every layer, builds its mip chain on the CPU (see mipmapgen.h),
+    // compressed if a block format is set, and fills 'levels' with mips [firstLevel,
+    // Levels()), each holding all the layers one after another. It doesn't touch GL or the
+    // texture cache, so it is safe to run on a worker thread. TextureStreamer uploads it.
+    void BuildLevels(int firstLevel, std::vector< std::vector<unsigned char> >& levels, int* missing = nullptr) const;
+
+    // How many layers have a baked file that fits the array, see OpenBaked
+    int BakedLayers() const;
+
+    // A quick stand-in for BuildLevels, made from the layers' cached thumbnails (see
+    // thumbnail.h) so it only reads a few kilobytes per layer. Fills 'levels' from the
+    // first level no bigger than a thumbnail and returns that level. Layers without a
+    // thumbnail yet are grey, BuildLevels writes the thumbnails for next time.
+    int BuildPreviewLevels(std::vector< std::vector<unsigned char> >& levels) const;
+
+    int Width() const { return width; }
+    int Height() const { return height; }
+    int Layers() const { return (int)layers.size(); }
+    int Levels() const;     // Full mip chain down to 1x1
+
+    bool Compressed() const { return compressed; }
+    GLenum InternalFormat() const;
+    size_t LevelBytes(int level) const;     // Of all the layers together
+
+private:
+    struct Layer
+    {
+        std::string fileName;
+        std::string maskFile;   // Packed into alpha, empty if the layer keeps its own
+        bool flipY, ntscSafe, srgb;
+    };
+
+    MipOptions LayerMipOptions(const Layer& layer) const;
+
+    // Maps the layer's <image>.btex if it has the array's size, block format and mip
+    // filtering (texbake -linear for colour layers) and a full chain. The array samples
+    // texels as stored, so a file flagged for an sRGB upload doesn't fit. The flip, NTSC
+    // and mask options can't be checked, they're whatever texbake was given.
+    bool OpenBaked(const Layer& layer, MappedFile& file, BakedTextureView& view) const;
+    void CopyBaked(const BakedTextureView& view, int firstLevel, int layer, std::vector< std::vector<unsigned char> >& levels) const;
+    size_t LayerBytes(int level) const;
+
+    // Copies (or compresses) one layer's image into its slot of a level
+    void StoreLayer(const unsigned char* rgba, int level, int layer, std::vector<unsigned char>& levelData) const;
+
+    int width, height;
+    std::vector<Layer> layers;
+    MipFilter mipFilter;
+    bool compressed;
+    BakedFormat blockFormat;
+    CompressQuality blockQuality;
+};
+
+#endif
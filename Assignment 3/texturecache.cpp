@@ -0,0 +1,385 @@
+/*****************************************
+ *
+ *           texturecache.cpp
+ *
+ *  Shared, reference counted texture and
+ *  decoded image cache.
+ *
+ ****************************************/
+
+#include "texturecache.h"
+#include "glstate.h"
+
+#include <SOIL.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <vector>
+
+std::map<TextureCache::ImageKey, ImageRef> TextureCache::images;
+std::map<TextureCache::TextureKey, TextureCache::TextureEntry> TextureCache::textures;
+std::map<GLuint, TextureCache::TextureKey> TextureCache::textureKeys;
+
+int TextureCache::decodes = 0;
+int TextureCache::imageHits = 0;
+int TextureCache::uploads = 0;
+int TextureCache::textureHits = 0;
+
+std::mutex TextureCache::soilMutex;
+
+DecodedImage::~DecodedImage()
+{
+    SOIL_free_image_data(pixels);
+}
+
+bool TextureCache::ImageKey::operator<(const ImageKey& o) const
+{
+    if (path != o.path) return path < o.path;
+    if (mtime != o.mtime) return mtime < o.mtime;
+    return channels < o.channels;
+}
+
+bool TextureCache::TextureKey::operator<(const TextureKey& o) const
+{
+    for (int i = 0; i < 6; i++)
+    {
+        if (faces[i] != o.faces[i]) return faces[i] < o.faces[i];
+        if (mtime[i] != o.mtime[i]) return mtime[i] < o.mtime[i];
+    }
+    if (channels != o.channels) return channels < o.channels;
+    return flags < o.flags;
+}
+
+// Resolve the file to one canonical name so "textures/../textures/a.png" and "textures/a.png" match
+bool TextureCache::MakeImageKey(const char* fileName, int forceChannels, ImageKey& key)
+{
+#ifdef _WIN32
+    char resolved[_MAX_PATH];
+    if (_fullpath(resolved, fileName, _MAX_PATH) == NULL)
+        return false;
+    struct _stat st;
+    if (_stat(resolved, &st) != 0)
+        return false;
+#else
+    char* resolvedPath = realpath(fileName, NULL);
+    if (resolvedPath == NULL)
+        return false;
+    std::string resolved = resolvedPath;
+    free(resolvedPath);
+    struct stat st;
+    if (stat(resolved.c_str(), &st) != 0)
+        return false;
+#endif
+
+    key.path = resolved;
+    key.mtime = (long long)st.st_mtime;
+    key.channels = forceChannels;
+    return true;
+}
+
+ImageRef TextureCache::LoadImage(const char* fileName, int forceChannels)
+{
+    ImageKey key;
+    if (!MakeImageKey(fileName, forceChannels, key))
+    {
+        printf("can't find image: %s\n", fileName);
+        return ImageRef();
+    }
+
+    std::map<ImageKey, ImageRef>::iterator itr = images.find(key);
+    if (itr != images.end())
+    {
+        imageHits++;
+        return itr->second;
+    }
+
+    DecodedImage* image = new DecodedImage();
+    {
+        std::lock_guard<std::mutex> lock(soilMutex);
+        image->pixels = SOIL_load_image(key.path.c_str(), &image->width, &image->height, &image->channels, forceChannels);
+        if (image->pixels == NULL)
+        {
+            printf("can't load image %s: %s\n", fileName, SOIL_last_result());
+            delete image;
+            return ImageRef();
+        }
+    }
+
+    // SOIL reports the channels in the file, we want the ones in the buffer
+    if (forceChannels != SOIL_LOAD_AUTO)
+        image->channels = forceChannels;
+
+    decodes++;
+    ImageRef ref(image);
+    images[key] = ref;
+    return ref;
+}
+
+GLuint TextureCache::FindTexture(const TextureKey& key, CubemapInfo* info)
+{
+    std::map<TextureKey, TextureEntry>::iterator itr = textures.find(key);
+    if (itr == textures.end())
+        return 0;
+
+    textureHits++;
+    itr->second.refCount++;
+    if (info)
+        *info = itr->second.info;
+    return itr->second.texture;
+}
+
+void TextureCache::AddTexture(const TextureKey& key, GLuint texture, const CubemapInfo* info)
+{
+    uploads++;
+    TextureEntry entry;
+    entry.texture = texture;
+    entry.refCount = 1;
+    entry.info.target = GL_TEXTURE_2D;
+    entry.info.bytes = 0;
+    entry.info.bytesSaved = 0;
+    if (info)
+        entry.info = *info;
+    textures[key] = entry;
+    textureKeys[texture] = key;
+}
+
+// Texel bytes for a whole mip chain
+static size_t MipChainBytes(int width, int height, int channels, bool mipmaps)
+{
+    size_t bytes = 0;
+    while (true)
+    {
+        bytes += (size_t)width * height * channels;
+        if (!mipmaps || (width == 1 && height == 1))
+            break;
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
+    }
+    return bytes;
+}
+
+bool TextureCache::MakeTextureKey(const char* fileName, int forceChannels, unsigned int soilFlags, TextureKey& key)
+{
+    ImageKey imageKey;
+    if (!MakeImageKey(fileName, forceChannels, imageKey))
+    {
+        printf("can't find texture: %s\n", fileName);
+        return false;
+    }
+
+    key.faces[0] = imageKey.path;
+    key.mtime[0] = imageKey.mtime;
+    for (int i = 1; i < 6; i++)
+        key.mtime[i] = 0;
+    key.channels = forceChannels;
+    key.flags = soilFlags;
+    return true;
+}
+
+GLuint TextureCache::LoadTexture(const char* fileName, int forceChannels, unsigned int soilFlags)
+{
+    TextureKey key;
+    if (!MakeTextureKey(fileName, forceChannels, soilFlags, key))
+        return 0;
+
+    GLuint texture = FindTexture(key);
+    if (texture != 0)
+        return texture;
+
+    ImageRef image = LoadImage(fileName, forceChannels);
+    if (!image)
+        return 0;
+
+    // SOIL works on its own copy of the pixels, so the shared buffer stays untouched
+    {
+        std::lock_guard<std::mutex> lock(soilMutex);
+        texture = SOIL_create_OGL_texture(image->pixels, image->width, image->height, image->channels,
+            SOIL_CREATE_NEW_ID, soilFlags);
+        GLState::Invalidate();  // SOIL binds it on whichever unit is active
+        if (texture == 0)
+        {
+            printf("can't create texture %s: %s\n", fileName, SOIL_last_result());
+            return 0;
+        }
+    }
+
+    AddTexture(key, texture);
+    return texture;
+}
+
+GLuint TextureCache::LoadCubemap(const char* posx, const char* negx, const char* posy,
+                                 const char* negy, const char* posz, const char* negz,
+                                 int forceChannels, unsigned int soilFlags, CubemapInfo* info)
+{
+    const char* names[6] = { posx, negx, posy, negy, posz, negz };
+
+    TextureKey key;
+    for (int i = 0; i < 6; i++)
+    {
+        ImageKey imageKey;
+        if (!MakeImageKey(names[i], forceChannels, imageKey))
+        {
+            printf("can't find cubemap face: %s\n", names[i]);
+            return 0;
+        }
+        key.faces[i] = imageKey.path;
+        key.mtime[i] = imageKey.mtime;
+    }
+    key.channels = forceChannels;
+    key.flags = soilFlags;
+
+    // Single image cubemaps are cached apart from full ones, they're bound differently
+    bool sameFaces = info != nullptr;
+    for (int i = 1; i < 6; i++)
+        sameFaces = sameFaces && key.faces[i] == key.faces[0];
+    if (sameFaces)
+        key.flags |= 0x80000000u;
+
+    GLuint texture = FindTexture(key, info);
+    if (texture != 0)
+        return texture;
+
+    // Faces that name the same file share one decode
+    ImageRef faces[6];
+    for (int i = 0; i < 6; i++)
+    {
+        faces[i] = LoadImage(names[i], forceChannels);
+        if (!faces[i])
+            return 0;
+        if (faces[i]->width != faces[0]->width || faces[i]->height != faces[0]->height ||
+            faces[i]->channels != faces[0]->channels)
+        {
+            printf("cubemap faces don't match in size: %s\n", names[i]);
+            return 0;
+        }
+    }
+
+    GLenum formats[5] = { GL_NONE, GL_RED, GL_RG, GL_RGB, GL_RGBA };
+    GLenum format = formats[faces[0]->channels];
+    int width = faces[0]->width, height = faces[0]->height;
+    bool mipmaps = (soilFlags & SOIL_FLAG_MIPMAPS) != 0;
+    size_t faceBytes = MipChainBytes(width, height, faces[0]->channels, mipmaps);
+
+    // Different file names can still hold the same picture. The 2D form is only ever
+    // handed to callers that passed 'info', so it's cached under the same flag as above,
+    // and one made by an earlier call is reused.
+    for (int i = 1; i < 6 && info != nullptr && !sameFaces; i++)
+    {
+        if (faces[i] != faces[0] && memcmp(faces[i]->pixels, faces[0]->pixels, (size_t)width * height * faces[0]->channels) != 0)
+            break;
+        sameFaces = i == 5;
+        if (sameFaces)
+        {
+            key.flags |= 0x80000000u;
+            texture = FindTexture(key, info);
+            if (texture != 0)
+                return texture;
+        }
+    }
+
+    if (sameFaces)
+    {   // Store the picture once. A texture view can't repeat one layer as six cube faces,
+        // so this is a plain 2D texture and skybox.frag does the face lookup itself.
+        {
+            std::lock_guard<std::mutex> lock(soilMutex);
+            texture = SOIL_create_OGL_texture(faces[0]->pixels, width, height, faces[0]->channels, SOIL_CREATE_NEW_ID,
+                soilFlags & (SOIL_FLAG_MIPMAPS | SOIL_FLAG_INVERT_Y));
+            GLState::Invalidate();
+            if (texture == 0)
+            {
+                printf("can't create texture %s: %s\n", names[0], SOIL_last_result());
+                return 0;
+            }
+        }
+
+        GLState::BindTexture(0, GL_TEXTURE_2D, texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        info->target = GL_TEXTURE_2D;
+        info->bytes = faceBytes;
+        info->bytesSaved = faceBytes * 5;
+        printf("Cubemap %s uses one image for all faces, saved %.2f MB\n", names[0], info->bytesSaved / (1024.0 * 1024.0));
+
+        AddTexture(key, texture, info);
+        return texture;
+    }
+
+    glGenTextures(1, &texture);
+    GLState::BindTexture(0, GL_TEXTURE_CUBE_MAP, texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    std::vector<unsigned char> flipped;
+    for (int i = 0; i < 6; i++)
+    {
+        const unsigned char* pixels = faces[i]->pixels;
+        if (soilFlags & SOIL_FLAG_INVERT_Y)
+        {
+            size_t row = (size_t)width * faces[i]->channels;
+            flipped.resize(row * height);
+            for (int y = 0; y < height; y++)
+                memcpy(&flipped[y * row], pixels + (height - 1 - y) * row, row);
+            pixels = &flipped[0];
+        }
+        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, pixels);
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    if (mipmaps)
+        glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, mipmaps ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+    CubemapInfo cubeInfo;
+    cubeInfo.target = GL_TEXTURE_CUBE_MAP;
+    cubeInfo.bytes = faceBytes * 6;
+    cubeInfo.bytesSaved = 0;
+    if (info)
+        *info = cubeInfo;
+
+    AddTexture(key, texture, &cubeInfo);
+    return texture;
+}
+
+void TextureCache::Release(GLuint texture)
+{
+    std::map<GLuint, TextureKey>::iterator keyItr = textureKeys.find(texture);
+    if (keyItr == textureKeys.end())
+    {   // Not one of ours (e.g. a baked texture), so nobody else is sharing it
+        if (texture != 0)
+            GLState::DeleteTextures(1, &texture);
+        return;
+    }
+
+    std::map<TextureKey, TextureEntry>::iterator itr = textures.find(keyItr->second);
+    if (--itr->second.refCount > 0)
+        return;
+
+    GLState::DeleteTextures(1, &texture);
+    textures.erase(itr);
+    textureKeys.erase(keyItr);
+}
+
+void TextureCache::TrimImages()
+{
+    for (std::map<ImageKey, ImageRef>::iterator itr = images.begin(); itr != images.end(); )
+    {
+        if (itr->second.use_count() == 1)
+            itr = images.erase(itr);
+        else
+            ++itr;
+    }
+}
+
+void TextureCache::PrintStats()
+{
+    printf("Texture cache: %d decodes (%d shared), %d uploads (%d shared), %d textures live\n",
+        decodes, imageHits, uploads, textureHits, (int)textures.size());
+}
@@ -0,0 +1,109 @@
+/**************************************************
+ *
+ *                 texturecache.h
+ *
+ *  Deduplicates texture loads. Decoded images are
+ *  keyed by (canonical path, modification time,
+ *  channels) and GL textures additionally by the
+ *  SOIL flags, so asking for the same file twice
+ *  costs one decode and one upload. Both are
+ *  reference counted.
+ *
+ ***************************************************/
+
+#ifndef TEXTURECACHE_H
+#define TEXTURECACHE_H
+
+#include <GL/gl3w.h>
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+struct DecodedImage
+{
+    unsigned char* pixels;  // Owned, freed with SOIL_free_image_data
+    int width, height, channels;
+
+    ~DecodedImage();
+};
+
+typedef std::shared_ptr<const DecodedImage> ImageRef;
+
+struct CubemapInfo
+{
+    GLenum target;      // GL_TEXTURE_CUBE_MAP, or GL_TEXTURE_2D when all six faces are the same image
+    size_t bytes;       // GPU memory used, including mips
+    size_t bytesSaved;  // Compared to storing six separate faces
+};
+
+class TextureCache
+{
+public:
+    // Drop-in replacements for SOIL_load_OGL_texture and SOIL_load_OGL_cubemap.
+    // Every successful call adds a reference that Release gives back.
+    //
+    // Callers that pass 'info' to LoadCubemap can handle a single image cubemap:
+    // when all six faces are the same picture it is stored once as a 2D texture
+    // (info->target == GL_TEXTURE_2D) and the shader samples it by direction
+    // instead of through a samplerCube. See skybox.frag.
+    static GLuint LoadTexture(const char* fileName, int forceChannels, unsigned int soilFlags);
+    static GLuint LoadCubemap(const char* posx, const char* negx, const char* posy,
+                              const char* negy, const char* posz, const char* negz,
+                              int forceChannels, unsigned int soilFlags, CubemapInfo* info = nullptr);
+
+    // Decoded pixels, shared between everyone asking for the same file. Returns null on failure.
+    static ImageRef LoadImage(const char* fileName, int forceChannels);
+
+    // Drops one reference, the texture is deleted with the last one.
+    // Textures that didn't come from the cache are deleted straight away.
+    static void Release(GLuint texture);
+
+    // Frees decoded images that only the cache is holding on to. Call once loading is done.
+    static void TrimImages();
+
+    static void PrintStats();
+
+    // SOIL isn't thread safe and keeps its last error in a global. Every SOIL call that
+    // could overlap the streamer's worker holds this, along with its SOIL_last_result.
+    static std::mutex soilMutex;
+
+private:
+    struct ImageKey
+    {
+        std::string path;
+        long long mtime;
+        int channels;
+        bool operator<(const ImageKey& o) const;
+    };
+
+    struct TextureKey
+    {
+        std::string faces[6];   // Canonical paths, only faces[0] used for 2D textures
+        long long mtime[6];
+        int channels;
+        unsigned int flags;
+        bool operator<(const TextureKey& o) const;
+    };
+
+    struct TextureEntry
+    {
+        GLuint texture;
+        int refCount;
+        CubemapInfo info;
+    };
+
+    static bool MakeImageKey(const char* fileName, int forceChannels, ImageKey& key);
+    static bool MakeTextureKey(const char* fileName, int forceChannels, unsigned int soilFlags, TextureKey& key);
+    static GLuint FindTexture(const TextureKey& key, CubemapInfo* info = nullptr);
+    static void AddTexture(const TextureKey& key, GLuint texture, const CubemapInfo* info = nullptr);
+
+    static std::map<ImageKey, ImageRef> images;
+    static std::map<TextureKey, TextureEntry> textures;
+    static std::map<GLuint, TextureKey> textureKeys;
+
+    static int decodes, imageHits, uploads, textureHits;
+};
+
+#endif
@@ -0,0 +1,142 @@
+/*****************************************
+ *
+ *           texturefile.cpp
+ *
+ *  Reading and writing of the baked texture
+ *  container. Nothing in here touches OpenGL
+ *  so the baking tool can share it.
+ *
+ ****************************************/
+
+#include "texturefile.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static const char btexMagic[4] = { 'B', 'T', 'E', 'X' };
+
+unsigned int BakedBlockBytes(BakedFormat format)
+{
+    return format == BTEX_BC1 ? 8 : 16;
+}
+
+size_t BakedLevelSize(BakedFormat format, unsigned int width, unsigned int height)
+{
+    size_t blocksX = (width + 3) / 4;
+    size_t blocksY = (height + 3) / 4;
+    if (blocksX == 0) blocksX = 1;
+    if (blocksY == 0) blocksY = 1;
+    return blocksX * blocksY * BakedBlockBytes(format);
+}
+
+bool ParseBakedTexture(const unsigned char* data, size_t size, BakedTextureView& view, const char* fileName)
+{
+    if (size < sizeof(BakedTextureHeader))
+    {
+        printf("baked texture too small: %s\n", fileName);
+        return false;
+    }
+
+    const BakedTextureHeader* header = (const BakedTextureHeader*)data;
+    if (memcmp(header->magic, btexMagic, 4) != 0 || header->version != BTEX_VERSION)
+    {
+        printf("not a baked texture (or wrong version): %s\n", fileName);
+        return false;
+    }
+
+    if (header->format < BTEX_BC1 || header->format > BTEX_BC5 ||
+        header->width == 0 || header->height == 0 ||
+        header->levels == 0 || header->levels > 32 ||
+        (header->faces != 1 && header->faces != 6))
+    {
+        printf("baked texture has a bad header: %s\n", fileName);
+        return false;
+    }
+
+    size_t count = (size_t)header->levels * header->faces;
+    if (size < sizeof(BakedTextureHeader) + count * sizeof(BakedTextureLevel))
+    {
+        printf("baked texture level table is truncated: %s\n", fileName);
+        return false;
+    }
+
+    const BakedTextureLevel* levels = (const BakedTextureLevel*)(data + sizeof(BakedTextureHeader));
+    for (unsigned int level = 0; level < header->levels; level++)
+    {
+        unsigned int w = header->width >> level;  if (w == 0) w = 1;
+        unsigned int h = header->height >> level; if (h == 0) h = 1;
+        size_t expected = BakedLevelSize((BakedFormat)header->format, w, h);
+
+        for (unsigned int face = 0; face < header->faces; face++)
+        {
+            const BakedTextureLevel& l = levels[level * header->faces + face];
+            if (l.size != expected || l.offset > size || l.size > size - l.offset)
+            {
+                printf("baked texture level %u face %u is out of range: %s\n", level, face, fileName);
+                return false;
+            }
+        }
+    }
+
+    view.header = header;
+    view.levels = levels;
+    view.base = data;
+    return true;
+}
+
+bool WriteBakedTexture(const char* fileName, BakedFormat format, unsigned int width, unsigned int height,
+    unsigned int faces, unsigned int flags, const std::vector< std::vector<unsigned char> >& levelData)
+{
+    if (faces == 0 || levelData.empty() || levelData.size() % faces != 0)
+    {
+        printf("can't write baked texture %s: level count doesn't match the faces\n", fileName);
+        return false;
+    }
+
+    BakedTextureHeader header;
+    memcpy(header.magic, btexMagic, 4);
+    header.version = BTEX_VERSION;
+    header.format = format;
+    header.width = width;
+    header.height = height;
+    header.levels = (uint32_t)(levelData.size() / faces);
+    header.faces = faces;
+    header.flags = flags;
+
+    // Work out where each level lands, keeping every level 16 byte aligned
+    std::vector<BakedTextureLevel> table(levelData.size());
+    uint64_t offset = sizeof(header) + table.size() * sizeof(BakedTextureLevel);
+    for (size_t i = 0; i < levelData.size(); i++)
+    {
+        offset = (offset + 15) & ~(uint64_t)15;
+        table[i].offset = offset;
+        table[i].size = levelData[i].size();
+        offset += levelData[i].size();
+    }
+
+    FILE* fid = fopen(fileName, "wb");
+    if (fid == NULL)
+    {
+        printf("can't open baked texture for writing: %s\n", fileName);
+        return false;
+    }
+
+    fwrite(&header, sizeof(header), 1, fid);
+    fwrite(&table[0], sizeof(BakedTextureLevel), table.size(), fid);
+
+    static const unsigned char padding[16] = { 0 };
+    uint64_t written = sizeof(header) + table.size() * sizeof(BakedTextureLevel);
+    for (size_t i = 0; i < levelData.size(); i++)
+    {
+        fwrite(padding, 1, (size_t)(table[i].offset - written), fid);
+        fwrite(levelData[i].data(), 1, levelData[i].size(), fid);
+        written = table[i].offset + table[i].size;
+    }
+
+    bool ok = ferror(fid) == 0;
+    fclose(fid);
+
+    if (!ok)
+        printf("error writing baked texture: %s\n", fileName);
+    return ok;
+}
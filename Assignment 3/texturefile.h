@@ -0,0 +1,86 @@
+/**************************************************
+ *
+ *                 texturefile.h
+ *
+ *  The baked texture container (*.btex). This is a
+ *  small KTX-like file holding block compressed data
+ *  for every mip level (and every face of a cubemap),
+ *  laid out so the runtime can upload it straight
+ *  out of a memory mapping.
+ *
+ *  Layout:
+ *      BakedTextureHeader
+ *      BakedTextureLevel[levels * faces]   (level major)
+ *      block data, each level 16 byte aligned
+ *
+ *  All values are little endian.
+ *
+ ***************************************************/
+
+#ifndef TEXTUREFILE_H
+#define TEXTUREFILE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#define BTEX_VERSION 1
+
+#define BTEX_FLAG_SRGB          0x1 // Colour data is sRGB encoded, uploaded with an sRGB format
+#define BTEX_FLAG_LINEAR_MIPS   0x2 // Mips were averaged in linear light, however they're sampled
+
+enum BakedFormat
+{
+    BTEX_BC1 = 1,   // RGB, 8 bytes per 4x4 block
+    BTEX_BC3 = 2,   // RGBA, 16 bytes per 4x4 block
+    BTEX_BC5 = 3,   // Two channel (RG), 16 bytes per 4x4 block
+};
+
+struct BakedTextureHeader
+{
+    char     magic[4];  // "BTEX"
+    uint32_t version;
+    uint32_t format;    // BakedFormat
+    uint32_t width;
+    uint32_t height;
+    uint32_t levels;    // Number of mip levels stored
+    uint32_t faces;     // 1 for a 2D texture, 6 for a cubemap
+    uint32_t flags;     // BTEX_FLAG_*
+};
+
+struct BakedTextureLevel
+{
+    uint64_t offset;    // From the start of the file
+    uint64_t size;      // In bytes
+};
+
+// A validated view into a baked file that lives somewhere in memory (usually a mapping)
+struct BakedTextureView
+{
+    const BakedTextureHeader* header;
+    const BakedTextureLevel* levels;    // header->levels * header->faces entries
+    const unsigned char* base;          // Start of the file
+
+    const unsigned char* LevelData(unsigned int level, unsigned int face) const
+    {
+        return base + levels[level * header->faces + face].offset;
+    }
+    size_t LevelSize(unsigned int level, unsigned int face) const
+    {
+        return (size_t)levels[level * header->faces + face].size;
+    }
+};
+
+// Size in bytes of one level of a block compressed image
+size_t BakedLevelSize(BakedFormat format, unsigned int width, unsigned int height);
+unsigned int BakedBlockBytes(BakedFormat format);
+
+// Checks the header and level table against the file size. Returns false and
+// prints the reason if the data isn't a well formed baked texture.
+bool ParseBakedTexture(const unsigned char* data, size_t size, BakedTextureView& view, const char* fileName);
+
+// levelData holds levels * faces compressed images, level major
+bool WriteBakedTexture(const char* fileName, BakedFormat format, unsigned int width, unsigned int height,
+    unsigned int faces, unsigned int flags, const std::vector< std::vector<unsigned char> >& levelData);
+
+#endif
@@ -0,0 +1,94 @@
+/*****************************************
+ *
+ *           textureloader.cpp
+ *
+ *  Uploads baked textures from a mapping.
+ *
+ ****************************************/
+
+#include "textureloader.h"
+#include "texturefile.h"
+#include "mappedfile.h"
+#include "glstate.h"
+
+#include <stdio.h>
+
+// S3TC isn't part of core GL, so gl3w's header doesn't always define these
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT         0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT        0x83F3
+#endif
+#ifndef GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT        0x8C4C
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT  0x8C4F
+#endif
+
+static GLenum BakedInternalFormat(const BakedTextureHeader* header)
+{
+    bool srgb = (header->flags & BTEX_FLAG_SRGB) != 0;
+    switch (header->format)
+    {
+    case BTEX_BC1: return srgb ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    case BTEX_BC3: return srgb ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    case BTEX_BC5: return GL_COMPRESSED_RG_RGTC2;
+    }
+    return GL_NONE;
+}
+
+GLuint LoadBakedTexture(const char* fileName, BakedTextureInfo* info)
+{
+    MappedFile file;
+    if (!file.Open(fileName))
+        return 0; // Not baked, the caller can fall back to the source image
+
+    BakedTextureView view;
+    if (!ParseBakedTexture(file.Data(), file.Size(), view, fileName))
+        return 0;
+
+    const BakedTextureHeader* header = view.header;
+    GLenum target = header->faces == 6 ? GL_TEXTURE_CUBE_MAP : GL_TEXTURE_2D;
+    GLenum internalFormat = BakedInternalFormat(header);
+
+    GLuint texture;
+    glGenTextures(1, &texture);
+    GLState::BindTexture(0, target, texture);
+
+    // Every level comes straight out of the mapping, the driver copies it during the call
+    size_t bytes = 0;
+    for (unsigned int level = 0; level < header->levels; level++)
+    {
+        GLsizei w = header->width >> level;  if (w == 0) w = 1;
+        GLsizei h = header->height >> level; if (h == 0) h = 1;
+
+        for (unsigned int face = 0; face < header->faces; face++)
+        {
+            GLenum faceTarget = header->faces == 6 ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + face : GL_TEXTURE_2D;
+            glCompressedTexImage2D(faceTarget, level, internalFormat, w, h, 0,
+                (GLsizei)view.LevelSize(level, face), view.LevelData(level, face));
+            bytes += view.LevelSize(level, face);
+        }
+    }
+
+    GLenum wrap = target == GL_TEXTURE_CUBE_MAP ? GL_CLAMP_TO_EDGE : GL_REPEAT;
+    glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, header->levels - 1);
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, header->levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(target, GL_TEXTURE_WRAP_S, wrap);
+    glTexParameteri(target, GL_TEXTURE_WRAP_T, wrap);
+    if (target == GL_TEXTURE_CUBE_MAP)
+        glTexParameteri(target, GL_TEXTURE_WRAP_R, wrap);
+
+
+    if (info)
+    {
+        info->target = target;
+        info->internalFormat = internalFormat;
+        info->width = header->width;
+        info->height = header->height;
+        info->levels = header->levels;
+        info->bytes = bytes;
+    }
+
+    return texture;
+}
@@ -0,0 +1,30 @@
+/**************************************************
+ *
+ *                 textureloader.h
+ *
+ *  Loads baked textures (see texturefile.h) into
+ *  OpenGL. There is no decoding or compression at
+ *  runtime, each level is uploaded straight from
+ *  the memory mapped file.
+ *
+ ***************************************************/
+
+#ifndef TEXTURELOADER_H
+#define TEXTURELOADER_H
+
+#include <GL/gl3w.h>
+#include <cstddef>
+
+struct BakedTextureInfo
+{
+    GLenum target;          // GL_TEXTURE_2D or GL_TEXTURE_CUBE_MAP
+    GLenum internalFormat;
+    int width, height;
+    int levels;
+    size_t bytes;           // Compressed size of all levels and faces
+};
+
+// Returns 0 if the file is missing or malformed. 'info' is optional.
+GLuint LoadBakedTexture(const char* fileName, BakedTextureInfo* info = nullptr);
+
+#endif
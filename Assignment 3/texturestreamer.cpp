@@ -0,0 +1,358 @@
+/*****************************************
+ *
+ *           texturestreamer.cpp
+ *
+ *  Mip streaming under a memory budget.
+ *
+ ****************************************/
+
+#include "texturestreamer.h"
+#include "glstate.h"
+
+#include <math.h>
+#include <stdio.h>
+
+// How long a texture may hold more detail than it needs before it's trimmed back.
+// Long enough that turning the camera around doesn't thrash.
+#define TRIM_DELAY_FRAMES 60
+
+std::vector< std::unique_ptr<TextureStreamer::StreamedTexture> > TextureStreamer::textures;
+size_t TextureStreamer::budget = 0;
+size_t TextureStreamer::resident = 0;
+unsigned int TextureStreamer::frame = 0;
+int TextureStreamer::streamedIn = 0;
+int TextureStreamer::evicted = 0;
+size_t TextureStreamer::bytesUploaded = 0;
+
+std::thread TextureStreamer::worker;
+std::mutex TextureStreamer::mutex;
+std::condition_variable TextureStreamer::wake;
+std::deque< std::unique_ptr<TextureStreamer::StreamJob> > TextureStreamer::jobs;
+std::deque< std::unique_ptr<TextureStreamer::StreamJob> > TextureStreamer::finished;
+bool TextureStreamer::running = false;
+
+void TextureStreamer::Start(size_t budgetBytes)
+{
+    budget = budgetBytes;
+    running = true;
+    worker = std::thread(WorkerMain);
+}
+
+void TextureStreamer::Shutdown()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    wake.notify_all();
+    if (worker.joinable())
+        worker.join();
+
+    jobs.clear();
+    finished.clear();
+
+    for (size_t i = 0; i < textures.size(); i++)
+        if (textures[i]->texture != 0)
+            GLState::DeleteTextures(1, &textures[i]->texture);
+    textures.clear();
+    resident = 0;
+}
+
+int TextureStreamer::Add(const TextureArrayBuilder& source)
+{
+    std::unique_ptr<StreamedTexture> t(new StreamedTexture(source));
+    t->texture = 0;
+    t->levels = source.Levels();
+    t->residentTop = t->levels;
+    t->desiredTop = t->levels - 1;
+    t->decoding = false;
+    t->maxPixels = 0.0f;
+    t->lastUsed = frame;
+    t->finerSince = frame;
+    t->bytes = 0;
+    printf("texture streamer: %d layers, %d baked\n", source.Layers(), source.BakedLayers());
+
+    // The name is kept for good, only the levels in it come and go
+    glGenTextures(1, &t->texture);
+    GLState::BindTexture(0, GL_TEXTURE_2D_ARRAY, t->texture);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, t->levels - 1);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    // Something to show in the first frame, it's only a few kilobytes per layer
+    LevelData preview;
+    int top = source.BuildPreviewLevels(preview);
+    for (int level = top; level < t->levels; level++)
+        UploadLevel(*t, level, preview[level - top]);
+    SetTop(*t, top);
+
+    textures.push_back(std::move(t));
+    return (int)textures.size() - 1;
+}
+
+GLuint TextureStreamer::Texture(int handle)
+{
+    if (handle < 0 || handle >= (int)textures.size())
+        return 0;
+    return textures[handle]->texture;
+}
+
+void TextureStreamer::RequestResolution(int handle, float pixelsAcross)
+{
+    if (handle < 0 || handle >= (int)textures.size())
+        return;
+
+    StreamedTexture& t = *textures[handle];
+    if (pixelsAcross > t.maxPixels)
+        t.maxPixels = pixelsAcross;
+    t.lastUsed = frame;
+}
+
+size_t TextureStreamer::LevelBytes(const StreamedTexture& t, int level)
+{
+    return t.source.LevelBytes(level);
+}
+
+size_t TextureStreamer::ChainBytes(const StreamedTexture& t, int top)
+{
+    size_t bytes = 0;
+    for (int level = top; level < t.levels; level++)
+        bytes += LevelBytes(t, level);
+    return bytes;
+}
+
+// Specifies one level of the texture, the others are left as they are. Levels are only
+// given storage once they're used, so the budget stays a real limit on GPU memory.
+void TextureStreamer::UploadLevel(StreamedTexture& t, int level, const std::vector<unsigned char>& data)
+{
+    GLsizei w = t.source.Width() >> level;  if (w == 0) w = 1;
+    GLsizei h = t.source.Height() >> level; if (h == 0) h = 1;
+    GLState::BindTexture(0, GL_TEXTURE_2D_ARRAY, t.texture);
+    if (t.source.Compressed())
+        glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, t.source.InternalFormat(), w, h, t.source.Layers(),
+            0, (GLsizei)data.size(), &data[0]);
+    else
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8, w, h, t.source.Layers(),
+            0, GL_RGBA, GL_UNSIGNED_BYTE, &data[0]);
+    bytesUploaded += data.size();
+}
+
+// Samples from 'top' down. Levels above the base level don't count towards completeness,
+// so the ones not uploaded yet (or given back) don't matter.
+void TextureStreamer::SetTop(StreamedTexture& t, int top)
+{
+    GLState::BindTexture(0, GL_TEXTURE_2D_ARRAY, t.texture);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, top);
+
+    size_t bytes = ChainBytes(t, top);
+    resident = resident - t.bytes + bytes;
+    t.bytes = bytes;
+    t.residentTop = top;
+}
+
+// Gives back the finest resident level. It's re-specified as empty so the driver can free
+// it, the decoded chain has it if it's wanted again.
+bool TextureStreamer::DropLevel(StreamedTexture& t)
+{
+    if (t.residentTop >= t.levels - 1)
+        return false;
+
+    int level = t.residentTop;
+    SetTop(t, level + 1);
+    if (t.source.Compressed())
+        glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, t.source.InternalFormat(), 0, 0, 0, 0, 0, NULL);
+    else
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8, 0, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    evicted++;
+    return true;
+}
+
+// Drops levels, least recently used textures first, until bytesNeeded more fits in the
+// budget. Textures holding more than they currently need go before anything else. The
+// ones used this frame are only touched when allowUsed is set, otherwise they would
+// just stream straight back in.
+bool TextureStreamer::EvictFor(size_t bytesNeeded, int keep, bool allowUsed)
+{
+    while (resident + bytesNeeded > budget)
+    {
+        StreamedTexture* victim = nullptr;
+        for (size_t i = 0; i < textures.size(); i++)
+        {
+            StreamedTexture& t = *textures[i];
+            if ((int)i == keep || t.residentTop >= t.levels - 1)
+                continue;
+            if (!allowUsed && t.lastUsed == frame)
+                continue;
+
+            if (victim == nullptr)
+            {
+                victim = &t;
+                continue;
+            }
+
+            bool overDetailed = t.residentTop < t.desiredTop;
+            bool victimOverDetailed = victim->residentTop < victim->desiredTop;
+            if (overDetailed != victimOverDetailed ? overDetailed : t.lastUsed < victim->lastUsed)
+                victim = &t;
+        }
+
+        if (victim == nullptr || !DropLevel(*victim))
+            return false;
+    }
+    return true;
+}
+
+void TextureStreamer::Update()
+{
+    // Keep the chains the worker finished since last frame. The resident levels are still
+    // the preview, so they're swapped for the real thing, it's the same size.
+    std::deque< std::unique_ptr<StreamJob> > done;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        done.swap(finished);
+    }
+
+    for (size_t j = 0; j < done.size(); j++)
+    {
+        StreamJob& job = *done[j];
+        StreamedTexture& t = *textures[job.handle];
+
+        t.chain.swap(job.levels);
+        t.decoding = false;
+        for (int level = t.residentTop; level < t.levels; level++)
+            UploadLevel(t, level, t.chain[level]);
+    }
+
+    for (size_t i = 0; i < textures.size(); i++)
+    {
+        StreamedTexture& t = *textures[i];
+
+        // The level where one texel lands on about one pixel
+        if (t.maxPixels > 0.0f)
+        {
+            float ratio = t.source.Width() / t.maxPixels;
+            int level = ratio > 1.0f ? (int)floorf(log2f(ratio)) : 0;
+            t.desiredTop = level < t.levels - 1 ? level : t.levels - 1;
+        }
+        else if (frame - t.lastUsed > TRIM_DELAY_FRAMES)
+        {
+            t.desiredTop = t.levels - 1; // Not drawn lately, only keep the tail
+        }
+        t.maxPixels = 0.0f;
+
+        // Trim textures that have held more detail than needed for a while, a level per frame
+        if (t.residentTop >= t.desiredTop)
+            t.finerSince = frame;
+        else if (frame - t.finerSince > TRIM_DELAY_FRAMES)
+            DropLevel(t);
+    }
+
+    // The budget can go down at any time
+    EvictFor(0, -1, true);
+
+    // Everything that wants more detail gets one level finer per frame, as long as it can
+    // be made to fit without touching textures in use this frame. The first time, the
+    // chain has to be decoded, and that happens once whatever level ends up being used.
+    for (size_t i = 0; i < textures.size(); i++)
+    {
+        StreamedTexture& t = *textures[i];
+        if (t.decoding || t.desiredTop >= t.residentTop)
+            continue;
+
+        if (t.chain.empty())
+        {
+            t.decoding = true;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                jobs.push_back(std::unique_ptr<StreamJob>(new StreamJob((int)i, t.source)));
+            }
+            wake.notify_one();
+            continue;
+        }
+
+        int level = t.residentTop - 1;
+        if (EvictFor(LevelBytes(t, level), (int)i, false))
+        {
+            UploadLevel(t, level, t.chain[level]);
+            SetTop(t, level);
+            streamedIn++;
+        }
+    }
+
+    frame++;
+}
+
+void TextureStreamer::WorkerMain()
+{
+    for (;;)
+    {
+        std::unique_ptr<StreamJob> job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [] { return !running || !jobs.empty(); });
+            if (!running)
+                return;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+
+        job->source.BuildLevels(0, job->levels);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        finished.push_back(std::move(job));
+    }
+}
+
+void TextureStreamer::SetBudget(size_t bytes)
+{
+    budget = bytes;
+}
+
+TextureStreamerStats TextureStreamer::Stats()
+{
+    TextureStreamerStats stats;
+    stats.budget = budget;
+    stats.resident = resident;
+    stats.cpuCopies = 0;
+    stats.textures = (int)textures.size();
+    stats.pendingJobs = 0;
+    stats.streamedIn = streamedIn;
+    stats.evicted = evicted;
+    stats.bytesUploaded = bytesUploaded;
+
+    for (size_t i = 0; i < textures.size(); i++)
+    {
+        const StreamedTexture& t = *textures[i];
+        for (size_t level = 0; level < t.chain.size(); level++)
+            stats.cpuCopies += t.chain[level].size();
+        if (t.decoding)
+            stats.pendingJobs++;
+    }
+    return stats;
+}
+
+int TextureStreamer::ResidentLevel(int handle)
+{
+    if (handle < 0 || handle >= (int)textures.size())
+        return -1;
+    return textures[handle]->residentTop;
+}
+
+int TextureStreamer::DesiredLevel(int handle)
+{
+    if (handle < 0 || handle >= (int)textures.size())
+        return -1;
+    return textures[handle]->desiredTop;
+}
+
+void TextureStreamer::PrintStats()
+{
+    TextureStreamerStats stats = Stats();
+    const double mb = 1024.0 * 1024.0;
+    printf("texture streamer: %d textures, %.1f / %.1f MB resident, %.1f MB cpu copies, %d pending, "
+           "%d streamed in, %d evicted, %.1f MB uploaded\n",
+        stats.textures, stats.resident / mb, stats.budget / mb, stats.cpuCopies / mb, stats.pendingJobs,
+        stats.streamedIn, stats.evicted, stats.bytesUploaded / mb);
+}
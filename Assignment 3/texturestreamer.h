@@ -0,0 +1,125 @@
+/**************************************************
+ *
+ *               texturestreamer.h
+ *
+ *  Keeps only the mip levels that are actually
+ *  visible resident on the GPU. Every frame the
+ *  objects using a texture report how big it is on
+ *  screen. The first time a texture needs more than
+ *  its preview, its whole chain is decoded once on
+ *  a worker thread and kept, finer levels are
+ *  uploaded from that copy as they're needed, and
+ *  the least recently used textures give detail
+ *  back when the memory budget is exceeded.
+ *
+ *  Streamed textures are texture arrays (a single
+ *  image is a one layer array), described by a
+ *  TextureArrayBuilder.
+ *
+ ***************************************************/
+
+#ifndef TEXTURESTREAMER_H
+#define TEXTURESTREAMER_H
+
+#include <GL/gl3w.h>
+
+#include "texturearray.h"
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct TextureStreamerStats
+{
+    size_t budget;          // In bytes
+    size_t resident;        // GPU memory used by streamed textures
+    size_t cpuCopies;       // Decoded chains kept in memory, so detail comes back without another decode
+    int textures;
+    int pendingJobs;        // Textures still being decoded
+    int streamedIn;         // Totals since Start
+    int evicted;
+    size_t bytesUploaded;
+};
+
+class TextureStreamer
+{
+public:
+    static void Start(size_t budgetBytes);
+    static void Shutdown();     // Stops the worker and deletes every streamed texture
+
+    // Takes a copy of the layer list and returns a handle. The texture starts out with
+    // a preview built from the layers' thumbnails, so it can be drawn straight away,
+    // and the real levels stream in after that.
+    static int Add(const TextureArrayBuilder& source);
+
+    // The texture name stays the same, only its base level moves as levels come and go
+    static GLuint Texture(int handle);
+
+    // Called for every object using the texture this frame. pixelsAcross is how many
+    // screen pixels the full width of the texture would cover on that object.
+    static void RequestResolution(int handle, float pixelsAcross);
+
+    // Once per frame on the GL thread, after the requests: picks the levels each texture
+    // needs, uploads finished decodes, queues new ones and evicts down to the budget.
+    static void Update();
+
+    static void SetBudget(size_t bytes);
+    static TextureStreamerStats Stats();
+    static int ResidentLevel(int handle);   // Finest level on the GPU, or the level count if none
+    static int DesiredLevel(int handle);
+    static void PrintStats();
+
+private:
+    typedef std::vector< std::vector<unsigned char> > LevelData;
+
+    struct StreamedTexture
+    {
+        TextureArrayBuilder source;
+        GLuint texture;
+        int levels;             // Length of the full chain
+        int residentTop;        // Finest level on the GPU, 'levels' when nothing is resident
+        int desiredTop;
+        bool decoding;          // A job is building 'chain'
+        float maxPixels;        // Largest request this frame
+        unsigned int lastUsed;  // Frame of the last request
+        unsigned int finerSince;// Frame the resident level became finer than needed
+        size_t bytes;           // On the GPU
+        LevelData chain;        // Every level, empty until the worker has decoded it
+
+        StreamedTexture(const TextureArrayBuilder& source) : source(source) {}
+    };
+
+    struct StreamJob
+    {
+        int handle;
+        TextureArrayBuilder source;     // Copied, so the worker never touches 'textures'
+        LevelData levels;
+
+        StreamJob(int handle, const TextureArrayBuilder& source) : handle(handle), source(source) {}
+    };
+
+    static size_t LevelBytes(const StreamedTexture& t, int level);
+    static size_t ChainBytes(const StreamedTexture& t, int top);
+    static void UploadLevel(StreamedTexture& t, int level, const std::vector<unsigned char>& data);
+    static void SetTop(StreamedTexture& t, int top);
+    static bool DropLevel(StreamedTexture& t);
+    static bool EvictFor(size_t bytesNeeded, int keep, bool allowUsed);
+    static void WorkerMain();
+
+    static std::vector< std::unique_ptr<StreamedTexture> > textures;
+    static size_t budget, resident;
+    static unsigned int frame;
+    static int streamedIn, evicted;
+    static size_t bytesUploaded;
+
+    static std::thread worker;
+    static std::mutex mutex;                // Guards the two queues and 'running'
+    static std::condition_variable wake;
+    static std::deque< std::unique_ptr<StreamJob> > jobs, finished;
+    static bool running;
+};
+
+#endif
@@ -0,0 +1,119 @@
+/*****************************************
+ *
+ *           threadpool.cpp
+ *
+ *  Worker threads for ParallelFor.
+ *
+ ****************************************/
+
+#include "threadpool.h"
+
+#include <algorithm>
+
+std::vector<std::thread> ThreadPool::workers;
+std::mutex ThreadPool::mutex;
+std::condition_variable ThreadPool::wake;
+std::condition_variable ThreadPool::finished;
+std::deque<ThreadPool::Loop*> ThreadPool::loops;
+int ThreadPool::threads = 0;
+bool ThreadPool::running = false;
+unsigned int ThreadPool::generation = 0;
+
+// Called with the mutex held
+void ThreadPool::StartWorkers()
+{
+    int total = threads > 0 ? threads : (int)std::thread::hardware_concurrency();
+    running = true;
+    for (int i = 1; i < total; i++)
+        workers.push_back(std::thread(WorkerMain, generation));
+}
+
+void ThreadPool::ParallelFor(int count, const std::function<void(int)>& body)
+{
+    if (count <= 0)
+        return;
+    if (count == 1)
+    {
+        body(0);
+        return;
+    }
+
+    Loop loop = { &body, count, 0, 0 };
+
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!running)
+        StartWorkers();
+
+    loops.push_back(&loop);
+    wake.notify_all();
+
+    // Work on our own loop rather than waiting, this is what makes nesting safe
+    while (loop.next < loop.count)
+    {
+        int i = loop.next++;
+        if (loop.next == loop.count)
+            loops.erase(std::find(loops.begin(), loops.end(), &loop));
+
+        lock.unlock();
+        body(i);
+        lock.lock();
+        loop.done++;
+    }
+
+    finished.wait(lock, [&loop] { return loop.done == loop.count; });
+}
+
+void ThreadPool::SetThreads(int count)
+{
+    Shutdown();
+    std::lock_guard<std::mutex> lock(mutex);
+    threads = count;
+}
+
+int ThreadPool::Threads()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (running)
+        return (int)workers.size() + 1;
+    int total = threads > 0 ? threads : (int)std::thread::hardware_concurrency();
+    return total > 0 ? total : 1;
+}
+
+void ThreadPool::Shutdown()
+{
+    std::vector<std::thread> stopping;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+        generation++;
+        stopping.swap(workers);
+    }
+    wake.notify_all();
+    for (size_t i = 0; i < stopping.size(); i++)
+        stopping[i].join();
+}
+
+// Workers belong to the generation they were started in, so one that's slow to notice
+// a Shutdown can't be mistaken for part of the next set
+void ThreadPool::WorkerMain(unsigned int started)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;)
+    {
+        wake.wait(lock, [started] { return generation != started || !loops.empty(); });
+        if (generation != started)
+            return;
+
+        Loop* loop = loops.front();
+        int i = loop->next++;
+        if (loop->next == loop->count)
+            loops.pop_front();
+
+        lock.unlock();
+        (*loop->body)(i);
+        lock.lock();
+
+        if (++loop->done == loop->count)
+            finished.notify_all();
+    }
+}
@@ -0,0 +1,61 @@
+/**************************************************
+ *
+ *                  threadpool.h
+ *
+ *  A fixed set of worker threads for splitting
+ *  CPU-heavy image work (mip chains, compression)
+ *  into pieces. The calling thread always works
+ *  on its own loop too, so a ParallelFor can be
+ *  issued from a loader thread, or from inside
+ *  another ParallelFor, without starving.
+ *
+ ***************************************************/
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+public:
+    // Calls body(i) for every i in [0, count) and returns once they've all finished.
+    // The workers are started on first use.
+    static void ParallelFor(int count, const std::function<void(int)>& body);
+
+    // Total threads working on a loop, counting the caller. 0 means one per core.
+    // Stops the current workers, so don't call it while a loop is running.
+    static void SetThreads(int threads);
+    static int Threads();
+
+    // Joins the workers, the next ParallelFor starts them again. Call it before exiting,
+    // threads that are still running when the statics are destroyed abort the program.
+    static void Shutdown();
+
+private:
+    struct Loop
+    {
+        const std::function<void(int)>* body;
+        int count;
+        int next;               // Next index to hand out
+        int done;
+    };
+
+    static void StartWorkers();
+    static void WorkerMain(unsigned int started);
+
+    static std::vector<std::thread> workers;
+    static std::mutex mutex;                // Guards everything below
+    static std::condition_variable wake, finished;
+    static std::deque<Loop*> loops;         // Loops with indices left to hand out
+    static int threads;
+    static bool running;
+    static unsigned int generation;         // Bumped by every Shutdown
+};
+
+#endif
@@ -0,0 +1,140 @@
+/*****************************************
+ *
+ *           tilefile.cpp
+ *
+ *  Layout and validation of the tiled
+ *  texture container. Like texturefile.cpp
+ *  it doesn't touch OpenGL, so the tiler
+ *  can share it.
+ *
+ ****************************************/
+
+#include "tilefile.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static const char vtexMagic[4] = { 'V', 'T', 'E', 'X' };
+
+unsigned int TiledTilePixels(unsigned int tileSize, unsigned int border)
+{
+    return tileSize + border * 2;
+}
+
+size_t TiledTileBytes(BakedFormat format, unsigned int tileSize, unsigned int border)
+{
+    unsigned int pixels = TiledTilePixels(tileSize, border);
+    return (BakedLevelSize(format, pixels, pixels) + 15) & ~(size_t)15;
+}
+
+void TiledTextureLayout(unsigned int width, unsigned int height, unsigned int tileSize,
+    std::vector<TiledTextureLevel>& levels)
+{
+    levels.clear();
+    uint64_t firstTile = 0;
+    for (unsigned int level = 0; ; level++)
+    {
+        unsigned int w = width >> level;  if (w == 0) w = 1;
+        unsigned int h = height >> level; if (h == 0) h = 1;
+
+        TiledTextureLevel l;
+        l.tilesX = (w + tileSize - 1) / tileSize;
+        l.tilesY = (h + tileSize - 1) / tileSize;
+        l.firstTile = firstTile;
+        levels.push_back(l);
+        firstTile += (uint64_t)l.tilesX * l.tilesY;
+
+        // Anything smaller would still take a whole tile
+        if (w <= tileSize && h <= tileSize)
+            break;
+    }
+}
+
+TiledTextureHeader MakeTiledTextureHeader(BakedFormat format, unsigned int width, unsigned int height,
+    unsigned int levels, unsigned int flags)
+{
+    TiledTextureHeader header;
+    memcpy(header.magic, vtexMagic, 4);
+    header.version = VTEX_VERSION;
+    header.format = format;
+    header.width = width;
+    header.height = height;
+    header.tileSize = VTEX_TILE_SIZE;
+    header.border = VTEX_TILE_BORDER;
+    header.levels = levels;
+    header.flags = flags;
+    header.reserved = 0;
+    return header;
+}
+
+size_t TiledTextureDataOffset(unsigned int levels)
+{
+    size_t offset = sizeof(TiledTextureHeader) + levels * sizeof(TiledTextureLevel);
+    return (offset + 15) & ~(size_t)15;
+}
+
+bool ParseTiledTexture(const unsigned char* data, size_t size, TiledTextureView& view, const char* fileName)
+{
+    if (size < sizeof(TiledTextureHeader))
+    {
+        printf("tiled texture too small: %s\n", fileName);
+        return false;
+    }
+
+    const TiledTextureHeader* header = (const TiledTextureHeader*)data;
+    if (memcmp(header->magic, vtexMagic, 4) != 0 || header->version != VTEX_VERSION)
+    {
+        printf("not a tiled texture (or wrong version): %s\n", fileName);
+        return false;
+    }
+
+    if (header->format < BTEX_BC1 || header->format > BTEX_BC5 ||
+        header->width == 0 || header->height == 0 ||
+        header->tileSize == 0 || header->tileSize % 4 != 0 || header->border % 4 != 0 ||
+        header->levels == 0 || header->levels > 32)
+    {
+        printf("tiled texture has a bad header: %s\n", fileName);
+        return false;
+    }
+
+    size_t dataOffset = TiledTextureDataOffset(header->levels);
+    if (size < dataOffset)
+    {
+        printf("tiled texture level table is truncated: %s\n", fileName);
+        return false;
+    }
+
+    // The table has to be exactly what the size says, the runtime indexes tiles with it
+    std::vector<TiledTextureLevel> expected;
+    TiledTextureLayout(header->width, header->height, header->tileSize, expected);
+    const TiledTextureLevel* levels = (const TiledTextureLevel*)(data + sizeof(TiledTextureHeader));
+    if (expected.size() != header->levels)
+    {
+        printf("tiled texture has the wrong number of levels: %s\n", fileName);
+        return false;
+    }
+    for (unsigned int level = 0; level < header->levels; level++)
+    {
+        if (levels[level].tilesX != expected[level].tilesX || levels[level].tilesY != expected[level].tilesY ||
+            levels[level].firstTile != expected[level].firstTile)
+        {
+            printf("tiled texture level %u doesn't match its size: %s\n", level, fileName);
+            return false;
+        }
+    }
+
+    const TiledTextureLevel& last = expected.back();
+    uint64_t tiles = last.firstTile + (uint64_t)last.tilesX * last.tilesY;
+    size_t tileBytes = TiledTileBytes((BakedFormat)header->format, header->tileSize, header->border);
+    if ((size - dataOffset) / tileBytes < tiles)
+    {
+        printf("tiled texture is truncated: %s\n", fileName);
+        return false;
+    }
+
+    view.header = header;
+    view.levels = levels;
+    view.tiles = data + dataOffset;
+    view.tileBytes = tileBytes;
+    return true;
+}
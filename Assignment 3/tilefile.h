@@ -0,0 +1,98 @@
+/**************************************************
+ *
+ *                  tilefile.h
+ *
+ *  The tiled texture container (*.vtex) used by
+ *  virtual textures. Every mip level is cut into
+ *  fixed size tiles with a border copied from the
+ *  neighbouring tiles, so a tile can be filtered on
+ *  its own once it's in the tile cache. Every tile
+ *  is block compressed to the same size, so one can
+ *  be found without a table.
+ *
+ *  Layout:
+ *      TiledTextureHeader
+ *      TiledTextureLevel[levels]
+ *      tiles, level major then row major, each
+ *      TiledTileBytes() long and 16 byte aligned
+ *
+ *  All values are little endian.
+ *
+ ***************************************************/
+
+#ifndef TILEFILE_H
+#define TILEFILE_H
+
+#include "texturefile.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#define VTEX_VERSION 1
+
+#define VTEX_TILE_SIZE      128     // Texels of the level in a tile, per side
+#define VTEX_TILE_BORDER    4       // Extra texels around them, enough for bilinear and BC blocks
+
+// The shader wraps or clamps across the left and right edges to match. Bit 0x1 isn't used:
+// -srgb only changes how the levels were filtered, the texels are sampled like any other map.
+#define VTEX_FLAG_WRAPX     0x2     // Left and right borders wrap around (planet maps)
+
+struct TiledTextureHeader
+{
+    char     magic[4];  // "VTEX"
+    uint32_t version;
+    uint32_t format;    // BakedFormat
+    uint32_t width;     // Of level 0
+    uint32_t height;
+    uint32_t tileSize;  // VTEX_TILE_SIZE
+    uint32_t border;    // VTEX_TILE_BORDER
+    uint32_t levels;    // Down to the first level that fits in one tile
+    uint32_t flags;     // VTEX_FLAG_*
+    uint32_t reserved;
+};
+
+struct TiledTextureLevel
+{
+    uint32_t tilesX;
+    uint32_t tilesY;
+    uint64_t firstTile; // Index of the level's top left tile
+};
+
+// A validated view into a tiled file that lives somewhere in memory (usually a mapping)
+struct TiledTextureView
+{
+    const TiledTextureHeader* header;
+    const TiledTextureLevel* levels;
+    const unsigned char* tiles;         // First tile
+    size_t tileBytes;                   // Stride between tiles
+
+    const unsigned char* TileData(unsigned int level, unsigned int x, unsigned int y) const
+    {
+        const TiledTextureLevel& l = levels[level];
+        return tiles + (l.firstTile + (uint64_t)y * l.tilesX + x) * tileBytes;
+    }
+};
+
+// Texels per side of a stored tile, the tile plus its border
+unsigned int TiledTilePixels(unsigned int tileSize, unsigned int border);
+
+// Bytes of one compressed tile, rounded up to keep the tiles 16 byte aligned
+size_t TiledTileBytes(BakedFormat format, unsigned int tileSize, unsigned int border);
+
+// Fills 'levels' with the tile grid of every level a texture of this size gets
+void TiledTextureLayout(unsigned int width, unsigned int height, unsigned int tileSize,
+    std::vector<TiledTextureLevel>& levels);
+
+// A header for the tiler to write, with the standard tile size and border
+TiledTextureHeader MakeTiledTextureHeader(BakedFormat format, unsigned int width, unsigned int height,
+    unsigned int levels, unsigned int flags);
+
+// Where the first tile starts, after the header and level table
+size_t TiledTextureDataOffset(unsigned int levels);
+
+// Checks the header and level table against the file size. Returns false and
+// prints the reason if the data isn't a well formed tiled texture.
+bool ParseTiledTexture(const unsigned char* data, size_t size, TiledTextureView& view, const char* fileName);
+
+#endif
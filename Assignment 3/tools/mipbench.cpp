@@ -0,0 +1,181 @@
+/*****************************************
+ *
+ *           mipbench.cpp
+ *
+ *  Times full mip chain generation for the
+ *  planet map sizes, comparing the old scalar
+ *  2x2 box loop against mipmapgen with each
+ *  filter, in linear and sRGB, on one thread
+ *  and on the whole pool.
+ *
+ *  Usage:
+ *    mipbench [-runs n] [-threads n] [image ...]
+ *
+ *  Without images it makes 2K, 4K and 8K
+ *  noise maps, the sizes the planets come in.
+ *
+ ****************************************/
+
+#include "../mipmapgen.h"
+#include "../threadpool.h"
+
+#include <SOIL.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+struct BenchImage
+{
+    std::string name;
+    int width, height;
+    std::vector<unsigned char> pixels;
+};
+
+// What texbake and the texture array used before, as the baseline
+static void ScalarChain(const unsigned char* rgba, int w, int h, std::vector< std::vector<unsigned char> >& levels)
+{
+    levels.clear();
+    std::vector<unsigned char> current(rgba, rgba + (size_t)w * h * 4);
+    while (w > 1 || h > 1)
+    {
+        int dw = w > 1 ? w / 2 : 1, dh = h > 1 ? h / 2 : 1;
+        std::vector<unsigned char> next((size_t)dw * dh * 4);
+        for (int y = 0; y < dh; y++)
+        {
+            int y0 = y * 2, y1 = h > 1 ? y * 2 + 1 : y0;
+            for (int x = 0; x < dw; x++)
+            {
+                int x0 = x * 2, x1 = w > 1 ? x * 2 + 1 : x0;
+                for (int c = 0; c < 4; c++)
+                {
+                    int sum = current[((size_t)y0 * w + x0) * 4 + c] + current[((size_t)y0 * w + x1) * 4 + c] +
+                              current[((size_t)y1 * w + x0) * 4 + c] + current[((size_t)y1 * w + x1) * 4 + c];
+                    next[((size_t)y * dw + x) * 4 + c] = (unsigned char)((sum + 2) / 4);
+                }
+            }
+        }
+        levels.push_back(next);
+        current.swap(next);
+        w = dw; h = dh;
+    }
+}
+
+static double Now()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Best of 'runs', in milliseconds
+template <typename F>
+static double Time(int runs, F f)
+{
+    double best = 1e30;
+    for (int i = 0; i < runs; i++)
+    {
+        double start = Now();
+        f();
+        double ms = (Now() - start) * 1000.0;
+        if (ms < best)
+            best = ms;
+    }
+    return best;
+}
+
+static void Report(const char* label, const BenchImage& image, double ms, double baseline)
+{
+    double mpix = (double)image.width * image.height / 1e6;
+    printf("  %-22s %9.1f ms %8.1f Mpix/s %6.2fx\n", label, ms, mpix / (ms / 1000.0), baseline / ms);
+}
+
+int main(int argc, char** argv)
+{
+    int runs = 3, threads = 0;
+    std::vector<BenchImage> images;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-runs") == 0 && i + 1 < argc)              runs = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc)      threads = atoi(argv[++i]);
+        else
+        {
+            BenchImage image;
+            int channels;
+            unsigned char* pixels = SOIL_load_image(argv[i], &image.width, &image.height, &channels, SOIL_LOAD_RGBA);
+            if (pixels == NULL)
+            {
+                printf("can't load image %s: %s\n", argv[i], SOIL_last_result());
+                return 1;
+            }
+            image.name = argv[i];
+            image.pixels.assign(pixels, pixels + (size_t)image.width * image.height * 4);
+            SOIL_free_image_data(pixels);
+            images.push_back(image);
+        }
+    }
+
+    if (images.empty())
+    {
+        for (int size = 2048; size <= 8192; size *= 2)
+        {
+            BenchImage image;
+            image.name = std::to_string(size / 1024) + "K noise";
+            image.width = size;
+            image.height = size / 2;
+            image.pixels.resize((size_t)image.width * image.height * 4);
+            unsigned int seed = 12345;
+            for (size_t p = 0; p < image.pixels.size(); p++)
+            {
+                seed = seed * 1664525u + 1013904223u;
+                image.pixels[p] = (unsigned char)(seed >> 24);
+            }
+            images.push_back(image);
+        }
+    }
+
+    ThreadPool::SetThreads(threads);
+    int poolThreads = ThreadPool::Threads();
+    printf("%s kernels, %d threads, best of %d\n", MipKernelName(), poolThreads, runs);
+
+    std::vector< std::vector<unsigned char> > levels;
+    for (size_t i = 0; i < images.size(); i++)
+    {
+        const BenchImage& image = images[i];
+        printf("%s (%dx%d)\n", image.name.c_str(), image.width, image.height);
+
+        double baseline = Time(runs, [&] { ScalarChain(&image.pixels[0], image.width, image.height, levels); });
+        Report("scalar box", image, baseline, baseline);
+
+        const char* filterNames[2] = { "box", "kaiser" };
+        for (int filter = MIP_BOX; filter <= MIP_KAISER; filter++)
+        {
+            for (int srgb = 0; srgb < 2; srgb++)
+            {
+                MipOptions options;
+                options.filter = (MipFilter)filter;
+                options.srgb = srgb != 0;
+                options.wrapX = true;
+
+                for (int pass = 0; pass < 2; pass++)
+                {
+                    ThreadPool::SetThreads(pass == 0 ? 1 : threads);
+                    double ms = Time(runs, [&] { GenerateMipChain(&image.pixels[0], image.width, image.height, options, levels); });
+
+                    char label[64];
+                    snprintf(label, sizeof(label), "%s %s, %d thr", filterNames[filter], srgb ? "sRGB" : "linear",
+                        pass == 0 ? 1 : poolThreads);
+                    Report(label, image, ms, baseline);
+
+                    if (poolThreads == 1)
+                        break;
+                }
+            }
+        }
+    }
+
+    ThreadPool::Shutdown();
+    return 0;
+}
@@ -0,0 +1,179 @@
+/*****************************************
+ *
+ *           texbake.cpp
+ *
+ *  Offline texture baker. Decodes an image,
+ *  builds the whole mip chain, block compresses
+ *  every level and writes a *.btex file that
+ *  LoadBakedTexture can upload directly.
+ *
+ *  Usage:
+ *    texbake [-bc1|-bc3|-bc5] [-fast|-high] [-flip] [-ntsc] [-srgb|-linear] [-kaiser] [-wrap] [-pack mask] [-size WxH] input output.btex
+ *
+ *  -flip and -ntsc match SOIL_FLAG_INVERT_Y and
+ *  SOIL_FLAG_NTSC_SAFE_RGB, which the runtime
+ *  used to apply on every launch. -linear makes
+ *  the mips filter in linear light but leaves
+ *  the texels to be sampled as stored. -srgb
+ *  does that too and flags the file so
+ *  LoadBakedTexture uploads it with an sRGB
+ *  format, which the shader then reads back
+ *  in linear. -kaiser picks the sharper mip filter and
+ *  -wrap filters across the left/right edge for
+ *  textures that repeat around a sphere.
+ *  -fast and -high trade compression quality
+ *  for speed, see CompressQuality. -pack puts
+ *  the green channel of a same sized grey map
+ *  (specular) into the alpha, use it with -bc3.
+ *  -size resamples to WxH first, the way
+ *  TextureArrayBuilder does, so the output can
+ *  be copied straight into a texture array's
+ *  layer. Name it <image>.btex next to the
+ *  image. The planets are baked with
+ *    -bc1 -flip -ntsc -linear -kaiser -wrap -size 2048x1024
+ *  and the lit ones with -bc3 and -pack.
+ *
+ ****************************************/
+
+#include "../texturefile.h"
+#include "../blockcompress.h"
+#include "../mipmapgen.h"
+#include "../threadpool.h"
+
+#include <SOIL.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+int main(int argc, char** argv)
+{
+    BakedFormat format = BTEX_BC1;
+    CompressQuality quality = COMPRESS_NORMAL;
+    bool flip = false, ntsc = false, srgb = false, linearMips = false;
+    MipOptions mipOptions;
+    const char* maskFile = NULL;
+    int sizeX = 0, sizeY = 0;
+    const char* input = NULL;
+    const char* output = NULL;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-bc1") == 0)       format = BTEX_BC1;
+        else if (strcmp(argv[i], "-bc3") == 0)  format = BTEX_BC3;
+        else if (strcmp(argv[i], "-bc5") == 0)  format = BTEX_BC5;
+        else if (strcmp(argv[i], "-fast") == 0) quality = COMPRESS_FAST;
+        else if (strcmp(argv[i], "-high") == 0) quality = COMPRESS_HIGH;
+        else if (strcmp(argv[i], "-flip") == 0) flip = true;
+        else if (strcmp(argv[i], "-ntsc") == 0) ntsc = true;
+        else if (strcmp(argv[i], "-srgb") == 0) srgb = linearMips = true;
+        else if (strcmp(argv[i], "-linear") == 0) linearMips = true;
+        else if (strcmp(argv[i], "-kaiser") == 0) mipOptions.filter = MIP_KAISER;
+        else if (strcmp(argv[i], "-wrap") == 0) mipOptions.wrapX = true;
+        else if (strcmp(argv[i], "-pack") == 0 && i + 1 < argc) maskFile = argv[++i];
+        else if (strcmp(argv[i], "-size") == 0 && i + 1 < argc) sscanf(argv[++i], "%dx%d", &sizeX, &sizeY);
+        else if (input == NULL)                 input = argv[i];
+        else if (output == NULL)                output = argv[i];
+    }
+
+    if (input == NULL || output == NULL)
+    {
+        printf("usage: texbake [-bc1|-bc3|-bc5] [-fast|-high] [-flip] [-ntsc] [-srgb|-linear] [-kaiser] [-wrap] [-pack mask] [-size WxH] input output.btex\n");
+        return 1;
+    }
+    if (maskFile != NULL && format != BTEX_BC3)
+        printf("warning: only -bc3 keeps the alpha that -pack writes\n");
+
+    int width, height, channels;
+    unsigned char* pixels = SOIL_load_image(input, &width, &height, &channels, SOIL_LOAD_RGBA);
+    if (pixels == NULL)
+    {
+        printf("can't load image %s: %s\n", input, SOIL_last_result());
+        return 1;
+    }
+
+    std::vector<unsigned char> image(pixels, pixels + (size_t)width * height * 4);
+    SOIL_free_image_data(pixels);
+
+    if (maskFile != NULL)
+    {
+        int mw, mh, mc;
+        unsigned char* mask = SOIL_load_image(maskFile, &mw, &mh, &mc, SOIL_LOAD_RGBA);
+        if (mask == NULL)
+        {
+            printf("can't load image %s: %s\n", maskFile, SOIL_last_result());
+            return 1;
+        }
+        if (mw != width || mh != height)
+        {
+            printf("%s is %dx%d, it has to match %s (%dx%d)\n", maskFile, mw, mh, input, width, height);
+            SOIL_free_image_data(mask);
+            return 1;
+        }
+        for (size_t i = 0; i < image.size(); i += 4)
+            image[i + 3] = mask[i + 1];
+        SOIL_free_image_data(mask);
+    }
+
+    if (sizeX > 0 && sizeY > 0 && (sizeX != width || sizeY != height))
+    {
+        std::vector<unsigned char> resized((size_t)sizeX * sizeY * 4);
+        ResampleToRGBA(&image[0], width, height, 4, &resized[0], sizeX, sizeY, false);
+        image.swap(resized);
+        width = sizeX;
+        height = sizeY;
+    }
+
+    if (flip)
+    {
+        size_t row = (size_t)width * 4;
+        for (int y = 0; y < height / 2; y++)
+            std::swap_ranges(image.begin() + y * row, image.begin() + (y + 1) * row, image.begin() + (height - 1 - y) * row);
+    }
+
+    if (ntsc)
+    {   // Squash RGB into 16-235, the same as SOIL does
+        for (size_t i = 0; i < image.size(); i += 4)
+            for (int c = 0; c < 3; c++)
+                image[i + c] = (unsigned char)(16 + (image[i + c] * 219) / 255);
+    }
+
+    // Build the whole chain first, then compress every level down to 1x1
+    mipOptions.srgb = linearMips;
+    std::vector< std::vector<unsigned char> > chain;
+    GenerateMipChain(&image[0], width, height, mipOptions, chain);
+
+    std::vector< std::vector<unsigned char> > levels;
+    size_t blocks = 0;
+    double seconds = 0.0, topPSNR = 0.0;
+    int w = width, h = height;
+    for (size_t level = 0; level <= chain.size(); level++)
+    {
+        const unsigned char* pixels = level == 0 ? &image[0] : &chain[level - 1][0];
+        std::vector<unsigned char> block(BakedLevelSize(format, w, h));
+        CompressStats stats;
+        CompressImage(format, pixels, w, h, &block[0], quality, &stats);
+        levels.push_back(block);
+
+        blocks += stats.blocks;
+        seconds += stats.seconds;
+        if (level == 0)
+            topPSNR = stats.psnr;
+
+        w = w > 1 ? w / 2 : 1;
+        h = h > 1 ? h / 2 : 1;
+    }
+    ThreadPool::Shutdown();
+
+    if (!WriteBakedTexture(output, format, width, height, 1, (srgb ? BTEX_FLAG_SRGB : 0) | (linearMips ? BTEX_FLAG_LINEAR_MIPS : 0), levels))
+        return 1;
+
+    size_t total = 0;
+    for (size_t i = 0; i < levels.size(); i++)
+        total += levels[i].size();
+    printf("%s: %dx%d, %d levels, %.2f MB\n", output, width, height, (int)levels.size(), total / (1024.0 * 1024.0));
+    printf("  %zu blocks in %.2f s (%.2f M blocks/s), level 0 PSNR %.2f dB\n",
+        blocks, seconds, seconds > 0.0 ? blocks / seconds / 1e6 : 0.0, topPSNR);
+    return 0;
+}
@@ -0,0 +1,198 @@
+/*****************************************
+ *
+ *           vttiler.cpp
+ *
+ *  Offline tiler for virtual textures. Cuts
+ *  every mip level of an image into 128x128
+ *  tiles with a 4 texel border, compresses
+ *  them and writes a *.vtex file for
+ *  VirtualTexture::Add.
+ *
+ *  Usage:
+ *    vttiler [-bc1|-bc3] [-fast|-high] [-flip] [-srgb] [-kaiser] [-wrap] [-pack mask] input output.vtex
+ *
+ *  The options mean the same as texbake's.
+ *  Every tile in the runtime's cache has to be
+ *  the same format, the planets use
+ *  -bc3 -flip -srgb -kaiser -wrap, with their
+ *  specular map packed in.
+ *
+ *  Only one level is held at a time, but the
+ *  source still has to fit in memory: a 32K
+ *  map is 2 GB decoded.
+ *
+ ****************************************/
+
+#include "../tilefile.h"
+#include "../blockcompress.h"
+#include "../mipmapgen.h"
+#include "../threadpool.h"
+
+#include <SOIL.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+// Copies one tile and its border out of a level, wrapping or clamping at the edges
+static void CutTile(const unsigned char* level, int width, int height, int tileX, int tileY, bool wrapX,
+                    unsigned char* tile)
+{
+    int pixels = (int)TiledTilePixels(VTEX_TILE_SIZE, VTEX_TILE_BORDER);
+    int left = tileX * VTEX_TILE_SIZE - VTEX_TILE_BORDER;
+    int top = tileY * VTEX_TILE_SIZE - VTEX_TILE_BORDER;
+
+    for (int y = 0; y < pixels; y++)
+    {
+        int sy = std::min(std::max(top + y, 0), height - 1);
+        for (int x = 0; x < pixels; x++)
+        {
+            int sx = left + x;
+            if (wrapX)
+                sx = ((sx % width) + width) % width;
+            else
+                sx = std::min(std::max(sx, 0), width - 1);
+            memcpy(tile + ((size_t)y * pixels + x) * 4, level + ((size_t)sy * width + sx) * 4, 4);
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    BakedFormat format = BTEX_BC3;
+    CompressQuality quality = COMPRESS_NORMAL;
+    bool flip = false, srgb = false;
+    MipOptions mipOptions;
+    const char* maskFile = NULL;
+    const char* input = NULL;
+    const char* output = NULL;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-bc1") == 0)       format = BTEX_BC1;
+        else if (strcmp(argv[i], "-bc3") == 0)  format = BTEX_BC3;
+        else if (strcmp(argv[i], "-fast") == 0) quality = COMPRESS_FAST;
+        else if (strcmp(argv[i], "-high") == 0) quality = COMPRESS_HIGH;
+        else if (strcmp(argv[i], "-flip") == 0) flip = true;
+        else if (strcmp(argv[i], "-srgb") == 0) srgb = true;
+        else if (strcmp(argv[i], "-kaiser") == 0) mipOptions.filter = MIP_KAISER;
+        else if (strcmp(argv[i], "-wrap") == 0) mipOptions.wrapX = true;
+        else if (strcmp(argv[i], "-pack") == 0 && i + 1 < argc) maskFile = argv[++i];
+        else if (input == NULL)                 input = argv[i];
+        else if (output == NULL)                output = argv[i];
+    }
+
+    if (input == NULL || output == NULL)
+    {
+        printf("usage: vttiler [-bc1|-bc3] [-fast|-high] [-flip] [-srgb] [-kaiser] [-wrap] [-pack mask] input output.vtex\n");
+        return 1;
+    }
+    if (maskFile != NULL && format != BTEX_BC3)
+        printf("warning: only -bc3 keeps the alpha that -pack writes\n");
+
+    int width, height, channels;
+    unsigned char* pixels = SOIL_load_image(input, &width, &height, &channels, SOIL_LOAD_RGBA);
+    if (pixels == NULL)
+    {
+        printf("can't load image %s: %s\n", input, SOIL_last_result());
+        return 1;
+    }
+
+    std::vector<unsigned char> image(pixels, pixels + (size_t)width * height * 4);
+    SOIL_free_image_data(pixels);
+
+    if (maskFile != NULL)
+    {
+        int mw, mh, mc;
+        unsigned char* mask = SOIL_load_image(maskFile, &mw, &mh, &mc, SOIL_LOAD_RGBA);
+        if (mask == NULL)
+        {
+            printf("can't load image %s: %s\n", maskFile, SOIL_last_result());
+            return 1;
+        }
+        if (mw != width || mh != height)
+        {
+            printf("%s is %dx%d, it has to match %s (%dx%d)\n", maskFile, mw, mh, input, width, height);
+            SOIL_free_image_data(mask);
+            return 1;
+        }
+        for (size_t i = 0; i < image.size(); i += 4)
+            image[i + 3] = mask[i + 1];
+        SOIL_free_image_data(mask);
+    }
+
+    if (flip)
+    {
+        size_t row = (size_t)width * 4;
+        for (int y = 0; y < height / 2; y++)
+            std::swap_ranges(image.begin() + y * row, image.begin() + (y + 1) * row, image.begin() + (height - 1 - y) * row);
+    }
+
+    std::vector<TiledTextureLevel> layout;
+    TiledTextureLayout(width, height, VTEX_TILE_SIZE, layout);
+
+    unsigned int flags = mipOptions.wrapX ? VTEX_FLAG_WRAPX : 0;
+    TiledTextureHeader header = MakeTiledTextureHeader(format, width, height, (unsigned int)layout.size(), flags);
+
+    FILE* fid = fopen(output, "wb");
+    if (fid == NULL)
+    {
+        printf("can't open tiled texture for writing: %s\n", output);
+        return 1;
+    }
+
+    static const unsigned char padding[16] = { 0 };
+    fwrite(&header, sizeof(header), 1, fid);
+    fwrite(&layout[0], sizeof(TiledTextureLevel), layout.size(), fid);
+    size_t written = sizeof(header) + layout.size() * sizeof(TiledTextureLevel);
+    fwrite(padding, 1, TiledTextureDataOffset((unsigned int)layout.size()) - written, fid);
+
+    // Tiles are compressed a row at a time, one tile per pool thread, and written straight
+    // out so only the current level is ever in memory
+    mipOptions.srgb = srgb;
+    size_t tileBytes = TiledTileBytes(format, VTEX_TILE_SIZE, VTEX_TILE_BORDER);
+    int tilePixels = (int)TiledTilePixels(VTEX_TILE_SIZE, VTEX_TILE_BORDER);
+    size_t tiles = 0;
+    std::vector<unsigned char> half;
+    int w = width, h = height;
+    for (size_t level = 0; level < layout.size(); level++)
+    {
+        const TiledTextureLevel& l = layout[level];
+        std::vector<unsigned char> row(tileBytes * l.tilesX, 0);
+        for (unsigned int ty = 0; ty < l.tilesY; ty++)
+        {
+            ThreadPool::ParallelFor((int)l.tilesX, [&](int tx)
+            {
+                std::vector<unsigned char> tile((size_t)tilePixels * tilePixels * 4);
+                CutTile(&image[0], w, h, tx, ty, mipOptions.wrapX, &tile[0]);
+                CompressImage(format, &tile[0], tilePixels, tilePixels, &row[tx * tileBytes], quality);
+            });
+            fwrite(&row[0], 1, row.size(), fid);
+        }
+        tiles += (size_t)l.tilesX * l.tilesY;
+        printf("  level %d: %dx%d, %ux%u tiles\n", (int)level, w, h, l.tilesX, l.tilesY);
+
+        if (level + 1 < layout.size())
+        {
+            int hw = w > 1 ? w / 2 : 1, hh = h > 1 ? h / 2 : 1;
+            half.resize((size_t)hw * hh * 4);
+            DownsampleRGBA(&image[0], w, h, &half[0], mipOptions);
+            image.swap(half);
+            w = hw; h = hh;
+        }
+    }
+    ThreadPool::Shutdown();
+
+    bool ok = ferror(fid) == 0;
+    fclose(fid);
+    if (!ok)
+    {
+        printf("error writing tiled texture: %s\n", output);
+        return 1;
+    }
+
+    printf("%s: %dx%d, %d levels, %zu tiles, %.2f MB\n", output, width, height, (int)layout.size(), tiles,
+        (TiledTextureDataOffset((unsigned int)layout.size()) + tiles * tileBytes) / (1024.0 * 1024.0));
+    return 0;
+}
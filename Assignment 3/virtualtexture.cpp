@@ -0,0 +1,643 @@
+/*****************************************
+ *
+ *           virtualtexture.cpp
+ *
+ *  Feedback driven tile streaming into a
+ *  fixed size cache.
+ *
+ ****************************************/
+
+#include "virtualtexture.h"
+#include "glstate.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+
+// S3TC isn't part of core GL, so gl3w's header doesn't always define these
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT         0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT        0x83F3
+#endif
+
+// Per frame limits, so a sudden camera move spreads its uploads over a few frames
+#define MAX_QUEUED_TILES    64
+#define MAX_UPLOADS         32
+
+std::vector< std::unique_ptr<VirtualTexture::Texture> > VirtualTexture::textures;
+std::vector<VirtualTexture::Slot> VirtualTexture::slots;
+std::vector<int> VirtualTexture::freeSlots;
+int VirtualTexture::cacheTiles = 0;
+BakedFormat VirtualTexture::cacheFormat = BTEX_BC3;
+GLuint VirtualTexture::cacheTexture = 0;
+GLuint VirtualTexture::indirectionTexture = 0;
+int VirtualTexture::indirectionWidth = 0;
+int VirtualTexture::indirectionHeight = 0;
+int VirtualTexture::indirectionLevels = 0;
+unsigned int VirtualTexture::frame = 0;
+int VirtualTexture::visibleTiles = 0;
+int VirtualTexture::pendingTiles = 0;
+int VirtualTexture::streamedIn = 0;
+int VirtualTexture::evicted = 0;
+int VirtualTexture::dropped = 0;
+
+GLuint VirtualTexture::feedbackFramebuffer = 0;
+GLuint VirtualTexture::feedbackColour = 0;
+GLuint VirtualTexture::feedbackDepth = 0;
+GLuint VirtualTexture::feedbackBuffers[2] = { 0, 0 };
+int VirtualTexture::feedbackWidth = 0;
+int VirtualTexture::feedbackHeight = 0;
+int VirtualTexture::feedbackSizes[2] = { 0, 0 };
+int VirtualTexture::feedbackNext = 0;
+GLint VirtualTexture::savedFramebuffer = 0;
+GLint VirtualTexture::savedViewport[4] = { 0, 0, 0, 0 };
+
+std::thread VirtualTexture::worker;
+std::mutex VirtualTexture::mutex;
+std::condition_variable VirtualTexture::wake;
+std::deque< std::unique_ptr<VirtualTexture::TileJob> > VirtualTexture::jobs;
+std::deque< std::unique_ptr<VirtualTexture::TileJob> > VirtualTexture::finished;
+bool VirtualTexture::running = false;
+
+static GLenum CacheInternalFormat(BakedFormat format)
+{
+    switch (format)
+    {
+    case BTEX_BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    case BTEX_BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    case BTEX_BC5: return GL_COMPRESSED_RG_RGTC2;
+    }
+    return GL_NONE;
+}
+
+bool VirtualTexture::Start(int tiles, BakedFormat format)
+{
+    // Slot coordinates go into 8 bit indirection texels
+    if (tiles <= 0 || tiles > 256)
+    {
+        printf("virtual texture cache of %d tiles per side isn't supported\n", tiles);
+        return false;
+    }
+
+    cacheTiles = tiles;
+    cacheFormat = format;
+
+    slots.assign(tiles * tiles, Slot());
+    freeSlots.clear();
+    for (int i = tiles * tiles - 1; i >= 0; i--)
+    {
+        slots[i].texture = -1;
+        freeSlots.push_back(i);
+    }
+
+    GLsizei size = tiles * TiledTilePixels(VTEX_TILE_SIZE, VTEX_TILE_BORDER);
+    glGenTextures(1, &cacheTexture);
+    GLState::BindTexture(0, GL_TEXTURE_2D, cacheTexture);
+    glCompressedTexImage2D(GL_TEXTURE_2D, 0, CacheInternalFormat(format), size, size, 0,
+        (GLsizei)BakedLevelSize(format, size, size), nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    glGenBuffers(2, feedbackBuffers);
+
+    running = true;
+    worker = std::thread(WorkerMain);
+    return true;
+}
+
+void VirtualTexture::Shutdown()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    wake.notify_all();
+    if (worker.joinable())
+        worker.join();
+
+    jobs.clear();
+    finished.clear();
+
+    GLState::DeleteTextures(1, &cacheTexture);
+    GLState::DeleteTextures(1, &indirectionTexture);
+    glDeleteFramebuffers(1, &feedbackFramebuffer);
+    GLState::DeleteTextures(1, &feedbackColour);
+    glDeleteRenderbuffers(1, &feedbackDepth);
+    GLState::DeleteBuffers(2, feedbackBuffers);
+    cacheTexture = indirectionTexture = feedbackFramebuffer = feedbackColour = feedbackDepth = 0;
+    feedbackBuffers[0] = feedbackBuffers[1] = 0;
+    feedbackWidth = feedbackHeight = 0;
+    feedbackSizes[0] = feedbackSizes[1] = 0;
+
+    textures.clear();
+    slots.clear();
+    freeSlots.clear();
+    pendingTiles = 0;
+}
+
+int VirtualTexture::Add(const char* fileName)
+{
+    if (cacheTexture == 0 || (int)textures.size() >= MAX_VIRTUAL_TEXTURES)
+        return -1;
+
+    std::unique_ptr<Texture> t(new Texture);
+    t->fileName = fileName;
+    if (!t->file.Open(fileName))
+    {
+        printf("can't open tiled texture %s\n", fileName);
+        return -1;
+    }
+    if (!ParseTiledTexture(t->file.Data(), t->file.Size(), t->view, fileName))
+        return -1;
+
+    const TiledTextureHeader& header = *t->view.header;
+    if (header.format != (uint32_t)cacheFormat || header.tileSize != VTEX_TILE_SIZE || header.border != VTEX_TILE_BORDER)
+    {
+        printf("tiled texture %s doesn't match the tile cache's format\n", fileName);
+        return -1;
+    }
+
+    int levels = t->Levels();
+    const TiledTextureLevel& coarsest = t->view.levels[levels - 1];
+    if ((int)(coarsest.tilesX * coarsest.tilesY) > (int)freeSlots.size())
+    {
+        printf("no room in the tile cache for the coarsest level of %s\n", fileName);
+        return -1;
+    }
+
+    t->tiles.resize(levels);
+    for (int level = 0; level < levels; level++)
+        t->tiles[level].assign(t->view.levels[level].tilesX * t->view.levels[level].tilesY, TILE_MISSING);
+    t->dirty = true;
+
+    int handle = (int)textures.size();
+    textures.push_back(std::move(t));
+    Texture& texture = *textures[handle];
+
+    // The coarsest level is small and always needed, so it's read here rather than streamed
+    for (unsigned int y = 0; y < coarsest.tilesY; y++)
+    {
+        for (unsigned int x = 0; x < coarsest.tilesX; x++)
+        {
+            int slot = AllocateSlot();
+            Slot& s = slots[slot];
+            s.texture = handle;
+            s.level = levels - 1;
+            s.x = x;
+            s.y = y;
+            s.lastSeen = frame;
+            s.pinned = true;
+            UploadTile(slot, texture.view.TileData(levels - 1, x, y));
+            texture.tiles[levels - 1][y * coarsest.tilesX + x] = slot;
+        }
+    }
+
+    CreateIndirection();
+
+    printf("virtual texture %s: %ux%u, %d levels, %u tiles at level 0\n", fileName, header.width, header.height,
+        levels, texture.view.levels[0].tilesX * texture.view.levels[0].tilesY);
+    return handle;
+}
+
+int VirtualTexture::Count()
+{
+    return (int)textures.size();
+}
+
+// One RGBA8UI texel per tile: the cache slot in xy, the level that's actually there in z.
+// The array is big enough for every level of every texture, each texture is one layer.
+void VirtualTexture::CreateIndirection()
+{
+    int width = 1, height = 1, levels = 1;
+    for (size_t i = 0; i < textures.size(); i++)
+    {
+        const Texture& t = *textures[i];
+        levels = std::max(levels, t.Levels());
+        for (int level = 0; level < t.Levels(); level++)
+        {
+            // A level's size is the base size shifted down, so the base has to cover the
+            // rounded up tile counts of the small levels as well
+            width = std::max(width, (int)t.view.levels[level].tilesX << level);
+            height = std::max(height, (int)t.view.levels[level].tilesY << level);
+        }
+    }
+
+    if (indirectionTexture != 0 && width <= indirectionWidth && height <= indirectionHeight && levels <= indirectionLevels)
+        return;
+
+    if (indirectionTexture != 0)
+        GLState::DeleteTextures(1, &indirectionTexture);
+
+    indirectionWidth = width;
+    indirectionHeight = height;
+    indirectionLevels = levels;
+
+    glGenTextures(1, &indirectionTexture);
+    GLState::BindTexture(0, GL_TEXTURE_2D_ARRAY, indirectionTexture);
+    for (int level = 0; level < levels; level++)
+    {
+        GLsizei w = std::max(width >> level, 1), h = std::max(height >> level, 1);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8UI, w, h, MAX_VIRTUAL_TEXTURES, 0,
+            GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, nullptr);
+    }
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    for (size_t i = 0; i < textures.size(); i++)
+        textures[i]->dirty = true;
+}
+
+// Rebuilt whole, coarsest level first, so a tile that isn't resident can copy the entry
+// of its parent. Even for a 32K map that's only about 44K texels.
+void VirtualTexture::WriteIndirection(int handle)
+{
+    Texture& t = *textures[handle];
+    int levels = t.Levels();
+
+    std::vector<unsigned char> entries, parent;
+    unsigned int parentTilesX = 0, parentTilesY = 0;
+
+    GLState::BindTexture(0, GL_TEXTURE_2D_ARRAY, indirectionTexture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (int level = levels - 1; level >= 0; level--)
+    {
+        const TiledTextureLevel& l = t.view.levels[level];
+        entries.resize((size_t)l.tilesX * l.tilesY * 4);
+        for (unsigned int y = 0; y < l.tilesY; y++)
+        {
+            for (unsigned int x = 0; x < l.tilesX; x++)
+            {
+                unsigned char* entry = &entries[((size_t)y * l.tilesX + x) * 4];
+                int slot = t.tiles[level][y * l.tilesX + x];
+                if (slot >= 0)
+                {
+                    entry[0] = (unsigned char)(slot % cacheTiles);
+                    entry[1] = (unsigned char)(slot / cacheTiles);
+                    entry[2] = (unsigned char)level;
+                    entry[3] = 255;
+                }
+                else if (level + 1 < levels)
+                {
+                    unsigned int px = std::min(x / 2, parentTilesX - 1), py = std::min(y / 2, parentTilesY - 1);
+                    memcpy(entry, &parent[((size_t)py * parentTilesX + px) * 4], 4);
+                }
+                else
+                {
+                    entry[0] = entry[1] = entry[3] = 0;
+                    entry[2] = (unsigned char)level;
+                }
+            }
+        }
+
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, handle, l.tilesX, l.tilesY, 1,
+            GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, &entries[0]);
+
+        parent.swap(entries);
+        parentTilesX = l.tilesX;
+        parentTilesY = l.tilesY;
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    t.dirty = false;
+}
+
+// A free slot, or the one seen least recently. Tiles seen in the latest feedback are
+// never taken, they would only be requested again. Returns -1 if the cache is full of them.
+int VirtualTexture::AllocateSlot()
+{
+    if (!freeSlots.empty())
+    {
+        int slot = freeSlots.back();
+        freeSlots.pop_back();
+        return slot;
+    }
+
+    int victim = -1;
+    for (size_t i = 0; i < slots.size(); i++)
+    {
+        const Slot& s = slots[i];
+        if (s.pinned || s.lastSeen == frame)
+            continue;
+        if (victim < 0 || s.lastSeen < slots[victim].lastSeen)
+            victim = (int)i;
+    }
+    if (victim < 0)
+        return -1;
+
+    Slot& s = slots[victim];
+    Texture& t = *textures[s.texture];
+    t.tiles[s.level][s.y * t.view.levels[s.level].tilesX + s.x] = TILE_MISSING;
+    t.dirty = true;
+    s.texture = -1;
+    evicted++;
+    return victim;
+}
+
+void VirtualTexture::UploadTile(int slot, const unsigned char* data)
+{
+    GLsizei pixels = TiledTilePixels(VTEX_TILE_SIZE, VTEX_TILE_BORDER);
+    GLState::BindTexture(0, GL_TEXTURE_2D, cacheTexture);
+    glCompressedTexSubImage2D(GL_TEXTURE_2D, 0, (slot % cacheTiles) * pixels, (slot / cacheTiles) * pixels,
+        pixels, pixels, CacheInternalFormat(cacheFormat), (GLsizei)BakedLevelSize(cacheFormat, pixels, pixels), data);
+}
+
+void VirtualTexture::BeginFeedback(int screenWidth, int screenHeight)
+{
+    int width = std::max(screenWidth / VT_FEEDBACK_SCALE, 1);
+    int height = std::max(screenHeight / VT_FEEDBACK_SCALE, 1);
+
+    if (width != feedbackWidth || height != feedbackHeight)
+    {
+        if (feedbackFramebuffer == 0)
+        {
+            glGenFramebuffers(1, &feedbackFramebuffer);
+            glGenTextures(1, &feedbackColour);
+            glGenRenderbuffers(1, &feedbackDepth);
+        }
+
+        GLState::BindTexture(0, GL_TEXTURE_2D, feedbackColour);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16UI, width, height, 0, GL_RGBA_INTEGER, GL_UNSIGNED_SHORT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        // Not left bound, it's about to be drawn into as the framebuffer's attachment
+        GLState::BindTexture(0, GL_TEXTURE_2D, GL_NONE);
+
+        glBindRenderbuffer(GL_RENDERBUFFER, feedbackDepth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, GL_NONE);
+
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &savedFramebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, feedbackFramebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, feedbackColour, 0);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, feedbackDepth);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            printf("virtual texture feedback framebuffer is incomplete\n");
+        glBindFramebuffer(GL_FRAMEBUFFER, savedFramebuffer);
+
+        // The old readbacks are the wrong size now
+        for (int i = 0; i < 2; i++)
+        {
+            GLState::BindBuffer(GL_PIXEL_PACK_BUFFER, feedbackBuffers[i]);
+            glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)width * height * 4 * sizeof(uint16_t), nullptr, GL_STREAM_READ);
+            feedbackSizes[i] = 0;
+        }
+        // A pack buffer left bound would catch every later glReadPixels
+        GLState::BindBuffer(GL_PIXEL_PACK_BUFFER, GL_NONE);
+
+        feedbackWidth = width;
+        feedbackHeight = height;
+    }
+
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &savedFramebuffer);
+    glGetIntegerv(GL_VIEWPORT, savedViewport);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, feedbackFramebuffer);
+    glViewport(0, 0, width, height);
+    static const GLuint clearTile[4] = { 0, 0, 0, 0 };  // Alpha 0 means no virtual texture
+    glClearBufferuiv(GL_COLOR, 0, clearTile);
+    glClear(GL_DEPTH_BUFFER_BIT);
+}
+
+void VirtualTexture::EndFeedback()
+{
+    // Into a pixel buffer, so this returns straight away and the copy happens on the GPU
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    GLState::BindBuffer(GL_PIXEL_PACK_BUFFER, feedbackBuffers[feedbackNext]);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, feedbackWidth, feedbackHeight, GL_RGBA_INTEGER, GL_UNSIGNED_SHORT, nullptr);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    GLState::BindBuffer(GL_PIXEL_PACK_BUFFER, GL_NONE);
+    feedbackSizes[feedbackNext] = feedbackWidth * feedbackHeight;
+    feedbackNext ^= 1;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, savedFramebuffer);
+    glViewport(savedViewport[0], savedViewport[1], savedViewport[2], savedViewport[3]);
+}
+
+// Sorting the requests by this puts coarse levels first, so the fallbacks load
+// before the detail, and makes duplicates neighbours
+static inline uint64_t TileKey(int texture, int level, int x, int y)
+{
+    return ((uint64_t)(63 - level) << 56) | ((uint64_t)texture << 48) | ((uint64_t)y << 24) | (uint64_t)x;
+}
+
+void VirtualTexture::ProcessFeedback(const uint16_t* pixels, int count)
+{
+    std::vector<uint64_t> seen;
+    for (int i = 0; i < count; i++)
+    {
+        const uint16_t* p = pixels + i * 4;
+        int texture = (int)p[3] - 1;
+        if (texture < 0 || texture >= (int)textures.size())
+            continue;
+        const Texture& t = *textures[texture];
+        int level = std::min((int)p[2], t.Levels() - 1);
+        int x = std::min((int)p[0], (int)t.view.levels[level].tilesX - 1);
+        int y = std::min((int)p[1], (int)t.view.levels[level].tilesY - 1);
+        seen.push_back(TileKey(texture, level, x, y));
+    }
+    std::sort(seen.begin(), seen.end());
+    seen.erase(std::unique(seen.begin(), seen.end()), seen.end());
+    visibleTiles = (int)seen.size();
+
+    // Every tile seen and the coarser ones covering it. They're what the shader falls back
+    // to, so they stay in the cache and load first.
+    std::vector<uint64_t> wanted;
+    for (size_t i = 0; i < seen.size(); i++)
+    {
+        int level = 63 - (int)(seen[i] >> 56);
+        int texture = (int)((seen[i] >> 48) & 0xFF);
+        int x = (int)(seen[i] & 0xFFFFFF), y = (int)((seen[i] >> 24) & 0xFFFFFF);
+        Texture& t = *textures[texture];
+        for (; level < t.Levels(); level++, x /= 2, y /= 2)
+        {
+            const TiledTextureLevel& l = t.view.levels[level];
+            x = std::min(x, (int)l.tilesX - 1);
+            y = std::min(y, (int)l.tilesY - 1);
+            int slot = t.tiles[level][y * l.tilesX + x];
+            if (slot >= 0)
+                slots[slot].lastSeen = frame;
+            else if (slot == TILE_MISSING)
+                wanted.push_back(TileKey(texture, level, x, y));
+        }
+    }
+    std::sort(wanted.begin(), wanted.end());
+    wanted.erase(std::unique(wanted.begin(), wanted.end()), wanted.end());
+
+    int queued = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i = 0; i < wanted.size() && pendingTiles < MAX_QUEUED_TILES; i++)
+        {
+            std::unique_ptr<TileJob> job(new TileJob);
+            job->level = 63 - (int)(wanted[i] >> 56);
+            job->texture = (int)((wanted[i] >> 48) & 0xFF);
+            job->x = (int)(wanted[i] & 0xFFFFFF);
+            job->y = (int)((wanted[i] >> 24) & 0xFFFFFF);
+
+            Texture& t = *textures[job->texture];
+            job->source = t.view.TileData(job->level, job->x, job->y);
+            t.tiles[job->level][job->y * t.view.levels[job->level].tilesX + job->x] = TILE_LOADING;
+
+            jobs.push_back(std::move(job));
+            pendingTiles++;
+            queued++;
+        }
+    }
+    if (queued > 0)
+        wake.notify_one();
+}
+
+void VirtualTexture::Update()
+{
+    if (textures.empty())
+        return;
+
+    // The buffer about to be written next is the one the GPU has had longest to fill
+    int read = feedbackNext;
+    if (feedbackSizes[read] > 0)
+    {
+        GLState::BindBuffer(GL_PIXEL_PACK_BUFFER, feedbackBuffers[read]);
+        const uint16_t* pixels = (const uint16_t*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0,
+            (GLsizeiptr)feedbackSizes[read] * 4 * sizeof(uint16_t), GL_MAP_READ_BIT);
+        if (pixels)
+        {
+            ProcessFeedback(pixels, feedbackSizes[read]);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        GLState::BindBuffer(GL_PIXEL_PACK_BUFFER, GL_NONE);
+        feedbackSizes[read] = 0;
+    }
+
+    // Upload what the worker has read, a limited number per frame
+    std::deque< std::unique_ptr<TileJob> > done;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (int i = 0; i < MAX_UPLOADS && !finished.empty(); i++)
+        {
+            done.push_back(std::move(finished.front()));
+            finished.pop_front();
+        }
+    }
+
+    for (size_t j = 0; j < done.size(); j++)
+    {
+        TileJob& job = *done[j];
+        Texture& t = *textures[job.texture];
+        int& entry = t.tiles[job.level][job.y * t.view.levels[job.level].tilesX + job.x];
+        pendingTiles--;
+
+        int slot = AllocateSlot();
+        if (slot < 0)
+        {
+            entry = TILE_MISSING;
+            dropped++;
+            continue;
+        }
+
+        Slot& s = slots[slot];
+        s.texture = job.texture;
+        s.level = job.level;
+        s.x = job.x;
+        s.y = job.y;
+        s.lastSeen = frame;
+        s.pinned = false;
+        UploadTile(slot, &job.data[0]);
+        entry = slot;
+        t.dirty = true;
+        streamedIn++;
+    }
+
+    for (size_t i = 0; i < textures.size(); i++)
+        if (textures[i]->dirty)
+            WriteIndirection((int)i);
+
+    frame++;
+}
+
+void VirtualTexture::Bind(GLuint program, int cacheUnit, int indirectionUnit)
+{
+    GLState::BindTexture(cacheUnit, GL_TEXTURE_2D, cacheTexture);
+    GLState::BindTexture(indirectionUnit, GL_TEXTURE_2D_ARRAY, indirectionTexture);
+
+    GLint sizes[MAX_VIRTUAL_TEXTURES * 2] = { 0 }, levels[MAX_VIRTUAL_TEXTURES] = { 0 }, flags[MAX_VIRTUAL_TEXTURES] = { 0 };
+    for (size_t i = 0; i < textures.size(); i++)
+    {
+        sizes[i * 2 + 0] = textures[i]->view.header->width;
+        sizes[i * 2 + 1] = textures[i]->view.header->height;
+        levels[i] = textures[i]->Levels();
+        flags[i] = (GLint)textures[i]->view.header->flags;
+    }
+
+    glUniform1i(glGetUniformLocation(program, "vtCache"), cacheUnit);
+    glUniform1i(glGetUniformLocation(program, "vtIndirection"), indirectionUnit);
+    glUniform1i(glGetUniformLocation(program, "vtCacheTiles"), cacheTiles);
+    glUniform2iv(glGetUniformLocation(program, "vtSizes"), MAX_VIRTUAL_TEXTURES, sizes);
+    glUniform1iv(glGetUniformLocation(program, "vtLevels"), MAX_VIRTUAL_TEXTURES, levels);
+    glUniform1iv(glGetUniformLocation(program, "vtFlags"), MAX_VIRTUAL_TEXTURES, flags);
+}
+
+void VirtualTexture::WorkerMain()
+{
+    for (;;)
+    {
+        std::unique_ptr<TileJob> job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [] { return !running || !jobs.empty(); });
+            if (!running)
+                return;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+
+        // Touching the mapping is what reads the file, so it happens here and not on the GL thread
+        size_t bytes = BakedLevelSize(cacheFormat, TiledTilePixels(VTEX_TILE_SIZE, VTEX_TILE_BORDER),
+            TiledTilePixels(VTEX_TILE_SIZE, VTEX_TILE_BORDER));
+        job->data.assign(job->source, job->source + bytes);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        finished.push_back(std::move(job));
+    }
+}
+
+VirtualTextureStats VirtualTexture::Stats()
+{
+    VirtualTextureStats stats;
+    stats.textures = (int)textures.size();
+    stats.cacheTiles = (int)slots.size();
+    stats.residentTiles = (int)(slots.size() - freeSlots.size());
+    stats.pinnedTiles = 0;
+    for (size_t i = 0; i < slots.size(); i++)
+        if (slots[i].texture >= 0 && slots[i].pinned)
+            stats.pinnedTiles++;
+    stats.visibleTiles = visibleTiles;
+    stats.pendingTiles = pendingTiles;
+    stats.streamedIn = streamedIn;
+    stats.evicted = evicted;
+    stats.dropped = dropped;
+
+    GLsizei size = cacheTiles * TiledTilePixels(VTEX_TILE_SIZE, VTEX_TILE_BORDER);
+    stats.cacheBytes = cacheTexture != 0 ? BakedLevelSize(cacheFormat, size, size) : 0;
+    stats.indirectionBytes = 0;
+    if (indirectionTexture != 0)
+        for (int level = 0; level < indirectionLevels; level++)
+            stats.indirectionBytes += (size_t)std::max(indirectionWidth >> level, 1) *
+                std::max(indirectionHeight >> level, 1) * 4 * MAX_VIRTUAL_TEXTURES;
+    return stats;
+}
+
+void VirtualTexture::PrintStats()
+{
+    VirtualTextureStats stats = Stats();
+    const double mb = 1024.0 * 1024.0;
+    printf("virtual textures: %d textures, %d / %d tiles resident (%d pinned), %.1f MB cache, %.2f MB indirection, "
+           "%d streamed in, %d evicted, %d dropped\n",
+        stats.textures, stats.residentTiles, stats.cacheTiles, stats.pinnedTiles, stats.cacheBytes / mb,
+        stats.indirectionBytes / mb, stats.streamedIn, stats.evicted, stats.dropped);
+}
@@ -0,0 +1,153 @@
+/**************************************************
+ *
+ *                virtualtexture.h
+ *
+ *  Virtual texturing for planet maps too big for
+ *  a full mip chain (16K and up). The maps are cut
+ *  into tiles offline (tools/vttiler), a low
+ *  resolution feedback pass records which tiles
+ *  the screen needs, and those are read on a
+ *  worker thread into a fixed size tile cache,
+ *  evicting the least recently seen. A small
+ *  indirection map per texture tells the shader
+ *  where each tile is in the cache, falling back
+ *  to a coarser one until it arrives.
+ *
+ *  The GPU memory used is the cache plus the
+ *  indirection maps, whatever the size of the
+ *  textures.
+ *
+ ***************************************************/
+
+#ifndef VIRTUALTEXTURE_H
+#define VIRTUALTEXTURE_H
+
+#include <GL/gl3w.h>
+
+#include "mappedfile.h"
+#include "tilefile.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define MAX_VIRTUAL_TEXTURES 4      // Must match simpleLights.frag and vtfeedback.frag
+#define VT_FEEDBACK_SCALE    8      // The feedback pass is this many times smaller than the screen
+
+struct VirtualTextureStats
+{
+    int textures;
+    int cacheTiles;         // Slots in the cache
+    int residentTiles;
+    int pinnedTiles;        // Coarsest levels, never evicted
+    int visibleTiles;       // In the last feedback read back
+    int pendingTiles;
+    int streamedIn;         // Totals since Start
+    int evicted;
+    int dropped;            // Finished loads with no slot to go in, the cache is too small
+    size_t cacheBytes;
+    size_t indirectionBytes;
+};
+
+class VirtualTexture
+{
+public:
+    // Creates a cache of cacheTiles x cacheTiles tiles. Every texture added has to be
+    // tiled to the same block format.
+    static bool Start(int cacheTiles, BakedFormat format);
+    static void Shutdown();     // Stops the worker, deletes the GL objects and unmaps the files
+
+    // Maps a *.vtex file and uploads its coarsest level, which stays resident so there is
+    // always something to sample. Returns a handle, the texture's layer in the indirection
+    // array, or -1 if the file is missing or doesn't fit the cache.
+    static int Add(const char* fileName);
+    static int Count();
+
+    // Everything drawn between these goes into the feedback buffer instead of the screen,
+    // with vtfeedback.frag writing the tile each pixel wants. It's read back asynchronously.
+    static void BeginFeedback(int screenWidth, int screenHeight);
+    static void EndFeedback();
+
+    // Once per frame on the GL thread: reads the oldest feedback, queues the tiles that
+    // aren't in the cache, uploads finished ones and rewrites the indirection maps.
+    static void Update();
+
+    // Binds the cache and the indirection array to the given texture units and sets the
+    // vt* uniforms of simpleLights.frag and vtfeedback.frag
+    static void Bind(GLuint program, int cacheUnit, int indirectionUnit);
+
+    static VirtualTextureStats Stats();
+    static void PrintStats();
+
+private:
+    enum
+    {
+        TILE_MISSING = -1,
+        TILE_LOADING = -2,
+    };
+
+    struct Texture
+    {
+        std::string fileName;
+        MappedFile file;
+        TiledTextureView view;
+        std::vector< std::vector<int> > tiles;  // Per level, row major: cache slot, or TILE_*
+        bool dirty;                             // Indirection needs rewriting
+
+        int Levels() const { return (int)view.header->levels; }
+    };
+
+    struct Slot
+    {
+        int texture;            // -1 when free
+        int level, x, y;
+        unsigned int lastSeen;  // Frame it was last in the feedback
+        bool pinned;
+    };
+
+    struct TileJob
+    {
+        int texture, level, x, y;
+        const unsigned char* source;    // In the mapping, which outlives the worker
+        std::vector<unsigned char> data;
+    };
+
+    static void CreateIndirection();
+    static void WriteIndirection(int handle);
+    static void ProcessFeedback(const uint16_t* pixels, int count);
+    static int AllocateSlot();
+    static void UploadTile(int slot, const unsigned char* data);
+    static void WorkerMain();
+
+    static std::vector< std::unique_ptr<Texture> > textures;
+    static std::vector<Slot> slots;
+    static std::vector<int> freeSlots;
+    static int cacheTiles;
+    static BakedFormat cacheFormat;
+    static GLuint cacheTexture, indirectionTexture;
+    static int indirectionWidth, indirectionHeight, indirectionLevels;
+    static unsigned int frame;
+    static int visibleTiles, pendingTiles, streamedIn, evicted, dropped;
+
+    // Feedback target and the two buffers it's read back through, so the CPU
+    // only ever maps the one the GPU finished a frame ago
+    static GLuint feedbackFramebuffer, feedbackColour, feedbackDepth;
+    static GLuint feedbackBuffers[2];
+    static int feedbackWidth, feedbackHeight;
+    static int feedbackSizes[2];            // Pixels written to each buffer, 0 if it's empty
+    static int feedbackNext;
+    static GLint savedFramebuffer, savedViewport[4];
+
+    static std::thread worker;
+    static std::mutex mutex;                // Guards the two queues and 'running'
+    static std::condition_variable wake;
+    static std::deque< std::unique_ptr<TileJob> > jobs, finished;
+    static bool running;
+};
+
+#endif
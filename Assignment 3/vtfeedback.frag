@@ -0,0 +1,52 @@
+#version 400
+
+// Feedback pass for virtual textures. Drawn into a small integer target with the same
+// vertex shader as simpleLights, it writes the tile each pixel would sample so the
+// streamer knows what to load. See virtualtexture.h.
+
+out uvec4 feedback;	// Tile x, tile y, level, virtual texture + 1 (0 for none)
+
+in VertexData
+{
+	vec3 normal;
+	vec3 worldPos;
+	vec3 eyePos;
+	vec2 texcoord;
+	flat int layer;
+	flat int virtualTexture;
+}	inData;
+
+#define MAX_VIRTUAL_TEXTURES 4
+#define VT_TILE_SIZE 128
+#define VT_FLAG_WRAPX 0x2
+
+uniform ivec2 vtSizes[MAX_VIRTUAL_TEXTURES];
+uniform int vtLevels[MAX_VIRTUAL_TEXTURES];
+uniform int vtFlags[MAX_VIRTUAL_TEXTURES];
+uniform float lodBias;	// The target is smaller than the screen, which makes the derivatives bigger
+
+void main()
+{
+	int id = inData.virtualTexture;
+	if (id < 0)
+	{
+		feedback = uvec4(0);	// Still drawn, so bodies without one hide what's behind them
+		return;
+	}
+
+	// The finer of the two levels SampleVirtual in simpleLights.frag mixes. The coarser
+	// one is loaded along with it, as every tile brings the ones covering it.
+	vec2 size = vec2(vtSizes[id]);
+	vec2 dx = dFdx(inData.texcoord) * size, dy = dFdy(inData.texcoord) * size;
+	float lod = clamp(0.5f * log2(max(dot(dx, dx), dot(dy, dy))) + lodBias, 0.0f, float(vtLevels[id] - 1));
+	int level = int(lod);
+
+	vec2 uv = inData.texcoord;
+	uv.x = (vtFlags[id] & VT_FLAG_WRAPX) != 0 ? fract(uv.x) : clamp(uv.x, 0.0f, 1.0f);
+	uv.y = clamp(uv.y, 0.0f, 1.0f);
+	ivec2 levelSize = max(vtSizes[id] >> level, ivec2(1));
+	ivec2 tiles = (levelSize + VT_TILE_SIZE - 1) / VT_TILE_SIZE;
+	ivec2 tile = min(ivec2(uv * vec2(levelSize)) / VT_TILE_SIZE, tiles - 1);
+
+	feedback = uvec4(uvec2(tile), uint(level), uint(id + 1));
+}
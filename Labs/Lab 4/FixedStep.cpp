@@ -0,0 +1,85 @@
+/*****************************************
+ *
+ *              FixedStep.cpp
+ *
+ *  The fixed timestep accumulator and
+ *  its spiral of death guard.
+ *
+ ****************************************/
+
+#include "FixedStep.h"
+
+#include <algorithm>
+
+float FixedStep::rate = 240.0f;
+int FixedStep::maxSteps = 8;
+double FixedStep::accumulator = 0.0;
+int FixedStep::steps = 0;
+float FixedStep::stepsPerSecond = 0.0f;
+double FixedStep::dropped = 0.0;
+int FixedStep::limitedFrames = 0;
+
+void FixedStep::SetRate(float rate, int maxSteps)
+{
+    // Keeps where the frame is between steps, so changing the rate doesn't jump
+    double alpha = Alpha();
+    FixedStep::rate = std::max(rate, 1.0f);
+    FixedStep::maxSteps = std::max(maxSteps, 1);
+    accumulator = alpha / FixedStep::rate;
+}
+
+int FixedStep::Advance(float deltaTime)
+{
+    double step = 1.0 / rate;
+    accumulator += std::max(deltaTime, 0.0f);
+
+    steps = (int)(accumulator / step);
+    if (steps > maxSteps)
+    {
+        // Run what's allowed and let the rest go, the simulation falls behind real time
+        // for a frame instead of for good
+        dropped += accumulator - maxSteps * step;
+        limitedFrames++;
+        steps = maxSteps;
+        accumulator = maxSteps * step;
+    }
+    accumulator -= steps * step;
+
+    // An average that forgets over about a second whatever the frame rate is
+    if (deltaTime > 0.0f)
+    {
+        float weight = std::min(deltaTime, 1.0f);
+        stepsPerSecond += (steps / deltaTime - stepsPerSecond) * weight;
+    }
+    return steps;
+}
+
+float FixedStep::Step()
+{
+    return 1.0f / rate;
+}
+
+float FixedStep::Rate()
+{
+    return rate;
+}
+
+int FixedStep::MaxSteps()
+{
+    return maxSteps;
+}
+
+float FixedStep::Alpha()
+{
+    return (float)std::min(std::max(accumulator * rate, 0.0), 1.0);
+}
+
+FixedStepStats FixedStep::Stats()
+{
+    FixedStepStats stats;
+    stats.steps = steps;
+    stats.stepsPerSecond = stepsPerSecond;
+    stats.droppedSeconds = (float)dropped;
+    stats.limitedFrames = limitedFrames;
+    return stats;
+}
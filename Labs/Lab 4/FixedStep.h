@@ -0,0 +1,60 @@
+/**************************************************
+ *
+ *                   FixedStep.h
+ *
+ *  Runs a simulation in steps of a fixed length,
+ *  however long the frames take. Each frame's
+ *  time goes into an accumulator and comes out
+ *  as whole steps, the remainder carried over.
+ *  What's left is how far the frame falls
+ *  between the last two steps, for the renderer
+ *  to interpolate the states by.
+ *
+ *  A frame that took too long only gets so many
+ *  steps, and the time past them is dropped:
+ *  otherwise steps that run slower than real
+ *  time would make every frame longer than the
+ *  last.
+ *
+ ***************************************************/
+
+#ifndef FIXEDSTEP_H
+#define FIXEDSTEP_H
+
+struct FixedStepStats
+{
+    int steps;              // Run by the last Advance
+    float stepsPerSecond;   // Averaged over the last second or so
+    float droppedSeconds;   // Time given up to the step limit since the start
+    int limitedFrames;      // Frames that hit it
+};
+
+class FixedStep
+{
+public:
+    // Steps a second, and the most that one frame may run
+    static void SetRate(float rate, int maxSteps = 8);
+
+    // Adds a frame's time and returns how many steps to run for it
+    static int Advance(float deltaTime);
+
+    static float Step();    // Seconds a step covers
+    static float Rate();
+    static int MaxSteps();
+
+    // How far from the second last step to the last the frame is, 0 to 1
+    static float Alpha();
+
+    static FixedStepStats Stats();
+
+private:
+    static float rate;
+    static int maxSteps;
+    static double accumulator;
+    static int steps;
+    static float stepsPerSecond;
+    static double dropped;
+    static int limitedFrames;
+};
+
+#endif
@@ -10,6 +10,7 @@
 
 #include "Shaders.h"
 #include "Object.h"
+#include "FixedStep.h"
 
 #define PI 3.141592f
 inline float DEG2RAD(float deg) { return (PI * deg / 180.0f); }
@@ -39,7 +40,12 @@ glm::vec3   accumPos = glm::vec3(0.0f);
 Model spaceship[6];
 int currentShip = 0;
 
-const float spaceshipMaxSpeed = 5.0f;
+// The ship was tuned a frame at a time at 60 fps, these are the same numbers per second
+const float spaceshipMaxSpeed = 5.0f * 60.0f;
+const float spaceshipThrust = 0.5f * 60.0f;         // Units a second, gained each second
+const float spaceshipTurn = DEG2RAD(5.0f) * 60.0f;  // Radians a second, gained each second
+const float spaceshipMaxSpin = DEG2RAD(720.0f);     // Twice round a second
+const float spaceshipFriction = 0.99f;              // Of the speed, kept every 1/60 s
 
 glm::vec2   spaceshipVelocity = glm::vec2(0.0f); // We're only moving X and Y
 glm::vec3   spaceshipPosition = glm::vec3(0.0f);
@@ -47,6 +53,16 @@ glm::vec3   spaceshipPosition = glm::vec3(0.0f);
 float       spaceshipAngularVelocity = 0.0f;
 float       spaceshipRotation = 0.0f;
 
+// As of the step before, the frame is drawn between these and the ones above
+glm::vec3   previousPosition = glm::vec3(0.0f);
+glm::vec3   previousAccumPos = glm::vec3(0.0f);
+float       previousRotation = 0.0f;
+
+// What Render draws, in between the steps
+glm::vec3   drawnPosition = glm::vec3(0.0f);
+glm::vec3   drawnAccumPos = glm::vec3(0.0f);
+float       drawnRotation = 0.0f;
+
 
 /*---------------------------- Functions ----------------------------*/
 void Initialize()
@@ -107,19 +123,24 @@ void Initialize()
 
 }
 
-void Update(float deltaTime)
+// One fixed step of the spaceship, so it flies the same at any frame rate
+void Simulate(float step)
 {
+    previousPosition = spaceshipPosition;
+    previousAccumPos = accumPos;
+    previousRotation = spaceshipRotation;
+
     //-------------------------------------SPACESHIP MOVEMENT-----------------------------------//
     // Very simple spaceship movement, get the keyboard input
-    if (glfwGetKey(window, GLFW_KEY_LEFT))  spaceshipAngularVelocity += DEG2RAD(5.0f) * deltaTime; // 180 deg per second
-    if (glfwGetKey(window, GLFW_KEY_RIGHT)) spaceshipAngularVelocity -= DEG2RAD(5.0f) * deltaTime; // 180 deg per second
+    if (glfwGetKey(window, GLFW_KEY_LEFT))  spaceshipAngularVelocity += spaceshipTurn * step;
+    if (glfwGetKey(window, GLFW_KEY_RIGHT)) spaceshipAngularVelocity -= spaceshipTurn * step;
     if (glfwGetKey(window, GLFW_KEY_DOWN))
     {
-        spaceshipVelocity -= glm::vec2(-sin(spaceshipRotation), cos(spaceshipRotation)) * 0.5f * deltaTime;
+        spaceshipVelocity -= glm::vec2(-sin(spaceshipRotation), cos(spaceshipRotation)) * spaceshipThrust * step;
     }
     if (glfwGetKey(window, GLFW_KEY_UP))
     {
-        spaceshipVelocity += glm::vec2(-sin(spaceshipRotation), cos(spaceshipRotation)) * 0.5f * deltaTime;
+        spaceshipVelocity += glm::vec2(-sin(spaceshipRotation), cos(spaceshipRotation)) * spaceshipThrust * step;
     }
 
     // Enforce maximum speed here
@@ -128,22 +149,47 @@ void Update(float deltaTime)
         spaceshipVelocity = glm::normalize(spaceshipVelocity) * spaceshipMaxSpeed;
     }
     // And maximum rotation here
-    if (spaceshipAngularVelocity > DEG2RAD(720.0f)) // If we're spinning more than 2 times per second
+    if (spaceshipAngularVelocity > spaceshipMaxSpin) // If we're spinning more than 2 times per second
     {
-        spaceshipAngularVelocity = DEG2RAD(720.0f);
+        spaceshipAngularVelocity = spaceshipMaxSpin;
     }
 
     // Move our spaceship
-    spaceshipPosition.x += spaceshipVelocity.x;
-    spaceshipPosition.y += spaceshipVelocity.y;
-    accumPos.x += spaceshipVelocity.x;
-    accumPos.y += spaceshipVelocity.y;
+    spaceshipPosition.x += spaceshipVelocity.x * step;
+    spaceshipPosition.y += spaceshipVelocity.y * step;
+    accumPos.x += spaceshipVelocity.x * step;
+    accumPos.y += spaceshipVelocity.y * step;
 
     // Rotate our spaceship
-    spaceshipRotation += spaceshipAngularVelocity;
+    spaceshipRotation += spaceshipAngularVelocity * step;
+
+    float friction = glm::pow(spaceshipFriction, step * 60.0f);
+    spaceshipVelocity *= friction; // Simple friction coefficient so we slow down
+    spaceshipAngularVelocity *= friction; // Simple angular friction coefficient so we stop spinning
+
+    float ratio = width / (float)height;
+    glm::vec3 unwrapped = spaceshipPosition;
+
+    // Because the orthographic matrix vertically goes from -10 to 10, we can wrap the spaceship Y position here
+    if (spaceshipPosition.y > 10.0f)    spaceshipPosition.y = -10.0f;
+    if (spaceshipPosition.y < -10.0f)   spaceshipPosition.y = 10.0f;
+
+    // Because the orthographic matrix horizontally goes from -10 * ratio to 10 * ratio, we can wrap the spaceship Y position here
+    if (spaceshipPosition.x > 10.0f * ratio)    spaceshipPosition.x = -10.0f * ratio;
+    if (spaceshipPosition.x < -10.0f * ratio)   spaceshipPosition.x = 10.0f * ratio;
 
-    spaceshipVelocity *= 0.99f; // Simple friction coefficient so we slow down
-    spaceshipAngularVelocity *= 0.99f; // Simple angular friction coefficient so we stop spinning
+    // Jumping to the other side isn't something to draw the ship halfway through
+    if (spaceshipPosition != unwrapped)
+        previousPosition = spaceshipPosition;
+}
+
+void Update(float deltaTime)
+{
+    // Where the ship is between its last two steps
+    float alpha = FixedStep::Alpha();
+    drawnPosition = glm::mix(previousPosition, spaceshipPosition, alpha);
+    drawnAccumPos = glm::mix(previousAccumPos, accumPos, alpha);
+    drawnRotation = glm::mix(previousRotation, spaceshipRotation, alpha);
 
     //-------------------------------------PROJECTION MATRICES-----------------------------------//
 
@@ -156,14 +202,6 @@ void Update(float deltaTime)
 
     //projectionMatrix = glm::perspective(DEG2RAD(90.0f), ratio, 0.1f, 100.0f);
 	projectionMatrix = glm::ortho(-10.0f * ratio, 10.0f * ratio, -10.0f, 10.0f, -100.0f, 100.0f);
-
-    // Because the orthographic matrix vertically goes from -10 to 10, we can wrap the spaceship Y position here
-    if (spaceshipPosition.y > 10.0f)    spaceshipPosition.y = -10.0f;
-    if (spaceshipPosition.y < -10.0f)   spaceshipPosition.y = 10.0f;
-
-    // Because the orthographic matrix horizontally goes from -10 * ratio to 10 * ratio, we can wrap the spaceship Y position here
-    if (spaceshipPosition.x > 10.0f * ratio)    spaceshipPosition.x = -10.0f * ratio;
-    if (spaceshipPosition.x < -10.0f * ratio)   spaceshipPosition.x = 10.0f * ratio;
 }
 
 void RenderModel(glm::mat4 modelMatrix, Model model)
@@ -190,7 +228,7 @@ void Render()
     glBindVertexArray(stars.vao);
     glUniform1f(glGetUniformLocation(star_shader_program, "ratio"), (float)height / (float)width);
     glUniform1f(glGetUniformLocation(star_shader_program, "iTime"), (float)glfwGetTime());
-    glUniform2fv(glGetUniformLocation(star_shader_program, "position"), 1, &accumPos[0]);
+    glUniform2fv(glGetUniformLocation(star_shader_program, "position"), 1, &drawnAccumPos[0]);
     glDrawArrays(GL_TRIANGLE_STRIP, 0, stars.vertexCount);
 #endif
 
@@ -209,8 +247,8 @@ void Render()
 
     {   // Draw the spaceship
         glm::mat4 modelMat = glm::mat4(1.0f);
-        modelMat = glm::translate(modelMat, spaceshipPosition);
-        modelMat = glm::rotate(modelMat, spaceshipRotation, glm::vec3(0.0f, 0.0f, 1.0f));
+        modelMat = glm::translate(modelMat, drawnPosition);
+        modelMat = glm::rotate(modelMat, drawnRotation, glm::vec3(0.0f, 0.0f, 1.0f));
         modelMat = glm::rotate(modelMat, 90.0f, glm::vec3(1.0f, 0.0f, 0.0f));
         modelMat = glm::scale(modelMat, glm::vec3(0.1f));
         RenderModel(modelMat, spaceship[currentShip]);
@@ -244,6 +282,14 @@ void GUI()
         ImGui::RadioButton("Spaceship 4", &currentShip, 3);
         ImGui::RadioButton("Spaceship 5", &currentShip, 4);
         ImGui::RadioButton("Spaceship 6", &currentShip, 5);
+
+        // The ship moves in fixed steps, however fast the frames come
+        float simulationRate = FixedStep::Rate();
+        if (ImGui::SliderFloat("Simulation rate (Hz)", &simulationRate, 30.0f, 960.0f, "%.0f"))
+            FixedStep::SetRate(simulationRate);
+        FixedStepStats stepStats = FixedStep::Stats();
+        ImGui::Text("%d steps this frame, %.0f a second, %.2f s dropped", stepStats.steps, stepStats.stepsPerSecond,
+            stepStats.droppedSeconds);
     }
     ImGui::End();
 }
@@ -308,6 +354,9 @@ int main()
         ImGui_ImplGlfwGL3_NewFrame();
 
         // Call the helper functions
+        int steps = FixedStep::Advance(deltaTime);
+        for (int i = 0; i < steps; i++)
+            Simulate(FixedStep::Step());
         Update(deltaTime);
         Render();
         GUI();
@@ -1,4 +1,5 @@
 #include "Loaders.h"
+#include "MappedFile.h"
 
 #include <GLM/glm.hpp>
 #define TINYOBJLOADER_IMPLEMENTATION
@@ -7,74 +8,94 @@
 #include <fstream>
 #include <cstdint>
 #include <iostream>
+#include <vector>
 
-int LoadBMP(const char * fileLoc, Texture & tex)
-{
-    typedef int8_t Uint8;
-
-    Uint8* datBuff[2] = { nullptr, nullptr }; // Header buffers
-    Uint8* pixels = nullptr; // Pixels
+// The BMP headers are read straight out of the file bytes (always little endian),
+// so we don't need the Windows BITMAPFILEHEADER/BITMAPINFOHEADER structs
+static inline uint16_t ReadU16(const unsigned char* p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+static inline uint32_t ReadU32(const unsigned char* p) { return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24); }
 
-    BITMAPFILEHEADER* bmpHeader = nullptr; // Header
-    BITMAPINFOHEADER* bmpInfo = nullptr; // Info 
+static const size_t BMP_FILE_HEADER_SIZE = 14;
+static const size_t BMP_INFO_HEADER_SIZE = 40;  // BITMAPINFOHEADER, V4/V5 headers are larger but start the same
+static const size_t BMP_V4_HEADER_SIZE = 108;   // Adds the alpha mask, at byte 52
+static const uint32_t BMP_RGB = 0;              // Uncompressed
+static const uint32_t BMP_BITFIELDS = 3;        // Uncompressed with channel masks
 
-    // The file... We open it with it's constructor
-    std::ifstream file(fileLoc, std::ios::binary);
-    if (!file)
+int LoadBMP(const char * fileLoc, Texture & tex)
+{
+    // Map the file, the pixels get handed to GL straight from the mapping
+    MappedFile file;
+    if (!file.Open(fileLoc))
     {
-        std::cout << "Failure to open bitmap file.\n";
-
+        std::cout << "Failure to open bitmap file \"" << fileLoc << "\".\n";
         return 1;
     }
 
-    // Allocate byte memory that will hold the two headers
-    datBuff[0] = new Uint8[sizeof(BITMAPFILEHEADER)];
-    datBuff[1] = new Uint8[sizeof(BITMAPINFOHEADER)];
-
-    file.read((char*)datBuff[0], sizeof(BITMAPFILEHEADER));
-    file.read((char*)datBuff[1], sizeof(BITMAPINFOHEADER));
-
-    // Construct the values from the buffers
-    bmpHeader = (BITMAPFILEHEADER*)datBuff[0];
-    bmpInfo = (BITMAPINFOHEADER*)datBuff[1];
+    const unsigned char* data = file.Data();
+    size_t size = file.Size();
 
     // Check if the file is an actual BMP file
-    if (bmpHeader->bfType != 0x4D42)
+    if (size < BMP_FILE_HEADER_SIZE + BMP_INFO_HEADER_SIZE || data[0] != 'B' || data[1] != 'M')
     {
         std::cout << "File \"" << fileLoc << "\" isn't a BMP\n";
         return 2;
     }
 
-    // First allocate pixel memory
-    pixels = new Uint8[bmpInfo->biSizeImage];
+    const unsigned char* info = data + BMP_FILE_HEADER_SIZE;
+    uint32_t pixelOffset = ReadU32(data + 10);
+    uint32_t infoSize    = ReadU32(info + 0);
+    int32_t  width       = (int32_t)ReadU32(info + 4);
+    int32_t  height      = (int32_t)ReadU32(info + 8);
+    uint16_t planes      = ReadU16(info + 12);
+    uint16_t bitCount    = ReadU16(info + 14);
+    uint32_t compression = ReadU32(info + 16);
+
+    // We only handle plain 24 bit BGR and 32 bit BGRA pixels
+    bool supported = infoSize >= BMP_INFO_HEADER_SIZE && planes == 1 && width > 0 && height != 0 &&
+        ((bitCount == 24 && compression == BMP_RGB) ||
+         (bitCount == 32 && (compression == BMP_RGB || compression == BMP_BITFIELDS)));
+
+    if (supported && compression == BMP_BITFIELDS)
+    {   // The masks follow the 40 byte header, they have to be the usual BGRA order
+        if (size < BMP_FILE_HEADER_SIZE + BMP_INFO_HEADER_SIZE + 12)
+            supported = false;
+        else
+        {
+            const unsigned char* masks = info + BMP_INFO_HEADER_SIZE;
+            supported = ReadU32(masks + 0) == 0x00FF0000 && ReadU32(masks + 4) == 0x0000FF00 && ReadU32(masks + 8) == 0x000000FF;
+        }
+    }
+
+    if (!supported)
+    {
+        std::cout << "BMP \"" << fileLoc << "\" isn't 24 or 32 bit uncompressed\n";
+        return 3;
+    }
 
-    // Go to where image data starts, then read in image data
-    file.seekg(bmpHeader->bfOffBits);
-    file.read((char*)pixels, bmpInfo->biSizeImage);
+    // Negative height means the rows are stored top to bottom
+    bool topDown = height < 0;
+    int rows = topDown ? -height : height;
 
-    // We're almost done. We have our image loaded, however it's
-    // not in the right format. *.bmp files store image data in the
-    // BGR format, and we have to convert it to RGB. Since we have 
-    // the value in bytes, this shouldn't be to hard to accomplish
-    Uint8 tmpRGB = 0; // Swap buffer
-    for (unsigned long i = 0; i < bmpInfo->biSizeImage; i += 3)
+    // Every row is padded out to 4 bytes
+    int bytesPerPixel = bitCount / 8;
+    size_t stride = ((size_t)width * bytesPerPixel + 3) & ~(size_t)3;
+    if (pixelOffset > size || stride * rows > size - pixelOffset)
     {
-        tmpRGB = pixels[i];
-        pixels[i] = pixels[i + 2];
-        pixels[i + 2] = tmpRGB;
+        std::cout << "BMP \"" << fileLoc << "\" is truncated\n";
+        return 4;
     }
 
+    const unsigned char* pixels = data + pixelOffset;
+
     // Set width and height to the values loaded from the file
-    tex.width   = bmpInfo->biWidth;
-    tex.height  = bmpInfo->biHeight;
+    tex.width   = width;
+    tex.height  = rows;
 
     /*******************GENERATING TEXTURES*******************/
 
     glGenTextures(1, &tex.texture);     // Generate a texture
     glBindTexture(GL_TEXTURE_2D, tex.texture); // Bind that texture
 
-    GLint mode = GL_RGB;    // Set the mode
-
     glTexParameteri(    // Set the minification filtering
         GL_TEXTURE_2D,
         GL_TEXTURE_MIN_FILTER,
@@ -97,26 +118,42 @@ int LoadBMP(const char * fileLoc, Texture & tex)
         GL_TEXTURE_WRAP_T,
 		GL_CLAMP_TO_BORDER);
 
+    // Only a bitfield file whose header has an alpha mask really has alpha. In the others the
+    // fourth byte is reserved and usually 0, so it's uploaded but dropped by the format.
+    bool hasAlpha = compression == BMP_BITFIELDS && infoSize >= BMP_V4_HEADER_SIZE &&
+        size >= BMP_FILE_HEADER_SIZE + BMP_V4_HEADER_SIZE && ReadU32(info + 52) == 0xFF000000;
+    GLint internalFormat = hasAlpha ? GL_RGBA8 : GL_RGB8;
 
-    // Create the texture. We get the offsets from the image, then
-    // we use it with the image's pixel data to create it.
-    glTexImage2D(GL_TEXTURE_2D, 0, mode, tex.width, tex.height,
-        0, mode, GL_UNSIGNED_BYTE, pixels);
+    // The BMP rows are already laid out the way GL unpacks them: BGR(A) texels, rows
+    // padded to 4 bytes, bottom row first. So the mapping can be uploaded as it is.
+    GLenum format = bytesPerPixel == 4 ? GL_BGRA : GL_BGR;
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, width);
+
+    if (!topDown)
+    {
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, tex.width, tex.height,
+            0, format, GL_UNSIGNED_BYTE, pixels);
+    }
+    else
+    {   // Top down files are flipped by uploading the rows in reverse, still without a copy
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, tex.width, tex.height,
+            0, format, GL_UNSIGNED_BYTE, nullptr);
+        for (int y = 0; y < rows; y++)
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, y, width, 1, format, GL_UNSIGNED_BYTE, pixels + (rows - 1 - y) * stride);
+    }
+
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
 
     glGenerateMipmap(GL_TEXTURE_2D);
 
     // Unbind the texture
-    glBindTexture(GL_TEXTURE_2D, NULL);
+    glBindTexture(GL_TEXTURE_2D, 0);
 
     // Output a successful message
     std::cout << "Texture \"" << fileLoc << "\" loaded success.\n";
 
-    // Delete the two buffers.
-    delete[] datBuff[0];
-    delete[] datBuff[1];
-    delete[] pixels;
-
-    return 0; // Return success code 
+    return 0; // Return success code, the mapping is released when 'file' goes out of scope
 }
 
 /*---------------------------- Functions ----------------------------*/
@@ -0,0 +1,41 @@
+/**************************************************
+ *
+ *                 MappedFile.h
+ *
+ *  Read-only memory mapping of a whole file, so
+ *  loaders can hand pointers into the file straight
+ *  to OpenGL without copying it first.
+ *
+ ***************************************************/
+
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cstddef>
+
+class MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile();
+
+    bool Open(const char* fileName);    // Returns false if the file can't be opened or mapped
+    void Close();
+
+    const unsigned char* Data() const { return data; }
+    size_t Size() const { return size; }
+    bool IsOpen() const { return data != nullptr; }
+
+private:
+    MappedFile(const MappedFile&);            // Not copyable, the mapping has one owner
+    MappedFile& operator=(const MappedFile&);
+
+    const unsigned char* data;
+    size_t size;
+#ifdef _WIN32
+    void* fileHandle;
+    void* mappingHandle;
+#endif
+};
+
+#endif
@@ -0,0 +1,72 @@
+/**************************************************
+ *
+ *                  camerapath.h
+ *
+ *  A rail for the camera to ride on: a smooth
+ *  curve through keyframes, each a position and
+ *  a point to look at, evaluated by distance
+ *  along it instead of by curve parameter, so
+ *  the camera moves at the same speed however
+ *  the keys are spaced.
+ *
+ *  Build samples every segment and keeps the
+ *  running length at each sample. Evaluate
+ *  binary searches that table for the distance
+ *  and only works out the one segment it lands
+ *  in, so a frame costs O(log n) in the keys.
+ *
+ ***************************************************/
+
+#ifndef CAMERAPATH_H
+#define CAMERAPATH_H
+
+#include <GLM/glm.hpp>
+
+#include <vector>
+
+#define CAMERAPATH_SAMPLES  32      // Arc length samples per segment
+
+enum CameraPathCurve
+{
+    CAMERAPATH_CATMULL_ROM,     // Goes through every key
+    CAMERAPATH_BEZIER           // Keys are anchor, handle, handle, anchor, handle, ...
+};
+
+class CameraPath
+{
+public:
+    CameraPath();
+
+    // 'targets' is either empty, to look along the rail, or has a point for every key.
+    // A Bezier rail needs 3n + 1 keys, or 3n if it's closed and runs back to the first.
+    // Returns false and leaves the rail empty if the keys don't make one.
+    bool Build(const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& targets,
+               CameraPathCurve curve, bool closed);
+
+    // Where the camera is and what it looks at, 'distance' along the rail. A closed rail
+    // wraps around, an open one stops at its ends.
+    void Evaluate(float distance, glm::vec3& position, glm::vec3& target) const;
+
+    float Length() const;
+    int Keys() const;                   // Keys the rail goes through, Bezier handles aren't
+    float KeyDistance(int key) const;   // How far along the rail a key is
+    float Wrap(float distance) const;   // Into [0, Length()) on a closed rail, clamped on an open one
+    bool Closed() const;
+
+private:
+    // A segment as a cubic Bezier, for the position and for the target
+    struct Segment
+    {
+        glm::vec3 position[4];
+        glm::vec3 target[4];
+    };
+
+    static glm::vec3 Bezier(const glm::vec3 c[4], float t);
+    static glm::vec3 BezierDirection(const glm::vec3 c[4], float t);
+
+    std::vector<Segment> segments;
+    std::vector<float> distances;   // The length up to each sample, CAMERAPATH_SAMPLES a segment and one for the end
+    bool closed, lookAlong;
+};
+
+#endif
@@ -0,0 +1,9 @@
+#version 400
+layout(location = 0) in vec3 vp;
+
+uniform mat4 mvp;
+
+void main()
+{
+    gl_Position = mvp * vec4(vp, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,87 @@
+/*****************************************
+ *
+ *              gputimer.cpp
+ *
+ *  A ring of GL_TIME_ELAPSED queries.
+ *
+ ****************************************/
+
+#include "gputimer.h"
+
+GpuTimer::GpuTimer() : next(0), milliseconds(0.0f)
+{
+    for (int i = 0; i < GPU_TIMER_QUERIES; i++)
+    {
+        queries[i] = 0;
+        pending[i] = false;
+    }
+}
+
+void GpuTimer::Begin()
+{
+    if (queries[0] == 0)
+        glGenQueries(GPU_TIMER_QUERIES, queries);
+
+    // All queries still out means the GPU is that far behind, the oldest is waited for
+    if (pending[next])
+    {
+        GLuint64 ns = 0;
+        glGetQueryObjectui64v(queries[next], GL_QUERY_RESULT, &ns);
+        pending[next] = false;
+        Add(ns);
+    }
+    glBeginQuery(GL_TIME_ELAPSED, queries[next]);
+}
+
+void GpuTimer::End()
+{
+    glEndQuery(GL_TIME_ELAPSED);
+    pending[next] = true;
+    next = (next + 1) % GPU_TIMER_QUERIES;
+    Collect();
+}
+
+// Reads back every result that is ready, oldest first
+void GpuTimer::Collect()
+{
+    for (int k = 0; k < GPU_TIMER_QUERIES; k++)
+    {
+        int i = (next + k) % GPU_TIMER_QUERIES;
+        if (!pending[i])
+            continue;
+
+        GLint available = 0;
+        glGetQueryObjectiv(queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            break;
+
+        GLuint64 ns = 0;
+        glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &ns);
+        pending[i] = false;
+        Add(ns);
+    }
+}
+
+void GpuTimer::Add(GLuint64 nanoseconds)
+{
+    float ms = nanoseconds * 1e-6f;
+    milliseconds = milliseconds == 0.0f ? ms : milliseconds * 0.9f + ms * 0.1f;
+}
+
+float GpuTimer::Milliseconds() const
+{
+    return milliseconds;
+}
+
+void GpuTimer::Release()
+{
+    if (queries[0] != 0)
+        glDeleteQueries(GPU_TIMER_QUERIES, queries);
+    for (int i = 0; i < GPU_TIMER_QUERIES; i++)
+    {
+        queries[i] = 0;
+        pending[i] = false;
+    }
+    next = 0;
+    milliseconds = 0.0f;
+}
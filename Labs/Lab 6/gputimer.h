@@ -0,0 +1,43 @@
+/**************************************************
+ *
+ *                   gputimer.h
+ *
+ *  Times draw calls on the GPU with timer
+ *  queries. Results are read back a few frames
+ *  late, once the GPU has them, so timing never
+ *  makes the CPU wait on it.
+ *
+ ***************************************************/
+
+#ifndef GPUTIMER_H
+#define GPUTIMER_H
+
+#include <GL/gl3w.h>
+
+#define GPU_TIMER_QUERIES 4     // Frames a result can take to come back
+
+class GpuTimer
+{
+public:
+    GpuTimer();
+
+    // Around the calls to time, at most once per frame
+    void Begin();
+    void End();
+
+    // Averaged over the last frames, 0 until the first result is back
+    float Milliseconds() const;
+
+    void Release();             // Deletes the queries, Begin makes them again
+
+private:
+    void Collect();
+    void Add(GLuint64 nanoseconds);
+
+    GLuint queries[GPU_TIMER_QUERIES];
+    bool pending[GPU_TIMER_QUERIES];
+    int next;
+    float milliseconds;
+};
+
+#endif
@@ -1,5 +1,5 @@
 #version 400
-in vec3 vp;
+layout(location = 0) in vec3 vp;
 
 uniform mat4 mvp;
 
@@ -14,13 +14,22 @@
 #include <stdio.h>  // Used for 'printf'
 #include <vector>   // Used for 'vector<vec3>'
 
-#include <unordered_map> // Used for fast smooth normals
-
 using namespace glm;
 
 extern "C" {
     #include "readply.h" // For reading in the bunny
 }
+#include "threadpool.h" // readply parses ASCII files on every core
+#include "streamedmesh.h" // Part 3, shows a scan while it streams in
+#include "smoothnormals.h" // Smooth normals for the bunny
+#include "pointoctree.h" // Part 4, builds a level of detail octree from a scan's points
+#include "pointcloud.h" // Part 4, draws it
+#include "polylines.h" // Part 2, the spline's control points
+#include "splinemesh.h" // Part 2, draws them through line.geom or as instanced ribbons
+#include "splinecache.h" // Part 2, or tessellated once on the CPU
+#include "gputimer.h" // Part 2, how long each takes on the GPU
+#include "camerapath.h" // The rail the bunny's camera rides between its positions
+#include "framepacer.h" // Sleeps the loop to its frame rate
 
 /*---------------------------- Variables ----------------------------*/
 // GLFW window
@@ -34,20 +43,53 @@ GLuint spec_loc, diff_loc, line_loc;
 GLuint pow_loc, tension_loc, divisions_loc, width_loc;
 
 // Shader programs
-GLuint bunny_program, bezier_program;
+GLuint bunny_program, bezier_program, scan_program, points_program;
 
 // Vertex Array Objects
-GLuint bunny_vao, bunny_vertexCount;
-GLuint bezier_vao, bezier_vertexCount;
+GLuint bunny_vao, bunny_vbo, bunny_ebo, bunny_indexCount;
 
 // model, view, projection, normal matrices
 mat4 m, v, p, n, mvp;
 
+// The splines' file, which of the three ways they're drawn and how long each way takes
+GLuint ribbon_program, ribbon_mvp_loc, ribbon_line_loc, ribbon_tension_loc, ribbon_divisions_loc, ribbon_width_loc;
+GLuint curve_program, curve_mvp_loc, curve_line_loc;
+Polylines splines;
+char splineFile[256] = ASSETS"points.polyline";
+int splineRenderer = 2; // 0 is line.geom, 1 the instanced ribbons, 2 the cached tessellation
+float splineTolerance = 0.25f; // Pixels the cached tessellation may stray from the curve
+GpuTimer geometryTimer, ribbonTimer, curveTimer;
+
+// Uniform locations and matrices for the streamed scan
+GLuint scan_mv_loc, scan_p_loc, scan_diff_loc, scan_points_loc;
+mat4 scan_mv;
+
+// File the scan is streamed from, and how much memory it may use while loading
+char scanFile[256] = ASSETS"bunny.ply";
+int scanMemoryMB = 16;
+
+// Uniform locations and matrices for the point cloud
+GLuint points_mv_loc, points_p_loc, points_diff_loc, points_scale_loc, points_confidence_loc;
+mat4 points_mv;
+
+// The point cloud's file, the octree is built next to it with .octree added, the memory
+// building it and drawing it may use, and the level of detail
+char pointFile[256] = ASSETS"bunny.ply";
+int pointBuildMB = 256, pointGpuMB = 512;
+int pointBudgetK = 2000; // Thousands of points drawn at most
+float pointSpacing = 1.5f; // Nodes are refined until their points are this many pixels apart
+float pointScale = 1.0f, minConfidence = 0.0f;
+
 // diffuse and specular color
 vec3 diffCol, specCol;
 vec3 lineCol;
 
 float specPower; // <-- For the bunny
+
+// The bunny, and how its smooth normals are weighted and where they are split
+ply_model* bunny;
+int normalWeight = NORMALS_AREA_ANGLE;
+float creaseAngle = 180.0f;
 float tension, width; int divisions; // <-- For the spline
 
 // Possible camera locations
@@ -57,10 +99,11 @@ vec3 cameraPositions[4] = {
     vec3(1.0f, 1.6f, 1.0f),
     vec3(-1.0f, -0.6f, 1.0f)
 };
-vec3 oldPosition = cameraPositions[0]; // Used in the interpolation function
-vec3 newPosition = cameraPositions[0]; // Used in the interpolation function
+CameraPath cameraRail; // A loop through the camera positions, all looking at the bunny
+float railDistance = 0.0f; // How far along the rail the camera is
+float railTravel = 0.0f; // How far it still has to go, negative goes back along the rail
+float railSpeed = 0.75f; // Units a second, the same all the way round
 vec3 camPosition; int cam = 0; // Camera position, and cam is used for the GUI buttons
-float interpolationValue = 1.0f; // This is 0 to 1, used for the mix function
 
 // ImGUI variables
 bool isOpen = false; int part = 0;
@@ -84,6 +127,31 @@ void CheckShader(GLuint a_shader)
     }
 }
 
+// Rebuilds the bunny's vertices and indices with the current normal settings. The
+// vertices are interleaved, a position then a normal, so the attributes stay the same.
+void BuildBunnyNormals()
+{
+    SmoothMesh mesh;
+    SmoothNormals::Build(bunny, (NormalWeight)normalWeight, creaseAngle, true, mesh);
+    bunny_indexCount = (GLuint)mesh.indices.size();
+
+    glBindBuffer(GL_ARRAY_BUFFER, bunny_vbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(float) * mesh.vertices.size(), mesh.vertices.data(), GL_STATIC_DRAW);
+    glBindVertexArray(bunny_vao);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bunny_ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * mesh.indices.size(), mesh.indices.data(), GL_STATIC_DRAW);
+}
+
+// Maps a polyline file and uploads its points, false if it can't be read (and then
+// there are no splines). The mapping stays open for the cached tessellation.
+bool LoadSplines(const char* fileName)
+{
+    bool ok = splines.Open(fileName);
+    SplineMesh::Upload(splines);
+    SplineCache::Invalidate();
+    return ok;
+}
+
 void Initialize()
 {
     // Initializing part 1
@@ -117,97 +185,18 @@ void Initialize()
         glAttachShader(bunny_program, vs);
         glLinkProgram(bunny_program);
 
-        // Read in the bunny model here, and then set it up
-        ply_model* bunny = readply(ASSETS"bunny.ply");
-        bunny_vertexCount = bunny->nface * 3; // 3 vertices per triangle
-
-                                            // this is where we will keep the points and normals
-        std::vector<vec3> points;
-        std::vector<vec3> normals;
-
-        // this is used for a fast computation of smooth normals
-        std::unordered_map<int, std::vector<int>> normalIndices;
-
-        // Here we translate the ply_model struct into a useful list of vertices
-        for (int i = 0, j = 0; i < bunny->nface; i++, j += 3)
-        {
-            ply_face f = bunny->faces[i];
-
-            ply_vertex a = bunny->vertices[f.vertices[0]];
-            ply_vertex b = bunny->vertices[f.vertices[1]];
-            ply_vertex c = bunny->vertices[f.vertices[2]];
-
-            // using glm math instead of ply_vertex
-            vec3 vert1 = vec3(a.x, a.y, a.z);
-            vec3 vert2 = vec3(b.x, b.y, b.z);
-            vec3 vert3 = vec3(c.x, c.y, c.z);
-
-            // computing the face normals, these are shared
-            vec3 normal;
-            normal = cross(
-                normalize(vert3 - vert1),
-                normalize(vert2 - vert1)
-            );
-
-            // add the normal indices into the array. These will
-            // either be displayed, or just used for the smooth
-            // normal computation
-            normalIndices[f.vertices[0]].push_back(j + 0);
-            normalIndices[f.vertices[1]].push_back(j + 1);
-            normalIndices[f.vertices[2]].push_back(j + 2);
-
-            // adding vertices
-            points.push_back(vert1);
-            points.push_back(vert2);
-            points.push_back(vert3);
-
-            // adding normals
-            normals.push_back(normal);
-            normals.push_back(normal);
-            normals.push_back(normal);
-        }
-
-        // copy the list over so we can easily allocate the space
-        std::vector<vec3> smoothNormals = normals;
-        for (auto itr = normalIndices.begin(); itr != normalIndices.end(); itr++)
-        {
-            // This will compute the 'average' of the shared normals, resulting in a smooth
-            // effect on the bunny
-            vec3 smoothNormal = vec3(0);
-            for (int i = 0; i < (*itr).second.size(); i++) // for each new normal
-            {
-                smoothNormal += normals[(*itr).second[i]]; // add the normal shared by the vertex
-            }
-            smoothNormal /= (float)(*itr).second.size(); // average it out
-
-                                                         // This populates our smoothed normal list with the new normals
-            for (int i = 0; i < (*itr).second.size(); i++) // add them to their respective indices
-            {
-                smoothNormals[(*itr).second[i]] = smoothNormal;
-            }
-        }
-
-        // This interleaved buffer means that the normals and vertices will occupy
-        // the same space in memory. It is useful because we can keep the same
-        // attribute locations and stride
-        vec3* interleaved_buffer = new vec3[bunny_vertexCount * 2];
-
-        for (int i = 0, j = 0; i < bunny_vertexCount * 2; i += 2, j++)
-        {
-            interleaved_buffer[i + 0] = points[j];
-            //interleaved_buffer[i + 1] = normals[j];
-            interleaved_buffer[i + 1] = smoothNormals[j];
-        }
-
-        GLuint vbo = 0;
-        glGenBuffers(1, &vbo);
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(vec3) * bunny_vertexCount * 2, &interleaved_buffer[0], GL_STATIC_DRAW);
+        // Read in the bunny model here, and then set it up. The model is kept so the
+        // normals can be rebuilt when their settings change in the GUI.
+        bunny = readply(ASSETS"bunny.ply");
 
         bunny_vao = 0;
         glGenVertexArrays(1, &bunny_vao);
         glBindVertexArray(bunny_vao);
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glGenBuffers(1, &bunny_vbo);
+        glBindBuffer(GL_ARRAY_BUFFER, bunny_vbo);
+        glGenBuffers(1, &bunny_ebo);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bunny_ebo);
+        BuildBunnyNormals();
 
         GLuint vpos_location = glGetAttribLocation(bunny_program, "vp");
         GLuint vnorm_location = glGetAttribLocation(bunny_program, "vn");
@@ -275,45 +264,53 @@ void Initialize()
         glAttachShader(bezier_program, vs);
         glLinkProgram(bezier_program);
 
-        std::vector<vec3> points;
-
-        {   // Read file
-            FILE* pFile;
-            long lSize;
-            char* buffer;
-            size_t result;
-
-            pFile = fopen(ASSETS"points.txt", "r");
-            if (pFile == NULL)
-            {
-                printf("ERR: File error"); exit(1);
-            }
-
-            // read the first word of the line
-            int res = fscanf(pFile, "%i\n", &bezier_vertexCount);
-
-            for (int i = 0; i < bezier_vertexCount; i++)
-            {
-                vec3 vertex;
-                fscanf(pFile, "%f %f %f\n", &vertex.x, &vertex.z, &vertex.y);
-                points.push_back(vertex);
-            }
-        }
-
-        GLuint vbo = 0;
-        glGenBuffers(1, &vbo);
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(vec3) * bezier_vertexCount, &points[0][0], GL_STATIC_DRAW);
-
-        bezier_vao = 0;
-        glGenVertexArrays(1, &bezier_vao);
-        glBindVertexArray(bezier_vao);
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
-
-        GLuint vpos_location = glGetAttribLocation(bezier_program, "vp");
-
-        glEnableVertexAttribArray(vpos_location);
-        glVertexAttribPointer(vpos_location, 3, GL_FLOAT, GL_FALSE, sizeof(vec3), (void*)0);
+        // The same spline without the geometry shader, every vertex placed by ribbon.vert
+        std::string ribbon_shader_contents;
+        std::ifstream rstream(ASSETS"ribbon.vert", std::ios::in);
+        while (std::getline(rstream, line))
+            ribbon_shader_contents.append(line).push_back('\n');
+        char const * ribbon_shader = ribbon_shader_contents.c_str();
+
+        GLuint rs = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(rs, 1, &ribbon_shader, NULL);
+        glCompileShader(rs);
+
+        CheckShader(rs);
+
+        ribbon_program = glCreateProgram();
+        glAttachShader(ribbon_program, fs);
+        glAttachShader(ribbon_program, rs);
+        glLinkProgram(ribbon_program);
+
+        // And already tessellated, curve.vert only transforms
+        std::string curve_shader_contents;
+        std::ifstream cstream(ASSETS"curve.vert", std::ios::in);
+        while (std::getline(cstream, line))
+            curve_shader_contents.append(line).push_back('\n');
+        char const * curve_shader = curve_shader_contents.c_str();
+
+        GLuint cs = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(cs, 1, &curve_shader, NULL);
+        glCompileShader(cs);
+
+        CheckShader(cs);
+
+        curve_program = glCreateProgram();
+        glAttachShader(curve_program, fs);
+        glAttachShader(curve_program, cs);
+        glLinkProgram(curve_program);
+
+        // The binary file is written from points.txt the first time
+        if (!LoadSplines(splineFile) && Polylines::ConvertText(ASSETS"points.txt", splineFile))
+            LoadSplines(splineFile);
+
+        ribbon_mvp_loc = glGetUniformLocation(ribbon_program, "mvp");
+        ribbon_line_loc = glGetUniformLocation(ribbon_program, "lineColor");
+        ribbon_tension_loc = glGetUniformLocation(ribbon_program, "tension");
+        ribbon_divisions_loc = glGetUniformLocation(ribbon_program, "divisions");
+        ribbon_width_loc = glGetUniformLocation(ribbon_program, "width");
+        curve_mvp_loc = glGetUniformLocation(curve_program, "mvp");
+        curve_line_loc = glGetUniformLocation(curve_program, "lineColor");
 
         mvp_loc = glGetUniformLocation(bezier_program, "mvp");
         line_loc = glGetUniformLocation(bezier_program, "lineColor");
@@ -326,6 +323,89 @@ void Initialize()
         divisions = 30;
         width = 0.006f;
     }
+
+    // Initializing part 3, the scan itself only loads when asked for in the GUI
+    {
+        std::string line;
+
+        std::string vertex_shader_contents;
+        std::ifstream vstream(ASSETS"scan.vert", std::ios::in);
+        while (std::getline(vstream, line))
+            vertex_shader_contents.append(line).push_back('\n');
+        char const * vertex_shader = vertex_shader_contents.c_str();
+
+        std::string fragment_shader_contents;
+        std::ifstream fstream(ASSETS"scan.frag", std::ios::in);
+        while (std::getline(fstream, line))
+            fragment_shader_contents.append(line).push_back('\n');
+        char const * fragment_shader = fragment_shader_contents.c_str();
+
+        GLuint vs = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(vs, 1, &vertex_shader, NULL);
+        glCompileShader(vs);
+        GLuint fs = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(fs, 1, &fragment_shader, NULL);
+        glCompileShader(fs);
+
+        CheckShader(vs);
+        CheckShader(fs);
+
+        scan_program = glCreateProgram();
+        glAttachShader(scan_program, fs);
+        glAttachShader(scan_program, vs);
+        glLinkProgram(scan_program);
+
+        scan_mv_loc = glGetUniformLocation(scan_program, "mv");
+        scan_p_loc = glGetUniformLocation(scan_program, "p");
+        scan_diff_loc = glGetUniformLocation(scan_program, "diffuseColor");
+        scan_points_loc = glGetUniformLocation(scan_program, "points");
+    }
+
+    // Initializing part 4, the point cloud is only opened when asked for in the GUI
+    {
+        std::string line;
+
+        std::string vertex_shader_contents;
+        std::ifstream vstream(ASSETS"points.vert", std::ios::in);
+        while (std::getline(vstream, line))
+            vertex_shader_contents.append(line).push_back('\n');
+        char const * vertex_shader = vertex_shader_contents.c_str();
+
+        std::string fragment_shader_contents;
+        std::ifstream fstream(ASSETS"points.frag", std::ios::in);
+        while (std::getline(fstream, line))
+            fragment_shader_contents.append(line).push_back('\n');
+        char const * fragment_shader = fragment_shader_contents.c_str();
+
+        GLuint vs = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(vs, 1, &vertex_shader, NULL);
+        glCompileShader(vs);
+        GLuint fs = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(fs, 1, &fragment_shader, NULL);
+        glCompileShader(fs);
+
+        CheckShader(vs);
+        CheckShader(fs);
+
+        points_program = glCreateProgram();
+        glAttachShader(points_program, fs);
+        glAttachShader(points_program, vs);
+        glLinkProgram(points_program);
+
+        points_mv_loc = glGetUniformLocation(points_program, "mv");
+        points_p_loc = glGetUniformLocation(points_program, "p");
+        points_diff_loc = glGetUniformLocation(points_program, "diffuseColor");
+        points_scale_loc = glGetUniformLocation(points_program, "pointScale");
+        points_confidence_loc = glGetUniformLocation(points_program, "minConfidence");
+    }
+
+    // The camera's rail, a Catmull-Rom loop through its positions
+    {
+        std::vector<vec3> positions(cameraPositions, cameraPositions + 4);
+        std::vector<vec3> targets(4, vec3(0.0f, 0.5f, 0.0f));
+        cameraRail.Build(positions, targets, CAMERAPATH_CATMULL_ROM, true);
+        railDistance = cameraRail.KeyDistance(cam);
+    }
 }
 
 void Update(float deltaTime)
@@ -336,26 +416,75 @@ void Update(float deltaTime)
     glViewport(0, 0, width, height);
     float ratio = width / (float)height;
 
+    // Uploads whatever the scan's reader has got through since last frame
+    StreamedMesh::Update();
+
     if (part == 0)
     {
-        float duration = 2.0f; // This means we want it to take 5 seconds to get from A to B
-        interpolationValue += deltaTime * (1.0f / duration); // This increases linearly
-        interpolationValue = glm::clamp(interpolationValue, 0.0f, 1.0f);
+        // Ride the rail towards the chosen position, at the same speed the whole way
+        float step = glm::min(glm::abs(railTravel), railSpeed * deltaTime);
+        step = railTravel < 0.0f ? -step : step;
+        railDistance = cameraRail.Wrap(railDistance + step);
+        railTravel -= step;
 
         // Compute the camera position here
-		float smoothInterpolation = glm::smoothstep(0.0f, 1.0f, interpolationValue);
-        camPosition = glm::mix(oldPosition, newPosition, smoothInterpolation);
+        vec3 camTarget;
+        cameraRail.Evaluate(railDistance, camPosition, camTarget);
 
         // compute the matrices and colors
         m = scale(mat4(1.0f), vec3(5.0f)); // scale of 5 for the bunny
-        v = lookAt(camPosition, vec3(0.0f, 0.5f, 0.0f), vec3(0.0f, 1.0f, 0.0f));
+        v = lookAt(camPosition, camTarget, vec3(0.0f, 1.0f, 0.0f));
         p = perspective(1.39626f, ratio, 0.01f, 10.0f); // 80 deg fov
         n = transpose(inverse(v * m));
     }
-    else
+    else if (part == 1)
     {
         mvp = ortho(-ratio, ratio, -1.0f, 1.0f, -10.0f, 10.0f);
         mvp = scale(mvp, vec3(0.75f));
+
+        // Tessellated again only if the tolerance, in the lines' units, or the curve changed
+        if (splineRenderer == 2)
+        {
+            float pixelsPerUnit = mvp[1][1] * height * 0.5f;
+            SplineCache::Update(splines, tension, ::width, splineTolerance / pixelsPerUnit); // The line's width, not the window's
+        }
+    }
+    else if (part == 2)
+    {
+        // Fit what has arrived so far into the space the bunny takes up
+        vec3 low, high;
+        mat4 fit = mat4(1.0f);
+        if (StreamedMesh::Bounds(low, high))
+        {
+            vec3 size = high - low;
+            float extent = max(max(size.x, size.y), max(size.z, 1e-6f));
+            fit = translate(mat4(1.0f), vec3(0.0f, 0.5f, 0.0f));
+            fit = scale(fit, vec3(0.8f / extent));
+            fit = translate(fit, -(low + high) * 0.5f);
+        }
+
+        v = lookAt(camPosition, vec3(0.0f, 0.5f, 0.0f), vec3(0.0f, 1.0f, 0.0f));
+        p = perspective(1.39626f, ratio, 0.01f, 10.0f); // 80 deg fov
+        scan_mv = v * fit;
+    }
+    else
+    {
+        // The octree's cube in the space the bunny takes up
+        vec3 low, high;
+        mat4 fit = mat4(1.0f);
+        if (PointCloud::Bounds(low, high))
+        {
+            fit = translate(mat4(1.0f), vec3(0.0f, 0.5f, 0.0f));
+            fit = scale(fit, vec3(0.8f / (high.x - low.x)));
+            fit = translate(fit, -(low + high) * 0.5f);
+        }
+
+        v = lookAt(camPosition, vec3(0.0f, 0.5f, 0.0f), vec3(0.0f, 1.0f, 0.0f));
+        p = perspective(1.39626f, ratio, 0.01f, 10.0f); // 80 deg fov
+        points_mv = v * fit;
+
+        // Picks the nodes for this view and uploads the ones that have been paged in
+        PointCloud::Update(fit, v, p, height, pointBudgetK * 1000, pointSpacing);
     }
 }
 
@@ -378,29 +507,99 @@ void Render()
         glUniform1fv(pow_loc, 1, &specPower);
 
         // draw points from the currently bound VAO with current in-use shader
-        glDrawArrays(GL_TRIANGLES, 0, bunny_vertexCount);
+        glDrawElements(GL_TRIANGLES, bunny_indexCount, GL_UNSIGNED_INT, (void*)0);
+    }
+    else if (part == 1)
+    {
+        if (splineRenderer == 0)
+        {
+            // send up the uniforms
+            glUseProgram(bezier_program);
+
+            glUniformMatrix4fv(mvp_loc, 1, GL_FALSE, &mvp[0][0]);
+            glUniform3fv(line_loc, 1, &lineCol[0]);
+            glUniform1fv(tension_loc, 1, &tension);
+            glUniform1iv(divisions_loc, 1, &divisions);
+            glUniform1fv(width_loc, 1, &width);
+
+            // every line as a strip with adjacency, line.geom makes the quads
+            geometryTimer.Begin();
+            SplineMesh::DrawAdjacency();
+            geometryTimer.End();
+        }
+        else if (splineRenderer == 1)
+        {
+            glUseProgram(ribbon_program);
+
+            glUniformMatrix4fv(ribbon_mvp_loc, 1, GL_FALSE, &mvp[0][0]);
+            glUniform3fv(ribbon_line_loc, 1, &lineCol[0]);
+            glUniform1fv(ribbon_tension_loc, 1, &tension);
+            glUniform1iv(ribbon_divisions_loc, 1, &divisions);
+            glUniform1fv(ribbon_width_loc, 1, &width);
+
+            // one instance per segment, ribbon.vert fetches the control points itself
+            ribbonTimer.Begin();
+            SplineMesh::DrawInstanced(divisions);
+            ribbonTimer.End();
+        }
+        else
+        {
+            glUseProgram(curve_program);
+
+            glUniformMatrix4fv(curve_mvp_loc, 1, GL_FALSE, &mvp[0][0]);
+            glUniform3fv(curve_line_loc, 1, &lineCol[0]);
+
+            // the strip was built on the CPU, one draw with nothing left to work out
+            curveTimer.Begin();
+            SplineCache::Draw();
+            curveTimer.End();
+        }
+    }
+    else if (part == 2)
+    {
+        glUseProgram(scan_program);
+
+        glUniformMatrix4fv(scan_mv_loc, 1, GL_FALSE, &scan_mv[0][0]);
+        glUniformMatrix4fv(scan_p_loc, 1, GL_FALSE, &p[0][0]);
+        glUniform3fv(scan_diff_loc, 1, &diffCol[0]);
+        glUniform1i(scan_points_loc, StreamedMesh::Triangles() ? 0 : 1);
+
+        // Points until the first faces are in, triangles after that
+        StreamedMesh::Draw();
     }
     else
     {
-        // send up the uniforms
-        glUseProgram(bezier_program);
-        glBindVertexArray(bezier_vao);
+        glUseProgram(points_program);
 
-        glUniformMatrix4fv(mvp_loc, 1, GL_FALSE, &mvp[0][0]);
-        glUniform3fv(line_loc, 1, &lineCol[0]);
-        glUniform1fv(tension_loc, 1, &tension);
-        glUniform1iv(divisions_loc, 1, &divisions);
-        glUniform1fv(width_loc, 1, &width);
+        glUniformMatrix4fv(points_mv_loc, 1, GL_FALSE, &points_mv[0][0]);
+        glUniformMatrix4fv(points_p_loc, 1, GL_FALSE, &p[0][0]);
+        glUniform3fv(points_diff_loc, 1, &diffCol[0]);
+        glUniform1f(points_scale_loc, pointScale);
+        glUniform1f(points_confidence_loc, minConfidence);
 
-        // draw points from the currently bound VAO with current in-use shader
-        glDrawArrays(GL_LINE_STRIP_ADJACENCY, 0, bezier_vertexCount);
+        PointCloud::Draw(points_program);
     }
 }
 
 void Cleanup()
 {
     glDeleteProgram(bunny_program);
+    freeply(bunny);
     glDeleteProgram(bezier_program);
+    glDeleteProgram(ribbon_program);
+    glDeleteProgram(curve_program);
+    SplineMesh::Release();
+    SplineCache::Release();
+    splines.Close();
+    geometryTimer.Release();
+    ribbonTimer.Release();
+    curveTimer.Release();
+    glDeleteProgram(scan_program);
+    glDeleteProgram(points_program);
+
+    StreamedMesh::Shutdown();
+    PointCloud::Close();
+    ThreadPool::Shutdown();
 }
 
 void GUI()
@@ -410,8 +609,24 @@ void GUI()
     {
         ImGui::Text("%.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
 
+        // How the frames are paced, and how closely they kept to it
+        int pacing = FramePacer::Mode();
+        float rate = FramePacer::Rate();
+        bool repace = ImGui::Combo("Frame pacing", &pacing, "Vsync\0Uncapped\0Capped\0");
+        if (pacing == PACING_CAPPED)
+            repace |= ImGui::SliderFloat("Frame rate", &rate, 30.0f, 240.0f, "%.0f");
+        if (repace)
+            FramePacer::SetMode(pacing, rate);
+        FramePacerStats pacingStats = FramePacer::Stats();
+        ImGui::Text("Frames %.2f ms, %.3f ms jitter", pacingStats.frameMs, pacingStats.jitterMs);
+        if (pacing == PACING_CAPPED)
+            ImGui::Text("Late by %.3f ms, %.2f ms at worst, %d missed, %.2f ms spinning",
+                pacingStats.meanErrorMs, pacingStats.worstErrorMs, pacingStats.missed, pacingStats.spinMs);
+
         ImGui::RadioButton("Part 1", &part, 0); ImGui::SameLine();
-        ImGui::RadioButton("Part 2", &part, 1);
+        ImGui::RadioButton("Part 2", &part, 1); ImGui::SameLine();
+        ImGui::RadioButton("Scan", &part, 2); ImGui::SameLine();
+        ImGui::RadioButton("Points", &part, 3);
 
         if (part == 0) // First part is the bunny, expose those variables
         {
@@ -419,8 +634,14 @@ void GUI()
             ImGui::ColorEdit3("Specular", &specCol[0]);
             ImGui::SliderFloat("Specular Power", &specPower, 2.0f, 20.0f, "%.f");
 
+            // Faces meeting at more than the crease angle get separate normals
+            bool rebuild = ImGui::Combo("Normal weights", &normalWeight, "Equal\0Area\0Angle\0Area and angle\0");
+            rebuild |= ImGui::SliderFloat("Crease angle", &creaseAngle, 10.0f, 180.0f, "%.0f deg");
+            if (rebuild)
+                BuildBunnyNormals();
+
             int oldCam = cam;
-            if (interpolationValue == 1.0f)
+            if (railTravel == 0.0f)
             {
                 ImGui::RadioButton("C1", &cam, 0); ImGui::SameLine();
                 ImGui::RadioButton("C2", &cam, 1); ImGui::SameLine();
@@ -429,17 +650,95 @@ void GUI()
             }
             if (cam != oldCam) // This means we changed something
             {
-                oldPosition = newPosition;
-                newPosition = cameraPositions[cam];
-                interpolationValue = 0.0f; // Restart the interpolation
+                // Whichever way round the loop is shorter
+                float length = cameraRail.Length();
+                railTravel = cameraRail.Wrap(cameraRail.KeyDistance(cam) - railDistance);
+                if (railTravel > length * 0.5f)
+                    railTravel -= length;
             }
+            ImGui::SliderFloat("Camera speed", &railSpeed, 0.1f, 4.0f, "%.2f");
         }
-        else // Second part is the line
+        else if (part == 1) // Second part is the line
         {
             ImGui::ColorEdit3("Line Color", &lineCol[0]);
             ImGui::SliderFloat("Line width", &width, 0.001f, 0.01f, "%.3f");
             ImGui::SliderFloat("Tension", &tension, 0.0f, 1.0f, "%.2f");
-            ImGui::SliderInt("Divisions", &divisions, 1, 30);
+            // Every way draws the same curve, switch between them to compare the GPU times
+            ImGui::RadioButton("Geometry shader", &splineRenderer, 0); ImGui::SameLine();
+            ImGui::RadioButton("Instanced", &splineRenderer, 1); ImGui::SameLine();
+            ImGui::RadioButton("Cached", &splineRenderer, 2);
+            if (splineRenderer == 2)
+            {
+                ImGui::SliderFloat("Tolerance (px)", &splineTolerance, 0.05f, 4.0f, "%.2f");
+                ImGui::Text("%d vertices, tessellated %d times, last in %.2f ms", SplineCache::Vertices(),
+                            SplineCache::Builds(), SplineCache::BuildMilliseconds());
+            }
+            else
+                ImGui::SliderInt("Divisions", &divisions, 1, 30);
+            ImGui::Text("GPU: %.3f ms geometry shader, %.3f ms instanced, %.3f ms cached",
+                        geometryTimer.Milliseconds(), ribbonTimer.Milliseconds(), curveTimer.Milliseconds());
+
+            ImGui::InputText("Polylines", splineFile, sizeof(splineFile));
+            if (ImGui::Button("Load"))
+                LoadSplines(splineFile);
+            ImGui::Text("%d lines, %d points, %d segments", SplineMesh::Lines(), SplineMesh::Points(),
+                        SplineMesh::Segments());
+        }
+        else if (part == 2) // The scan streams in from any PLY file, however big
+        {
+            ImGui::InputText("File", scanFile, sizeof(scanFile));
+            ImGui::SliderInt("Memory (MB)", &scanMemoryMB, 1, 1024);
+            if (ImGui::Button("Stream"))
+                StreamedMesh::Load(scanFile, (size_t)scanMemoryMB * 1024 * 1024);
+            ImGui::ColorEdit3("Diffuse", &diffCol[0]);
+
+            StreamedMeshStats stats = StreamedMesh::Stats();
+            float done = stats.vertices + stats.faces > 0 ?
+                (stats.uploadedVertices + stats.skippedVertices + stats.uploadedFaces) /
+                (float)(stats.vertices + stats.faces) : 0.0f;
+            ImGui::ProgressBar(done);
+            ImGui::Text("%d / %d vertices, %d / %d faces", stats.uploadedVertices, stats.vertices,
+                        stats.uploadedFaces, stats.faces);
+            ImGui::Text("%.1f MB waiting to upload%s", stats.queuedBytes / (1024.0f * 1024.0f),
+                        stats.failed ? ", the file couldn't all be read" : "");
+            ImGui::Text("%.1f MB on the GPU", stats.gpuBytes / (1024.0f * 1024.0f));
+            if (stats.skippedVertices > 0 || stats.skippedTriangles > 0)
+                ImGui::Text("Over the memory ceiling, %d vertices and %d triangles left out",
+                            stats.skippedVertices, stats.skippedTriangles);
+        }
+        else // A PLY file's points through a level of detail octree, however many there are
+        {
+            std::string treeFile = std::string(pointFile) + ".octree";
+            ImGui::InputText("File", pointFile, sizeof(pointFile));
+            ImGui::SliderInt("Build memory (MB)", &pointBuildMB, 16, 4096);
+            ImGui::SliderInt("GPU memory (MB)", &pointGpuMB, 16, 4096);
+
+            // Building stops the lab until it's done, big scans are better built with tools/octreebuild
+            if (ImGui::Button("Build"))
+            {
+                OctreeBuildStats built;
+                if (PointOctree::Build(pointFile, treeFile.c_str(), (size_t)pointBuildMB * 1024 * 1024, &built))
+                {
+                    printf("%s: %llu points into %d nodes in %.2f s\n", treeFile.c_str(), built.sourcePoints,
+                           built.nodes, built.seconds);
+                    PointCloud::Open(treeFile.c_str(), (size_t)pointGpuMB * 1024 * 1024);
+                }
+            }
+            ImGui::SameLine();
+            if (ImGui::Button("Open"))
+                PointCloud::Open(treeFile.c_str(), (size_t)pointGpuMB * 1024 * 1024);
+
+            ImGui::SliderInt("Point budget (k)", &pointBudgetK, 100, 20000);
+            ImGui::SliderFloat("Spacing (px)", &pointSpacing, 0.5f, 8.0f, "%.1f");
+            ImGui::SliderFloat("Point size", &pointScale, 0.5f, 3.0f, "%.1f");
+            ImGui::SliderFloat("Min confidence", &minConfidence, 0.0f, 1.0f, "%.2f");
+            ImGui::ColorEdit3("Diffuse", &diffCol[0]);
+
+            PointCloudStats stats = PointCloud::Stats();
+            ImGui::Text("%llu points in %d nodes", stats.points, stats.nodes);
+            ImGui::Text("%d nodes picked, %d drawn, %d loading", stats.picked, stats.drawn, stats.loading);
+            ImGui::Text("%llu / %llu points drawn", stats.drawnPoints, stats.pickedPoints);
+            ImGui::Text("%d nodes, %.1f MB on the GPU", stats.resident, stats.gpuBytes / (1024.0f * 1024.0f));
         }
     }
     ImGui::End();
@@ -460,7 +759,7 @@ int main()
         return 1;
     }
     glfwMakeContextCurrent(window);
-    glfwSwapInterval(0); // essentially turn off vsync
+    FramePacer::SetMode(PACING_CAPPED, 120.0f); // 120 fps, sleeping rather than spinning between frames
 
     // start GL3W
     gl3wInit();
@@ -484,7 +783,8 @@ int main()
     float oldTime = 0.0f, currentTime = 0.0f, deltaTime = 0.0f;
     while (!glfwWindowShouldClose(window))
     {
-        do { currentTime = (float)glfwGetTime(); } while (currentTime - oldTime < 1.0f / 120.0f);
+        FramePacer::Wait();
+        currentTime = (float)glfwGetTime();
 
         // update other events like input handling 
         glfwPollEvents();
@@ -508,9 +808,10 @@ int main()
         glfwSwapBuffers(window);
     }
 
-    // close GL context and any other GLFW resources
-    glfwTerminate();
-    ImGui_ImplGlfwGL3_Shutdown();
+    // Free our GL objects and ImGui's while the context still exists,
+    // then close GL context and any other GLFW resources
     Cleanup();
+    ImGui_ImplGlfwGL3_Shutdown();
+    glfwTerminate();
     return 0;
 }
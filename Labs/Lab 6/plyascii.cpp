@@ -0,0 +1,214 @@
+/*****************************************
+ *
+ *           plyascii.cpp
+ *
+ *  Parallel, memory mapped ASCII PLY
+ *  body parsing.
+ *
+ ****************************************/
+
+#include "plyascii.h"
+#include "mappedfile.h"
+#include "threadpool.h"
+
+extern "C" {
+    #include "readply.h"
+}
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <vector>
+
+#define CHUNK_BYTES (64 * 1024)     // Smallest piece of the body one thread gets
+
+struct Chunk
+{
+    const char* begin;
+    const char* end;
+    size_t firstLine;
+    size_t lines;
+    size_t firstIndex;              // Into the model's index array
+    size_t indices;
+};
+
+static const char* SkipSpaces(const char* p, const char* end)
+{
+    while (p < end && (*p == ' ' || *p == '\t'))
+        p++;
+    return p;
+}
+
+static const char* SkipToken(const char* p, const char* end)
+{
+    while (p < end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n')
+        p++;
+    return p;
+}
+
+static const char* NextLine(const char* p, const char* end)
+{
+    const char* eol = (const char*)memchr(p, '\n', end - p);
+    return eol != NULL ? eol + 1 : end;
+}
+
+template<typename T>
+static const char* ParseNumber(const char* p, const char* end, T& value, bool& ok)
+{
+    p = SkipSpaces(p, end);
+    std::from_chars_result result = std::from_chars(p, end, value);
+    if (result.ec != std::errc() || (result.ptr < end && *result.ptr != ' ' && *result.ptr != '\t' &&
+                                     *result.ptr != '\r' && *result.ptr != '\n'))
+        ok = false;
+    return result.ptr;
+}
+
+// Runs body(line, begin, end) for every line of the chunk in [from, to)
+template<typename F>
+static bool ForLines(const Chunk& chunk, size_t from, size_t to, const F& body)
+{
+    const char* p = chunk.begin;
+    for (size_t line = chunk.firstLine; line < chunk.firstLine + chunk.lines && p < chunk.end; line++)
+    {
+        const char* next = NextLine(p, chunk.end);
+        if (line >= to)
+            break;
+        if (line >= from && !body(line, p, next))
+            return false;
+        p = next;
+    }
+    return true;
+}
+
+int ply_read_ascii_body(const char *filename, long body, int nprops, const int columns[3],
+    struct ply_model *model)
+{
+    int nverts = model->nvertex, nface = model->nface;
+    ply_vertex* vertices = model->vertices;
+    int* offsets = model->face_offsets;
+
+    MappedFile file;
+    if (!file.Open(filename) || body < 0 || (size_t)body > file.Size())
+        return 0;
+
+    const char* start = (const char*)file.Data() + body;
+    const char* end = (const char*)file.Data() + file.Size();
+    size_t bytes = end - start;
+
+    // Cut the body into roughly equal chunks that start on a line
+    int count = (int)std::min<size_t>(std::max<size_t>(bytes / CHUNK_BYTES, 1), (size_t)ThreadPool::Threads() * 8);
+    std::vector<Chunk> chunks(count);
+    for (int i = 0; i < count; i++)
+    {
+        const char* p = start + bytes / count * i;
+        chunks[i].begin = i == 0 ? start : NextLine(p - 1, end);
+        chunks[i].lines = chunks[i].indices = 0;
+    }
+    for (int i = 0; i < count; i++)
+        chunks[i].end = i + 1 < count ? std::max(chunks[i + 1].begin, chunks[i].begin) : end;
+
+    ThreadPool::ParallelFor(count, [&](int i)
+    {
+        Chunk& c = chunks[i];
+        for (const char* p = c.begin; p < c.end; p = NextLine(p, c.end))
+            c.lines++;
+    });
+
+    size_t lines = 0;
+    for (int i = 0; i < count; i++)
+    {
+        chunks[i].firstLine = lines;
+        lines += chunks[i].lines;
+    }
+    size_t faceLine = (size_t)nverts, lastLine = (size_t)nverts + nface;
+    if (lines < lastLine)
+        return 0;
+
+    // The face counts say where each face's indices go
+    std::atomic<bool> ok(true);
+    ThreadPool::ParallelFor(count, [&](int i)
+    {
+        Chunk& c = chunks[i];
+        bool good = ForLines(c, faceLine, lastLine, [&](size_t, const char* p, const char* e)
+        {
+            int n = 0;
+            bool parsed = true;
+            ParseNumber(p, e, n, parsed);
+            c.indices += n;
+            return parsed && n >= 0 && n <= 255;
+        });
+        if (!good)
+            ok = false;
+    });
+    if (!ok)
+        return 0;
+
+    size_t indices = 0;
+    for (int i = 0; i < count; i++)
+    {
+        chunks[i].firstIndex = indices;
+        indices += chunks[i].indices;
+    }
+    if (indices > (size_t)INT_MAX)
+        return 0;
+    int* block = (int*)ply_alloc(model, sizeof(int) * std::max<size_t>(indices, 1));
+    if (block == NULL)
+        return 0;
+
+    ThreadPool::ParallelFor(count, [&](int i)
+    {
+        Chunk& c = chunks[i];
+        int* index = block + c.firstIndex;
+
+        // Floats go through double first, that's what plyfile.c's atof does and it
+        // rounds differently to parsing straight to float in rare cases
+        bool good = ForLines(c, 0, faceLine, [&](size_t line, const char* p, const char* e)
+        {
+            float xyz[3] = { 0.0f, 0.0f, 0.0f };
+            bool parsed = true;
+            for (int prop = 0; prop < nprops && parsed; prop++)
+            {
+                int column = prop == columns[0] ? 0 : prop == columns[1] ? 1 : prop == columns[2] ? 2 : -1;
+                if (column < 0)
+                {
+                    p = SkipToken(SkipSpaces(p, e), e);
+                    continue;
+                }
+                double value = 0.0;
+                p = ParseNumber(p, e, value, parsed);
+                xyz[column] = (float)value;
+            }
+            vertices[line].x = xyz[0];
+            vertices[line].y = xyz[1];
+            vertices[line].z = xyz[2];
+            return parsed;
+        });
+
+        // The counts were checked when the indices were sized
+        good = good && ForLines(c, faceLine, lastLine, [&](size_t line, const char* p, const char* e)
+        {
+            int n = 0;
+            bool parsed = true;
+            p = ParseNumber(p, e, n, parsed);
+            offsets[line - faceLine] = (int)(index - block);
+            for (int k = 0; k < n && parsed; k++)
+                p = ParseNumber(p, e, *index++, parsed);
+            return parsed;
+        });
+
+        if (!good)
+            ok = false;
+    });
+
+    // A failed parse leaves the block in the arena until the model is freed
+    if (!ok)
+        return 0;
+
+    offsets[nface] = (int)indices;
+    model->indices = block;
+    model->nindex = (int)indices;
+    return 1;
+}
@@ -0,0 +1,44 @@
+/**********************************************************
+ *
+ *                 plyascii.h
+ *
+ *  A parallel reader for the body of ASCII PLY files,
+ *  used by readply in place of plyfile.c's word at a
+ *  time parsing.  The file is memory mapped, the line
+ *  boundaries are found on every core and each core
+ *  then parses its own lines (with std::from_chars, so
+ *  this needs C++17) straight into the model's vertex
+ *  table and face arrays.
+ *
+ **********************************************************/
+
+#ifndef PLYASCII_H
+#define PLYASCII_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct ply_model;
+
+/*
+ * Reads model->nvertex vertex lines and then model->nface
+ * face lines, starting 'body' bytes into the file.  Every
+ * vertex has 'nprops' scalar properties and columns[0..2]
+ * say which ones are x, y and z.  Every face is a count
+ * followed by that many indices.  The vertex table and
+ * face_offsets have to be allocated already, the indices
+ * are allocated here from the model's arena.
+ *
+ * Returns 0 if the body isn't one element per line or
+ * doesn't parse, for the caller to fall back to plyfile.c,
+ * which fills the tables in again from scratch.
+ */
+int ply_read_ascii_body(const char *filename, long body, int nprops, const int columns[3],
+	struct ply_model *model);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
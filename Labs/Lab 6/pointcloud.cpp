@@ -0,0 +1,387 @@
+/*****************************************
+ *
+ *             pointcloud.cpp
+ *
+ *  Level of detail picking, paging and
+ *  drawing for a point octree.
+ *
+ ****************************************/
+
+#include "pointcloud.h"
+#include "pointoctree.h"
+
+#include <float.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <queue>
+
+MappedFile PointCloud::file;
+const OctreeHeader* PointCloud::header = NULL;
+std::vector<PointCloud::Node> PointCloud::nodes;
+std::vector<int> PointCloud::picked;
+float PointCloud::pixelsPerUnit = 0.0f;
+unsigned int PointCloud::frame = 0;
+size_t PointCloud::gpuBytes = 0;
+size_t PointCloud::gpuLimit = 0;
+PointCloudStats PointCloud::stats = PointCloudStats();
+
+std::thread PointCloud::worker;
+std::mutex PointCloud::mutex;
+std::condition_variable PointCloud::wake;
+std::deque<int> PointCloud::requests;
+std::deque<PointCloud::Loaded> PointCloud::loaded;
+size_t PointCloud::loadedBytes = 0;
+bool PointCloud::cancel = false;
+
+bool PointCloud::Open(const char* treeFile, size_t maxGpuBytes)
+{
+    Close();
+
+    if (!file.Open(treeFile))
+    {
+        printf("PointCloud: can't open %s\n", treeFile);
+        return false;
+    }
+    header = (const OctreeHeader*)file.Data();
+    if (file.Size() < sizeof(OctreeHeader) || memcmp(header->magic, OCTREE_MAGIC, sizeof(header->magic)) != 0 ||
+        header->nodeTable > file.Size() ||
+        header->nodeTable + (unsigned long long)header->nodes * sizeof(OctreeNode) != file.Size() ||
+        header->root >= header->nodes)
+    {
+        printf("PointCloud: %s isn't a point octree\n", treeFile);
+        Close();
+        return false;
+    }
+
+    // Every node's points have to be inside the file and its children inside the table.
+    // A child is a level further down, so walking the tree always comes to an end.
+    const OctreeNode* table = (const OctreeNode*)(file.Data() + header->nodeTable);
+    nodes.resize(header->nodes);
+    bool ok = true;
+    for (size_t n = 0; ok && n < nodes.size(); n++)
+    {
+        const OctreeNode& info = table[n];
+        nodes[n].info = &info;
+        nodes[n].state = NODE_EMPTY;
+        nodes[n].vao = nodes[n].vbo = 0;
+        nodes[n].lastPicked = 0;
+
+        ok = info.offset <= file.Size() && (file.Size() - info.offset) / sizeof(OctreePoint) >= info.points;
+        for (int i = 0; ok && i < 8; i++)
+        {
+            int c = info.children[i];
+            ok = c == -1 || (c >= 0 && (unsigned int)c < header->nodes && table[c].level == info.level + 1);
+        }
+    }
+    if (!ok)
+    {
+        printf("PointCloud: %s has a broken node table\n", treeFile);
+        Close();
+        return false;
+    }
+    stats.nodes = (int)header->nodes;
+    stats.points = header->sourcePoints;
+
+    frame = 0;
+    gpuLimit = maxGpuBytes;
+    cancel = false;
+    worker = std::thread(WorkerMain);
+    return true;
+}
+
+// Against the clip planes of the model view projection, so in the file's coordinates
+bool PointCloud::Visible(const OctreeNode& node, const glm::vec4 planes[6])
+{
+    for (int i = 0; i < 6; i++)
+    {
+        // The corner furthest along the plane's normal
+        glm::vec4 corner(node.min[0] + (planes[i].x > 0.0f ? node.size : 0.0f),
+                         node.min[1] + (planes[i].y > 0.0f ? node.size : 0.0f),
+                         node.min[2] + (planes[i].z > 0.0f ? node.size : 0.0f), 1.0f);
+        if (glm::dot(planes[i], corner) < 0.0f)
+            return false;
+    }
+    return true;
+}
+
+void PointCloud::Update(const glm::mat4& model, const glm::mat4& view, const glm::mat4& projection,
+                        int viewportHeight, int pointBudget, float minPixels)
+{
+    if (header == NULL)
+        return;
+    frame++;
+
+    glm::mat4 modelView = view * model;
+    glm::mat4 mvp = projection * modelView;
+    glm::vec4 planes[6];
+    for (int i = 0; i < 3; i++)
+    {
+        glm::vec4 row(mvp[0][i], mvp[1][i], mvp[2][i], mvp[3][i]);
+        glm::vec4 w(mvp[0][3], mvp[1][3], mvp[2][3], mvp[3][3]);
+        planes[i * 2] = w + row;
+        planes[i * 2 + 1] = w - row;
+    }
+    float scale = glm::length(glm::vec3(modelView[0]));     // File units to view units
+    pixelsPerUnit = projection[1][1] * viewportHeight * 0.5f;
+
+    // Biggest on screen first, until the budget is used up. Children are only worth
+    // looking at while the parent's points are still visibly apart.
+    picked.clear();
+    stats.pickedPoints = 0;
+    std::priority_queue<Candidate> queue;
+    Candidate root = { FLT_MAX, (int)header->root };
+    if (Visible(*nodes[root.node].info, planes))
+        queue.push(root);
+    while (!queue.empty())
+    {
+        Candidate top = queue.top();
+        queue.pop();
+        Node& node = nodes[top.node];
+        if (stats.pickedPoints + node.info->points > (unsigned long long)pointBudget && !picked.empty())
+            break;
+        picked.push_back(top.node);
+        stats.pickedPoints += node.info->points;
+        node.lastPicked = frame;
+
+        for (int i = 0; i < 8; i++)
+        {
+            int c = node.info->children[i];
+            if (c < 0 || !Visible(*nodes[c].info, planes))
+                continue;
+            const OctreeNode& child = *nodes[c].info;
+            float half = child.size * 0.5f;
+            glm::vec3 center = glm::vec3(modelView * glm::vec4(child.min[0] + half, child.min[1] + half, child.min[2] + half, 1.0f));
+            float radius = half * 1.7320508f * scale;
+            float distance = glm::length(center);
+            float nearest = std::max(distance - radius, 1e-6f);
+            if (node.info->spacing * scale * pixelsPerUnit / nearest < minPixels)
+                continue;
+            Candidate candidate = { distance <= radius ? FLT_MAX : radius * pixelsPerUnit / distance, c };
+            queue.push(candidate);
+        }
+    }
+
+    // Ask for the picked nodes that aren't on the GPU, the most important first. Anything
+    // still waiting from last frame that hasn't been picked again is forgotten.
+    stats.loading = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i = 0; i < requests.size(); i++)
+            nodes[requests[i]].state = NODE_EMPTY;
+        requests.clear();
+        for (size_t i = 0; i < picked.size(); i++)
+        {
+            Node& node = nodes[picked[i]];
+            if (node.state == NODE_EMPTY)
+            {
+                node.state = NODE_QUEUED;
+                requests.push_back(picked[i]);
+            }
+            if (node.state == NODE_QUEUED)
+                stats.loading++;
+        }
+    }
+    wake.notify_one();
+
+    // Upload what has been paged in, at least one node per frame
+    size_t budget = POINT_UPLOAD_BUDGET;
+    bool any = false;
+    for (;;)
+    {
+        Loaded next;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (loaded.empty() || (any && loaded.front().points.size() > budget))
+                break;
+            next.node = loaded.front().node;
+            next.points.swap(loaded.front().points);
+            loaded.pop_front();
+        }
+
+        size_t bytes = next.points.size();
+        Upload(next);
+        budget -= std::min(budget, bytes);
+        any = true;
+
+        std::vector<unsigned char>().swap(next.points);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            loadedBytes -= bytes;
+        }
+        wake.notify_one();
+    }
+
+    Evict();
+}
+
+void PointCloud::Upload(Loaded& next)
+{
+    Node& node = nodes[next.node];
+    glGenVertexArrays(1, &node.vao);
+    glBindVertexArray(node.vao);
+    glGenBuffers(1, &node.vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, node.vbo);
+    glBufferData(GL_ARRAY_BUFFER, next.points.size(), next.points.empty() ? NULL : &next.points[0], GL_STATIC_DRAW);
+
+    // Positions as fractions of the node's cube, confidence and intensity as
+    // fractions of the node's ranges of them
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(OctreePoint), (void*)0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 2, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(OctreePoint), (void*)offsetof(OctreePoint, confidence));
+    glBindVertexArray(0);
+
+    node.state = NODE_RESIDENT;
+    gpuBytes += next.points.size();
+    stats.resident++;
+}
+
+// Drops the nodes that were picked longest ago until the GPU memory is back under the
+// ceiling. What this frame picked always stays, even over it.
+void PointCloud::Evict()
+{
+    if (gpuBytes <= gpuLimit)
+        return;
+
+    std::vector<int> unused;
+    for (size_t n = 0; n < nodes.size(); n++)
+    {
+        if (nodes[n].state == NODE_RESIDENT && nodes[n].lastPicked != frame)
+            unused.push_back((int)n);
+    }
+    std::sort(unused.begin(), unused.end(), [](int a, int b) { return nodes[a].lastPicked < nodes[b].lastPicked; });
+    for (size_t i = 0; i < unused.size() && gpuBytes > gpuLimit; i++)
+    {
+        Node& node = nodes[unused[i]];
+        glDeleteVertexArrays(1, &node.vao);
+        glDeleteBuffers(1, &node.vbo);
+        node.vao = node.vbo = 0;
+        node.state = NODE_EMPTY;
+        gpuBytes -= (size_t)node.info->points * sizeof(OctreePoint);
+        stats.resident--;
+    }
+}
+
+void PointCloud::Draw(GLuint program)
+{
+    if (header == NULL)
+        return;
+
+    GLint nodeMinLoc = glGetUniformLocation(program, "nodeMin");
+    GLint nodeSizeLoc = glGetUniformLocation(program, "nodeSize");
+    GLint spacingLoc = glGetUniformLocation(program, "spacing");
+    GLint confidenceLoc = glGetUniformLocation(program, "confidenceRange");
+    GLint intensityLoc = glGetUniformLocation(program, "intensityRange");
+    GLint childMaskLoc = glGetUniformLocation(program, "childMask");
+    GLint pixelsLoc = glGetUniformLocation(program, "pixelsPerUnit");
+    glUniform1f(pixelsLoc, pixelsPerUnit);
+
+    glEnable(GL_PROGRAM_POINT_SIZE);
+    stats.drawn = 0;
+    stats.drawnPoints = 0;
+    for (size_t i = 0; i < picked.size(); i++)
+    {
+        const Node& node = nodes[picked[i]];
+        if (node.state != NODE_RESIDENT)
+            continue;
+
+        // Points under a child that is drawn too are only half as far apart
+        int childMask = 0;
+        for (int c = 0; c < 8; c++)
+        {
+            int child = node.info->children[c];
+            if (child >= 0 && nodes[child].lastPicked == frame && nodes[child].state == NODE_RESIDENT)
+                childMask |= 1 << c;
+        }
+
+        glUniform3fv(nodeMinLoc, 1, node.info->min);
+        glUniform1f(nodeSizeLoc, node.info->size);
+        glUniform1f(spacingLoc, node.info->spacing);
+        glUniform2fv(confidenceLoc, 1, node.info->confidence);
+        glUniform2fv(intensityLoc, 1, node.info->intensity);
+        glUniform1i(childMaskLoc, childMask);
+
+        glBindVertexArray(node.vao);
+        glDrawArrays(GL_POINTS, 0, (GLsizei)node.info->points);
+        stats.drawn++;
+        stats.drawnPoints += node.info->points;
+    }
+    glBindVertexArray(0);
+    glDisable(GL_PROGRAM_POINT_SIZE);
+}
+
+bool PointCloud::Bounds(glm::vec3& min, glm::vec3& max)
+{
+    if (header == NULL)
+        return false;
+    min = glm::vec3(header->min[0], header->min[1], header->min[2]);
+    max = min + glm::vec3(header->size);
+    return true;
+}
+
+PointCloudStats PointCloud::Stats()
+{
+    PointCloudStats s = stats;
+    s.picked = (int)picked.size();
+    s.gpuBytes = gpuBytes;
+    return s;
+}
+
+void PointCloud::Close()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        cancel = true;
+    }
+    wake.notify_all();
+    if (worker.joinable())
+        worker.join();
+
+    requests.clear();
+    loaded.clear();
+    loadedBytes = 0;
+    for (size_t n = 0; n < nodes.size(); n++)
+    {
+        if (nodes[n].vao != 0)
+            glDeleteVertexArrays(1, &nodes[n].vao);
+        if (nodes[n].vbo != 0)
+            glDeleteBuffers(1, &nodes[n].vbo);
+    }
+    nodes.clear();
+    picked.clear();
+    gpuBytes = 0;
+    stats = PointCloudStats();
+    header = NULL;
+    file.Close();
+}
+
+// Copies the asked for nodes out of the mapping, so it's this thread that waits on the
+// disk and not the GL thread's glBufferData
+void PointCloud::WorkerMain()
+{
+    for (;;)
+    {
+        int n;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [] { return cancel || (!requests.empty() && loadedBytes < POINT_QUEUE_BYTES); });
+            if (cancel)
+                return;
+            n = requests.front();
+            requests.pop_front();
+        }
+
+        // The node table and the mapping stay put until Close has joined this thread
+        const OctreeNode& info = *nodes[n].info;
+        const unsigned char* data = file.Data() + info.offset;
+        Loaded next;
+        next.node = n;
+        next.points.assign(data, data + (size_t)info.points * sizeof(OctreePoint));
+
+        std::lock_guard<std::mutex> lock(mutex);
+        loadedBytes += next.points.size();
+        loaded.push_back(std::move(next));
+    }
+}
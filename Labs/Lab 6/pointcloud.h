@@ -0,0 +1,134 @@
+/**************************************************
+ *
+ *                  pointcloud.h
+ *
+ *  Draws a point octree built by PointOctree at
+ *  a level of detail that holds the frame rate
+ *  whatever the size of the scan. Every frame
+ *  the nodes are picked biggest on screen first,
+ *  going down only where a node's points are
+ *  still further apart on screen than a pixel
+ *  limit, until a point budget is used up.
+ *
+ *  The file is memory mapped. A worker thread
+ *  pages in the picked nodes that aren't on the
+ *  GPU yet, the GL thread uploads a few of them
+ *  per frame, and nodes that haven't been picked
+ *  for longest are dropped once the GPU memory
+ *  ceiling is reached.
+ *
+ *  points.vert takes the node's quantized points
+ *  at locations 0 (position) and 1 (confidence,
+ *  intensity).
+ *
+ ***************************************************/
+
+#ifndef POINTCLOUD_H
+#define POINTCLOUD_H
+
+#include <GL/gl3w.h>
+#include <GLM/glm.hpp>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "mappedfile.h"
+
+#define POINT_UPLOAD_BUDGET (4 * 1024 * 1024)   // Bytes uploaded per frame at most
+#define POINT_QUEUE_BYTES   (16 * 1024 * 1024)  // Paged in and waiting for the GL thread at most
+
+struct OctreeHeader;
+struct OctreeNode;
+
+struct PointCloudStats
+{
+    int nodes;                  // In the file
+    unsigned long long points;
+    int picked;                 // Nodes the level of detail wants this frame
+    int drawn;                  // Of those, the ones on the GPU
+    int resident;               // On the GPU in all
+    int loading;
+    unsigned long long pickedPoints;
+    unsigned long long drawnPoints;
+    size_t gpuBytes;
+};
+
+class PointCloud
+{
+public:
+    // Maps a file written by PointOctree and starts the loader. Nodes are kept on the GPU
+    // up to about 'gpuBytes'. Returns false if the file isn't a point octree.
+    static bool Open(const char* treeFile, size_t gpuBytes);
+
+    // Once per frame on the GL thread: picks the nodes for this view, asks for the ones
+    // that are missing and uploads what has been paged in. 'model' places the file's
+    // points in the world. Nodes are refined until their points are 'minPixels' apart
+    // on screen, or 'pointBudget' points are picked.
+    static void Update(const glm::mat4& model, const glm::mat4& view, const glm::mat4& projection,
+                       int viewportHeight, int pointBudget, float minPixels);
+
+    // Draws the picked nodes that are on the GPU with 'program', which has to be in use
+    static void Draw(GLuint program);
+
+    // The cube around the file's points
+    static bool Bounds(glm::vec3& min, glm::vec3& max);
+
+    static PointCloudStats Stats();
+    static void Close();        // Stops the loader, deletes the buffers and unmaps the file
+
+private:
+    enum State
+    {
+        NODE_EMPTY,
+        NODE_QUEUED,            // Asked for, or being paged in
+        NODE_RESIDENT,
+    };
+
+    struct Node
+    {
+        const OctreeNode* info;
+        State state;
+        GLuint vao, vbo;
+        unsigned int lastPicked;    // Frame it was last picked in
+    };
+
+    struct Loaded
+    {
+        int node;
+        std::vector<unsigned char> points;
+    };
+
+    struct Candidate
+    {
+        float priority;
+        int node;
+        bool operator<(const Candidate& o) const { return priority < o.priority; }
+    };
+
+    static bool Visible(const OctreeNode& node, const glm::vec4 planes[6]);
+    static void Upload(Loaded& loaded);
+    static void Evict();
+    static void WorkerMain();
+
+    static MappedFile file;
+    static const OctreeHeader* header;
+    static std::vector<Node> nodes;
+    static std::vector<int> picked;
+    static float pixelsPerUnit;     // Projected size of a unit at distance 1
+    static unsigned int frame;
+    static size_t gpuBytes, gpuLimit;
+    static PointCloudStats stats;
+
+    static std::thread worker;
+    static std::mutex mutex;        // Guards the queues, loadedBytes and 'cancel'
+    static std::condition_variable wake;
+    static std::deque<int> requests;
+    static std::deque<Loaded> loaded;
+    static size_t loadedBytes;
+    static bool cancel;
+};
+
+#endif
@@ -0,0 +1,486 @@
+/*****************************************
+ *
+ *             pointoctree.cpp
+ *
+ *  The out of core octree build: bounds,
+ *  a count grid to cut space into chunks,
+ *  an on-disk bucket sort by chunk, then
+ *  every chunk's subtree in memory.
+ *
+ ****************************************/
+
+#include "pointoctree.h"
+
+extern "C" {
+    #include "readply.h"
+}
+
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#define COUNT_LEVEL         6           // Points are counted in a 2^6 = 64 cells a side grid
+#define COUNT_SIDE          (1 << COUNT_LEVEL)
+#define BUILD_POINT_BYTES   48          // A point in a chunk being built, twice over plus the child lists
+#define SORT_BUFFER_POINTS  4096        // Most points held back for one chunk while sorting
+
+struct Chunk
+{
+    int level, x, y, z;                 // Its cell of the count grids
+    unsigned long long points;
+    unsigned long long offset;          // In points, into the sorted file
+    unsigned long long written;
+    std::vector<ply_point> buffer;
+    int node;
+    unsigned long long sampleOffset;    // Its top node's points for the levels above, in points
+    unsigned long long samplePoints;    // into the sorted file after all the sorted ones
+};
+
+struct OctreeBuild
+{
+    float min[3];
+    float size;
+    unsigned long long sourcePoints;
+
+    std::vector<unsigned long long> counts[COUNT_LEVEL + 1];   // counts[l] is the grid 2^l cells a side
+    std::vector<int> cellChunk;                                 // Which chunk each COUNT_SIDE^3 cell went to
+    std::vector<Chunk> chunks;
+    unsigned long long chunkPoints;
+
+    FILE* sorted;
+    size_t sortBuffer;
+
+    FILE* out;
+    unsigned long long written;
+    std::vector<OctreeNode> nodes;
+    std::vector<unsigned char> taken;   // One flag per sample cell
+    int levels;
+    bool failed;
+};
+
+static bool Seek(FILE* fp, unsigned long long offset)
+{
+#ifdef _WIN32
+    return _fseeki64(fp, (__int64)offset, SEEK_SET) == 0;
+#else
+    return fseeko(fp, (off_t)offset, SEEK_SET) == 0;
+#endif
+}
+
+static int GridIndex(int level, int x, int y, int z)
+{
+    return (((z << level) | y) << level) | x;
+}
+
+// The cell of a 'side' cells a side grid over the cube that p falls in, along each axis
+static void GridCell(const float* p, const float min[3], float size, int side, int cell[3])
+{
+    for (int k = 0; k < 3; k++)
+    {
+        int c = (int)((p[k] - min[k]) / size * side);
+        cell[k] = c < 0 ? 0 : c >= side ? side - 1 : c;
+    }
+}
+
+// Scanners write NaN for directions nothing came back from, those points are left out
+static bool Finite(const ply_point& p)
+{
+    return p.x - p.x == 0.0f && p.y - p.y == 0.0f && p.z - p.z == 0.0f;
+}
+
+static void CellCube(const OctreeBuild& b, int level, int x, int y, int z, float min[3], float& size)
+{
+    size = b.size / (float)(1 << level);
+    min[0] = b.min[0] + x * size;
+    min[1] = b.min[1] + y * size;
+    min[2] = b.min[2] + z * size;
+}
+
+static int BoundsPoints(void* user, const ply_point* points, int, int count)
+{
+    float* bounds = (float*)user;
+    for (int i = 0; i < count; i++)
+    {
+        const float* p = &points[i].x;
+        for (int k = 0; k < 3 && Finite(points[i]); k++)
+        {
+            bounds[k] = std::min(bounds[k], p[k]);
+            bounds[k + 3] = std::max(bounds[k + 3], p[k]);
+        }
+    }
+    return 1;
+}
+
+static int CountPoints(void* user, const ply_point* points, int, int count)
+{
+    OctreeBuild& b = *(OctreeBuild*)user;
+    for (int i = 0; i < count; i++)
+    {
+        if (!Finite(points[i]))
+            continue;
+        int cell[3];
+        GridCell(&points[i].x, b.min, b.size, COUNT_SIDE, cell);
+        b.counts[COUNT_LEVEL][GridIndex(COUNT_LEVEL, cell[0], cell[1], cell[2])]++;
+        b.sourcePoints++;
+    }
+    return 1;
+}
+
+static bool FlushChunk(OctreeBuild& b, Chunk& chunk)
+{
+    if (chunk.buffer.empty())
+        return true;
+    bool ok = Seek(b.sorted, (chunk.offset + chunk.written) * sizeof(ply_point)) &&
+              fwrite(&chunk.buffer[0], sizeof(ply_point), chunk.buffer.size(), b.sorted) == chunk.buffer.size();
+    chunk.written += chunk.buffer.size();
+    chunk.buffer.clear();
+    return ok;
+}
+
+static int SortPoints(void* user, const ply_point* points, int, int count)
+{
+    OctreeBuild& b = *(OctreeBuild*)user;
+    for (int i = 0; i < count; i++)
+    {
+        if (!Finite(points[i]))
+            continue;
+        int cell[3];
+        GridCell(&points[i].x, b.min, b.size, COUNT_SIDE, cell);
+        Chunk& chunk = b.chunks[b.cellChunk[GridIndex(COUNT_LEVEL, cell[0], cell[1], cell[2])]];
+        chunk.buffer.push_back(points[i]);
+        if (chunk.buffer.size() >= b.sortBuffer && !FlushChunk(b, chunk))
+        {
+            printf("PointOctree: can't write the sorted points\n");
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// A cell is a chunk when its points fit in memory, or it is as small as the count grid goes
+static bool IsChunk(const OctreeBuild& b, int level, int x, int y, int z)
+{
+    return level == COUNT_LEVEL || b.counts[level][GridIndex(level, x, y, z)] <= b.chunkPoints;
+}
+
+static void PickChunks(OctreeBuild& b, int level, int x, int y, int z)
+{
+    unsigned long long points = b.counts[level][GridIndex(level, x, y, z)];
+    if (points == 0)
+        return;
+    if (!IsChunk(b, level, x, y, z))
+    {
+        for (int i = 0; i < 8; i++)
+            PickChunks(b, level + 1, x * 2 + (i & 1), y * 2 + ((i >> 1) & 1), z * 2 + (i >> 2));
+        return;
+    }
+
+    Chunk chunk;
+    chunk.level = level;
+    chunk.x = x;
+    chunk.y = y;
+    chunk.z = z;
+    chunk.points = points;
+    chunk.offset = b.chunks.empty() ? 0 : b.chunks.back().offset + b.chunks.back().points;
+    chunk.written = 0;
+    chunk.node = -1;
+    chunk.sampleOffset = 0;
+    chunk.samplePoints = 0;
+    b.chunks.push_back(chunk);
+
+    int span = 1 << (COUNT_LEVEL - level);
+    for (int k = 0; k < span; k++)
+        for (int j = 0; j < span; j++)
+            for (int i = 0; i < span; i++)
+                b.cellChunk[GridIndex(COUNT_LEVEL, x * span + i, y * span + j, z * span + k)] = (int)b.chunks.size() - 1;
+}
+
+// Keeps the first point that lands in each of the node's POINT_GRID^3 cells, and hands
+// the others to 'rest' by octant if it's given
+static void Subsample(OctreeBuild& b, const std::vector<ply_point>& points, const float min[3], float size,
+                      std::vector<ply_point>& kept, std::vector<ply_point>* rest)
+{
+    std::fill(b.taken.begin(), b.taken.end(), 0);
+    for (size_t i = 0; i < points.size(); i++)
+    {
+        int cell[3];
+        GridCell(&points[i].x, min, size, POINT_GRID, cell);
+        unsigned char& taken = b.taken[((size_t)cell[2] * POINT_GRID + cell[1]) * POINT_GRID + cell[0]];
+        if (!taken)
+        {
+            taken = 1;
+            kept.push_back(points[i]);
+        }
+        else if (rest != NULL)
+        {
+            int octant = (cell[0] >= POINT_GRID / 2) | (cell[1] >= POINT_GRID / 2) << 1 | (cell[2] >= POINT_GRID / 2) << 2;
+            rest[octant].push_back(points[i]);
+        }
+    }
+}
+
+// Adds a node for 'points', quantized to its cube, and writes them out
+static int WriteNode(OctreeBuild& b, const std::vector<ply_point>& points, const float min[3], float size, int level)
+{
+    OctreeNode node;
+    memset(&node, 0, sizeof(node));
+    node.offset = b.written;
+    node.points = (unsigned int)points.size();
+    node.level = level;
+    for (int i = 0; i < 8; i++)
+        node.children[i] = -1;
+    memcpy(node.min, min, sizeof(node.min));
+    node.size = size;
+    node.spacing = size / POINT_GRID;
+    node.confidence[0] = node.intensity[0] = FLT_MAX;
+    node.confidence[1] = node.intensity[1] = -FLT_MAX;
+    for (size_t i = 0; i < points.size(); i++)
+    {
+        node.confidence[0] = std::min(node.confidence[0], points[i].confidence);
+        node.confidence[1] = std::max(node.confidence[1], points[i].confidence);
+        node.intensity[0] = std::min(node.intensity[0], points[i].intensity);
+        node.intensity[1] = std::max(node.intensity[1], points[i].intensity);
+    }
+
+    float scale = 65535.0f / size;
+    float confidenceScale = node.confidence[1] > node.confidence[0] ? 255.0f / (node.confidence[1] - node.confidence[0]) : 0.0f;
+    float intensityScale = node.intensity[1] > node.intensity[0] ? 255.0f / (node.intensity[1] - node.intensity[0]) : 0.0f;
+    std::vector<OctreePoint> quantized(points.size());
+    for (size_t i = 0; i < points.size(); i++)
+    {
+        const float* p = &points[i].x;
+        unsigned short* q = &quantized[i].x;
+        for (int k = 0; k < 3; k++)
+            q[k] = (unsigned short)std::min(std::max((p[k] - min[k]) * scale + 0.5f, 0.0f), 65535.0f);
+        quantized[i].confidence = (unsigned char)((points[i].confidence - node.confidence[0]) * confidenceScale + 0.5f);
+        quantized[i].intensity = (unsigned char)((points[i].intensity - node.intensity[0]) * intensityScale + 0.5f);
+    }
+    if (!quantized.empty() && fwrite(&quantized[0], sizeof(OctreePoint), quantized.size(), b.out) != quantized.size())
+        b.failed = true;
+    b.written += quantized.size() * sizeof(OctreePoint);
+
+    b.levels = std::max(b.levels, level + 1);
+    b.nodes.push_back(node);
+    return (int)b.nodes.size() - 1;
+}
+
+// Builds the node for 'points' and everything under it, and empties 'points'. When
+// 'sample' is given it gets the node's own points.
+static int BuildNode(OctreeBuild& b, std::vector<ply_point>& points, const float min[3], float size, int level,
+                     std::vector<ply_point>* sample)
+{
+    if (points.size() <= POINT_LEAF || level >= POINT_MAX_LEVEL)
+    {
+        int leaf = WriteNode(b, points, min, size, level);
+        if (sample != NULL)
+            sample->swap(points);
+        std::vector<ply_point>().swap(points);
+        return leaf;
+    }
+
+    std::vector<ply_point> kept, rest[8];
+    Subsample(b, points, min, size, kept, rest);
+    std::vector<ply_point>().swap(points);
+
+    int node = WriteNode(b, kept, min, size, level);
+    if (sample != NULL)
+        sample->swap(kept);
+    std::vector<ply_point>().swap(kept);
+
+    float half = size * 0.5f;
+    for (int i = 0; i < 8; i++)
+    {
+        if (rest[i].empty())
+            continue;
+        float childMin[3] = { min[0] + (i & 1) * half, min[1] + ((i >> 1) & 1) * half, min[2] + (i >> 2) * half };
+        int child = BuildNode(b, rest[i], childMin, half, level + 1, NULL);
+        b.nodes[node].children[i] = child;
+    }
+    return node;
+}
+
+// The nodes above the chunks are sampled from their children's points
+static int BuildUpper(OctreeBuild& b, int level, int x, int y, int z, std::vector<ply_point>& sample)
+{
+    if (IsChunk(b, level, x, y, z))
+    {
+        int span = 1 << (COUNT_LEVEL - level);
+        const Chunk& chunk = b.chunks[b.cellChunk[GridIndex(COUNT_LEVEL, x * span, y * span, z * span)]];
+        sample.resize((size_t)chunk.samplePoints);
+        if (!sample.empty() && !(Seek(b.sorted, chunk.sampleOffset * sizeof(ply_point)) &&
+                                 fread(&sample[0], sizeof(ply_point), sample.size(), b.sorted) == sample.size()))
+        {
+            printf("PointOctree: can't read back the sorted points\n");
+            b.failed = true;
+            sample.clear();
+        }
+        return chunk.node;
+    }
+
+    int children[8];
+    std::vector<ply_point> points;
+    for (int i = 0; i < 8; i++)
+    {
+        int cx = x * 2 + (i & 1), cy = y * 2 + ((i >> 1) & 1), cz = z * 2 + (i >> 2);
+        children[i] = -1;
+        if (b.counts[level + 1][GridIndex(level + 1, cx, cy, cz)] == 0)
+            continue;
+        std::vector<ply_point> childSample;
+        children[i] = BuildUpper(b, level + 1, cx, cy, cz, childSample);
+        points.insert(points.end(), childSample.begin(), childSample.end());
+    }
+
+    float min[3], size;
+    CellCube(b, level, x, y, z, min, size);
+    Subsample(b, points, min, size, sample, NULL);
+    int node = WriteNode(b, sample, min, size, level);
+    memcpy(b.nodes[node].children, children, sizeof(children));
+    return node;
+}
+
+bool PointOctree::Build(const char* plyFile, const char* treeFile, size_t maxBytes, OctreeBuildStats* stats)
+{
+    auto start = std::chrono::steady_clock::now();
+    std::string source(plyFile);
+    std::string sortedFile = std::string(treeFile) + ".tmp";
+
+    ply_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    stream.max_bytes = maxBytes / 4;
+
+    // Pass one: the bounds, grown into a cube a little bigger so the far faces are inside
+    float bounds[6] = { FLT_MAX, FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    stream.user = bounds;
+    stream.points = BoundsPoints;
+    if (!readply_stream(&source[0], &stream))
+        return false;
+
+    OctreeBuild b;
+    b.size = std::max(std::max(bounds[3] - bounds[0], bounds[4] - bounds[1]), bounds[5] - bounds[2]);
+    if (!(b.size >= 0.0f))
+    {
+        printf("PointOctree: %s has no vertices\n", plyFile);
+        return false;
+    }
+    b.size = b.size > 0.0f ? b.size * 1.001f : 1.0f;
+    for (int k = 0; k < 3; k++)
+        b.min[k] = bounds[k] - (b.size - (bounds[k + 3] - bounds[k])) * 0.5f;
+
+    // Pass two: counts, summed up into coarser grids, and the chunks cut from them
+    for (int l = 0; l <= COUNT_LEVEL; l++)
+        b.counts[l].assign((size_t)1 << (3 * l), 0);
+    b.sourcePoints = 0;
+    stream.user = &b;
+    stream.points = CountPoints;
+    if (!readply_stream(&source[0], &stream))
+        return false;
+    for (int l = COUNT_LEVEL; l > 0; l--)
+    {
+        int side = 1 << l;
+        for (int z = 0; z < side; z++)
+            for (int y = 0; y < side; y++)
+                for (int x = 0; x < side; x++)
+                    b.counts[l - 1][GridIndex(l - 1, x >> 1, y >> 1, z >> 1)] += b.counts[l][GridIndex(l, x, y, z)];
+    }
+    b.chunkPoints = std::max((unsigned long long)(maxBytes / BUILD_POINT_BYTES), (unsigned long long)POINT_LEAF * 4);
+    b.cellChunk.assign((size_t)COUNT_SIDE * COUNT_SIDE * COUNT_SIDE, -1);
+    PickChunks(b, 0, 0, 0, 0);
+
+    // Pass three: the points bucket sorted by chunk into the temporary file
+    b.sorted = fopen(sortedFile.c_str(), "w+b");
+    if (b.sorted == NULL)
+    {
+        printf("PointOctree: can't create %s\n", sortedFile.c_str());
+        return false;
+    }
+    b.sortBuffer = std::min(std::max(maxBytes / 2 / (b.chunks.size() * sizeof(ply_point)), (size_t)64),
+                            (size_t)SORT_BUFFER_POINTS);
+    stream.points = SortPoints;
+    bool ok = readply_stream(&source[0], &stream) != 0;
+    for (size_t c = 0; c < b.chunks.size() && ok; c++)
+    {
+        ok = FlushChunk(b, b.chunks[c]);
+        std::vector<ply_point>().swap(b.chunks[c].buffer);
+    }
+
+    b.out = ok ? fopen(treeFile, "wb") : NULL;
+    if (ok && b.out == NULL)
+        printf("PointOctree: can't create %s\n", treeFile);
+    ok = ok && b.out != NULL;
+
+    // Pass four: every chunk's subtree, then the levels above them
+    OctreeHeader header;
+    memset(&header, 0, sizeof(header));
+    b.written = sizeof(header);
+    b.levels = 0;
+    b.failed = false;
+    b.taken.resize((size_t)POINT_GRID * POINT_GRID * POINT_GRID);
+    ok = ok && fwrite(&header, sizeof(header), 1, b.out) == 1;
+    unsigned long long sampleEnd = b.chunks.empty() ? 0 : b.chunks.back().offset + b.chunks.back().points;
+    for (size_t c = 0; c < b.chunks.size() && ok; c++)
+    {
+        Chunk& chunk = b.chunks[c];
+        std::vector<ply_point> points((size_t)chunk.points);
+        ok = Seek(b.sorted, chunk.offset * sizeof(ply_point)) &&
+             fread(&points[0], sizeof(ply_point), points.size(), b.sorted) == points.size();
+        if (!ok)
+        {
+            printf("PointOctree: can't read back the sorted points\n");
+            break;
+        }
+        float min[3], size;
+        CellCube(b, chunk.level, chunk.x, chunk.y, chunk.z, min, size);
+        std::vector<ply_point> sample;
+        chunk.node = BuildNode(b, points, min, size, chunk.level, &sample);
+
+        // Held on disk rather than in memory until the levels above are built, or a scan
+        // cut into many chunks would keep all their samples past the ceiling
+        chunk.sampleOffset = sampleEnd;
+        chunk.samplePoints = sample.size();
+        sampleEnd += sample.size();
+        ok = sample.empty() || (Seek(b.sorted, chunk.sampleOffset * sizeof(ply_point)) &&
+                                fwrite(&sample[0], sizeof(ply_point), sample.size(), b.sorted) == sample.size());
+        if (!ok)
+            printf("PointOctree: can't write the sorted points\n");
+    }
+    std::vector<ply_point> rootSample;
+    header.root = ok ? (unsigned int)BuildUpper(b, 0, 0, 0, 0, rootSample) : 0;
+    fclose(b.sorted);
+    remove(sortedFile.c_str());
+
+    memcpy(header.magic, OCTREE_MAGIC, sizeof(header.magic));
+    header.nodeTable = b.written;
+    header.points = (b.written - sizeof(header)) / sizeof(OctreePoint);
+    header.sourcePoints = b.sourcePoints;
+    header.nodes = (unsigned int)b.nodes.size();
+    memcpy(header.min, b.min, sizeof(header.min));
+    header.size = b.size;
+    ok = ok && !b.failed &&
+         fwrite(&b.nodes[0], sizeof(OctreeNode), b.nodes.size(), b.out) == b.nodes.size() &&
+         Seek(b.out, 0) && fwrite(&header, sizeof(header), 1, b.out) == 1;
+    if (b.out != NULL && fclose(b.out) != 0)
+        ok = false;
+    if (!ok)
+    {
+        if (b.out != NULL)
+            printf("PointOctree: can't write %s\n", treeFile);
+        remove(treeFile);
+        return false;
+    }
+
+    if (stats != NULL)
+    {
+        stats->sourcePoints = header.sourcePoints;
+        stats->storedPoints = header.points;
+        stats->nodes = (int)header.nodes;
+        stats->chunks = (int)b.chunks.size();
+        stats->levels = b.levels;
+        stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    return true;
+}
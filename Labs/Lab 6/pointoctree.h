@@ -0,0 +1,92 @@
+/**************************************************
+ *
+ *                  pointoctree.h
+ *
+ *  Builds a level of detail octree out of the
+ *  vertices of a PLY file of any size, for
+ *  PointCloud to draw. Every node keeps a thinned
+ *  out sample of the points in its cube, at most
+ *  one per cell of a POINT_GRID^3 grid, and passes
+ *  the rest down to its children, so the further
+ *  down the tree the denser the points get.
+ *
+ *  The build never holds more than a memory
+ *  ceiling's worth of points. The file is first
+ *  sorted on disk into chunks of space small
+ *  enough to fit, each chunk is built on its own,
+ *  and the levels above the chunks are sampled
+ *  from the chunks' top nodes.
+ *
+ *  Points are stored quantized to their node: 16
+ *  bits per axis within the node's cube and 8 bits
+ *  each for confidence and intensity within the
+ *  node's range of them.
+ *
+ ***************************************************/
+
+#ifndef POINTOCTREE_H
+#define POINTOCTREE_H
+
+#include <stddef.h>
+
+#define POINT_GRID          128         // Sample cells along each side of a node
+#define POINT_LEAF          20000       // Nodes with fewer points than this keep them all
+#define POINT_MAX_LEVEL     20
+#define OCTREE_MAGIC        "PLYOCT01"
+
+#pragma pack(push, 4)
+
+struct OctreeHeader
+{
+    char magic[8];
+    unsigned long long nodeTable;       // File offset of the node table
+    unsigned long long points;          // Stored, upper levels repeat some of their children's
+    unsigned long long sourcePoints;    // In the PLY file
+    unsigned int nodes;
+    unsigned int root;
+    float min[3];                       // The root cube
+    float size;
+};
+
+struct OctreeNode
+{
+    unsigned long long offset;          // File offset of the points
+    unsigned int points;
+    int level;
+    int children[8];                    // Node indices, -1 where the octant is empty
+    float min[3];                       // The node's cube
+    float size;
+    float spacing;                      // Roughly the distance between its points
+    float confidence[2];                // Range the quantized values map to
+    float intensity[2];
+};
+
+// One stored point, 8 bytes
+struct OctreePoint
+{
+    unsigned short x, y, z;
+    unsigned char confidence, intensity;
+};
+
+#pragma pack(pop)
+
+struct OctreeBuildStats
+{
+    unsigned long long sourcePoints;
+    unsigned long long storedPoints;
+    int nodes;
+    int chunks;
+    int levels;
+    double seconds;
+};
+
+class PointOctree
+{
+public:
+    // Builds 'treeFile' from the vertices of 'plyFile', using about 'maxBytes' of memory
+    // at most. A temporary file next to 'treeFile' holds the sorted points meanwhile.
+    // Returns false if either file can't be used, with the reason printed.
+    static bool Build(const char* plyFile, const char* treeFile, size_t maxBytes, OctreeBuildStats* stats);
+};
+
+#endif
@@ -0,0 +1,18 @@
+#version 400
+out vec4 frag_colour;
+in float confidence;
+in float intensity;
+
+uniform vec3 diffuseColor;
+uniform float minConfidence;
+
+void main()
+{
+    // Round sprites, and points the scanner wasn't sure enough of are left out
+    vec2 offset = gl_PointCoord * 2.0 - 1.0;
+    if (dot(offset, offset) > 1.0 || confidence < minConfidence)
+        discard;
+
+    vec3 ambient = vec3(0.1f);
+    frag_colour = vec4(ambient + clamp(intensity, 0.0, 1.0) * diffuseColor, 1.0);
+}
\ No newline at end of file
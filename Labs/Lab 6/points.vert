@@ -0,0 +1,34 @@
+#version 400
+layout(location = 0) in vec3 vp;            // Fraction of the node's cube
+layout(location = 1) in vec2 attributes;    // Confidence and intensity, fractions of the node's ranges
+out float confidence;
+out float intensity;
+
+uniform mat4 mv;
+uniform mat4 p;
+
+uniform vec3 nodeMin;
+uniform float nodeSize;
+uniform float spacing;
+uniform vec2 confidenceRange;
+uniform vec2 intensityRange;
+uniform int childMask;          // Octants whose child node is drawn as well
+uniform float pixelsPerUnit;
+uniform float pointScale;
+
+void main()
+{
+    vec4 viewPosition = mv * vec4(nodeMin + vp * nodeSize, 1.0);
+    gl_Position = p * viewPosition;
+
+    // Big enough to close the gap to the next point. Where the child is drawn too its
+    // points fill in between this node's, so they only have to be half as big.
+    ivec3 side = ivec3(greaterThanEqual(vp, vec3(0.5)));
+    int octant = side.x | (side.y << 1) | (side.z << 2);
+    float gap = ((childMask >> octant) & 1) != 0 ? spacing * 0.5 : spacing;
+    float scale = length(mv[0].xyz);
+    gl_PointSize = clamp(pointScale * gap * scale * pixelsPerUnit / max(-viewPosition.z, 1e-4), 1.0, 64.0);
+
+    confidence = mix(confidenceRange.x, confidenceRange.y, attributes.x);
+    intensity = mix(intensityRange.x, intensityRange.y, attributes.y);
+}
\ No newline at end of file
@@ -0,0 +1,128 @@
+/*****************************************
+ *
+ *             polylines.cpp
+ *
+ *  Reading, writing and converting the
+ *  binary polyline format.
+ *
+ ****************************************/
+
+#include "polylines.h"
+
+#include <stdio.h>
+#include <string.h>
+
+Polylines::Polylines() : header(NULL)
+{
+}
+
+bool Polylines::Open(const char* fileName)
+{
+    Close();
+    if (!file.Open(fileName))
+        return false;
+
+    // Every line has to end inside the points, and the points inside the file
+    const PolylineHeader* h = (const PolylineHeader*)file.Data();
+    bool ok = file.Size() >= sizeof(PolylineHeader) && memcmp(h->magic, POLYLINE_MAGIC, sizeof(h->magic)) == 0 &&
+              file.Size() == sizeof(PolylineHeader) + ((size_t)h->lines + 1) * sizeof(unsigned int) +
+                             (size_t)h->points * 3 * sizeof(float);
+    const unsigned int* starts = (const unsigned int*)(h + 1);
+    for (unsigned int i = 0; ok && i < h->lines; i++)
+        ok = starts[i] <= starts[i + 1];
+    ok = ok && starts[0] == 0 && starts[h->lines] == h->points;
+    if (!ok)
+    {
+        printf("Polylines: %s isn't a polyline file\n", fileName);
+        file.Close();
+        return false;
+    }
+    header = h;
+    return true;
+}
+
+void Polylines::Close()
+{
+    file.Close();
+    header = NULL;
+}
+
+int Polylines::Lines() const
+{
+    return header != NULL ? (int)header->lines : 0;
+}
+
+int Polylines::Points() const
+{
+    return header != NULL ? (int)header->points : 0;
+}
+
+const unsigned int* Polylines::Starts() const
+{
+    return header != NULL ? (const unsigned int*)(header + 1) : NULL;
+}
+
+const float* Polylines::Positions() const
+{
+    return header != NULL ? (const float*)(Starts() + header->lines + 1) : NULL;
+}
+
+bool Polylines::Write(const char* fileName, const std::vector<unsigned int>& starts,
+                      const std::vector<float>& positions)
+{
+    FILE* fp = fopen(fileName, "wb");
+    if (fp == NULL)
+    {
+        printf("Polylines: can't create %s\n", fileName);
+        return false;
+    }
+
+    PolylineHeader h;
+    memcpy(h.magic, POLYLINE_MAGIC, sizeof(h.magic));
+    h.lines = (unsigned int)starts.size() - 1;
+    h.points = (unsigned int)(positions.size() / 3);
+    bool ok = fwrite(&h, sizeof(h), 1, fp) == 1 &&
+              fwrite(&starts[0], sizeof(unsigned int), starts.size(), fp) == starts.size() &&
+              (positions.empty() || fwrite(&positions[0], sizeof(float), positions.size(), fp) == positions.size());
+    if (fclose(fp) != 0 || !ok)
+    {
+        printf("Polylines: can't write %s\n", fileName);
+        remove(fileName);
+        return false;
+    }
+    return true;
+}
+
+bool Polylines::ConvertText(const char* textFile, const char* binaryFile)
+{
+    FILE* fp = fopen(textFile, "r");
+    if (fp == NULL)
+    {
+        printf("Polylines: can't open %s\n", textFile);
+        return false;
+    }
+
+    int count = 0;
+    bool ok = fscanf(fp, "%i", &count) == 1 && count >= 0;
+    std::vector<float> positions;
+    positions.reserve((size_t)(ok ? count : 0) * 3);
+    for (int i = 0; ok && i < count; i++)
+    {
+        float x, y, z;
+        ok = fscanf(fp, "%f %f %f", &x, &z, &y) == 3;
+        positions.push_back(x);
+        positions.push_back(y);
+        positions.push_back(z);
+    }
+    fclose(fp);
+    if (!ok)
+    {
+        printf("Polylines: %s ends before its %d points\n", textFile, count);
+        return false;
+    }
+
+    std::vector<unsigned int> starts(2);
+    starts[0] = 0;
+    starts[1] = (unsigned int)count;
+    return Write(binaryFile, starts, positions);
+}
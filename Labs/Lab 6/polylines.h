@@ -0,0 +1,61 @@
+/**************************************************
+ *
+ *                  polylines.h
+ *
+ *  A binary file of spline control points that
+ *  is memory mapped and handed to OpenGL as it
+ *  is, instead of being scanned one number at a
+ *  time out of text. It holds any number of
+ *  lines, one after the other:
+ *
+ *    PolylineHeader
+ *    unsigned int starts[lines + 1]
+ *    float positions[points * 3]
+ *
+ *  Line i is the points starts[i] up to (not
+ *  including) starts[i + 1].
+ *
+ ***************************************************/
+
+#ifndef POLYLINES_H
+#define POLYLINES_H
+
+#include <vector>
+
+#include "mappedfile.h"
+
+#define POLYLINE_MAGIC "POLYLN01"
+
+struct PolylineHeader
+{
+    char magic[8];
+    unsigned int lines;
+    unsigned int points;
+};
+
+class Polylines
+{
+public:
+    Polylines();
+
+    bool Open(const char* fileName);    // Returns false if the file can't be mapped or isn't one
+    void Close();
+
+    int Lines() const;
+    int Points() const;
+    const unsigned int* Starts() const;
+    const float* Positions() const;
+
+    static bool Write(const char* fileName, const std::vector<unsigned int>& starts,
+                      const std::vector<float>& positions);
+
+    // Converts the lab's text format, a count and then a point per line, into one line.
+    // The file's y and z are swapped, the way Lab 6 has always read them.
+    static bool ConvertText(const char* textFile, const char* binaryFile);
+
+private:
+    MappedFile file;
+    const PolylineHeader* header;
+};
+
+#endif
@@ -9,6 +9,7 @@
 
 #include "readply.h"
 #include "ply.h"
+#include "plyascii.h"
 #include <stdio.h>
 
 typedef struct vertex {
@@ -32,67 +33,683 @@ PlyProperty face_props[] = { /* list of property information for a face */
    1, PLY_UCHAR, PLY_UCHAR, 0},
 };
 
-struct ply_model* readply(char *filename) {
+extern int ply_type_size[];
+extern PlyProperty *find_property(PlyElement *, char *, int *);
+
+int readply_fast = 1;
+
+#define VERTEX_BLOCK   65536        /* vertices read per fread */
+#define FACE_BUFFER    (1 << 20)    /* bytes of face data read per fread */
+#define MAX_FACE_BYTES (1 + 255 * 4)
+#define STREAM_BYTES   (16 << 20)   /* readply_stream's default memory ceiling */
+#define STREAM_MIN     (64 << 10)
+
+PlyProperty point_props[] = { /* the same for a ply_point */
+  {"x", PLY_FLOAT, PLY_FLOAT, offsetof(struct ply_point, x), 0, 0, 0, 0},
+  {"y", PLY_FLOAT, PLY_FLOAT, offsetof(struct ply_point, y), 0, 0, 0, 0},
+  {"z", PLY_FLOAT, PLY_FLOAT, offsetof(struct ply_point, z), 0, 0, 0, 0},
+  {"confidence", PLY_FLOAT, PLY_FLOAT, offsetof(struct ply_point, confidence), 0, 0, 0, 0},
+  {"intensity", PLY_FLOAT, PLY_FLOAT, offsetof(struct ply_point, intensity), 0, 0, 0, 0}
+};
+
+#define VERTEX_FIELDS  3            /* x, y and z, what a ply_vertex holds */
+#define POINT_FIELDS   5            /* and confidence and intensity for a ply_point */
+
+/*
+ * Checks whether the vertex element has a fixed size layout
+ * with float x, y and z, so it can be read in blocks instead of
+ * a property at a time.  Fills in the size of a vertex on disk
+ * and where each of the first 'nfields' of point_props is in it.
+ * Fields past x, y and z may be missing, their offset is -1, but
+ * have to be floats if they are there.
+ */
+static int vertex_layout(PlyElement *elem, int nfields, int *stride, int offsets[]) {
+	int i, j;
+	int found = 0;
+
+	*stride = 0;
+	for(j=0; j<nfields; j++)
+		offsets[j] = -1;
+	for(i=0; i<elem->nprops; i++) {
+		PlyProperty *prop = elem->props[i];
+		if(prop->is_list)
+			return 0;
+		for(j=0; j<nfields; j++) {
+			if(equal_strings(prop->name, point_props[j].name)) {
+				if(prop->external_type != PLY_FLOAT)
+					return 0;
+				offsets[j] = *stride;
+				found |= 1 << j;
+			}
+		}
+		*stride += ply_type_size[prop->external_type];
+	}
+	return (found & 7) == 7;
+}
+
+/*
+ * Finds which of the vertex properties are x, y and z for the
+ * ASCII reader, which needs every property to be a scalar so a
+ * vertex is always the same number of words.
+ */
+static int vertex_columns(PlyElement *elem, int columns[3]) {
+	static char *names[3] = { "x", "y", "z" };
+	int i, j;
+	int found = 0;
+
+	for(i=0; i<elem->nprops; i++) {
+		if(elem->props[i]->is_list)
+			return 0;
+		for(j=0; j<3; j++) {
+			if(equal_strings(elem->props[i]->name, names[j])) {
+				columns[j] = i;
+				found |= 1 << j;
+			}
+		}
+	}
+	return found == 7;
+}
+
+/*
+ * Checks whether the face element is nothing but a vertex_indices
+ * list with a one byte count and four byte indices, which is what
+ * almost every scanner writes.  Those can be decoded without going
+ * through plyfile.c for every index, in binary and ASCII files.
+ */
+static int face_layout(PlyElement *elem) {
+	PlyProperty *prop;
+
+	if(elem->nprops != 1)
+		return 0;
+	prop = elem->props[0];
+	return prop->is_list && equal_strings(prop->name, "vertex_indices") &&
+		(prop->count_external == PLY_UCHAR || prop->count_external == PLY_CHAR) &&
+		(prop->external_type == PLY_INT || prop->external_type == PLY_UINT);
+}
+
+static float read_float(const unsigned char *p, int swap) {
+	unsigned char b[4];
+	float f;
+	if(swap) {
+		b[0] = p[3]; b[1] = p[2]; b[2] = p[1]; b[3] = p[0];
+		memcpy(&f, b, 4);
+	}
+	else
+		memcpy(&f, p, 4);
+	return f;
+}
+
+static int read_int(const unsigned char *p, int swap) {
+	unsigned char b[4];
+	int i;
+	if(swap) {
+		b[0] = p[3]; b[1] = p[2]; b[2] = p[1]; b[3] = p[0];
+		memcpy(&i, b, 4);
+	}
+	else
+		memcpy(&i, p, 4);
+	return i;
+}
+
+/*
+ * Reads the vertex block with a few large freads into 'nfields'
+ * floats per vertex, laid out as vertex_layout found them.  Missing
+ * fields read as 1.  Vertices that are nothing but those floats in
+ * native byte order go straight into the table.
+ */
+static int read_binary_vertices(FILE *fp, int swap, int nverts, int stride, const int offsets[],
+	int nfields, float *v) {
+	unsigned char *block;
+	int i, j, n, done;
+	int direct = !swap && stride == nfields * 4;
+
+	for(j=0; j<nfields; j++)
+		direct = direct && offsets[j] == j * 4;
+	if(direct)
+		return fread(v, stride, nverts, fp) == (size_t)nverts;
+
+	block = (unsigned char*) malloc((size_t)(nverts < VERTEX_BLOCK ? nverts : VERTEX_BLOCK) * stride);
+	for(done=0; done<nverts; done+=n) {
+		n = nverts - done < VERTEX_BLOCK ? nverts - done : VERTEX_BLOCK;
+		if(fread(block, stride, n, fp) != (size_t)n) {
+			free(block);
+			return 0;
+		}
+		for(i=0; i<n; i++) {
+			const unsigned char *p = block + (size_t)i * stride;
+			float *out = v + (size_t)(done + i) * nfields;
+			for(j=0; j<nfields; j++)
+				out[j] = offsets[j] >= 0 ? read_float(p + offsets[j], swap) : 1.0f;
+		}
+	}
+	free(block);
+	return 1;
+}
+
+/*
+ * The arena is a list of blocks, newest first, handed out front to
+ * back.  readply sizes the first block for the whole of an all
+ * triangle model, so that usually takes a single malloc.
+ */
+struct ply_arena {
+	struct ply_arena *next;
+	size_t size;
+	size_t used;
+};
+
+#define ARENA_ALIGN   16
+#define ARENA_HEADER  ((sizeof(struct ply_arena) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+#define ARENA_BLOCK   (1 << 20)     /* smallest block added once the first is used up */
+
+static size_t arena_round(size_t bytes) {
+	return (bytes + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+static struct ply_arena *arena_block(size_t size) {
+	struct ply_arena *a;
+
+	a = (struct ply_arena*) malloc(ARENA_HEADER + size);
+	if(a == NULL)
+		return NULL;
+	a->next = NULL;
+	a->size = size;
+	a->used = 0;
+	return a;
+}
+
+static void *arena_take(struct ply_arena *a, size_t bytes) {
+	void *p = (char*)a + ARENA_HEADER + a->used;
+	a->used += bytes;
+	return p;
+}
+
+void *ply_alloc(struct ply_model *model, size_t bytes) {
+	struct ply_arena *a = model->arena;
+	struct ply_arena *b;
+
+	bytes = arena_round(bytes);
+	if(a->size - a->used >= bytes)
+		return arena_take(a, bytes);
+
+	/* Something bigger than a block gets one of its own, behind the
+	   current block so what's left of that can still be used */
+	if(bytes >= ARENA_BLOCK) {
+		b = arena_block(bytes);
+		if(b == NULL)
+			return NULL;
+		b->next = a->next;
+		a->next = b;
+		return arena_take(b, bytes);
+	}
+	b = arena_block(ARENA_BLOCK);
+	if(b == NULL)
+		return NULL;
+	b->next = a;
+	model->arena = b;
+	return arena_take(b, bytes);
+}
+
+void freeply(struct ply_model *model) {
+	struct ply_arena *a, *next;
+
+	if(model == NULL)
+		return;
+	/* The model itself is in one of the blocks */
+	for(a=model->arena; a!=NULL; a=next) {
+		next = a->next;
+		free(a);
+	}
+}
+
+/*
+ * Makes sure there is room for 'need' indices.  The first guess
+ * is that the faces still to come are triangles, when that turns
+ * out wrong the indices move to a bigger piece of the arena.
+ */
+static int reserve_indices(struct ply_model *model, int *capacity, int used, int need, int faces_left) {
+	int grown;
+	int *moved;
+
+	if(need <= *capacity)
+		return 1;
+	grown = need + faces_left * 3;
+	if(grown < *capacity * 2)
+		grown = *capacity * 2;
+	moved = (int*) ply_alloc(model, sizeof(int) * (size_t)grown);
+	if(moved == NULL)
+		return 0;
+	if(used > 0)
+		memcpy(moved, model->indices, sizeof(int) * (size_t)used);
+	model->indices = moved;
+	*capacity = grown;
+	return 1;
+}
+
+/*
+ * Binary face lists are decoded out of a buffer that is refilled
+ * whenever less than a full face is left in it.
+ */
+struct face_reader {
 	FILE *fp;
+	int swap;
+	unsigned char *buffer;
+	size_t size, start, end;
+};
+
+static void open_faces(struct face_reader *r, FILE *fp, int swap, size_t size) {
+	r->fp = fp;
+	r->swap = swap;
+	r->size = size;
+	r->start = r->end = 0;
+	r->buffer = (unsigned char*) malloc(size);
+}
+
+/*
+ * Decodes the next face into 'indices' and returns how many it has,
+ * or -1 if the file ends first.
+ */
+static int next_face(struct face_reader *r, int *indices) {
+	const unsigned char *p;
+	int k, n;
+
+	if(r->end - r->start < MAX_FACE_BYTES) {
+		memmove(r->buffer, r->buffer + r->start, r->end - r->start);
+		r->end -= r->start;
+		r->start = 0;
+		r->end += fread(r->buffer + r->end, 1, r->size - r->end, r->fp);
+	}
+	if(r->end - r->start < 1)
+		return -1;
+	p = r->buffer + r->start;
+	n = p[0];
+	if(r->end - r->start < 1 + (size_t)n * 4)
+		return -1;
+	for(k=0; k<n; k++)
+		indices[k] = read_int(p + 1 + k * 4, r->swap);
+	r->start += 1 + (size_t)n * 4;
+	return n;
+}
+
+static void close_faces(struct face_reader *r) {
+	/* Put back what was read past the faces, in case anything follows them */
+	fseek(r->fp, -(long)(r->end - r->start), SEEK_CUR);
+	free(r->buffer);
+}
+
+/*
+ * Reads the binary faces straight into the model's index array.
+ */
+static int read_binary_faces(FILE *fp, int swap, struct ply_model *model) {
+	struct face_reader r;
+	int capacity = 0;
+	int used = 0;
+	int nface = model->nface;
+	int face[255];
+	int i, n;
+
+	open_faces(&r, fp, swap, FACE_BUFFER);
+	for(i=0; i<nface; i++) {
+		n = next_face(&r, face);
+		if(n < 0 || !reserve_indices(model, &capacity, used, used + n, nface - i - 1))
+			break;
+		model->face_offsets[i] = used;
+		memcpy(model->indices + used, face, sizeof(int) * n);
+		used += n;
+	}
+	close_faces(&r);
+	model->face_offsets[i] = used;
+	model->nindex = used;
+	return i == nface;
+}
+
+/*
+ * Reads the faces through plyfile.c, which mallocs every index list,
+ * and copies each one into the model's index array.
+ */
+static int read_generic_faces(PlyFile *ply, struct ply_model *model) {
+	Face face;
+	int capacity = 0;
+	int used = 0;
+	int i, k;
+
+	ply_get_property(ply,"face",&face_props[0]);
+
+	for(i=0; i<model->nface; i++) {
+		face.nverts = 0;
+		face.verts = NULL;
+		ply_get_element(ply,&face);
+		if(!reserve_indices(model, &capacity, used, used + face.nverts, model->nface - i - 1)) {
+			free(face.verts);
+			return 0;
+		}
+		model->face_offsets[i] = used;
+		for(k=0; k<face.nverts; k++)
+			model->indices[used + k] = (int) face.verts[k];
+		used += face.nverts;
+		free(face.verts);
+	}
+	model->face_offsets[i] = used;
+	model->nindex = used;
+	return 1;
+}
+
+static void free_properties(PlyProperty **properties, int nprops) {
+	int i;
+
+	if(properties == NULL)
+		return;
+	for(i=0; i<nprops; i++) {
+		free(properties[i]->name);
+		free(properties[i]);
+	}
+	free(properties);
+}
+
+static int all_triangles(struct ply_model *model) {
+	int i;
+
+	if(model->nindex != model->nface * 3)
+		return 0;
+	for(i=0; i<model->nface; i++)
+		if(model->face_offsets[i+1] - model->face_offsets[i] != 3)
+			return 0;
+	return 1;
+}
+
+/*
+ * Opens a file and reads its header, leaving the file at the start
+ * of the body.
+ */
+static PlyFile *open_ply(char *filename, FILE **fp) {
 	PlyFile *ply;
 	int nelem;
 	char **elem_list;
-	int normals = 0;
+	int i;
+
+	*fp = fopen(filename,"rb");
+	if(*fp == NULL) {
+		fprintf(stderr, "readply: can't open %s\n", filename);
+		return(NULL);
+	}
+	ply = ply_read(*fp,&nelem,&elem_list);
+	if(ply == NULL) {
+		fprintf(stderr, "readply: %s isn't a PLY file\n", filename);
+		fclose(*fp);
+		return(NULL);
+	}
+	for(i=0; i<nelem; i++)
+		free(elem_list[i]);
+	free(elem_list);
+	return(ply);
+}
+
+/*
+ * How many of the element called 'name' the file has, 0 if none.
+ */
+static int element_count(PlyFile *ply, char *name) {
 	PlyProperty **properties;
-	int nverts;
-	int nprops;
+	int count = 0;
+	int nprops = 0;
+
+	properties = ply_get_element_description(ply,name,&count,&nprops);
+	if(properties == NULL)
+		return 0;
+	free_properties(properties, nprops);
+	return count;
+}
+
+struct ply_model* readply(char *filename) {
+	FILE *fp;
+	PlyFile *ply;
+	int nverts, nface;
 	int i;
 	struct ply_vertex *v;
-	int nface;
-	struct ply_face *f;
-	int min = 10;
-	int max = 0;
-	int type;
-	long *mesh;
-	int j,k;
-	FILE *dbgfile;
-	int nmesh;
+	struct ply_arena *arena;
 	struct ply_model *model;
+	size_t size;
+	int ordered, binary, ascii, swap, stride, ok;
+	int offsets[3], columns[3];
 
-	dbgfile = fopen("debug.txt","w");
+	ply = open_ply(filename, &fp);
+	if(ply == NULL)
+		return(NULL);
 
-	fp = fopen(filename,"rb");
-	ply = ply_read(fp,&nelem,&elem_list);
-	fprintf(dbgfile,"nelem = %d\n",nelem);
-	fflush(dbgfile);
+	/* The fast paths read the elements straight from the file, so they
+	   have to be in the order readply asks for them */
+	ordered = readply_fast && ply->nelems >= 2 &&
+		equal_strings(ply->elems[0]->name, "vertex") && equal_strings(ply->elems[1]->name, "face");
+	binary = ordered && ply->file_type != PLY_ASCII;
+	swap = ply->file_type != get_native_binary_type2();
 
-	properties = ply_get_element_description(ply,"vertex",&nverts,&nprops);
+	nverts = element_count(ply, "vertex");
+	nface = element_count(ply, "face");
 
-	fprintf(dbgfile,"nverts = %d\n",nverts);
-	fflush(dbgfile);
-	
-	model = (struct ply_model*) malloc(sizeof(*model));
+	/* One block holds the model, the vertex table, the offsets and
+	   the indices of an all triangle mesh */
+	size = arena_round(sizeof(*model)) + arena_round(sizeof(*v) * (size_t)nverts) +
+		arena_round(sizeof(int) * ((size_t)nface + 1)) + arena_round(sizeof(int) * (size_t)nface * 3);
+	arena = arena_block(size);
+	if(arena == NULL) {
+		fprintf(stderr, "readply: not enough memory for %s\n", filename);
+		ply_close(ply);
+		return(NULL);
+	}
+	model = (struct ply_model*) arena_take(arena, arena_round(sizeof(*model)));
+	model->arena = arena;
 	model->nvertex = nverts;
+	model->nface = nface;
+	model->nindex = 0;
+	model->indices = NULL;
+	model->triangles = 0;
 
-	v = (struct ply_vertex*) malloc(nverts*sizeof(*v));
+	v = (struct ply_vertex*) ply_alloc(model, sizeof(*v) * (size_t)nverts);
 	model->vertices = v;
-	ply_get_property(ply,"vertex",&vert_props[0]);
-	ply_get_property(ply,"vertex",&vert_props[1]);
-	ply_get_property(ply,"vertex",&vert_props[2]);
+	model->face_offsets = (int*) ply_alloc(model, sizeof(int) * ((size_t)nface + 1));
+	model->face_offsets[0] = 0;
 
-	for(i=0; i<nverts; i++) {
-		ply_get_element(ply,&(v[i]));
+	/* ASCII bodies are parsed from a mapping of the file on every core. If
+	   that can't make sense of it, plyfile.c carries on from the header. */
+	ascii = ordered && ply->file_type == PLY_ASCII &&
+		vertex_columns(ply->elems[0], columns) && face_layout(ply->elems[1]) &&
+		ply_read_ascii_body(filename, ftell(fp), ply->elems[0]->nprops, columns, model);
+	if(ascii) {
+		ply_close(ply);
+		model->triangles = all_triangles(model);
+		return(model);
 	}
 
-	properties = ply_get_element_description(ply,"face",&nface,&nprops);
-	f = (struct ply_face *) malloc(nface*sizeof(*f));
-	ply_get_property(ply,"face",&face_props[0]);
+	if(binary && vertex_layout(ply->elems[0], VERTEX_FIELDS, &stride, offsets)) {
+		if(!read_binary_vertices(fp, swap, nverts, stride, offsets, VERTEX_FIELDS, &v->x)) {
+			fprintf(stderr, "readply: %s ends in the middle of the vertices\n", filename);
+			ply_close(ply);
+			freeply(model);
+			return(NULL);
+		}
+	}
+	else {
+		ply_get_property(ply,"vertex",&vert_props[0]);
+		ply_get_property(ply,"vertex",&vert_props[1]);
+		ply_get_property(ply,"vertex",&vert_props[2]);
 
-	fprintf(dbgfile,"nface = %d\n",nface);
-	fflush(dbgfile);
-	
-	model->nface = nface;
-	model->faces = f;
+		for(i=0; i<nverts; i++) {
+			ply_get_element(ply,&(v[i]));
+		}
+	}
 
-	for(i=0; i<nface; i++) {
-		ply_get_element(ply,&f[i]);
+	if(binary && face_layout(ply->elems[1])) {
+		ok = read_binary_faces(fp, swap, model);
+		if(!ok)
+			fprintf(stderr, "readply: %s ends in the middle of the faces\n", filename);
+	}
+	else {
+		ok = read_generic_faces(ply, model);
+		if(!ok)
+			fprintf(stderr, "readply: not enough memory for the faces of %s\n", filename);
+	}
+	ply_close(ply);
+	if(!ok) {
+		freeply(model);
+		return(NULL);
 	}
 
+	model->triangles = all_triangles(model);
 	return(model);
 
 }
+
+/*
+ * Hands the vertices to the stream a batch at a time, each batch
+ * read with plyfile.c or, for fixed size binary vertices, a single
+ * fread.  They go to the points callback with their confidence and
+ * intensity if there is one, otherwise to the vertices callback.
+ */
+static int stream_vertices(PlyFile *ply, FILE *fp, int swap, int nverts, size_t bytes,
+	struct ply_stream *stream) {
+	float *v;
+	int points = stream->points != NULL;
+	int nfields = points ? POINT_FIELDS : VERTEX_FIELDS;
+	int binary, stride = 0;
+	int offsets[POINT_FIELDS], present[POINT_FIELDS];
+	int i, j, n, done, batch, index;
+	int ok = 1;
+
+	if(nverts == 0)
+		return 1;
+	binary = readply_fast && ply->file_type != PLY_ASCII && vertex_layout(ply->elems[0], nfields, &stride, offsets);
+	batch = (int)(bytes / (sizeof(float) * nfields + stride));
+	if(batch > nverts)
+		batch = nverts;
+
+	/* x, y and z are at the same offsets in a ply_vertex and a ply_point */
+	if(!binary) {
+		for(j=0; j<nfields; j++) {
+			present[j] = find_property(ply->elems[0], point_props[j].name, &index) != NULL;
+			if(present[j])
+				ply_get_property(ply,"vertex",&point_props[j]);
+		}
+	}
+	v = (float*) malloc(sizeof(float) * nfields * batch);
+	for(done=0; done<nverts && ok; done+=n) {
+		n = nverts - done < batch ? nverts - done : batch;
+		if(binary) {
+			ok = read_binary_vertices(fp, swap, n, stride, offsets, nfields, v);
+			if(!ok)
+				fprintf(stderr, "readply: the file ends in the middle of the vertices\n");
+		}
+		else {
+			for(i=0; i<n; i++) {
+				float *out = v + (size_t)i * nfields;
+				for(j=0; j<nfields; j++)
+					if(!present[j])
+						out[j] = 1.0f;
+				ply_get_element(ply,out);
+			}
+		}
+		if(ok && points)
+			ok = stream->points(stream->user, (struct ply_point*)v, done, n);
+		else if(ok && stream->vertices != NULL)
+			ok = stream->vertices(stream->user, (struct ply_vertex*)v, done, n);
+	}
+	free(v);
+	return ok;
+}
+
+/*
+ * Hands the faces to the stream a batch at a time.  A batch is cut
+ * short when a face might not fit in what's left of its indices.
+ */
+static int stream_faces(PlyFile *ply, FILE *fp, int swap, int nface, size_t bytes,
+	struct ply_stream *stream) {
+	struct face_reader r;
+	Face face;
+	int *offsets, *indices;
+	int binary, batch, capacity;
+	int i, k, n;
+	int first = 0, count = 0, used = 0;
+	int ok = 1;
+
+	/* Binary files get a quarter of the memory for the file buffer,
+	   the rest holds a batch of triangles, an offset and three
+	   indices each */
+	binary = readply_fast && ply->file_type != PLY_ASCII && face_layout(ply->elems[1]);
+	if(binary) {
+		open_faces(&r, fp, swap, bytes / 4);
+		bytes -= bytes / 4;
+	}
+	else
+		ply_get_property(ply,"face",&face_props[0]);
+	batch = (int)(bytes / (sizeof(int) * 4));
+	capacity = batch * 3;
+	offsets = (int*) malloc(sizeof(int) * ((size_t)batch + 1));
+	indices = (int*) malloc(sizeof(int) * (size_t)capacity);
+
+	for(i=0; i<nface && ok; i++) {
+		if(count == batch || capacity - used < 255) {
+			offsets[count] = used;
+			ok = stream->faces == NULL || stream->faces(stream->user, offsets, indices, first, count);
+			first += count;
+			count = used = 0;
+			if(!ok)
+				break;
+		}
+		offsets[count] = used;
+		if(binary) {
+			n = next_face(&r, indices + used);
+			if(n < 0) {
+				fprintf(stderr, "readply: the file ends in the middle of the faces\n");
+				ok = 0;
+				break;
+			}
+		}
+		else {
+			face.nverts = 0;
+			face.verts = NULL;
+			ply_get_element(ply,&face);
+			n = face.nverts;
+			for(k=0; k<n; k++)
+				indices[used + k] = (int) face.verts[k];
+			free(face.verts);
+		}
+		used += n;
+		count++;
+	}
+	if(ok && count > 0) {
+		offsets[count] = used;
+		ok = stream->faces == NULL || stream->faces(stream->user, offsets, indices, first, count);
+	}
+
+	if(binary)
+		close_faces(&r);
+	free(offsets);
+	free(indices);
+	return ok;
+}
+
+int readply_stream(char *filename, struct ply_stream *stream) {
+	FILE *fp;
+	PlyFile *ply;
+	int nverts, nface, swap, ok;
+	size_t bytes;
+
+	ply = open_ply(filename, &fp);
+	if(ply == NULL)
+		return 0;
+	if(ply->nelems < 1 || !equal_strings(ply->elems[0]->name, "vertex")) {
+		fprintf(stderr, "readply: %s has to start with its vertices to be streamed\n", filename);
+		ply_close(ply);
+		return 0;
+	}
+
+	nverts = element_count(ply, "vertex");
+	nface = ply->nelems >= 2 && equal_strings(ply->elems[1]->name, "face") ? element_count(ply, "face") : 0;
+	swap = ply->file_type != get_native_binary_type2();
+	bytes = stream->max_bytes == 0 ? STREAM_BYTES : stream->max_bytes;
+	if(bytes < STREAM_MIN)
+		bytes = STREAM_MIN;
+
+	ok = stream->begin == NULL || stream->begin(stream->user, nverts, nface);
+	ok = ok && stream_vertices(ply, fp, swap, nverts, bytes, stream);
+	ok = ok && (nface == 0 || stream_faces(ply, fp, swap, nface, bytes, stream));
+	ply_close(ply);
+	return ok;
+}
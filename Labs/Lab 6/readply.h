@@ -7,7 +7,9 @@
  *  the procedure.
  *
  **********************************************************/
- 
+
+#include <stddef.h>
+
  /*
   *  The vertex struct contains the information
   *  for a single vertex.  This includes its x,
@@ -17,34 +19,49 @@
  struct ply_vertex {
         float x, y, z;
  };
- 
- /*
-  *  The ply_face struct contains all the information
-  *  for a single face or polygon in the model.  The n
-  *  field contains the number of vertices in the face,
-  *  and the vertices field is an array of vertex
-  *  table indices.  The face table is an array of
-  *  these structs.
-  */
- struct ply_face {
-        unsigned char n;
-        int *vertices;
-};
 
+/*
+ * A vertex along with the two values range scanners
+ * write for every point, how sure the scanner was of
+ * it and how much light came back.  Files that don't
+ * have them read as 1.
+ */
+struct ply_point {
+       float x, y, z;
+       float confidence, intensity;
+};
+ 
 /*
  * The ply_model struct is the value returned by the
  * readply functon.  This structure contains all the
  * information in the model.  The nvertex field is the
  * number of vertices in the vertex table.  The vertices
  * field is the vertex table.  The nface field is the
- * number of entries in the face table.  The faces
- * field is the faces table.
+ * number of faces.
+ *
+ * The faces are stored compressed row style: the vertex
+ * table indices of every face follow one another in the
+ * indices array, and face i uses the entries from
+ * face_offsets[i] up to (not including) face_offsets[i+1].
+ * face_offsets has nface+1 entries and the last one is
+ * nindex, the length of indices.  When triangles is 1
+ * every face has three vertices, so face i is simply
+ * indices[3*i], indices[3*i+1] and indices[3*i+2].
+ *
+ * Everything, the struct included, lives in one arena
+ * that freeply releases in one go.
  */
+struct ply_arena;
+
 struct ply_model {
        int nvertex;
        struct ply_vertex *vertices;
        int nface;
-       struct ply_face *faces;
+       int *face_offsets;
+       int *indices;
+       int nindex;
+       int triangles;
+       struct ply_arena *arena;
 };
 
 /*
@@ -53,4 +70,63 @@ struct ply_model {
  * return value is a pointer to the model read from the file.
  */
 struct ply_model *readply(char *filename);
+
+/*
+ * Frees a model returned by readply, and everything in it.
+ */
+void freeply(struct ply_model *model);
+
+/*
+ * Hands out memory from the model's arena, which is freed
+ * along with the model.  The readers use it for the tables
+ * and it is there for anything else that should live
+ * exactly as long as the model.  Returns NULL when out of
+ * memory.
+ */
+void *ply_alloc(struct ply_model *model, size_t bytes);
+
+/*
+ * Binary files whose vertices are fixed size with float x, y
+ * and z, and whose faces are plain index lists, are read in
+ * large blocks instead of one property at a time.  Setting
+ * this to 0 forces the generic plyfile.c path (for comparing).
+ */
+extern int readply_fast;
+
+/*
+ * readply_stream is for files too big to hold at once.  It
+ * goes through the file front to back a single time and
+ * hands the vertices, then the faces, to the callbacks a
+ * batch at a time.  Its buffers never take more than
+ * max_bytes together (0 means 16 MB, anything under 64 KB
+ * is raised to that).  Every callback returns 1 to carry
+ * on or 0 to stop, and any of them can be NULL.
+ *
+ * begin gets the counts from the header before anything
+ * else.  A vertices batch is vertices first to
+ * first+count-1.  A faces batch is faces first to
+ * first+count-1, laid out like a ply_model's faces: face
+ * i of the batch uses indices[offsets[i]] up to (not
+ * including) indices[offsets[i+1]].  The batches are
+ * only valid during the call.
+ *
+ * When points is set the vertices are read as ply_points
+ * and go to it instead of to vertices.
+ */
+struct ply_stream {
+	void *user;
+	size_t max_bytes;
+	int (*begin)(void *user, int nvertex, int nface);
+	int (*vertices)(void *user, const struct ply_vertex *vertices, int first, int count);
+	int (*faces)(void *user, const int *offsets, const int *indices, int first, int count);
+	int (*points)(void *user, const struct ply_point *points, int first, int count);
+};
+
+/*
+ * Returns 1 once the whole file has gone through the
+ * callbacks, 0 if it couldn't be read or a callback
+ * stopped it.  The vertices have to be the file's first
+ * element, the faces (if there are any) its second.
+ */
+int readply_stream(char *filename, struct ply_stream *stream);
         
@@ -0,0 +1,39 @@
+#version 400
+layout(location = 0) in uint segment;   // The segment's first control point, one before where it starts
+
+uniform samplerBuffer points;
+uniform mat4 mvp;
+
+uniform float width;
+uniform float tension;
+uniform int divisions;
+
+// The same curve as line.geom, but each vertex works out its own place on it:
+// instance i is segment i, vertices 2k and 2k + 1 are the two sides at step k
+void main()
+{
+	int first = int(segment);
+	vec3 pn1 = texelFetch(points, first).xyz;
+	vec3 p0  = texelFetch(points, first + 1).xyz;
+	vec3 p1  = texelFetch(points, first + 2).xyz;
+	vec3 p2  = texelFetch(points, first + 3).xyz;
+
+	vec3 m0 = (1.0f - tension) * ((p1 - pn1) / 2.0f);
+	vec3 m1 = (1.0f - tension) * ((p2 - p0) / 2.0f);
+
+	float s = float(gl_VertexID >> 1) / float(divisions);
+	float s2 = s * s;
+	float s3 = s2 * s;
+
+	vec3 p = (2 * s3 - 3 * s2 + 1) * p0 + (-2 * s3 + 3 * s2) * p1 + (s3 - 2 * s2 + s) * m0 + (s3 - s2) * m1;
+
+	// The curve's direction from the basis functions' derivatives, so neighbouring
+	// quads share their edge instead of leaving a crack where they bend
+	vec3 d = (6 * s2 - 6 * s) * p0 + (-6 * s2 + 6 * s) * p1 + (3 * s2 - 4 * s + 1) * m0 + (3 * s2 - 2 * s) * m1;
+	if (dot(d, d) == 0.0)
+		d = p1 - p0;
+	vec3 across = cross(normalize(d), vec3(0, 0, 1)) * width;
+
+	float side = (gl_VertexID & 1) == 0 ? -1.0 : 1.0;
+	gl_Position = mvp * vec4(p + side * across, 1.0);
+}
\ No newline at end of file
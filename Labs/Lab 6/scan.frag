@@ -0,0 +1,19 @@
+#version 400
+out vec4 frag_colour;
+in vec3 position;
+
+uniform vec3 diffuseColor;
+uniform bool points;
+
+void main()
+{
+    // Scans come without normals, so triangles use the one of the face,
+    // from how the position changes across it. Points just face the camera.
+    vec3 N = points ? vec3(0, 0, 1) : normalize(cross(dFdx(position), dFdy(position)));
+    vec3 L = normalize(vec3(2, 5, -1));
+
+    float diffuse = abs(dot(N, L));
+    vec3 ambient = vec3(0.1f);
+
+    frag_colour = vec4(ambient + diffuse * diffuseColor, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,14 @@
+#version 400
+layout(location = 0) in vec3 vp;
+smooth out vec3 position;
+
+uniform mat4 mv;
+uniform mat4 p;
+
+void main()
+{
+    vec4 viewPosition = mv * vec4(vp, 1.0);
+    gl_Position = p * viewPosition;
+
+    position = viewPosition.xyz;
+}
\ No newline at end of file
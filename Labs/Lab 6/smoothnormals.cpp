@@ -0,0 +1,273 @@
+/*****************************************
+ *
+ *            smoothnormals.cpp
+ *
+ *  Weighted smooth normals over a vertex
+ *  to corner table, built in parallel.
+ *
+ ****************************************/
+
+#include "smoothnormals.h"
+#include "threadpool.h"
+
+extern "C" {
+    #include "readply.h"
+}
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#define NORMAL_CHUNK 4096   // Triangles or vertices in one piece of a ParallelFor
+
+// Runs body(begin, end) over [0, count) in NORMAL_CHUNK pieces on every core
+template<typename F>
+static void ForChunks(int count, const F& body)
+{
+    ThreadPool::ParallelFor((count + NORMAL_CHUNK - 1) / NORMAL_CHUNK, [&](int chunk)
+    {
+        int begin = chunk * NORMAL_CHUNK;
+        body(begin, std::min(begin + NORMAL_CHUNK, count));
+    });
+}
+
+SmoothNormals::Vec3 SmoothNormals::Sub(const Vec3& a, const Vec3& b)
+{
+    Vec3 r = { a.x - b.x, a.y - b.y, a.z - b.z };
+    return r;
+}
+
+SmoothNormals::Vec3 SmoothNormals::Cross(const Vec3& a, const Vec3& b)
+{
+    Vec3 r = { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+    return r;
+}
+
+float SmoothNormals::Dot(const Vec3& a, const Vec3& b)
+{
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+float SmoothNormals::Length(const Vec3& a)
+{
+    return sqrtf(Dot(a, a));
+}
+
+// Degenerate vectors stay zero instead of turning into NaNs
+SmoothNormals::Vec3 SmoothNormals::Normalize(const Vec3& a)
+{
+    float length = Length(a);
+    Vec3 r = { 0.0f, 0.0f, 0.0f };
+    if (length > 0.0f)
+    {
+        r.x = a.x / length;
+        r.y = a.y / length;
+        r.z = a.z / length;
+    }
+    return r;
+}
+
+void SmoothNormals::Build(const ply_model* model, NormalWeight weight, float creaseDegrees,
+                          bool clockwise, SmoothMesh& mesh)
+{
+    static_assert(sizeof(ply_vertex) == sizeof(Vec3), "ply_vertex is read as a Vec3");
+    const Vec3* positions = (const Vec3*)model->vertices;
+    int nvertex = model->nvertex;
+
+    mesh.vertices.clear();
+    mesh.indices.clear();
+    mesh.splits = 0;
+
+    // All triangle models are used as they are, polygons are split into fans first
+    std::vector<int> fans;
+    const int* tris = model->indices;
+    int ntri = model->nface;
+    if (!model->triangles)
+    {
+        for (int f = 0; f < model->nface; f++)
+        {
+            const int* face = model->indices + model->face_offsets[f];
+            int n = model->face_offsets[f + 1] - model->face_offsets[f];
+            for (int k = 1; k + 1 < n; k++)
+            {
+                fans.push_back(face[0]);
+                fans.push_back(face[k]);
+                fans.push_back(face[k + 1]);
+            }
+        }
+        tris = fans.empty() ? NULL : &fans[0];
+        ntri = (int)(fans.size() / 3);
+    }
+    int ncorner = ntri * 3;
+
+    // Corners sorted by vertex with a counting sort, vertex v's corners
+    // are corners[start[v]] up to corners[start[v + 1]]
+    std::vector<int> start(nvertex + 1, 0);
+    for (int c = 0; c < ncorner; c++)
+    {
+        if (tris[c] < 0 || tris[c] >= nvertex)
+        {
+            printf("SmoothNormals: a face uses vertex %d, there are only %d\n", tris[c], nvertex);
+            return;
+        }
+        start[tris[c] + 1]++;
+    }
+    for (int v = 0; v < nvertex; v++)
+        start[v + 1] += start[v];
+
+    std::vector<int> corners(ncorner);
+    std::vector<int> cursor(start.begin(), start.end() - 1);
+    for (int c = 0; c < ncorner; c++)
+        corners[cursor[tris[c]]++] = c;
+
+    // Unit face normals, and what every corner adds to its vertex's normal:
+    // the face normal scaled by the face's area and/or the corner's angle
+    std::vector<Vec3> faceNormals(ntri);
+    std::vector<Vec3> weighted(ncorner);
+    bool byArea = weight == NORMALS_AREA || weight == NORMALS_AREA_ANGLE;
+    bool byAngle = weight == NORMALS_ANGLE || weight == NORMALS_AREA_ANGLE;
+    ForChunks(ntri, [&](int begin, int end)
+    {
+        for (int t = begin; t < end; t++)
+        {
+            const Vec3* p[3] = { &positions[tris[t * 3]], &positions[tris[t * 3 + 1]], &positions[tris[t * 3 + 2]] };
+            Vec3 n = clockwise ? Cross(Sub(*p[2], *p[0]), Sub(*p[1], *p[0])) : Cross(Sub(*p[1], *p[0]), Sub(*p[2], *p[0]));
+            Vec3 unit = Normalize(n);
+            faceNormals[t] = unit;
+
+            // edges[k] runs from corner k to the next one, so the angle at corner k
+            // is between edges[k] and the reversed edges[k + 2]
+            Vec3 edges[3];
+            if (byAngle)
+            {
+                for (int k = 0; k < 3; k++)
+                    edges[k] = Normalize(Sub(*p[(k + 1) % 3], *p[k]));
+            }
+            float area = byArea ? Length(n) * 0.5f : 1.0f;
+            for (int k = 0; k < 3; k++)
+            {
+                float w = area;
+                if (byAngle)
+                    w *= acosf(std::max(-1.0f, std::min(1.0f, -Dot(edges[k], edges[(k + 2) % 3]))));
+                Vec3 c = { unit.x * w, unit.y * w, unit.z * w };
+                weighted[t * 3 + k] = c;
+            }
+        }
+    });
+
+    // Sums the weighted normals of v's faces, only those within the crease
+    // angle of 'face' unless that is -1
+    float creaseCos = cosf(creaseDegrees * 3.14159265f / 180.0f);
+    auto Accumulate = [&](int v, int face)
+    {
+        Vec3 sum = { 0.0f, 0.0f, 0.0f };
+        for (int i = start[v]; i < start[v + 1]; i++)
+        {
+            int c = corners[i];
+            if (face >= 0 && Dot(faceNormals[face], faceNormals[c / 3]) < creaseCos)
+                continue;
+            sum.x += weighted[c].x;
+            sum.y += weighted[c].y;
+            sum.z += weighted[c].z;
+        }
+        return Normalize(sum);
+    };
+
+    auto Write = [&](int out, int v, const Vec3& normal)
+    {
+        float* p = &mesh.vertices[(size_t)out * 6];
+        p[0] = positions[v].x;
+        p[1] = positions[v].y;
+        p[2] = positions[v].z;
+        p[3] = normal.x;
+        p[4] = normal.y;
+        p[5] = normal.z;
+    };
+
+    mesh.indices.resize(ncorner);
+    if (creaseDegrees >= 180.0f)
+    {
+        // One normal per vertex, the indices are the model's
+        mesh.vertices.resize((size_t)nvertex * 6);
+        ForChunks(nvertex, [&](int begin, int end)
+        {
+            for (int v = begin; v < end; v++)
+                Write(v, v, Accumulate(v, -1));
+        });
+        for (int c = 0; c < ncorner; c++)
+            mesh.indices[c] = (unsigned int)tris[c];
+        return;
+    }
+
+    // Every corner gets the normal of the faces around its vertex that are within the
+    // crease angle of its own face. Corners that come out with the same normal share
+    // a vertex, they summed the same faces in the same order so they match exactly.
+    std::vector<Vec3> cornerNormals(ncorner);
+    std::vector<int> slot(ncorner);         // Which of its vertex's copies a corner uses
+    std::vector<int> copies(nvertex + 1, 0);
+    ForChunks(nvertex, [&](int begin, int end)
+    {
+        for (int v = begin; v < end; v++)
+        {
+            // Most vertices are on smooth surface, where every face is within the crease
+            // angle of every other and they all share one normal
+            bool smooth = true;
+            for (int i = start[v]; i < start[v + 1] && smooth; i++)
+                for (int j = start[v]; j < i && smooth; j++)
+                    smooth = Dot(faceNormals[corners[i] / 3], faceNormals[corners[j] / 3]) >= creaseCos;
+            if (smooth)
+            {
+                Vec3 normal = Accumulate(v, -1);
+                for (int i = start[v]; i < start[v + 1]; i++)
+                {
+                    cornerNormals[corners[i]] = normal;
+                    slot[corners[i]] = 0;
+                }
+                copies[v + 1] = 1;
+                continue;
+            }
+
+            int count = 0;
+            for (int i = start[v]; i < start[v + 1]; i++)
+            {
+                int c = corners[i];
+                cornerNormals[c] = Accumulate(v, c / 3);
+
+                slot[c] = count;
+                for (int j = start[v]; j < i; j++)
+                {
+                    if (memcmp(&cornerNormals[corners[j]], &cornerNormals[c], sizeof(Vec3)) == 0)
+                    {
+                        slot[c] = slot[corners[j]];
+                        break;
+                    }
+                }
+                if (slot[c] == count)
+                    count++;
+            }
+            copies[v + 1] = std::max(count, 1);     // Unused vertices are still kept
+        }
+    });
+    for (int v = 0; v < nvertex; v++)
+        copies[v + 1] += copies[v];
+
+    mesh.vertices.resize((size_t)copies[nvertex] * 6);
+    mesh.splits = copies[nvertex] - nvertex;
+    ForChunks(nvertex, [&](int begin, int end)
+    {
+        for (int v = begin; v < end; v++)
+        {
+            Vec3 none = { 0.0f, 0.0f, 0.0f };
+            if (start[v] == start[v + 1])
+                Write(copies[v], v, none);
+            for (int i = start[v]; i < start[v + 1]; i++)
+            {
+                int c = corners[i];
+                int out = copies[v] + slot[c];
+                mesh.indices[c] = (unsigned int)out;
+                Write(out, v, cornerNormals[c]);
+            }
+        }
+    });
+}
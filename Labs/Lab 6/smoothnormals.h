@@ -0,0 +1,61 @@
+/**************************************************
+ *
+ *                 smoothnormals.h
+ *
+ *  Smooth vertex normals for a ply_model, as
+ *  indexed geometry ready to upload. Every vertex
+ *  finds its faces through a compressed row table
+ *  built with a counting sort, so there is no
+ *  hashing and no allocation per vertex, and the
+ *  vertices are worked through on every core.
+ *
+ *  With a crease angle, faces that meet at a
+ *  sharper angle than it don't share normals and
+ *  their vertices are split.
+ *
+ ***************************************************/
+
+#ifndef SMOOTHNORMALS_H
+#define SMOOTHNORMALS_H
+
+#include <vector>
+
+struct ply_model;
+
+enum NormalWeight
+{
+    NORMALS_EQUAL,          // Every face counts the same
+    NORMALS_AREA,           // Big faces count more
+    NORMALS_ANGLE,          // By the angle of the face's corner at the vertex
+    NORMALS_AREA_ANGLE,     // Both, the least sensitive to how the surface was triangulated
+};
+
+struct SmoothMesh
+{
+    std::vector<float> vertices;        // x, y, z, nx, ny, nz for every vertex
+    std::vector<unsigned int> indices;  // Three per triangle, polygons are split into fans
+    int splits;                         // Vertices added by the crease angle
+};
+
+class SmoothNormals
+{
+public:
+    // Fills 'mesh' from the model. 'creaseDegrees' of 180 or more smooths across every
+    // edge. Faces are taken to be counter-clockwise seen from the front unless 'clockwise'.
+    static void Build(const ply_model* model, NormalWeight weight, float creaseDegrees,
+                      bool clockwise, SmoothMesh& mesh);
+
+private:
+    struct Vec3
+    {
+        float x, y, z;
+    };
+
+    static Vec3 Sub(const Vec3& a, const Vec3& b);
+    static Vec3 Cross(const Vec3& a, const Vec3& b);
+    static float Dot(const Vec3& a, const Vec3& b);
+    static float Length(const Vec3& a);
+    static Vec3 Normalize(const Vec3& a);
+};
+
+#endif
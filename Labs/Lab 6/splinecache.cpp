@@ -0,0 +1,255 @@
+/*****************************************
+ *
+ *             splinecache.cpp
+ *
+ *  Adaptive tessellation of the splines
+ *  into a cached triangle strip.
+ *
+ ****************************************/
+
+#include "splinecache.h"
+#include "polylines.h"
+#include "threadpool.h"
+
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+
+GLuint SplineCache::vao = 0;
+GLuint SplineCache::vbo = 0;
+int SplineCache::vertices = 0;
+bool SplineCache::valid = false;
+float SplineCache::lastTension = 0.0f;
+float SplineCache::lastWidth = 0.0f;
+float SplineCache::lastTolerance = 0.0f;
+int SplineCache::builds = 0;
+float SplineCache::buildMilliseconds = 0.0f;
+
+SplineCache::Vec3 SplineCache::Tangent(const Vec3& next, const Vec3& previous, float tension)
+{
+    float c = (1.0f - tension) / 2.0f;
+    Vec3 t = { (next.x - previous.x) * c, (next.y - previous.y) * c, (next.z - previous.z) * c };
+    return t;
+}
+
+SplineCache::Vec3 SplineCache::Point(const Segment& g, float s)
+{
+    float s2 = s * s;
+    float s3 = s2 * s;
+    float h1 = 2 * s3 - 3 * s2 + 1;
+    float h2 = -2 * s3 + 3 * s2;
+    float h3 = s3 - 2 * s2 + s;
+    float h4 = s3 - s2;
+    Vec3 p = { h1 * g.p0.x + h2 * g.p1.x + h3 * g.m0.x + h4 * g.m1.x,
+               h1 * g.p0.y + h2 * g.p1.y + h3 * g.m0.y + h4 * g.m1.y,
+               h1 * g.p0.z + h2 * g.p1.z + h3 * g.m0.z + h4 * g.m1.z };
+    return p;
+}
+
+// The derivative of Point, the direction the curve runs in at s
+SplineCache::Vec3 SplineCache::Direction(const Segment& g, float s)
+{
+    float s2 = s * s;
+    float d1 = 6 * s2 - 6 * s;
+    float d2 = -6 * s2 + 6 * s;
+    float d3 = 3 * s2 - 4 * s + 1;
+    float d4 = 3 * s2 - 2 * s;
+    Vec3 d = { d1 * g.p0.x + d2 * g.p1.x + d3 * g.m0.x + d4 * g.m1.x,
+               d1 * g.p0.y + d2 * g.p1.y + d3 * g.m0.y + d4 * g.m1.y,
+               d1 * g.p0.z + d2 * g.p1.z + d3 * g.m0.z + d4 * g.m1.z };
+    if (d.x == 0.0f && d.y == 0.0f && d.z == 0.0f)
+    {
+        d.x = g.p1.x - g.p0.x;
+        d.y = g.p1.y - g.p0.y;
+        d.z = g.p1.z - g.p0.z;
+    }
+    return d;
+}
+
+// Whether the curve between s0 and s1 stays within 'tolerance' of the straight piece
+// between them, tried at a quarter, half and three quarters of the way
+bool SplineCache::Flat(const Segment& g, float s0, float s1, float tolerance)
+{
+    Vec3 a = Point(g, s0);
+    Vec3 b = Point(g, s1);
+    Vec3 ab = { b.x - a.x, b.y - a.y, b.z - a.z };
+    float length2 = ab.x * ab.x + ab.y * ab.y + ab.z * ab.z;
+    for (int k = 1; k <= 3; k++)
+    {
+        Vec3 p = Point(g, s0 + (s1 - s0) * k * 0.25f);
+        Vec3 ap = { p.x - a.x, p.y - a.y, p.z - a.z };
+        float t = length2 > 0.0f ? std::min(std::max((ap.x * ab.x + ap.y * ab.y + ap.z * ab.z) / length2, 0.0f), 1.0f) : 0.0f;
+        Vec3 off = { ap.x - ab.x * t, ap.y - ab.y * t, ap.z - ab.z * t };
+        if (off.x * off.x + off.y * off.y + off.z * off.z > tolerance * tolerance)
+            return false;
+    }
+    return true;
+}
+
+// Adds the end of every piece between s0 and s1 to 'steps'
+void SplineCache::Split(const Segment& g, float s0, float s1, int depth, float tolerance, std::vector<float>& steps)
+{
+    if (depth >= SPLINE_MAX_DEPTH || Flat(g, s0, s1, tolerance))
+    {
+        steps.push_back(s1);
+        return;
+    }
+    float middle = (s0 + s1) * 0.5f;
+    Split(g, s0, middle, depth + 1, tolerance, steps);
+    Split(g, middle, s1, depth + 1, tolerance, steps);
+}
+
+// Both sides of the ribbon at s, the way ribbon.vert places them
+void SplineCache::Emit(const Segment& g, float s, float width, std::vector<float>& out)
+{
+    Vec3 p = Point(g, s);
+    Vec3 d = Direction(g, s);
+    float length = sqrtf(d.x * d.x + d.y * d.y + d.z * d.z);
+    float scale = length > 0.0f ? width / length : 0.0f;
+    Vec3 across = { d.y * scale, -d.x * scale, 0.0f };  // cross(d, (0, 0, 1))
+
+    float sides[] = { -1.0f, 1.0f };
+    for (int i = 0; i < 2; i++)
+    {
+        out.push_back(p.x + sides[i] * across.x);
+        out.push_back(p.y + sides[i] * across.y);
+        out.push_back(p.z + sides[i] * across.z);
+    }
+}
+
+bool SplineCache::Update(const Polylines& lines, float tension, float width, float tolerance)
+{
+    if (valid && tension == lastTension && width == lastWidth && tolerance == lastTolerance)
+        return false;
+    auto start = std::chrono::steady_clock::now();
+
+    // Every segment by its first control point, and whether it starts or ends its line
+    struct Span
+    {
+        unsigned int first;
+        bool starts, ends;
+    };
+    std::vector<Span> spans;
+    const unsigned int* starts = lines.Starts();
+    for (int l = 0; l < lines.Lines(); l++)
+    {
+        for (unsigned int p = starts[l]; p + 3 < starts[l + 1]; p++)
+        {
+            Span span = { p, p == starts[l], p + 4 == starts[l + 1] };
+            spans.push_back(span);
+        }
+    }
+
+    // Each chunk of segments becomes its own run of the strip. A line's first and last
+    // vertices are doubled, which joins it to its neighbours with degenerate triangles.
+    const Vec3* points = (const Vec3*)lines.Positions();
+    int chunks = ((int)spans.size() + SPLINE_CHUNK - 1) / SPLINE_CHUNK;
+    std::vector< std::vector<float> > runs(chunks);
+    ThreadPool::ParallelFor(chunks, [&](int chunk)
+    {
+        std::vector<float> steps;
+        std::vector<float>& out = runs[chunk];
+        int end = std::min((chunk + 1) * SPLINE_CHUNK, (int)spans.size());
+        for (int i = chunk * SPLINE_CHUNK; i < end; i++)
+        {
+            const Vec3* c = &points[spans[i].first];
+            Segment g;
+            g.p0 = c[1];
+            g.p1 = c[2];
+            g.m0 = Tangent(c[2], c[0], tension);
+            g.m1 = Tangent(c[3], c[1], tension);
+
+            // The segment's start is the previous one's end, except at the start of a line
+            steps.clear();
+            Split(g, 0.0f, 1.0f, 0, tolerance, steps);
+            if (spans[i].starts)
+            {
+                Emit(g, 0.0f, width, out);
+                float first[3] = { out[out.size() - 6], out[out.size() - 5], out[out.size() - 4] };
+                out.insert(out.end() - 6, first, first + 3);
+            }
+            for (size_t k = 0; k < steps.size(); k++)
+                Emit(g, steps[k], width, out);
+            if (spans[i].ends)
+            {
+                float last[3] = { out[out.size() - 3], out[out.size() - 2], out[out.size() - 1] };
+                out.insert(out.end(), last, last + 3);
+            }
+        }
+    });
+
+    size_t total = 0;
+    for (int c = 0; c < chunks; c++)
+        total += runs[c].size();
+
+    if (vao == 0)
+    {
+        glGenVertexArrays(1, &vao);
+        glBindVertexArray(vao);
+        glGenBuffers(1, &vbo);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 3, (void*)0);
+        glBindVertexArray(0);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(float) * total, NULL, GL_STATIC_DRAW);
+    size_t offset = 0;
+    for (int c = 0; c < chunks; c++)
+    {
+        if (runs[c].empty())
+            continue;
+        glBufferSubData(GL_ARRAY_BUFFER, sizeof(float) * offset, sizeof(float) * runs[c].size(), &runs[c][0]);
+        offset += runs[c].size();
+    }
+    vertices = (int)(total / 3);
+
+    valid = true;
+    lastTension = tension;
+    lastWidth = width;
+    lastTolerance = tolerance;
+    builds++;
+    buildMilliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return true;
+}
+
+void SplineCache::Draw()
+{
+    if (vertices == 0)
+        return;
+
+    glBindVertexArray(vao);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, vertices);
+    glBindVertexArray(0);
+}
+
+void SplineCache::Invalidate()
+{
+    valid = false;
+}
+
+int SplineCache::Vertices()
+{
+    return vertices;
+}
+
+int SplineCache::Builds()
+{
+    return builds;
+}
+
+float SplineCache::BuildMilliseconds()
+{
+    return buildMilliseconds;
+}
+
+void SplineCache::Release()
+{
+    if (vao != 0)
+        glDeleteVertexArrays(1, &vao);
+    if (vbo != 0)
+        glDeleteBuffers(1, &vbo);
+    vao = vbo = 0;
+    vertices = 0;
+    valid = false;
+}
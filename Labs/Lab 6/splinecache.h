@@ -0,0 +1,81 @@
+/**************************************************
+ *
+ *                  splinecache.h
+ *
+ *  The splines tessellated once on the CPU and
+ *  kept in a static buffer, so drawing them is a
+ *  single plain glDrawArrays. They are only
+ *  tessellated again when the lines, the tension,
+ *  the width or the tolerance change.
+ *
+ *  Every segment is split where it bends, not
+ *  into a fixed number of pieces: a piece is
+ *  halved until it strays from the curve by less
+ *  than the tolerance, so straight runs take one
+ *  quad and tight turns as many as they need. The
+ *  segments are worked through on every core.
+ *
+ *  The result is one triangle strip, the lines
+ *  joined by degenerate triangles. curve.vert
+ *  takes the positions at location 0.
+ *
+ ***************************************************/
+
+#ifndef SPLINECACHE_H
+#define SPLINECACHE_H
+
+#include <GL/gl3w.h>
+
+#include <vector>
+
+#define SPLINE_MAX_DEPTH    10      // A segment is split into 2^10 pieces at most
+#define SPLINE_CHUNK        256     // Segments in one piece of a ParallelFor
+
+class Polylines;
+
+class SplineCache
+{
+public:
+    // Tessellates the lines again if anything changed since the last call and returns
+    // true if it did. 'tolerance' is how far the pieces may stray from the curve, in the
+    // lines' own units.
+    static bool Update(const Polylines& lines, float tension, float width, float tolerance);
+
+    static void Draw();
+
+    // Has the next Update tessellate whatever it's given, for when the lines were reloaded
+    static void Invalidate();
+
+    static int Vertices();
+    static int Builds();                // Times tessellated since the start
+    static float BuildMilliseconds();   // How long the last one took
+    static void Release();
+
+private:
+    struct Vec3
+    {
+        float x, y, z;
+    };
+
+    // A segment's ends and tangents, the way line.geom works them out
+    struct Segment
+    {
+        Vec3 p0, p1, m0, m1;
+    };
+
+    static Vec3 Tangent(const Vec3& next, const Vec3& previous, float tension);
+    static Vec3 Point(const Segment& segment, float s);
+    static Vec3 Direction(const Segment& segment, float s);
+    static bool Flat(const Segment& segment, float s0, float s1, float tolerance);
+    static void Split(const Segment& segment, float s0, float s1, int depth, float tolerance, std::vector<float>& steps);
+    static void Emit(const Segment& segment, float s, float width, std::vector<float>& out);
+
+    static GLuint vao, vbo;
+    static int vertices;
+    static bool valid;
+    static float lastTension, lastWidth, lastTolerance;
+    static int builds;
+    static float buildMilliseconds;
+};
+
+#endif
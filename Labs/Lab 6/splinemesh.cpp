@@ -0,0 +1,126 @@
+/*****************************************
+ *
+ *             splinemesh.cpp
+ *
+ *  Buffers and draw calls for the two
+ *  ways of drawing the splines.
+ *
+ ****************************************/
+
+#include "splinemesh.h"
+#include "polylines.h"
+
+GLuint SplineMesh::pointBuffer = 0;
+GLuint SplineMesh::segmentBuffer = 0;
+GLuint SplineMesh::pointTexture = 0;
+GLuint SplineMesh::adjacencyVao = 0;
+GLuint SplineMesh::instancedVao = 0;
+std::vector<GLint> SplineMesh::firsts;
+std::vector<GLsizei> SplineMesh::counts;
+int SplineMesh::points = 0;
+int SplineMesh::segments = 0;
+
+void SplineMesh::Upload(const Polylines& lines)
+{
+    Release();
+
+    // Each segment is known by its first control point, lines too short for
+    // a segment are left out
+    std::vector<GLuint> firstPoints;
+    const unsigned int* starts = lines.Starts();
+    for (int l = 0; l < lines.Lines(); l++)
+    {
+        int n = (int)(starts[l + 1] - starts[l]);
+        if (n < 4)
+            continue;
+        firsts.push_back((GLint)starts[l]);
+        counts.push_back((GLsizei)n);
+        for (unsigned int p = starts[l]; p + 3 < starts[l + 1]; p++)
+            firstPoints.push_back(p);
+    }
+    points = lines.Points();
+    segments = (int)firstPoints.size();
+
+    glGenBuffers(1, &pointBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, pointBuffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 3 * points, lines.Positions(), GL_STATIC_DRAW);
+
+    glGenVertexArrays(1, &adjacencyVao);
+    glBindVertexArray(adjacencyVao);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 3, (void*)0);
+
+    // The same points again as a texture buffer for ribbon.vert to fetch from
+    glGenTextures(1, &pointTexture);
+    glBindTexture(GL_TEXTURE_BUFFER, pointTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGB32F, pointBuffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+    glGenBuffers(1, &segmentBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, segmentBuffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(GLuint) * segments, firstPoints.empty() ? NULL : &firstPoints[0],
+                 GL_STATIC_DRAW);
+
+    glGenVertexArrays(1, &instancedVao);
+    glBindVertexArray(instancedVao);
+    glEnableVertexAttribArray(0);
+    glVertexAttribIPointer(0, 1, GL_UNSIGNED_INT, sizeof(GLuint), (void*)0);
+    glVertexAttribDivisor(0, 1);
+    glBindVertexArray(0);
+}
+
+void SplineMesh::DrawAdjacency()
+{
+    if (firsts.empty())
+        return;
+
+    glBindVertexArray(adjacencyVao);
+    glMultiDrawArrays(GL_LINE_STRIP_ADJACENCY, &firsts[0], &counts[0], (GLsizei)firsts.size());
+    glBindVertexArray(0);
+}
+
+void SplineMesh::DrawInstanced(int divisions)
+{
+    if (segments == 0)
+        return;
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_BUFFER, pointTexture);
+    glBindVertexArray(instancedVao);
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 2 * (divisions + 1), segments);
+    glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+int SplineMesh::Lines()
+{
+    return (int)firsts.size();
+}
+
+int SplineMesh::Points()
+{
+    return points;
+}
+
+int SplineMesh::Segments()
+{
+    return segments;
+}
+
+void SplineMesh::Release()
+{
+    if (adjacencyVao != 0)
+        glDeleteVertexArrays(1, &adjacencyVao);
+    if (instancedVao != 0)
+        glDeleteVertexArrays(1, &instancedVao);
+    if (pointTexture != 0)
+        glDeleteTextures(1, &pointTexture);
+    if (pointBuffer != 0)
+        glDeleteBuffers(1, &pointBuffer);
+    if (segmentBuffer != 0)
+        glDeleteBuffers(1, &segmentBuffer);
+    adjacencyVao = instancedVao = pointTexture = pointBuffer = segmentBuffer = 0;
+    firsts.clear();
+    counts.clear();
+    points = segments = 0;
+}
@@ -0,0 +1,57 @@
+/**************************************************
+ *
+ *                  splinemesh.h
+ *
+ *  Polylines on the GPU, drawn as Catmull-Rom
+ *  splines one of two ways over the same points:
+ *
+ *  - DrawAdjacency feeds every line to line.geom
+ *    as a GL_LINE_STRIP_ADJACENCY, which expands
+ *    each segment into quads.
+ *  - DrawInstanced draws one instance per segment
+ *    with no geometry shader. ribbon.vert fetches
+ *    the segment's four control points from a
+ *    texture buffer and places the vertices of a
+ *    strip of quads along the curve itself.
+ *
+ *  A segment runs between the middle two of four
+ *  consecutive points of a line, so a line of n
+ *  points has n - 3 of them.
+ *
+ ***************************************************/
+
+#ifndef SPLINEMESH_H
+#define SPLINEMESH_H
+
+#include <GL/gl3w.h>
+
+#include <vector>
+
+class Polylines;
+
+class SplineMesh
+{
+public:
+    // Uploads the points straight from the file's mapping, dropping whatever was there
+    static void Upload(const Polylines& lines);
+
+    // With line.geom's program in use, its 'vp' at location 0
+    static void DrawAdjacency();
+
+    // With ribbon.vert's program in use and its 'points' sampler on texture unit 0
+    static void DrawInstanced(int divisions);
+
+    static int Lines();
+    static int Points();
+    static int Segments();
+    static void Release();
+
+private:
+    static GLuint pointBuffer, segmentBuffer, pointTexture;
+    static GLuint adjacencyVao, instancedVao;
+    static std::vector<GLint> firsts;       // Where each line starts, for glMultiDrawArrays
+    static std::vector<GLsizei> counts;
+    static int points, segments;
+};
+
+#endif
@@ -0,0 +1,353 @@
+/*****************************************
+ *
+ *             streamedmesh.cpp
+ *
+ *  A PLY file uploaded batch by batch
+ *  while a worker streams it in.
+ *
+ ****************************************/
+
+#include "streamedmesh.h"
+
+extern "C" {
+    #include "readply.h"
+}
+
+#include <float.h>
+#include <algorithm>
+
+GLuint StreamedMesh::vao = 0;
+GLuint StreamedMesh::vbo = 0;
+GLuint StreamedMesh::ebo = 0;
+int StreamedMesh::vboCapacity = 0;
+size_t StreamedMesh::eboCapacity = 0;
+size_t StreamedMesh::gpuLimit = 0;
+StreamedMeshStats StreamedMesh::stats = StreamedMeshStats();
+glm::vec3 StreamedMesh::boundsMin;
+glm::vec3 StreamedMesh::boundsMax;
+
+std::thread StreamedMesh::worker;
+std::mutex StreamedMesh::mutex;
+std::condition_variable StreamedMesh::room;
+std::deque< std::unique_ptr<StreamedMesh::Batch> > StreamedMesh::queue;
+size_t StreamedMesh::queuedBytes = 0;
+size_t StreamedMesh::queueLimit = 0;
+bool StreamedMesh::cancel = false;
+
+size_t StreamedMesh::Batch::Bytes() const
+{
+    return positions.size() * sizeof(float) + indices.size() * sizeof(GLuint);
+}
+
+void StreamedMesh::Load(const char* fileName, size_t maxBytes)
+{
+    Shutdown();
+
+    stats = StreamedMeshStats();
+    stats.loading = true;
+    boundsMin = glm::vec3(FLT_MAX);
+    boundsMax = glm::vec3(-FLT_MAX);
+
+    // Half the ceiling for batches waiting on the GL thread, half for the reader.
+    // The buffers on the GPU get a ceiling of their own, just as big.
+    queueLimit = maxBytes / 2;
+    gpuLimit = maxBytes;
+    cancel = false;
+    worker = std::thread(WorkerMain, std::string(fileName), maxBytes - queueLimit);
+}
+
+void StreamedMesh::Update()
+{
+    size_t budget = MESH_UPLOAD_BUDGET;
+    bool any = false;
+    for (;;)
+    {
+        std::unique_ptr<Batch> batch;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (queue.empty() || (any && queue.front()->Bytes() > budget))
+                break;
+            batch = std::move(queue.front());
+            queue.pop_front();
+        }
+
+        size_t bytes = batch->Bytes();
+        Upload(*batch);
+        budget -= std::min(budget, bytes);
+        any = true;
+
+        // The batch only stops counting against the ceiling once it's freed
+        batch.reset();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queuedBytes -= bytes;
+        }
+        room.notify_one();
+    }
+}
+
+void StreamedMesh::Draw()
+{
+    if (vao == 0)
+        return;
+
+    glBindVertexArray(vao);
+    if (stats.triangles > 0)
+        glDrawElements(GL_TRIANGLES, stats.triangles * 3, GL_UNSIGNED_INT, (void*)0);
+    else
+        glDrawArrays(GL_POINTS, 0, stats.uploadedVertices);
+    glBindVertexArray(0);
+}
+
+bool StreamedMesh::Triangles()
+{
+    return stats.triangles > 0;
+}
+
+bool StreamedMesh::Bounds(glm::vec3& min, glm::vec3& max)
+{
+    if (stats.uploadedVertices == 0)
+        return false;
+    min = boundsMin;
+    max = boundsMax;
+    return true;
+}
+
+StreamedMeshStats StreamedMesh::Stats()
+{
+    StreamedMeshStats s = stats;
+    std::lock_guard<std::mutex> lock(mutex);
+    s.queuedBytes = queuedBytes;
+    return s;
+}
+
+void StreamedMesh::Shutdown()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        cancel = true;
+    }
+    room.notify_all();
+    if (worker.joinable())
+        worker.join();
+
+    queue.clear();
+    queuedBytes = 0;
+    Release();
+    stats.loading = false;
+}
+
+void StreamedMesh::Upload(Batch& batch)
+{
+    switch (batch.kind)
+    {
+    case BATCH_BEGIN:
+    {
+        stats.vertices = batch.first;
+        stats.faces = batch.count;
+
+        // Sized for the whole file from the start, so batches only ever fill them in.
+        // The index buffer assumes triangles and grows if the faces are bigger. A file
+        // that doesn't fit under the ceiling gets the same share of its vertices and
+        // faces, so the vertices that are kept still have faces to draw.
+        size_t vertexBytes = sizeof(float) * 3 * (size_t)stats.vertices;
+        size_t indexBytes = sizeof(GLuint) * 3 * (size_t)stats.faces;
+        vboCapacity = stats.vertices;
+        eboCapacity = (size_t)stats.faces * 3;
+        if (vertexBytes + indexBytes > gpuLimit)
+        {
+            double share = gpuLimit / (double)(vertexBytes + indexBytes);
+            vboCapacity = (int)(stats.vertices * share);
+            eboCapacity = (size_t)(stats.faces * share) * 3;
+        }
+        stats.gpuBytes = sizeof(float) * 3 * (size_t)vboCapacity + sizeof(GLuint) * eboCapacity;
+
+        glGenVertexArrays(1, &vao);
+        glBindVertexArray(vao);
+        glGenBuffers(1, &vbo);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 3 * vboCapacity, NULL, GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 3, (void*)0);
+
+        glGenBuffers(1, &ebo);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * eboCapacity, NULL, GL_STATIC_DRAW);
+        glBindVertexArray(0);
+        break;
+    }
+
+    case BATCH_VERTICES:
+    {
+        // Vertices past the buffer are left out, the file is read in order so that's its tail
+        int kept = std::max(0, std::min(batch.count, vboCapacity - batch.first));
+        if (kept > 0)
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, vbo);
+            glBufferSubData(GL_ARRAY_BUFFER, sizeof(float) * 3 * batch.first, sizeof(float) * 3 * kept,
+                            &batch.positions[0]);
+            for (size_t i = 0; i < (size_t)kept * 3; i += 3)
+            {
+                glm::vec3 p(batch.positions[i], batch.positions[i + 1], batch.positions[i + 2]);
+                boundsMin = glm::min(boundsMin, p);
+                boundsMax = glm::max(boundsMax, p);
+            }
+            stats.uploadedVertices = batch.first + kept;
+        }
+        stats.skippedVertices += batch.count - kept;
+        break;
+    }
+
+    case BATCH_TRIANGLES:
+    {
+        // Triangles using a vertex that was left out can't be drawn
+        std::vector<GLuint>& indices = batch.indices;
+        size_t kept = 0;
+        for (size_t i = 0; i + 2 < indices.size(); i += 3)
+        {
+            if (indices[i] >= (GLuint)vboCapacity || indices[i + 1] >= (GLuint)vboCapacity ||
+                indices[i + 2] >= (GLuint)vboCapacity)
+                continue;
+            indices[kept++] = indices[i];
+            indices[kept++] = indices[i + 1];
+            indices[kept++] = indices[i + 2];
+        }
+        stats.skippedTriangles += (int)((indices.size() - kept) / 3);
+        indices.resize(kept);
+
+        // The index buffer can grow into whatever the vertex buffer left of the ceiling
+        size_t indexLimit = (gpuLimit - std::min(gpuLimit, sizeof(float) * 3 * (size_t)vboCapacity)) / sizeof(GLuint) / 3 * 3;
+        size_t used = (size_t)stats.triangles * 3;
+        size_t need = used + indices.size();
+        if (need > eboCapacity && eboCapacity < indexLimit)
+        {
+            size_t grown = std::min(std::max(need, eboCapacity * 2), indexLimit);
+            GLuint bigger = 0;
+            glGenBuffers(1, &bigger);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, bigger);
+            glBufferData(GL_COPY_WRITE_BUFFER, sizeof(GLuint) * grown, NULL, GL_STATIC_DRAW);
+            glBindBuffer(GL_COPY_READ_BUFFER, ebo);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, sizeof(GLuint) * used);
+            glDeleteBuffers(1, &ebo);
+            ebo = bigger;
+            eboCapacity = grown;
+
+            glBindVertexArray(vao);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+            glBindVertexArray(0);
+            stats.gpuBytes = sizeof(float) * 3 * (size_t)vboCapacity + sizeof(GLuint) * eboCapacity;
+        }
+        if (need > eboCapacity)
+        {   // Full, the rest of the faces are left out
+            stats.skippedTriangles += (int)((need - eboCapacity) / 3);
+            indices.resize(eboCapacity - used);
+        }
+        if (!indices.empty())
+        {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, ebo);
+            glBufferSubData(GL_COPY_WRITE_BUFFER, sizeof(GLuint) * used, sizeof(GLuint) * indices.size(),
+                            &indices[0]);
+        }
+        stats.triangles += (int)(indices.size() / 3);
+        stats.uploadedFaces = batch.first + batch.count;
+        break;
+    }
+
+    case BATCH_END:
+        stats.loading = false;
+        stats.failed = !batch.ok;
+        break;
+    }
+}
+
+void StreamedMesh::Release()
+{
+    if (vao != 0)
+        glDeleteVertexArrays(1, &vao);
+    if (vbo != 0)
+        glDeleteBuffers(1, &vbo);
+    if (ebo != 0)
+        glDeleteBuffers(1, &ebo);
+    vao = vbo = ebo = 0;
+    vboCapacity = 0;
+    eboCapacity = 0;
+}
+
+bool StreamedMesh::Push(std::unique_ptr<Batch> batch)
+{
+    size_t bytes = batch->Bytes();
+    std::unique_lock<std::mutex> lock(mutex);
+
+    // A batch bigger than the whole queue still goes through on its own
+    room.wait(lock, [bytes] { return cancel || queuedBytes == 0 || queuedBytes + bytes <= queueLimit; });
+    if (cancel)
+        return false;
+    queuedBytes += bytes;
+    queue.push_back(std::move(batch));
+    return true;
+}
+
+int StreamedMesh::OnBegin(void*, int nvertex, int nface)
+{
+    std::unique_ptr<Batch> batch(new Batch());
+    batch->kind = BATCH_BEGIN;
+    batch->first = nvertex;
+    batch->count = nface;
+    return Push(std::move(batch));
+}
+
+int StreamedMesh::OnVertices(void*, const ply_vertex* vertices, int first, int count)
+{
+    std::unique_ptr<Batch> batch(new Batch());
+    batch->kind = BATCH_VERTICES;
+    batch->first = first;
+    batch->count = count;
+    batch->positions.resize((size_t)count * 3);
+    for (int i = 0; i < count; i++)
+    {
+        batch->positions[i * 3 + 0] = vertices[i].x;
+        batch->positions[i * 3 + 1] = vertices[i].y;
+        batch->positions[i * 3 + 2] = vertices[i].z;
+    }
+    return Push(std::move(batch));
+}
+
+int StreamedMesh::OnFaces(void*, const int* offsets, const int* indices, int first, int count)
+{
+    std::unique_ptr<Batch> batch(new Batch());
+    batch->kind = BATCH_TRIANGLES;
+    batch->first = first;
+    batch->count = count;
+    batch->indices.reserve((size_t)std::max(offsets[count] - offsets[0] - count * 2, 0) * 3);
+
+    // Polygons become fans around their first vertex, anything smaller than a triangle is dropped
+    for (int i = 0; i < count; i++)
+    {
+        const int* face = indices + offsets[i];
+        int n = offsets[i + 1] - offsets[i];
+        for (int k = 1; k + 1 < n; k++)
+        {
+            batch->indices.push_back((GLuint)face[0]);
+            batch->indices.push_back((GLuint)face[k]);
+            batch->indices.push_back((GLuint)face[k + 1]);
+        }
+    }
+    return Push(std::move(batch));
+}
+
+void StreamedMesh::WorkerMain(std::string fileName, size_t readerBytes)
+{
+    ply_stream stream;
+    stream.user = NULL;
+    stream.max_bytes = readerBytes;
+    stream.begin = OnBegin;
+    stream.vertices = OnVertices;
+    stream.faces = OnFaces;
+    stream.points = NULL;
+
+    std::unique_ptr<Batch> end(new Batch());
+    end->kind = BATCH_END;
+    end->first = end->count = 0;
+    end->ok = readply_stream(&fileName[0], &stream) != 0;
+    Push(std::move(end));
+}
@@ -0,0 +1,119 @@
+/**************************************************
+ *
+ *                 streamedmesh.h
+ *
+ *  Shows a PLY file while it loads. A worker
+ *  thread streams the file through readply_stream
+ *  and queues the batches, the GL thread uploads a
+ *  few of them per frame into buffers sized from
+ *  the header. What has arrived is drawn as points
+ *  until the first faces are in, then as triangles.
+ *  The reader's buffers and the queue together stay
+ *  under a memory ceiling, so files far bigger than
+ *  memory can be looked at. The GPU buffers are
+ *  held to the same ceiling, whatever doesn't fit
+ *  is left out and counted in the stats.
+ *
+ *  scan.vert takes the positions at location 0.
+ *
+ ***************************************************/
+
+#ifndef STREAMEDMESH_H
+#define STREAMEDMESH_H
+
+#include <GL/gl3w.h>
+#include <GLM/glm.hpp>
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define MESH_UPLOAD_BUDGET  (4 * 1024 * 1024)   // Bytes uploaded per frame at most
+
+struct ply_vertex;
+
+struct StreamedMeshStats
+{
+    int vertices, faces;        // In the file
+    int uploadedVertices;
+    int uploadedFaces;
+    int triangles;              // Drawn, polygons are split into fans
+    int skippedVertices;        // Past the GPU memory ceiling, not drawn
+    int skippedTriangles;       // Past the ceiling, or using a skipped vertex
+    size_t gpuBytes;            // In the vertex and index buffers
+    size_t queuedBytes;         // Read but not uploaded yet
+    bool loading;
+    bool failed;                // The file couldn't be read, what was uploaded stays
+};
+
+class StreamedMesh
+{
+public:
+    // Starts streaming a file in the background, dropping whatever was loaded before.
+    // The reader and the batches waiting to be uploaded use at most 'maxBytes' between them,
+    // and so do the vertex and index buffers.
+    static void Load(const char* fileName, size_t maxBytes);
+
+    // Once per frame on the GL thread: uploads queued batches, up to MESH_UPLOAD_BUDGET
+    // bytes of them (always at least one)
+    static void Update();
+
+    // Draws what has been uploaded so far with the program in use
+    static void Draw();
+
+    // True once any faces are in, Draw draws triangles instead of points from then on
+    static bool Triangles();
+
+    // Box around the vertices uploaded so far, false if there are none yet
+    static bool Bounds(glm::vec3& min, glm::vec3& max);
+
+    static StreamedMeshStats Stats();
+    static void Shutdown();     // Stops the reader and deletes the buffers
+
+private:
+    enum Kind
+    {
+        BATCH_BEGIN,            // The counts from the header
+        BATCH_VERTICES,
+        BATCH_TRIANGLES,
+        BATCH_END,
+    };
+
+    struct Batch
+    {
+        Kind kind;
+        int first, count;       // Vertices or faces, for BEGIN the vertex and face counts
+        bool ok;                // For END, whether the whole file was read
+        std::vector<float> positions;
+        std::vector<GLuint> indices;
+        size_t Bytes() const;
+    };
+
+    static int OnBegin(void* user, int nvertex, int nface);
+    static int OnVertices(void* user, const struct ply_vertex* vertices, int first, int count);
+    static int OnFaces(void* user, const int* offsets, const int* indices, int first, int count);
+    static bool Push(std::unique_ptr<Batch> batch);     // False if the load was cancelled
+    static void Upload(Batch& batch);
+    static void Release();
+    static void WorkerMain(std::string fileName, size_t readerBytes);
+
+    static GLuint vao, vbo, ebo;
+    static int vboCapacity;         // In vertices
+    static size_t eboCapacity;      // In indices
+    static size_t gpuLimit;
+    static StreamedMeshStats stats;
+    static glm::vec3 boundsMin, boundsMax;
+
+    static std::thread worker;
+    static std::mutex mutex;        // Guards the queue, queuedBytes and 'cancel'
+    static std::condition_variable room;
+    static std::deque< std::unique_ptr<Batch> > queue;
+    static size_t queuedBytes, queueLimit;
+    static bool cancel;
+};
+
+#endif
@@ -0,0 +1,183 @@
+/*****************************************
+ *
+ *           normalbench.cpp
+ *
+ *  Times SmoothNormals against the
+ *  unordered_map smooth normals Lab 6
+ *  used to compute, on the bunny or any
+ *  other PLY files.
+ *
+ *  Usage:
+ *    normalbench [-runs n] [file.ply ...]
+ *
+ *  Without a file it uses bunny.ply. For
+ *  something bigger, plybench writes a
+ *  grid of a million faces.
+ *
+ *  Build it with plyfile.c, readply.c,
+ *  plyascii.cpp, mappedfile.cpp,
+ *  threadpool.cpp and smoothnormals.cpp.
+ *
+ ****************************************/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <unordered_map>
+#include <vector>
+
+extern "C" {
+    #include "../readply.h"
+}
+#include "../smoothnormals.h"
+#include "../threadpool.h"
+
+struct vec3
+{
+    float x, y, z;
+    vec3(float s = 0.0f) : x(s), y(s), z(s) {}
+    vec3(float a, float b, float c) : x(a), y(b), z(c) {}
+    vec3 operator-(const vec3& o) const { return vec3(x - o.x, y - o.y, z - o.z); }
+    vec3& operator+=(const vec3& o) { x += o.x; y += o.y; z += o.z; return *this; }
+    vec3& operator/=(float s) { x /= s; y /= s; z /= s; return *this; }
+};
+
+static vec3 normalize(const vec3& a)
+{
+    float l = sqrtf(a.x * a.x + a.y * a.y + a.z * a.z);
+    return vec3(a.x / l, a.y / l, a.z / l);
+}
+
+static vec3 cross(const vec3& a, const vec3& b)
+{
+    return vec3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+}
+
+// What Lab 6's Initialize did: a vector per vertex in a map, then a second pass to average
+static size_t MapNormals(const ply_model* bunny, std::vector<vec3>& points, std::vector<vec3>& smoothNormals)
+{
+    std::vector<vec3> normals;
+    std::unordered_map<int, std::vector<int>> normalIndices;
+    points.clear();
+
+    for (int i = 0, j = 0; i < bunny->nface; i++, j += 3)
+    {
+        const int* f = &bunny->indices[bunny->face_offsets[i]];
+
+        ply_vertex a = bunny->vertices[f[0]];
+        ply_vertex b = bunny->vertices[f[1]];
+        ply_vertex c = bunny->vertices[f[2]];
+
+        vec3 vert1 = vec3(a.x, a.y, a.z);
+        vec3 vert2 = vec3(b.x, b.y, b.z);
+        vec3 vert3 = vec3(c.x, c.y, c.z);
+
+        vec3 normal = cross(normalize(vert3 - vert1), normalize(vert2 - vert1));
+
+        normalIndices[f[0]].push_back(j + 0);
+        normalIndices[f[1]].push_back(j + 1);
+        normalIndices[f[2]].push_back(j + 2);
+
+        points.push_back(vert1);
+        points.push_back(vert2);
+        points.push_back(vert3);
+
+        normals.push_back(normal);
+        normals.push_back(normal);
+        normals.push_back(normal);
+    }
+
+    smoothNormals = normals;
+    for (auto itr = normalIndices.begin(); itr != normalIndices.end(); itr++)
+    {
+        vec3 smoothNormal = vec3(0);
+        for (size_t i = 0; i < (*itr).second.size(); i++)
+            smoothNormal += normals[(*itr).second[i]];
+        smoothNormal /= (float)(*itr).second.size();
+
+        for (size_t i = 0; i < (*itr).second.size(); i++)
+            smoothNormals[(*itr).second[i]] = smoothNormal;
+    }
+    return points.size();
+}
+
+template<typename F>
+static double Best(int runs, const F& body)
+{
+    double best = 1e30;
+    for (int i = 0; i < runs; i++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        body();
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        best = ms < best ? ms : best;
+    }
+    return best;
+}
+
+// Largest angle in degrees between the map's normals and the mesh's for the same corners
+static double Disagreement(const std::vector<vec3>& mapNormals, const SmoothMesh& mesh)
+{
+    double worst = 0.0;
+    for (size_t c = 0; c < mesh.indices.size() && c < mapNormals.size(); c++)
+    {
+        const float* n = &mesh.vertices[(size_t)mesh.indices[c] * 6 + 3];
+        vec3 m = normalize(mapNormals[c]);
+        double d = m.x * n[0] + m.y * n[1] + m.z * n[2];
+        double angle = acos(d > 1.0 ? 1.0 : d < -1.0 ? -1.0 : d) * 180.0 / 3.14159265;
+        worst = angle > worst ? angle : worst;
+    }
+    return worst;
+}
+
+int main(int argc, char** argv)
+{
+    int runs = 5;
+    std::vector<char*> inputs;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-runs") == 0 && i + 1 < argc) runs = atoi(argv[++i]);
+        else                                               inputs.push_back(argv[i]);
+    }
+    static char bunny[] = "bunny.ply";
+    if (inputs.empty())
+        inputs.push_back(bunny);
+
+    printf("%d threads, best of %d runs\n", ThreadPool::Threads(), runs);
+    for (size_t f = 0; f < inputs.size(); f++)
+    {
+        ply_model* model = readply(inputs[f]);
+        if (model == NULL)
+        {
+            printf("can't read %s\n", inputs[f]);
+            continue;
+        }
+        if (!model->triangles)
+        {
+            printf("%s: the map version only handles triangles\n", inputs[f]);
+            freeply(model);
+            continue;
+        }
+
+        std::vector<vec3> points, mapNormals;
+        SmoothMesh mesh;
+        double mapMs = Best(runs, [&] { MapNormals(model, points, mapNormals); });
+        double equalMs = Best(runs, [&] { SmoothNormals::Build(model, NORMALS_EQUAL, 180.0f, true, mesh); });
+        double disagree = Disagreement(mapNormals, mesh);
+        double weightedMs = Best(runs, [&] { SmoothNormals::Build(model, NORMALS_AREA_ANGLE, 180.0f, true, mesh); });
+        double creaseMs = Best(runs, [&] { SmoothNormals::Build(model, NORMALS_AREA_ANGLE, 60.0f, true, mesh); });
+
+        printf("%s: %d vertices, %d triangles\n", inputs[f], model->nvertex, model->nface);
+        printf("  unordered_map:       %8.2f ms, %zu vertices\n", mapMs, points.size());
+        printf("  equal weights:       %8.2f ms (%.1fx), %d vertices, %.2f deg from the map's\n",
+               equalMs, mapMs / equalMs, model->nvertex, disagree);
+        printf("  area and angle:      %8.2f ms (%.1fx)\n", weightedMs, mapMs / weightedMs);
+        printf("  ... with 60 crease:  %8.2f ms (%.1fx), %zu vertices, %d split\n",
+               creaseMs, mapMs / creaseMs, mesh.vertices.size() / 6, mesh.splits);
+        freeply(model);
+    }
+    ThreadPool::Shutdown();
+    return 0;
+}
@@ -0,0 +1,110 @@
+/*****************************************
+ *
+ *           octreebuild.cpp
+ *
+ *  Builds the point octree PointCloud
+ *  draws out of the vertices of a PLY
+ *  file, for scans too big to build from
+ *  inside the lab, and checks the result
+ *  reads back.
+ *
+ *  Usage:
+ *    octreebuild [-mem MB] file.ply [out.octree]
+ *
+ *  The memory ceiling defaults to 256 MB,
+ *  the output to the input's name with
+ *  .octree added.
+ *
+ *  Build it with plyfile.c, readply.c,
+ *  plyascii.cpp, mappedfile.cpp,
+ *  threadpool.cpp and pointoctree.cpp.
+ *
+ ****************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "../mappedfile.h"
+#include "../pointoctree.h"
+
+// Every node's points inside the file, every child inside the table and one level down,
+// every point accounted for once in the leaves' or the interior nodes' share
+static bool Check(const char* treeFile)
+{
+    MappedFile file;
+    if (!file.Open(treeFile) || file.Size() < sizeof(OctreeHeader))
+    {
+        printf("can't read %s back\n", treeFile);
+        return false;
+    }
+    const OctreeHeader* header = (const OctreeHeader*)file.Data();
+    if (memcmp(header->magic, OCTREE_MAGIC, sizeof(header->magic)) != 0 ||
+        header->nodeTable + (unsigned long long)header->nodes * sizeof(OctreeNode) != file.Size())
+    {
+        printf("%s: bad header\n", treeFile);
+        return false;
+    }
+
+    const OctreeNode* nodes = (const OctreeNode*)(file.Data() + header->nodeTable);
+    std::vector<int> parents(header->nodes, 0);
+    for (unsigned int n = 0; n < header->nodes; n++)
+    {
+        const OctreeNode& node = nodes[n];
+        if (node.offset + (unsigned long long)node.points * sizeof(OctreePoint) > header->nodeTable)
+        {
+            printf("node %u: points past the node table\n", n);
+            return false;
+        }
+        for (int i = 0; i < 8; i++)
+        {
+            int c = node.children[i];
+            if (c == -1)
+                continue;
+            if (c < 0 || c >= (int)header->nodes || nodes[c].level != node.level + 1)
+            {
+                printf("node %u: bad child %d\n", n, c);
+                return false;
+            }
+            parents[c]++;
+        }
+    }
+    for (unsigned int n = 0; n < header->nodes; n++)
+    {
+        if (parents[n] != (n == header->root ? 0 : 1))
+        {
+            printf("node %u has %d parents\n", n, parents[n]);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    size_t megabytes = 256;
+    std::vector<char*> files;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-mem") == 0 && i + 1 < argc) megabytes = (size_t)atoi(argv[++i]);
+        else                                              files.push_back(argv[i]);
+    }
+    if (files.empty() || files.size() > 2)
+    {
+        printf("usage: octreebuild [-mem MB] file.ply [out.octree]\n");
+        return 1;
+    }
+    std::string out = files.size() == 2 ? files[1] : std::string(files[0]) + ".octree";
+
+    OctreeBuildStats stats;
+    if (!PointOctree::Build(files[0], out.c_str(), megabytes << 20, &stats))
+        return 1;
+    printf("%s: %llu points into %d nodes over %d levels from %d chunks in %.2f s\n", out.c_str(),
+           stats.sourcePoints, stats.nodes, stats.levels, stats.chunks, stats.seconds);
+    printf("  %llu points stored, %.1f%% more for the coarser levels, %.1f MB\n", stats.storedPoints,
+           100.0 * (double)(stats.storedPoints - stats.sourcePoints) / (double)stats.sourcePoints,
+           (double)(stats.storedPoints * sizeof(OctreePoint)) / (1 << 20));
+    return Check(out.c_str()) ? 0 : 1;
+}
@@ -0,0 +1,192 @@
+/*****************************************
+ *
+ *           plybench.cpp
+ *
+ *  Times readply on a PLY file with the
+ *  fast paths (bulk binary reads, parallel
+ *  ASCII parsing) on and off, checks both
+ *  give the same model and reports how much
+ *  memory the model takes.
+ *
+ *  Usage:
+ *    plybench [-runs n] [file.ply]
+ *
+ *  Without a file it writes plybench.ply, a
+ *  binary little endian grid of about a
+ *  million faces with the same vertex
+ *  properties as bunny.ply.
+ *
+ *  Build it with plyfile.c, readply.c,
+ *  plyascii.cpp, mappedfile.cpp and
+ *  threadpool.cpp.
+ *
+ ****************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+#ifdef _WIN32
+    #include <windows.h>
+    #include <psapi.h>
+    #pragma comment(lib, "psapi.lib")
+#else
+    #include <sys/resource.h>
+#endif
+
+extern "C" {
+    #include "../readply.h"
+}
+#include "../threadpool.h"
+
+#define GRID_SIZE 708   // 708x708 vertices, 999,698 triangles
+
+static bool WriteGrid(const char* fileName)
+{
+    FILE* fid = fopen(fileName, "wb");
+    if (fid == NULL)
+    {
+        printf("can't open %s for writing\n", fileName);
+        return false;
+    }
+
+    int faces = (GRID_SIZE - 1) * (GRID_SIZE - 1) * 2;
+    fprintf(fid, "ply\nformat binary_little_endian 1.0\n");
+    fprintf(fid, "element vertex %d\n", GRID_SIZE * GRID_SIZE);
+    fprintf(fid, "property float x\nproperty float y\nproperty float z\n");
+    fprintf(fid, "property float confidence\nproperty float intensity\n");
+    fprintf(fid, "element face %d\n", faces);
+    fprintf(fid, "property list uchar int vertex_indices\nend_header\n");
+
+    std::vector<float> vertices;
+    vertices.reserve((size_t)GRID_SIZE * GRID_SIZE * 5);
+    for (int y = 0; y < GRID_SIZE; y++)
+    {
+        for (int x = 0; x < GRID_SIZE; x++)
+        {
+            float u = x / (float)(GRID_SIZE - 1), v = y / (float)(GRID_SIZE - 1);
+            vertices.push_back(u);
+            vertices.push_back(0.1f * u * v);
+            vertices.push_back(v);
+            vertices.push_back(1.0f);
+            vertices.push_back(0.5f);
+        }
+    }
+    fwrite(&vertices[0], sizeof(float), vertices.size(), fid);
+
+    std::vector<unsigned char> face(13);
+    face[0] = 3;
+    for (int y = 0; y < GRID_SIZE - 1; y++)
+    {
+        for (int x = 0; x < GRID_SIZE - 1; x++)
+        {
+            int a = y * GRID_SIZE + x, b = a + 1, c = a + GRID_SIZE, d = c + 1;
+            int tris[2][3] = { { a, c, b }, { b, c, d } };
+            for (int t = 0; t < 2; t++)
+            {
+                memcpy(&face[1], tris[t], 12);
+                fwrite(&face[0], 1, 13, fid);
+            }
+        }
+    }
+
+    bool ok = ferror(fid) == 0;
+    fclose(fid);
+    return ok;
+}
+
+static bool SameModel(const ply_model* a, const ply_model* b)
+{
+    if (a->nvertex != b->nvertex || a->nface != b->nface || a->nindex != b->nindex ||
+        a->triangles != b->triangles)
+        return false;
+    if (memcmp(a->vertices, b->vertices, sizeof(ply_vertex) * a->nvertex) != 0)
+        return false;
+    return memcmp(a->face_offsets, b->face_offsets, sizeof(int) * (a->nface + 1)) == 0 &&
+           memcmp(a->indices, b->indices, sizeof(int) * a->nindex) == 0;
+}
+
+// Peak memory of the whole process so far, in megabytes
+static double PeakMemory()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+    return counters.PeakWorkingSetSize / (1024.0 * 1024.0);
+#else
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1024.0;
+#endif
+}
+
+// Best of 'runs' loads, in milliseconds. Every model but the last is freed.
+static double TimeLoad(char* fileName, int fast, int runs, ply_model** model)
+{
+    readply_fast = fast;
+    double best = 1e30;
+    for (int i = 0; i < runs; i++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        *model = readply(fileName);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (*model == NULL)
+            return -1.0;
+        best = ms < best ? ms : best;
+        if (i + 1 < runs)
+            freeply(*model);
+    }
+    return best;
+}
+
+int main(int argc, char** argv)
+{
+    int runs = 3;
+    char* input = NULL;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-runs") == 0 && i + 1 < argc) runs = atoi(argv[++i]);
+        else if (input == NULL)                           input = argv[i];
+    }
+
+    static char generated[] = "plybench.ply";
+    if (input == NULL)
+    {
+        if (!WriteGrid(generated))
+            return 1;
+        input = generated;
+    }
+
+    // The fast path goes first so the peak after it is its own, the
+    // generic path's peak only shows if it is higher
+    double startMb = PeakMemory();
+    ply_model *generic, *fast;
+    double fastMs = TimeLoad(input, 1, runs, &fast);
+    double fastMb = PeakMemory();
+    double genericMs = TimeLoad(input, 0, runs, &generic);
+    double genericMb = PeakMemory();
+    if (genericMs < 0.0 || fastMs < 0.0)
+    {
+        printf("can't read %s\n", input);
+        return 1;
+    }
+
+    size_t modelBytes = sizeof(ply_vertex) * fast->nvertex + sizeof(int) * (fast->nface + 1 + fast->nindex);
+    printf("%s: %d vertices, %d faces%s, %.1f MB of tables\n", input, fast->nvertex, fast->nface,
+           fast->triangles ? " (all triangles)" : "", modelBytes / (1024.0 * 1024.0));
+    printf("  generic: %8.1f ms, peak %6.1f MB\n", genericMs, genericMb);
+    printf("  fast:    %8.1f ms, peak %6.1f MB (%.1fx, %d threads, %.1f MB before loading)\n",
+           fastMs, fastMb, genericMs / fastMs, ThreadPool::Threads(), startMb);
+    ThreadPool::Shutdown();
+    bool same = SameModel(generic, fast);
+    freeply(generic);
+    freeply(fast);
+    if (!same)
+    {
+        printf("  the two paths read different models\n");
+        return 1;
+    }
+    return 0;
+}
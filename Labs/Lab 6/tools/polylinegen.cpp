@@ -0,0 +1,92 @@
+/*****************************************
+ *
+ *           polylinegen.cpp
+ *
+ *  Writes polyline files for Lab 6's
+ *  spline part: big random ones to time
+ *  the two renderers on, or points.txt
+ *  converted.
+ *
+ *  Usage:
+ *    polylinegen [-lines n] points out.polyline
+ *    polylinegen -text points.txt out.polyline
+ *
+ *  Random lines wander smoothly around
+ *  the square the lab's view shows, in
+ *  the z = 0 plane like points.txt. The
+ *  points are split evenly between
+ *  'lines' lines, 1000 by default.
+ *
+ *  Build it with polylines.cpp and
+ *  mappedfile.cpp.
+ *
+ ****************************************/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "../polylines.h"
+
+int main(int argc, char** argv)
+{
+    int lines = 1000;
+    const char* text = NULL;
+    std::vector<char*> args;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-lines") == 0 && i + 1 < argc) lines = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-text") == 0 && i + 1 < argc) text = argv[++i];
+        else                                                    args.push_back(argv[i]);
+    }
+
+    if (text != NULL && args.size() == 1)
+        return Polylines::ConvertText(text, args[0]) ? 0 : 1;
+    if (text != NULL || args.size() != 2 || lines < 1)
+    {
+        printf("usage: polylinegen [-lines n] points out.polyline\n");
+        printf("       polylinegen -text points.txt out.polyline\n");
+        return 1;
+    }
+
+    long long total = atoll(args[0]);
+    if (total < lines * 4LL || total > 0x7fffffffLL)
+    {
+        printf("need at least 4 points a line, and fewer than 2^31 in all\n");
+        return 1;
+    }
+
+    std::vector<unsigned int> starts(lines + 1);
+    std::vector<float> positions((size_t)total * 3);
+    srand(1);
+    for (int l = 0; l <= lines; l++)
+        starts[l] = (unsigned int)(total * l / lines);
+    for (int l = 0; l < lines; l++)
+    {
+        // A walk that turns a little at every point and bounces off the edges
+        float x = rand() / (float)RAND_MAX * 2.0f - 1.0f;
+        float y = rand() / (float)RAND_MAX * 2.0f - 1.0f;
+        float heading = rand() / (float)RAND_MAX * 6.2831853f;
+        float step = 0.02f;
+        for (unsigned int p = starts[l]; p < starts[l + 1]; p++)
+        {
+            positions[(size_t)p * 3 + 0] = x;
+            positions[(size_t)p * 3 + 1] = y;
+            positions[(size_t)p * 3 + 2] = 0.0f;
+
+            heading += (rand() / (float)RAND_MAX - 0.5f) * 0.8f;
+            x += cosf(heading) * step;
+            y += sinf(heading) * step;
+            if (x < -1.0f || x > 1.0f) { heading = 3.14159265f - heading; x = x < 0.0f ? -1.0f : 1.0f; }
+            if (y < -1.0f || y > 1.0f) { heading = -heading; y = y < 0.0f ? -1.0f : 1.0f; }
+        }
+    }
+
+    if (!Polylines::Write(args[1], starts, positions))
+        return 1;
+    printf("%s: %d lines, %lld points, %.1f MB\n", args[1], lines, total,
+           (sizeof(PolylineHeader) + starts.size() * 4 + positions.size() * 4) / (1024.0 * 1024.0));
+    return 0;
+}
@@ -0,0 +1,211 @@
+/*****************************************
+ *
+ *             framepacer.cpp
+ *
+ *  Sleep then spin frame pacing, and its
+ *  error stats.
+ *
+ ****************************************/
+
+#include "framepacer.h"
+
+#include <GLFW/glfw3.h>
+
+#include <math.h>
+#include <algorithm>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+#else
+#include <errno.h>
+#include <time.h>
+#endif
+
+#define MIN_WAKE_MARGIN     0.00002     // Seconds the spin is never shorter than
+#define MARGIN_STEP         0.00005     // Seconds the margin moves by at most a frame
+#define MARGIN_QUANTILE     0.98        // Share of sleeps the margin should cover
+#define MISSED_ERROR        0.001       // Seconds late that counts as a missed frame
+
+int FramePacer::mode = PACING_CAPPED;
+float FramePacer::rate = 120.0f;
+double FramePacer::deadline = 0.0;
+double FramePacer::lastFrame = 0.0;
+double FramePacer::wakeMargin = 0.001;
+int FramePacer::frames = 0;
+int FramePacer::intervals = 0;
+int FramePacer::missed = 0;
+double FramePacer::intervalSum = 0.0;
+double FramePacer::intervalSquares = 0.0;
+double FramePacer::errorSum = 0.0;
+double FramePacer::worstError = 0.0;
+double FramePacer::spinSum = 0.0;
+
+#ifdef _WIN32
+
+double FramePacer::Now()
+{
+    static LARGE_INTEGER frequency = { 0 };
+    if (frequency.QuadPart == 0)
+        QueryPerformanceFrequency(&frequency);
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return counter.QuadPart / (double)frequency.QuadPart;
+}
+
+// A high resolution waitable timer where Windows has them, otherwise an ordinary one,
+// which wakes late enough that the margin grows to cover it
+void FramePacer::SleepUntil(double time)
+{
+    static HANDLE timer = NULL;
+    if (timer == NULL)
+        timer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+    if (timer == NULL)
+        timer = CreateWaitableTimerExW(NULL, NULL, 0, TIMER_ALL_ACCESS);
+
+    double seconds = time - Now();
+    if (seconds <= 0.0 || timer == NULL)
+        return;
+    LARGE_INTEGER due;
+    due.QuadPart = -(LONGLONG)(seconds * 1e7);  // Relative, in 100 ns steps
+    if (SetWaitableTimer(timer, &due, 0, NULL, NULL, FALSE))
+        WaitForSingleObject(timer, INFINITE);
+}
+
+#else
+
+double FramePacer::Now()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+// To an absolute time on the same clock Now reads, so being woken early by a signal
+// just means going back to sleep
+void FramePacer::SleepUntil(double time)
+{
+    timespec until;
+    until.tv_sec = (time_t)time;
+    until.tv_nsec = (long)((time - (double)until.tv_sec) * 1e9);
+    if (until.tv_nsec >= 1000000000L)
+    {
+        until.tv_sec++;
+        until.tv_nsec -= 1000000000L;
+    }
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL) == EINTR)
+    {
+    }
+}
+
+#endif
+
+void FramePacer::SetMode(int mode, float rate)
+{
+    FramePacer::mode = mode;
+    FramePacer::rate = std::max(rate, 1.0f);
+    glfwSwapInterval(mode == PACING_VSYNC ? 1 : 0);
+    deadline = 0.0;
+    ResetStats();
+}
+
+void FramePacer::Wait()
+{
+    double now = Now();
+    if (mode != PACING_CAPPED)
+    {
+        Record(now, 0.0, 0.0);
+        return;
+    }
+
+    double period = 1.0 / rate;
+    if (deadline == 0.0)
+        deadline = now;
+
+    // Sleep to just short of the deadline. The margin follows how late the sleeps wake,
+    // stepping up a lot when one wakes past it and down a little when one doesn't, so it
+    // settles where MARGIN_QUANTILE of them are covered. Chasing the worst wake instead
+    // would have a busy machine spinning half of every frame.
+    double wake = deadline - wakeMargin;
+    if (now < wake)
+    {
+        SleepUntil(wake);
+        double late = Now() - wake;
+        wakeMargin += late > wakeMargin - MIN_WAKE_MARGIN ? MARGIN_STEP * MARGIN_QUANTILE
+                                                          : -MARGIN_STEP * (1.0 - MARGIN_QUANTILE);
+        wakeMargin = std::min(std::max(wakeMargin, MIN_WAKE_MARGIN), period * 0.5);
+    }
+
+    double spinStart = Now();
+    while ((now = Now()) < deadline)
+    {
+    }
+    Record(now, now - deadline, now - spinStart);
+
+    // Keep to the cadence, unless the frame was so late that catching up would mean
+    // rushing the next ones out back to back
+    deadline += period;
+    if (deadline < now)
+        deadline = now + period;
+}
+
+void FramePacer::Record(double now, double error, double spin)
+{
+    if (lastFrame > 0.0)
+    {
+        double interval = now - lastFrame;
+        intervalSum += interval;
+        intervalSquares += interval * interval;
+        intervals++;
+    }
+    lastFrame = now;
+
+    frames++;
+    errorSum += error;
+    worstError = std::max(worstError, fabs(error));
+    spinSum += spin;
+    if (error > MISSED_ERROR)
+        missed++;
+}
+
+int FramePacer::Mode()
+{
+    return mode;
+}
+
+float FramePacer::Rate()
+{
+    return rate;
+}
+
+FramePacerStats FramePacer::Stats()
+{
+    FramePacerStats stats = {};
+    stats.frames = frames;
+    stats.missed = missed;
+    if (intervals > 0)
+    {
+        double mean = intervalSum / intervals;
+        double variance = std::max(intervalSquares / intervals - mean * mean, 0.0);
+        stats.frameMs = (float)(mean * 1000.0);
+        stats.jitterMs = (float)(sqrt(variance) * 1000.0);
+    }
+    if (frames > 0)
+    {
+        stats.meanErrorMs = (float)(errorSum / frames * 1000.0);
+        stats.worstErrorMs = (float)(worstError * 1000.0);
+        stats.spinMs = (float)(spinSum / frames * 1000.0);
+    }
+    return stats;
+}
+
+void FramePacer::ResetStats()
+{
+    lastFrame = 0.0;
+    frames = intervals = missed = 0;
+    intervalSum = intervalSquares = 0.0;
+    errorSum = worstError = spinSum = 0.0;
+}
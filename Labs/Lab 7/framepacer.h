@@ -0,0 +1,73 @@
+/**************************************************
+ *
+ *                  framepacer.h
+ *
+ *  Holds the main loop to a frame rate without
+ *  spinning a core to do it. Capped frames sleep
+ *  until just before they're due, to a deadline
+ *  rather than for a duration so the error never
+ *  adds up, then spin for only the last sliver
+ *  the sleep can't be trusted with. How early it
+ *  wakes adapts to how late the sleeps have been
+ *  coming back.
+ *
+ *  Vsync leaves the waiting to the swap, and
+ *  uncapped doesn't wait at all. Either way the
+ *  stats say how evenly the frames came.
+ *
+ ***************************************************/
+
+#ifndef FRAMEPACER_H
+#define FRAMEPACER_H
+
+enum FramePacing
+{
+    PACING_VSYNC,       // glfwSwapInterval(1), the swap waits for the display
+    PACING_UNCAPPED,    // As fast as it will go
+    PACING_CAPPED       // Sleeps to a fixed rate
+};
+
+struct FramePacerStats
+{
+    int frames;             // Since the mode was last set
+    float frameMs;          // Mean time between frames
+    float jitterMs;         // Their standard deviation
+    float meanErrorMs;      // Capped only, how late frames started on average
+    float worstErrorMs;     // And the latest one
+    int missed;             // Started over a millisecond late, the frame before ran long
+    float spinMs;           // Capped only, mean time spent spinning a frame
+};
+
+class FramePacer
+{
+public:
+    // With the window's context current, it sets the swap interval. 'rate' is the
+    // frames a second PACING_CAPPED holds to.
+    static void SetMode(int mode, float rate = 120.0f);
+
+    // At the top of the loop, returns once the frame is due
+    static void Wait();
+
+    static int Mode();
+    static float Rate();
+    static FramePacerStats Stats();
+    static void ResetStats();
+
+private:
+    static double Now();                // Seconds on a monotonic clock
+    static void SleepUntil(double time);
+    static void Record(double now, double error, double spin);
+
+    static int mode;
+    static float rate;
+    static double deadline;             // When the next capped frame is due
+    static double lastFrame;
+    static double wakeMargin;           // How far ahead of the deadline to wake and start spinning
+
+    // Running sums for the stats
+    static int frames, intervals, missed;
+    static double intervalSum, intervalSquares;
+    static double errorSum, worstError, spinSum;
+};
+
+#endif
@@ -18,6 +18,8 @@
 
 #include "shaders.h"
 #include "mesh.h"
+#include "progressivetexture.h"
+#include "framepacer.h"
 
 #include <SOIL.h>
 
@@ -83,7 +85,8 @@ void Initialize()
     v_loc[skyboxProgram] = glGetUniformLocation(skyboxProgram, "v");
     p_loc[skyboxProgram] = glGetUniformLocation(skyboxProgram, "p");
 
-    skybox_textures[0] = SOIL_load_OGL_cubemap
+    // The skyboxes show a blurry preview straight away and sharpen once the faces are decoded
+    skybox_textures[0] = ProgressiveTexture::LoadCubemap
     (
         ASSETS"skybox/cloudtop_ft.png", // xneg
         ASSETS"skybox/cloudtop_bk.png", // xpos
@@ -92,11 +95,10 @@ void Initialize()
         ASSETS"skybox/cloudtop_rt.png", // zpos
         ASSETS"skybox/cloudtop_lf.png", // zneg
         SOIL_LOAD_RGB,
-        SOIL_CREATE_NEW_ID,
         SOIL_FLAG_MIPMAPS
     );
 
-    skybox_textures[1] = SOIL_load_OGL_cubemap
+    skybox_textures[1] = ProgressiveTexture::LoadCubemap
     (
         ASSETS"skybox/alps_ft.png", // xneg
         ASSETS"skybox/alps_bk.png", // xpos
@@ -105,7 +107,6 @@ void Initialize()
         ASSETS"skybox/alps_rt.png", // zpos
         ASSETS"skybox/alps_lf.png", // zneg
         SOIL_LOAD_RGB,
-        SOIL_CREATE_NEW_ID,
         SOIL_FLAG_MIPMAPS
     );
 
@@ -161,6 +162,7 @@ void Render()
 
 void Cleanup()
 {
+    ProgressiveTexture::Shutdown();
     glDeleteProgram(skyboxProgram);
     glDeleteProgram(simpleProgram);
 }
@@ -172,6 +174,20 @@ void GUI()
     {
         ImGui::Text("%.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
 
+        // How the frames are paced, and how closely they kept to it
+        int pacing = FramePacer::Mode();
+        float rate = FramePacer::Rate();
+        bool repace = ImGui::Combo("Frame pacing", &pacing, "Vsync\0Uncapped\0Capped\0");
+        if (pacing == PACING_CAPPED)
+            repace |= ImGui::SliderFloat("Frame rate", &rate, 30.0f, 240.0f, "%.0f");
+        if (repace)
+            FramePacer::SetMode(pacing, rate);
+        FramePacerStats pacingStats = FramePacer::Stats();
+        ImGui::Text("Frames %.2f ms, %.3f ms jitter", pacingStats.frameMs, pacingStats.jitterMs);
+        if (pacing == PACING_CAPPED)
+            ImGui::Text("Late by %.3f ms, %.2f ms at worst, %d missed, %.2f ms spinning",
+                pacingStats.meanErrorMs, pacingStats.worstErrorMs, pacingStats.missed, pacingStats.spinMs);
+
         ImGui::RadioButton("Clouds", &currentSkybox, 0); ImGui::SameLine();
         ImGui::RadioButton("Alps", &currentSkybox, 1);
 
@@ -202,7 +218,7 @@ int main()
         return 1;
     }
     glfwMakeContextCurrent(window);
-    glfwSwapInterval(0); // essentially turn off vsync
+    FramePacer::SetMode(PACING_CAPPED, 120.0f); // 120 fps, sleeping rather than spinning between frames
 
     // start GL3W
     gl3wInit();
@@ -228,7 +244,8 @@ int main()
     float oldTime = 0.0f, currentTime = 0.0f, deltaTime = 0.0f;
     while (!glfwWindowShouldClose(window))
     {
-        do { currentTime = (float)glfwGetTime(); } while (currentTime - oldTime < 1.0f / 120.0f);
+        FramePacer::Wait();
+        currentTime = (float)glfwGetTime();
 
         FreeCam(deltaTime);
 
@@ -245,6 +262,7 @@ int main()
         oldTime = currentTime;
         
         // Call the helper functions
+        ProgressiveTexture::Update();
         Update(deltaTime);
         Render();
         GUI();
@@ -0,0 +1,301 @@
+/*****************************************
+ *
+ *           progressivetexture.cpp
+ *
+ *  Preview first, full image later.
+ *
+ ****************************************/
+
+#include "progressivetexture.h"
+#include "thumbnail.h"
+
+#include <SOIL.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+std::map<GLuint, unsigned int> ProgressiveTexture::loading;
+unsigned int ProgressiveTexture::nextId = 1;
+
+std::thread ProgressiveTexture::worker;
+std::mutex ProgressiveTexture::mutex;
+std::mutex ProgressiveTexture::soilMutex;
+std::condition_variable ProgressiveTexture::wake;
+std::deque< std::unique_ptr<ProgressiveTexture::Job> > ProgressiveTexture::jobs;
+std::deque< std::unique_ptr<ProgressiveTexture::Job> > ProgressiveTexture::finished;
+bool ProgressiveTexture::running = false;
+
+ProgressiveTexture::Job::Job()
+{
+    for (int i = 0; i < 6; i++)
+    {
+        source[i] = i;
+        pixels[i] = NULL;
+        width[i] = height[i] = channels[i] = 0;
+    }
+}
+
+ProgressiveTexture::Job::~Job()
+{
+    for (int i = 0; i < 6; i++)
+        if (pixels[i] != NULL)
+            SOIL_free_image_data(pixels[i]);
+}
+
+GLuint ProgressiveTexture::Load(const char* fileName, int forceChannels, unsigned int soilFlags)
+{
+    return Start(&fileName, 1, forceChannels, soilFlags);
+}
+
+GLuint ProgressiveTexture::LoadCubemap(const char* posx, const char* negx, const char* posy,
+                                       const char* negy, const char* posz, const char* negz,
+                                       int forceChannels, unsigned int soilFlags)
+{
+    const char* files[6] = { posx, negx, posy, negy, posz, negz };
+    return Start(files, 6, forceChannels, soilFlags);
+}
+
+GLuint ProgressiveTexture::Start(const char* const* files, int faces, int forceChannels, unsigned int soilFlags)
+{
+    // A missing file is reported now rather than in a few frames' time
+    for (int i = 0; i < faces; i++)
+    {
+        FILE* file = fopen(files[i], "rb");
+        if (file == NULL)
+        {
+            printf("can't find texture: %s\n", files[i]);
+            return 0;
+        }
+        fclose(file);
+    }
+
+    std::unique_ptr<Job> job(new Job());
+    job->id = nextId++;
+    job->faces = faces;
+    for (int i = 0; i < faces; i++)
+        job->files[i] = files[i];
+    job->forceChannels = forceChannels;
+    job->soilFlags = soilFlags;
+
+    glGenTextures(1, &job->texture);
+    UploadPreview(*job);
+
+    GLuint texture = job->texture;
+    loading[texture] = job->id;
+
+    if (!running)
+    {
+        running = true;
+        worker = std::thread(WorkerMain);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(std::move(job));
+    }
+    wake.notify_one();
+
+    return texture;
+}
+
+void ProgressiveTexture::UploadPreview(Job& job)
+{
+    GLenum target = job.faces == 6 ? GL_TEXTURE_CUBE_MAP : GL_TEXTURE_2D;
+
+    // Every face needs a thumbnail of the same size, otherwise they all get a grey texel
+    std::vector<unsigned char> thumbnails[6];
+    int width[6], height[6];
+    job.haveThumbnails = true;
+    for (int i = 0; i < job.faces && job.haveThumbnails; i++)
+    {
+        job.haveThumbnails = LoadThumbnail(job.files[i].c_str(), thumbnails[i], width[i], height[i]) &&
+            width[i] == width[0] && height[i] == height[0];
+    }
+
+    glBindTexture(target, job.texture);
+    for (int i = 0; i < job.faces; i++)
+    {
+        GLenum faceTarget = job.faces == 6 ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + i : GL_TEXTURE_2D;
+        if (job.haveThumbnails)
+        {
+            std::vector<unsigned char>& pixels = thumbnails[i];
+            if (job.soilFlags & SOIL_FLAG_INVERT_Y)
+            {
+                size_t row = (size_t)width[i] * 4;
+                for (int y = 0; y < height[i] / 2; y++)
+                    std::swap_ranges(pixels.begin() + y * row, pixels.begin() + (y + 1) * row,
+                        pixels.begin() + (height[i] - 1 - y) * row);
+            }
+            glTexImage2D(faceTarget, 0, GL_RGBA8, width[i], height[i], 0, GL_RGBA, GL_UNSIGNED_BYTE, &pixels[0]);
+        }
+        else
+        {
+            static const unsigned char grey[4] = { 128, 128, 128, 255 };
+            glTexImage2D(faceTarget, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+        }
+    }
+
+    glGenerateMipmap(target);
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    if (target == GL_TEXTURE_CUBE_MAP)
+    {
+        glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(target, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    }
+    glBindTexture(target, GL_NONE);
+}
+
+// Replaces the preview with the decoded image. Anything that fails keeps the preview.
+void ProgressiveTexture::Finish(Job& job)
+{
+    for (int i = 0; i < job.faces; i++)
+    {
+        int s = job.source[i];
+        if (job.pixels[s] == NULL)
+            return; // Already reported by the worker
+
+        if (job.width[s] != job.width[0] || job.height[s] != job.height[0] || job.channels[s] != job.channels[0])
+        {
+            printf("cubemap faces don't match in size: %s\n", job.files[i].c_str());
+            return;
+        }
+    }
+
+    if (job.faces == 1)
+    {   // SOIL re-specifies the preview texture in place, so the name everyone holds stays valid
+        std::lock_guard<std::mutex> lock(soilMutex);
+        if (SOIL_create_OGL_texture(job.pixels[0], job.width[0], job.height[0], job.channels[0], job.texture, job.soilFlags) == 0)
+            printf("can't create texture %s: %s\n", job.files[0].c_str(), SOIL_last_result());
+        return;
+    }
+
+    GLenum formats[5] = { GL_NONE, GL_RED, GL_RG, GL_RGB, GL_RGBA };
+    GLenum format = formats[job.channels[0]];
+    int width = job.width[0], height = job.height[0];
+    bool mipmaps = (job.soilFlags & SOIL_FLAG_MIPMAPS) != 0;
+
+    glBindTexture(GL_TEXTURE_CUBE_MAP, job.texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    std::vector<unsigned char> flipped;
+    for (int i = 0; i < 6; i++)
+    {
+        const unsigned char* pixels = job.pixels[job.source[i]];
+        if (job.soilFlags & SOIL_FLAG_INVERT_Y)
+        {
+            size_t row = (size_t)width * job.channels[0];
+            flipped.resize(row * height);
+            for (int y = 0; y < height; y++)
+                memcpy(&flipped[y * row], pixels + (height - 1 - y) * row, row);
+            pixels = &flipped[0];
+        }
+        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, pixels);
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    // The preview's smaller levels are still there, so either rebuild them or stop using them
+    if (mipmaps)
+        glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, mipmaps ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, GL_NONE);
+}
+
+void ProgressiveTexture::Update()
+{
+    std::unique_ptr<Job> job;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (finished.empty())
+            return;
+        job = std::move(finished.front());
+        finished.pop_front();
+    }
+
+    // Skip textures that were deleted (and maybe handed out again) in the meantime
+    std::map<GLuint, unsigned int>::iterator itr = loading.find(job->texture);
+    if (itr == loading.end() || itr->second != job->id)
+        return;
+
+    loading.erase(itr);
+    Finish(*job);
+}
+
+void ProgressiveTexture::Cancel(GLuint texture)
+{
+    loading.erase(texture);
+}
+
+int ProgressiveTexture::Pending()
+{
+    return (int)loading.size();
+}
+
+void ProgressiveTexture::Shutdown()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    wake.notify_all();
+    if (worker.joinable())
+        worker.join();
+
+    jobs.clear();
+    finished.clear();
+    loading.clear();
+}
+
+void ProgressiveTexture::WorkerMain()
+{
+    for (;;)
+    {
+        std::unique_ptr<Job> job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [] { return !running || !jobs.empty(); });
+            if (!running)
+                return;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+
+        for (int i = 0; i < job->faces; i++)
+        {
+            for (int j = 0; j < i; j++)
+            {
+                if (job->files[j] == job->files[i])
+                {
+                    job->source[i] = j;
+                    break;
+                }
+            }
+            if (job->source[i] != i)
+                continue;
+
+            const char* fileName = job->files[i].c_str();
+            {
+                std::lock_guard<std::mutex> lock(soilMutex);
+                job->pixels[i] = SOIL_load_image(fileName, &job->width[i], &job->height[i], &job->channels[i], job->forceChannels);
+                if (job->pixels[i] == NULL)
+                    printf("can't load image %s: %s\n", fileName, SOIL_last_result());
+            }
+            if (job->pixels[i] == NULL)
+                continue;
+
+            // SOIL reports the channels in the file, we want the ones in the buffer
+            if (job->forceChannels != SOIL_LOAD_AUTO)
+                job->channels[i] = job->forceChannels;
+
+            if (!job->haveThumbnails)
+                SaveThumbnail(fileName, job->pixels[i], job->width[i], job->height[i], job->channels[i]);
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        finished.push_back(std::move(job));
+    }
+}
@@ -0,0 +1,146 @@
+/*****************************************
+ *
+ *           thumbnail.cpp
+ *
+ *  Cached image previews.
+ *
+ ****************************************/
+
+#include "thumbnail.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <string>
+#include <sys/stat.h>
+
+#define THUMBNAIL_VERSION 1
+
+struct ThumbnailHeader
+{
+    char     magic[4];      // "THMB"
+    uint32_t version;
+    int64_t  sourceTime;    // Modification time and size of the image it was made from
+    int64_t  sourceSize;
+    uint32_t width;
+    uint32_t height;        // RGBA pixels follow
+};
+
+static bool StatSource(const char* fileName, int64_t& time, int64_t& size)
+{
+#ifdef _WIN32
+    struct _stat st;
+    if (_stat(fileName, &st) != 0)
+        return false;
+#else
+    struct stat st;
+    if (stat(fileName, &st) != 0)
+        return false;
+#endif
+    time = (int64_t)st.st_mtime;
+    size = (int64_t)st.st_size;
+    return true;
+}
+
+bool LoadThumbnail(const char* fileName, std::vector<unsigned char>& rgba, int& width, int& height)
+{
+    int64_t time, size;
+    if (!StatSource(fileName, time, size))
+        return false;
+
+    std::string thumbName = std::string(fileName) + ".thumb";
+    FILE* file = fopen(thumbName.c_str(), "rb");
+    if (file == NULL)
+        return false;
+
+    ThumbnailHeader header;
+    bool ok = fread(&header, sizeof(header), 1, file) == 1 &&
+        memcmp(header.magic, "THMB", 4) == 0 && header.version == THUMBNAIL_VERSION &&
+        header.sourceTime == time && header.sourceSize == size &&
+        header.width > 0 && header.width <= THUMBNAIL_SIZE &&
+        header.height > 0 && header.height <= THUMBNAIL_SIZE;
+
+    if (ok)
+    {
+        rgba.resize((size_t)header.width * header.height * 4);
+        ok = fread(&rgba[0], rgba.size(), 1, file) == 1;
+    }
+    fclose(file);
+
+    if (!ok)
+        return false;
+
+    width = (int)header.width;
+    height = (int)header.height;
+    return true;
+}
+
+bool SaveThumbnail(const char* fileName, const unsigned char* pixels, int width, int height, int channels)
+{
+    int64_t time, size;
+    if (!StatSource(fileName, time, size) || width <= 0 || height <= 0)
+        return false;
+
+    int tw = width, th = height;
+    if (tw >= th && tw > THUMBNAIL_SIZE) { th = th * THUMBNAIL_SIZE / tw; tw = THUMBNAIL_SIZE; }
+    if (th > tw && th > THUMBNAIL_SIZE)  { tw = tw * THUMBNAIL_SIZE / th; th = THUMBNAIL_SIZE; }
+    if (tw < 1) tw = 1;
+    if (th < 1) th = 1;
+
+    // Average every source pixel under each thumbnail pixel, a plain box filter is plenty here
+    std::vector<unsigned char> rgba((size_t)tw * th * 4);
+    for (int y = 0; y < th; y++)
+    {
+        int y0 = y * height / th, y1 = (y + 1) * height / th;
+        if (y1 <= y0) y1 = y0 + 1;
+        for (int x = 0; x < tw; x++)
+        {
+            int x0 = x * width / tw, x1 = (x + 1) * width / tw;
+            if (x1 <= x0) x1 = x0 + 1;
+
+            unsigned int sum[4] = { 0, 0, 0, 0 };
+            for (int sy = y0; sy < y1; sy++)
+            {
+                const unsigned char* p = pixels + ((size_t)sy * width + x0) * channels;
+                for (int sx = x0; sx < x1; sx++, p += channels)
+                {
+                    sum[0] += p[0];
+                    sum[1] += p[channels >= 3 ? 1 : 0];
+                    sum[2] += p[channels >= 3 ? 2 : 0];
+                    sum[3] += channels == 4 ? p[3] : channels == 2 ? p[1] : 255;
+                }
+            }
+
+            unsigned int count = (unsigned int)((y1 - y0) * (x1 - x0));
+            for (int i = 0; i < 4; i++)
+                rgba[((size_t)y * tw + x) * 4 + i] = (unsigned char)((sum[i] + count / 2) / count);
+        }
+    }
+
+    // Write to a temporary name first, so another run never reads half a file
+    std::string thumbName = std::string(fileName) + ".thumb";
+    std::string tempName = thumbName + ".tmp";
+    FILE* file = fopen(tempName.c_str(), "wb");
+    if (file == NULL)
+        return false;
+
+    ThumbnailHeader header;
+    memcpy(header.magic, "THMB", 4);
+    header.version = THUMBNAIL_VERSION;
+    header.sourceTime = time;
+    header.sourceSize = size;
+    header.width = (uint32_t)tw;
+    header.height = (uint32_t)th;
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+        fwrite(&rgba[0], rgba.size(), 1, file) == 1;
+    ok = fclose(file) == 0 && ok;
+
+    remove(thumbName.c_str());
+    if (!ok || rename(tempName.c_str(), thumbName.c_str()) != 0)
+    {
+        remove(tempName.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,28 @@
+/**************************************************
+ *
+ *                  thumbnail.h
+ *
+ *  Tiny previews of images, cached next to them as
+ *  <image>.thumb. Reading one is a few kilobytes
+ *  instead of a full decode, so loaders can show
+ *  something in the very first frame while the
+ *  real image is still on its way.
+ *
+ ***************************************************/
+
+#ifndef THUMBNAIL_H
+#define THUMBNAIL_H
+
+#include <vector>
+
+#define THUMBNAIL_SIZE 64   // Longest side, the aspect ratio is kept
+
+// Reads the cached preview of fileName as RGBA, rows in the order SOIL decodes them.
+// Returns false if there is none or the image has changed since it was written.
+bool LoadThumbnail(const char* fileName, std::vector<unsigned char>& rgba, int& width, int& height);
+
+// Shrinks a decoded image (1 to 4 channels) and writes it as the preview of fileName.
+// Doesn't use GL, so it can run on a loader thread.
+bool SaveThumbnail(const char* fileName, const unsigned char* pixels, int width, int height, int channels);
+
+#endif
@@ -0,0 +1,84 @@
+/**************************************************
+ *
+ *              progressivetexture.h
+ *
+ *  Textures that are usable straight away. Loading
+ *  one returns a texture holding the image's cached
+ *  thumbnail (a grey texel the very first time),
+ *  the full image is decoded on a worker thread and
+ *  swapped into the same texture name once it's
+ *  ready. The thumbnail is written on the way, so
+ *  the next run starts with a preview.
+ *
+ ***************************************************/
+
+#ifndef PROGRESSIVETEXTURE_H
+#define PROGRESSIVETEXTURE_H
+
+#include <GL/gl3w.h>
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+class ProgressiveTexture
+{
+public:
+    // Same arguments as SOIL_load_OGL_texture and SOIL_load_OGL_cubemap (without the
+    // texture id). Returns 0 only if a file doesn't exist.
+    static GLuint Load(const char* fileName, int forceChannels, unsigned int soilFlags);
+    static GLuint LoadCubemap(const char* posx, const char* negx, const char* posy,
+                              const char* negy, const char* posz, const char* negz,
+                              int forceChannels, unsigned int soilFlags);
+
+    // Once per frame on the GL thread. Swaps in at most one finished image per call,
+    // so no frame pays for more than one full upload.
+    static void Update();
+
+    // Call before deleting a texture that might still be loading
+    static void Cancel(GLuint texture);
+
+    static int Pending();       // Textures still showing their preview
+    static void Shutdown();     // Stops the worker, unfinished loads keep their preview
+
+private:
+    struct Job
+    {
+        unsigned int id;
+        GLuint texture;
+        int faces;              // 1, or 6 for a cubemap
+        std::string files[6];
+        int forceChannels;
+        unsigned int soilFlags;
+        bool haveThumbnails;
+
+        // Filled in by the worker. Faces naming the same file share one decode,
+        // source[i] is the face whose pixels face i uses.
+        int source[6];
+        unsigned char* pixels[6];
+        int width[6], height[6], channels[6];
+
+        Job();
+        ~Job();
+    };
+
+    static GLuint Start(const char* const* files, int faces, int forceChannels, unsigned int soilFlags);
+    static void UploadPreview(Job& job);
+    static void Finish(Job& job);
+    static void WorkerMain();
+
+    static std::map<GLuint, unsigned int> loading;     // Texture -> id of the job filling it in
+    static unsigned int nextId;
+
+    static std::thread worker;
+    static std::mutex mutex;                // Guards the two queues and 'running'
+    static std::condition_variable wake;
+    static std::deque< std::unique_ptr<Job> > jobs, finished;
+    static bool running;
+};
+
+#endif
@@ -3,11 +3,13 @@
 in vec3 direction;
  
 uniform samplerCube skybox;
+uniform samplerCube skyboxNext;	// The sky being faded in, the same as skybox when there's no fade
+uniform float skyboxBlend;		// 0 shows skybox, 1 shows skyboxNext
 
 out vec4 frag_colour;
  
 void main()
 {    
 	float exposure = 2.0f;
-	frag_colour = texture(skybox, direction) * exposure;
+	frag_colour = mix(texture(skybox, direction), texture(skyboxNext, direction), skyboxBlend) * exposure;
 }
\ No newline at end of file
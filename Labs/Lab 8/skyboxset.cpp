@@ -0,0 +1,481 @@
+/*****************************************
+ *
+ *              skyboxset.cpp
+ *
+ *  Crossfading skies, loaded lazily and
+ *  evicted when they go unused.
+ *
+ ****************************************/
+
+#include "skyboxset.h"
+#include "texturecache.h"
+
+#include <SOIL.h>
+
+#include <stdio.h>
+#include <chrono>
+#include <algorithm>
+
+std::vector<SkyboxSet::Sky> SkyboxSet::skies;
+int SkyboxSet::current = -1;
+int SkyboxSet::next = -1;
+int SkyboxSet::pending = -1;
+float SkyboxSet::fade = 0.0f;
+float SkyboxSet::fadeSeconds = 0.0f;
+float SkyboxSet::pendingSeconds = 0.0f;
+double SkyboxSet::lastUpdate = 0.0;
+unsigned int SkyboxSet::nextJobId = 1;
+int SkyboxSet::loads = 0;
+int SkyboxSet::evictions = 0;
+
+std::thread SkyboxSet::worker;
+std::mutex SkyboxSet::mutex;
+std::condition_variable SkyboxSet::wake;
+std::deque< std::unique_ptr<SkyboxSet::Job> > SkyboxSet::jobs;
+std::deque< std::unique_ptr<SkyboxSet::Job> > SkyboxSet::finished;
+bool SkyboxSet::running = false;
+
+SkyboxSet::Faces::Faces()
+{
+    for (int i = 0; i < 6; i++)
+    {
+        source[i] = i;
+        pixels[i] = NULL;
+    }
+    width = height = 0;
+}
+
+SkyboxSet::Faces::~Faces()
+{
+    for (int i = 0; i < 6; i++)
+        if (pixels[i] != NULL)
+            SOIL_free_image_data(pixels[i]);
+}
+
+double SkyboxSet::Now()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int SkyboxSet::Add(const char* posx, const char* negx, const char* posy,
+                   const char* negy, const char* posz, const char* negz)
+{
+    const char* files[6] = { posx, negx, posy, negy, posz, negz };
+
+    // A missing file is reported now rather than when the sky is first wanted
+    for (int i = 0; i < 6; i++)
+    {
+        FILE* file = fopen(files[i], "rb");
+        if (file == NULL)
+        {
+            printf("can't find skybox face: %s\n", files[i]);
+            return -1;
+        }
+        fclose(file);
+    }
+
+    Sky sky;
+    for (int i = 0; i < 6; i++)
+        sky.files[i] = files[i];
+    sky.state = SKY_UNLOADED;
+    sky.jobId = 0;
+    sky.uploadFace = sky.uploadRow = 0;
+    sky.texture = 0;
+    sky.bytes = 0;
+    sky.lastUsed = 0.0;
+    skies.push_back(std::move(sky));
+    return (int)skies.size() - 1;
+}
+
+// Runs on either thread, so it doesn't touch GL or the skies
+bool SkyboxSet::Decode(const std::string* files, Faces& faces)
+{
+    for (int i = 0; i < 6; i++)
+    {
+        for (int j = 0; j < i; j++)
+        {
+            if (files[j] == files[i])
+            {
+                faces.source[i] = j;
+                break;
+            }
+        }
+        if (faces.source[i] != i)
+            continue;
+
+        // Also called from the GL thread by Load, the cache's lock keeps SOIL to one caller
+        int width, height, channels;
+        {
+            std::lock_guard<std::mutex> lock(TextureCache::soilMutex);
+            faces.pixels[i] = SOIL_load_image(files[i].c_str(), &width, &height, &channels, SOIL_LOAD_RGB);
+            if (faces.pixels[i] == NULL)
+            {
+                printf("can't load image %s: %s\n", files[i].c_str(), SOIL_last_result());
+                return false;
+            }
+        }
+
+        if (i == 0)
+        {
+            faces.width = width;
+            faces.height = height;
+        }
+        if (width != height || width != faces.width || height != faces.height)
+        {
+            printf("skybox faces have to be square and the same size: %s\n", files[i].c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+// Allocates the cubemap, the faces are filled in by UploadRows
+void SkyboxSet::BeginUpload(Sky& sky)
+{
+    int size = sky.faces->width;
+
+    glGenTextures(1, &sky.texture);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, sky.texture);
+    for (int i = 0; i < 6; i++)
+        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB8, size, size, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, GL_NONE);
+
+    sky.uploadFace = sky.uploadRow = 0;
+    sky.state = SKY_UPLOADING;
+}
+
+bool SkyboxSet::UploadRows(Sky& sky, size_t& budget)
+{
+    const Faces& faces = *sky.faces;
+    int size = faces.width;
+    size_t rowBytes = (size_t)size * 3;
+
+    glBindTexture(GL_TEXTURE_CUBE_MAP, sky.texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    // Always at least one row, so a tiny budget still gets there eventually
+    bool first = true;
+    while (sky.uploadFace < 6 && (first || budget >= rowBytes))
+    {
+        int rows = std::min(size - sky.uploadRow, std::max(1, (int)(budget / rowBytes)));
+        const unsigned char* pixels = faces.pixels[faces.source[sky.uploadFace]] + sky.uploadRow * rowBytes;
+        glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + sky.uploadFace, 0, 0, sky.uploadRow, size, rows,
+            GL_RGB, GL_UNSIGNED_BYTE, pixels);
+
+        budget -= std::min(budget, rows * rowBytes);
+        sky.uploadRow += rows;
+        if (sky.uploadRow == size)
+        {
+            sky.uploadFace++;
+            sky.uploadRow = 0;
+        }
+        first = false;
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    bool done = sky.uploadFace == 6;
+    if (done)
+    {
+        glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+
+        sky.bytes = 0;
+        for (int s = size; ; s = std::max(s / 2, 1))
+        {
+            sky.bytes += (size_t)s * s * 3 * 6;
+            if (s == 1)
+                break;
+        }
+        sky.faces.reset();
+        sky.state = SKY_RESIDENT;
+        loads++;
+    }
+
+    glBindTexture(GL_TEXTURE_CUBE_MAP, GL_NONE);
+    return done;
+}
+
+bool SkyboxSet::Load(int sky)
+{
+    if (sky < 0 || sky >= (int)skies.size() || skies[sky].state == SKY_FAILED)
+        return false;
+
+    Sky& s = skies[sky];
+    if (s.state == SKY_UNLOADED || s.state == SKY_DECODING)
+    {
+        s.jobId = 0;    // A decode already under way is dropped when it comes back
+        s.faces.reset(new Faces());
+        if (!Decode(s.files, *s.faces))
+        {
+            s.faces.reset();
+            s.state = SKY_FAILED;
+            return false;
+        }
+        BeginUpload(s);
+    }
+    if (s.state == SKY_UPLOADING)
+    {
+        size_t unlimited = (size_t)-1;
+        UploadRows(s, unlimited);
+    }
+
+    current = sky;
+    next = pending = -1;
+    fade = 0.0f;
+    s.lastUsed = Now();
+    return true;
+}
+
+void SkyboxSet::Prefetch(int sky)
+{
+    if (sky < 0 || sky >= (int)skies.size())
+        return;
+
+    Sky& s = skies[sky];
+    s.lastUsed = Now();
+    if (s.state != SKY_UNLOADED)
+        return;
+
+    std::unique_ptr<Job> job(new Job());
+    job->sky = sky;
+    job->id = nextJobId++;
+    for (int i = 0; i < 6; i++)
+        job->files[i] = s.files[i];
+
+    s.jobId = job->id;
+    s.state = SKY_DECODING;
+
+    if (!running)
+    {
+        running = true;
+        worker = std::thread(WorkerMain);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(std::move(job));
+    }
+    wake.notify_one();
+}
+
+void SkyboxSet::Show(int sky, float seconds)
+{
+    if (sky < 0 || sky >= (int)skies.size() || skies[sky].state == SKY_FAILED)
+        return;
+
+    if (next != -1)
+    {
+        if (sky == next)
+        {
+            pending = -1;
+            return;
+        }
+        if (sky == current)
+        {   // Turn around from wherever the fade has got to
+            std::swap(current, next);
+            fade = 1.0f - fade;
+            pending = -1;
+            return;
+        }
+    }
+    else if (sky == current)
+    {
+        pending = -1;
+        return;
+    }
+
+    pending = sky;
+    pendingSeconds = seconds;
+    Prefetch(sky);
+}
+
+bool SkyboxSet::InUse(int sky)
+{
+    return sky == current || sky == next || sky == pending;
+}
+
+void SkyboxSet::Evict(Sky& sky)
+{
+    if (sky.state == SKY_RESIDENT || sky.state == SKY_UPLOADING)
+        evictions++;
+
+    if (sky.texture != 0)
+        glDeleteTextures(1, &sky.texture);
+    sky.texture = 0;
+    sky.bytes = 0;
+    sky.faces.reset();
+    sky.jobId = 0;          // A decode still in the queue is dropped when it comes back
+    if (sky.state != SKY_FAILED)
+        sky.state = SKY_UNLOADED;
+}
+
+void SkyboxSet::Update()
+{
+    double now = Now();
+    float deltaTime = lastUpdate > 0.0 ? (float)(now - lastUpdate) : 0.0f;
+    lastUpdate = now;
+
+    std::deque< std::unique_ptr<Job> > done;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        done.swap(finished);
+    }
+
+    for (size_t i = 0; i < done.size(); i++)
+    {
+        Job& job = *done[i];
+        Sky& s = skies[job.sky];
+        if (s.state != SKY_DECODING || s.jobId != job.id)
+            continue;   // Evicted or loaded some other way in the meantime
+
+        if (job.faces == nullptr)
+        {
+            s.state = SKY_FAILED;
+            continue;
+        }
+        s.faces = std::move(job.faces);
+        BeginUpload(s);
+    }
+
+    // The sky waiting to be shown goes first, then the others share what's left
+    size_t budget = SKY_UPLOAD_BUDGET;
+    if (pending != -1 && skies[pending].state == SKY_UPLOADING)
+        UploadRows(skies[pending], budget);
+    for (size_t i = 0; i < skies.size() && budget > 0; i++)
+        if (skies[i].state == SKY_UPLOADING)
+            UploadRows(skies[i], budget);
+
+    if (next != -1)
+    {
+        fade = fadeSeconds > 0.0f ? fade + deltaTime / fadeSeconds : 1.0f;
+        if (fade >= 1.0f)
+        {
+            current = next;
+            next = -1;
+            fade = 0.0f;
+        }
+    }
+
+    if (pending != -1 && next == -1)
+    {
+        if (skies[pending].state == SKY_FAILED)
+            pending = -1;
+        else if (skies[pending].state == SKY_RESIDENT)
+        {
+            if (current == -1 || pendingSeconds <= 0.0f)
+                current = pending;
+            else
+            {
+                next = pending;
+                fade = 0.0f;
+                fadeSeconds = pendingSeconds;
+            }
+            pending = -1;
+        }
+    }
+
+    for (int i = 0; i < (int)skies.size(); i++)
+    {
+        Sky& s = skies[i];
+        if (InUse(i))
+            s.lastUsed = now;
+        else if (s.state != SKY_UNLOADED && s.state != SKY_FAILED && now - s.lastUsed > SKY_EVICT_SECONDS)
+            Evict(s);
+    }
+}
+
+void SkyboxSet::Bind(GLuint program, int unit)
+{
+    GLuint from = current != -1 ? skies[current].texture : 0;
+    GLuint to = next != -1 ? skies[next].texture : from;
+
+    // Smoothstep, so the fade doesn't start and stop abruptly
+    float blend = next != -1 ? fade * fade * (3.0f - 2.0f * fade) : 0.0f;
+
+    glUniform1i(glGetUniformLocation(program, "skybox"), unit);
+    glUniform1i(glGetUniformLocation(program, "skyboxNext"), unit + 1);
+    glUniform1f(glGetUniformLocation(program, "skyboxBlend"), blend);
+
+    glActiveTexture(GL_TEXTURE0 + unit + 1);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, to);
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, from);
+}
+
+int SkyboxSet::Current()
+{
+    return current;
+}
+
+bool SkyboxSet::Resident(int sky)
+{
+    return sky >= 0 && sky < (int)skies.size() && skies[sky].state == SKY_RESIDENT;
+}
+
+SkyboxStats SkyboxSet::Stats()
+{
+    SkyboxStats stats = {};
+    stats.skies = (int)skies.size();
+    stats.loads = loads;
+    stats.evictions = evictions;
+    stats.fade = next != -1 ? fade : 0.0f;
+    for (size_t i = 0; i < skies.size(); i++)
+    {
+        if (skies[i].state == SKY_RESIDENT)
+        {
+            stats.resident++;
+            stats.residentBytes += skies[i].bytes;
+        }
+        else if (skies[i].state == SKY_DECODING || skies[i].state == SKY_UPLOADING)
+            stats.loading++;
+    }
+    return stats;
+}
+
+void SkyboxSet::Shutdown()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    wake.notify_all();
+    if (worker.joinable())
+        worker.join();
+
+    jobs.clear();
+    finished.clear();
+    for (size_t i = 0; i < skies.size(); i++)
+        Evict(skies[i]);
+    skies.clear();
+    current = next = pending = -1;
+}
+
+void SkyboxSet::WorkerMain()
+{
+    for (;;)
+    {
+        std::unique_ptr<Job> job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [] { return !running || !jobs.empty(); });
+            if (!running)
+                return;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+
+        std::unique_ptr<Faces> faces(new Faces());
+        if (Decode(job->files, *faces))
+            job->faces = std::move(faces);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        finished.push_back(std::move(job));
+    }
+}
@@ -0,0 +1,143 @@
+/**************************************************
+ *
+ *                   skyboxset.h
+ *
+ *  A set of cubemap skies that can be switched
+ *  between with a crossfade. Only the skies in use
+ *  are resident: one that might be needed soon is
+ *  decoded on a worker thread and uploaded a few
+ *  rows per frame, and one nobody has used for a
+ *  while is deleted again. A switch only starts
+ *  fading once the new sky is fully uploaded, so
+ *  it never costs a frame a full cubemap load.
+ *
+ *  skybox.frag blends the two cubemaps Bind sets.
+ *
+ ***************************************************/
+
+#ifndef SKYBOXSET_H
+#define SKYBOXSET_H
+
+#include <GL/gl3w.h>
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define SKY_UPLOAD_BUDGET   (4 * 1024 * 1024)   // Bytes of faces uploaded per frame at most
+#define SKY_EVICT_SECONDS   30.0                // Unused skies are deleted after this long
+
+struct SkyboxStats
+{
+    int skies;
+    int resident;
+    int loading;            // Decoding or uploading
+    int loads;              // Totals since the first Add
+    int evictions;
+    float fade;             // 0 to 1 while a crossfade is running, otherwise 0
+    size_t residentBytes;   // Including mips
+};
+
+class SkyboxSet
+{
+public:
+    // Registers a sky without loading anything. Faces naming the same file are decoded
+    // once. Returns a handle, or -1 if a file doesn't exist.
+    static int Add(const char* posx, const char* negx, const char* posy,
+                   const char* negy, const char* posz, const char* negz);
+
+    // Decodes and uploads a sky on the calling thread and makes it current straight away.
+    // Meant for the first sky, before anything is on screen.
+    static bool Load(int sky);
+
+    // Hints that a sky will probably be shown soon. It starts loading in the background
+    // if it isn't resident, and won't be evicted for another SKY_EVICT_SECONDS.
+    static void Prefetch(int sky);
+
+    // Switches to a sky, fading over 'fadeSeconds' once it is resident. Until then the
+    // current sky stays on screen. A switch asked for during a fade waits for it to end,
+    // unless it goes back to the sky being faded out, which reverses the fade.
+    static void Show(int sky, float fadeSeconds);
+
+    // Once per frame on the GL thread: advances the fade, uploads part of a loaded sky
+    // and evicts skies that timed out
+    static void Update();
+
+    // Binds the current sky to 'unit' and the one it's fading to (or itself) to 'unit' + 1,
+    // and sets skybox, skyboxNext and skyboxBlend on the program.
+    static void Bind(GLuint program, int unit);
+
+    static int Current();       // The sky fading out during a fade, -1 before the first Load
+    static bool Resident(int sky);
+
+    static SkyboxStats Stats();
+    static void Shutdown();     // Stops the worker and deletes every sky
+
+private:
+    enum State
+    {
+        SKY_UNLOADED,
+        SKY_DECODING,
+        SKY_UPLOADING,
+        SKY_RESIDENT,
+        SKY_FAILED,             // A face is missing or the wrong size, never tried again
+    };
+
+    struct Faces
+    {
+        // source[i] is the face whose pixels face i uses
+        int source[6];
+        unsigned char* pixels[6];
+        int width, height;
+
+        Faces();
+        ~Faces();
+    };
+
+    struct Sky
+    {
+        std::string files[6];
+        State state;
+        unsigned int jobId;                 // Of the decode in flight, stale results are dropped
+        std::unique_ptr<Faces> faces;       // While uploading
+        int uploadFace, uploadRow;
+        GLuint texture;
+        size_t bytes;
+        double lastUsed;                    // Seconds, shown or prefetched
+    };
+
+    struct Job
+    {
+        int sky;
+        unsigned int id;
+        std::string files[6];
+        std::unique_ptr<Faces> faces;       // Null if the decode failed
+    };
+
+    static bool Decode(const std::string* files, Faces& faces);
+    static void BeginUpload(Sky& sky);
+    static bool UploadRows(Sky& sky, size_t& budget);  // True once the last row is in
+    static void Evict(Sky& sky);
+    static bool InUse(int sky);
+    static double Now();
+    static void WorkerMain();
+
+    static std::vector<Sky> skies;
+    static int current, next, pending;     // next is being faded in, pending waits for its turn
+    static float fade, fadeSeconds, pendingSeconds;
+    static double lastUpdate;
+    static unsigned int nextJobId;
+    static int loads, evictions;
+
+    static std::thread worker;
+    static std::mutex mutex;                // Guards the two queues and 'running'
+    static std::condition_variable wake;
+    static std::deque< std::unique_ptr<Job> > jobs, finished;
+    static bool running;
+};
+
+#endif